@@ -20,48 +20,24 @@ if [ -f "$img2" ]; then
     echo "Warning: File $img2 already exists. It will be overwritten."
 fi
 
-# convert to ppm if not already in ppm
-if [ "${img1##*.}" != "ppm" ]; then
-    img1_orginal="$img1"
-    img1=$(mktemp --suffix=.ppm)
-    # we want P3 => color ascii
-    convert "$img1_orginal" -depth 8 -colorspace RGB -compress none "$img1"
-    if [ $? -ne 0 ]; then
-        echo "Error converting $img1_orginal to ppm."
-        exit 1
+# stream the input to carve_opt, converting it to a binary pixmap (P6) on the
+# fly if it is not a ppm already
+read_input() {
+    if [ "${img1##*.}" = "ppm" ]; then
+        cat "$img1"
+    else
+        convert "$img1" -depth 8 -colorspace RGB ppm:-
     fi
-    # echo "Converted $img1_orginal to $img1"
-fi
+}
 
-./bin/carve_opt $args "$img1"
+# --trim writes only the remaining columns, so nothing has to be cropped, and
+# the result goes straight to img2 or through a pipe into convert
+if [ "${img2##*.}" = "ppm" ]; then
+    read_input | ./bin/carve_opt --trim $args -o "$img2" -
+else
+    read_input | ./bin/carve_opt --trim $args -o - - | convert ppm:- "$img2"
+fi
 if [ $? -ne 0 ]; then
-    echo "Error running carve_opt."
+    echo "Error carving $img1 into $img2."
     exit 1
 fi
-
-# if args contains -n X, remove X pixels from the right
-if echo "$args" | grep -q -E '\-n [0-9]+'; then
-    n=$(echo "$args" | grep -o -E '\-n [0-9]+' | awk '{print $2}')
-    if [ $n -gt 0 ]; then
-        echo "Removing $n pixels from the right of out.ppm"
-        # remove n pixels from the right
-        convert out.ppm -crop +0+0 -crop -$n+0 out.ppm
-        if [ $? -ne 0 ]; then
-            echo "Error cropping out.ppm."
-            exit 1
-        fi
-        # echo "Cropped $n pixels from the right of out.ppm"
-    fi
-fi
-
-# convert out.ppm to img2
-if [ "${img2##*.}" != "ppm" ]; then
-    convert out.ppm "$img2"
-    if [ $? -ne 0 ]; then
-        echo "Error converting out.ppm to $img2."
-        exit 1
-    fi
-    # echo "Converted out.ppm to $img2"
-else
-    mv out.ppm "$img2"
-fi
@@ -4,47 +4,172 @@
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "qoi.h"
+
 /**
  * Print the usage of the program.
  */
 static void usage(char const *const name) {
-  fprintf(stderr, "usage: %s [-n <count>] [-p] [-s] <image file>\n", name);
+  fprintf(stderr,
+          "usage: %s [-n <count>] [-p] [-s] [-f <p3|p6|qoi>] [-t|--trim] "
+          "[-m|--mmap] [-j|--threads <count>] [-o|--output <file|->] "
+          "[-k|--kernel <auto|scalar|sse4.1|avx2|avx512>] "
+          "[-l|--layout <packed|rgbx|planar>] [-y|--luma] "
+          "[-e|--energy <gradient|dual-gradient|sobel|forward>] "
+          "[-d|--dp <u32|u16|verify>] [-b|--seams-per-pass <count>] "
+          "[-r|--pyramid <band>] [-c|--defer <count>] <image file|->\n",
+          name);
 }
 
 /**
- * Parse the arguments and fill in the values on the bool pointers @p
- * `show_min_path`, @p `show_statistics` and @p `n_steps`.
+ * The long options, each of which is an alias of the short option stored in
+ * its `val` field.
+ */
+static struct option const long_options[] = {
+    {"format", required_argument, NULL, 'f'},
+    {"trim", no_argument, NULL, 't'},
+    {"mmap", no_argument, NULL, 'm'},
+    {"threads", required_argument, NULL, 'j'},
+    {"output", required_argument, NULL, 'o'},
+    {"kernel", required_argument, NULL, 'k'},
+    {"layout", required_argument, NULL, 'l'},
+    {"luma", no_argument, NULL, 'y'},
+    {"energy", required_argument, NULL, 'e'},
+    {"dp", required_argument, NULL, 'd'},
+    {"seams-per-pass", required_argument, NULL, 'b'},
+    {"pyramid", required_argument, NULL, 'r'},
+    {"defer", required_argument, NULL, 'c'},
+    {NULL, 0, NULL, 0},
+};
+
+/**
+ * Parse the arguments and fill in the values of @p `args`; options that are
+ * not given keep their default values. Without `-f`, an output file name
+ * ending with `.qoi` selects the QOI format.
+ * @returns the image file name, `-` for the standard input, or NULL if the
+ * arguments are invalid.
  */
 char const *parse_arguments(int const argc, char **const argv,
-                            bool *show_min_path, bool *show_statistics,
-                            int *n_steps) {
+                            struct arguments *const args) {
+  bool format_given = false;
   for (;;) {
-    switch (getopt(argc, argv, "n:ps")) {
+    switch (getopt_long(argc, argv, "n:psf:tmj:o:k:l:ye:d:b:r:c:", long_options,
+                        NULL)) {
     case -1:
       if (argc - optind != 1) {
         usage(argv[0]);
         return NULL;
       }
+      if (!format_given && args->output && qoi_is_filename(args->output))
+        args->format = IMAGE_FORMAT_QOI;
       return argv[optind];
 
     case 'n': {
       char *end;
-      *n_steps = (int)strtoul(optarg, &end, 0);
+      args->n_steps = (int)strtoul(optarg, &end, 0);
       if (end == optarg || *end != '\0')
         errx(EXIT_FAILURE, "invalid iteration count '%s'", optarg);
       break;
     }
 
     case 'p':
-      *show_min_path = true;
+      args->show_min_path = true;
       break;
 
     case 's':
-      *show_statistics = true;
+      args->show_statistics = true;
+      break;
+
+    case 'f':
+      // the graymap variants are accepted as aliases
+      if (strcmp(optarg, "p3") == 0 || strcmp(optarg, "p2") == 0)
+        args->format = IMAGE_FORMAT_P3;
+      else if (strcmp(optarg, "p6") == 0 || strcmp(optarg, "p5") == 0)
+        args->format = IMAGE_FORMAT_P6;
+      else if (strcmp(optarg, "qoi") == 0)
+        args->format = IMAGE_FORMAT_QOI;
+      else
+        errx(EXIT_FAILURE, "invalid output format '%s'", optarg);
+      format_given = true;
+      break;
+
+    case 't':
+      args->trim = true;
+      break;
+
+    case 'm':
+      args->map = true;
       break;
 
+    case 'j': {
+      char *end;
+      args->threads = (int)strtoul(optarg, &end, 0);
+      if (end == optarg || *end != '\0')
+        errx(EXIT_FAILURE, "invalid thread count '%s'", optarg);
+      break;
+    }
+
+    case 'o':
+      args->output = optarg;
+      break;
+
+    case 'k':
+      args->kernel = kernels_find(optarg);
+      if (args->kernel == KERNEL_COUNT)
+        errx(EXIT_FAILURE, "invalid kernel '%s'", optarg);
+      if (args->kernel != KERNEL_AUTO && kernels_get(args->kernel) == NULL)
+        errx(EXIT_FAILURE, "kernel '%s' is not supported by this CPU", optarg);
+      break;
+
+    case 'l':
+      if (!pixel_layout_find(optarg, &args->layout))
+        errx(EXIT_FAILURE, "invalid layout '%s'", optarg);
+      break;
+
+    case 'y':
+      args->luma = true;
+      break;
+
+    case 'e':
+      args->energy = energy_find(optarg);
+      if (args->energy == ENERGY_COUNT)
+        errx(EXIT_FAILURE, "invalid energy function '%s'", optarg);
+      break;
+
+    case 'd':
+      args->dp = seam_dp_find(optarg);
+      if (args->dp == SEAM_DP_COUNT)
+        errx(EXIT_FAILURE, "invalid DP representation '%s'", optarg);
+      break;
+
+    case 'b': {
+      char *end;
+      args->seams_per_pass = (int)strtoul(optarg, &end, 0);
+      if (end == optarg || *end != '\0' || args->seams_per_pass < 1)
+        errx(EXIT_FAILURE, "invalid seam count per pass '%s'", optarg);
+      break;
+    }
+
+    case 'r': {
+      char *end;
+      args->pyramid_band = (int)strtoul(optarg, &end, 0);
+      if (end == optarg || *end != '\0' || args->pyramid_band < 1)
+        errx(EXIT_FAILURE, "invalid pyramid band '%s'", optarg);
+      break;
+    }
+
+    case 'c': {
+      char *end;
+      long const seams = strtol(optarg, &end, 0);
+      if (end == optarg || *end != '\0' || seams < 0 || seams > UINT16_MAX)
+        errx(EXIT_FAILURE, "invalid deferred seam count '%s'", optarg);
+      args->defer_seams = (int)seams;
+      break;
+    }
+
     case '?':
       usage(argv[0]);
       return NULL;
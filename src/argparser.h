@@ -4,11 +4,38 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "energy.h"
+#include "energy_functions.h"
+#include "image.h"
+#include "kernels.h"
+
+/**
+ * The settings chosen on the command line.
+ */
+struct arguments {
+    bool show_min_path;
+    bool show_statistics;
+    int n_steps;
+    enum image_format format;
+    bool trim;
+    bool map;
+    int threads;
+    char const* output;
+    enum kernel_isa kernel;
+    enum pixel_type layout;
+    bool luma;
+    enum energy_kind energy;
+    enum seam_dp dp;
+    int seams_per_pass;
+    int pyramid_band;
+    int defer_seams;
+};
+
 /**
- * Parse the arguments and fill in the values on the bool pointers @p
- * `show_min_path`, @p `show_statistics` and @p `n_steps`.
+ * Parse the arguments and fill in the values of @p `args`; options that are
+ * not given keep their default values.
+ * @returns the image file name or NULL if the arguments are invalid.
  */
-char const* parse_arguments(int argc, char** argv, bool* show_min_path,
-                            bool* show_statistics, int* n_steps);
+char const* parse_arguments(int argc, char** argv, struct arguments* args);
 
 #endif
@@ -1,9 +1,12 @@
 #include "energy.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "energy_functions.h"
 #include "indexing.h"
+#include "kernels.h"
 #include "util.h"
 
 uint32_t max(uint32_t a, uint32_t b) { return a > b ? a : b; }
@@ -25,73 +28,830 @@ inline uint32_t diff_color(struct pixel const a, struct pixel const b) {
   return diff_a * diff_a + diff_b * diff_b + diff_g * diff_g;
 }
 
+/**
+ * Calculate the difference of two gray values @p a and @p b, i.e. the square
+ * of their difference.
+ */
+inline uint32_t diff_gray(uint8_t const a, uint8_t const b) {
+  int const diff = a - b;
+  return diff * diff;
+}
+
+/**
+ * Calculate the difference of two 16-bit color values @p a and @p b, i.e. the
+ * sum of the squares of the differences of their color components. Each square
+ * still fits into 32 bits, their sum does not.
+ */
+inline uint64_t diff_color16(struct pixel16 const a, struct pixel16 const b) {
+  uint32_t const diff_r = a.r > b.r ? a.r - b.r : b.r - a.r;
+  uint32_t const diff_g = a.g > b.g ? a.g - b.g : b.g - a.g;
+  uint32_t const diff_b = a.b > b.b ? a.b - b.b : b.b - a.b;
+
+  return (uint64_t)(diff_r * diff_r) + diff_g * diff_g + diff_b * diff_b;
+}
+
+/**
+ * Calculate the difference of two 16-bit gray values @p a and @p b, i.e. the
+ * square of their difference.
+ */
+inline uint64_t diff_gray16(uint16_t const a, uint16_t const b) {
+  uint32_t const diff = a > b ? a - b : b - a;
+  return diff * diff;
+}
+
+/**
+ * Calculate the difference of two padded color values @p a and @p b like
+ * `diff_color`.
+ */
+inline uint32_t diff_colorx(struct pixelx const a, struct pixelx const b) {
+  int const diff_r = a.r - b.r;
+  int const diff_g = a.g - b.g;
+  int const diff_b = a.b - b.b;
+
+  return diff_r * diff_r + diff_g * diff_g + diff_b * diff_b;
+}
+
+/**
+ * Calculate the difference of the two planar color values at @p a and @p b,
+ * whose green and blue samples follow @p `plane` and `2 * plane` samples later,
+ * like `diff_color`.
+ */
+inline uint32_t diff_planar(uint8_t const *const a, uint8_t const *const b,
+                            size_t const plane) {
+  return diff_gray(a[0], b[0]) + diff_gray(a[plane], b[plane]) +
+         diff_gray(a[2 * plane], b[2 * plane]);
+}
+
+static inline uint64_t min64(uint64_t const a, uint64_t const b) {
+  return a < b ? a : b;
+}
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the RGB row @p `row`
+ * into @p `out`, i.e. the color difference to the pixel in the row @p `above`
+ * plus the one to the pixel on the left. In the top row, @p `above` is NULL,
+ * so the pixels only have a left neighbour, and the first one has energy 0.
+ */
+static void local_energy_row_rgb8(uint32_t *const out,
+                                  struct pixel const *const row,
+                                  struct pixel const *const above,
+                                  int const w) {
+  if (above == NULL) {
+    out[0] = 0;
+    for (int x = 1; x < w; x++)
+      out[x] = diff_color(row[x], row[x - 1]);
+    return;
+  }
+  out[0] = diff_color(row[0], above[0]);
+  for (int x = 1; x < w; x++)
+    out[x] = diff_color(row[x], above[x]) + diff_color(row[x], row[x - 1]);
+}
+
+/**
+ * Like `local_energy_row_rgb8`, but for a grayscale row. The first column is
+ * handled separately, so the loop has no branches.
+ */
+static void local_energy_row_gray8(uint32_t *const out,
+                                   uint8_t const *const row,
+                                   uint8_t const *const above, int const w) {
+  if (above == NULL) {
+    out[0] = 0;
+    for (int x = 1; x < w; x++)
+      out[x] = diff_gray(row[x], row[x - 1]);
+    return;
+  }
+  out[0] = diff_gray(row[0], above[0]);
+  for (int x = 1; x < w; x++)
+    out[x] = diff_gray(row[x], above[x]) + diff_gray(row[x], row[x - 1]);
+}
+
+/**
+ * Like `local_energy_row_rgb8`, but for a padded RGB row.
+ */
+static void local_energy_row_rgbx8(uint32_t *const out,
+                                   struct pixelx const *const row,
+                                   struct pixelx const *const above,
+                                   int const w) {
+  if (above == NULL) {
+    out[0] = 0;
+    for (int x = 1; x < w; x++)
+      out[x] = diff_colorx(row[x], row[x - 1]);
+    return;
+  }
+  out[0] = diff_colorx(row[0], above[0]);
+  for (int x = 1; x < w; x++)
+    out[x] = diff_colorx(row[x], above[x]) + diff_colorx(row[x], row[x - 1]);
+}
+
+/**
+ * Like `local_energy_row_rgb8`, but for a planar RGB row: @p `row` and
+ * @p `above` point to the red samples, the green and blue ones follow
+ * @p `plane` and `2 * plane` samples later.
+ */
+static void local_energy_row_planar8(uint32_t *const out,
+                                     uint8_t const *const row,
+                                     uint8_t const *const above,
+                                     size_t const plane, int const w) {
+  if (above == NULL) {
+    out[0] = 0;
+    for (int x = 1; x < w; x++)
+      out[x] = diff_planar(&row[x], &row[x - 1], plane);
+    return;
+  }
+  out[0] = diff_planar(&row[0], &above[0], plane);
+  for (int x = 1; x < w; x++)
+    out[x] = diff_planar(&row[x], &above[x], plane) +
+             diff_planar(&row[x], &row[x - 1], plane);
+}
+
+/**
+ * Like `local_energy_row_rgb8`, but for a 16-bit RGB row and 64-bit energies.
+ * Like `local_energy_row_gray8`, the loop has no branches, so it can be
+ * vectorized.
+ */
+static void local_energy_row_rgb16(uint64_t *const out,
+                                   struct pixel16 const *const row,
+                                   struct pixel16 const *const above,
+                                   int const w) {
+  if (above == NULL) {
+    out[0] = 0;
+    for (int x = 1; x < w; x++)
+      out[x] = diff_color16(row[x], row[x - 1]);
+    return;
+  }
+  out[0] = diff_color16(row[0], above[0]);
+  for (int x = 1; x < w; x++)
+    out[x] = diff_color16(row[x], above[x]) + diff_color16(row[x], row[x - 1]);
+}
+
+/**
+ * Like `local_energy_row_rgb16`, but for a 16-bit grayscale row.
+ */
+static void local_energy_row_gray16(uint64_t *const out,
+                                    uint16_t const *const row,
+                                    uint16_t const *const above, int const w) {
+  if (above == NULL) {
+    out[0] = 0;
+    for (int x = 1; x < w; x++)
+      out[x] = diff_gray16(row[x], row[x - 1]);
+    return;
+  }
+  out[0] = diff_gray16(row[0], above[0]);
+  for (int x = 1; x < w; x++)
+    out[x] = diff_gray16(row[x], above[x]) + diff_gray16(row[x], row[x - 1]);
+}
+
+/**
+ * Return the pixel type of the samples the energy of @p `img` is calculated
+ * on: `PIXEL_GRAY8` for the luma plane if it has one, its own otherwise.
+ */
+static enum pixel_type energy_type(struct image const *const img) {
+  return img->luma != NULL ? PIXEL_GRAY8 : img->type;
+}
+
+/**
+ * Return row @p `y` of the samples the energy of @p `img` is calculated on,
+ * see `energy_type`, and store the size of a row in bytes in
+ * @p `row_size`. Planar rows point to the red samples.
+ */
+static char const *energy_row(struct image const *const img, int const y,
+                              size_t *const row_size) {
+  enum pixel_type const type = energy_type(img);
+  *row_size = (size_t)img->w *
+              (type == PIXEL_PLANAR8 ? sizeof(uint8_t) : pixel_size(type));
+  char const *const samples =
+      img->luma != NULL ? (char const *)img->luma : (char const *)img->pixels;
+  return samples + y * *row_size;
+}
+
+/**
+ * Calculate the total energy of the @p `w` left pixels of row @p `y` of the
+ * 8-bit image @p `img` into @p `out` in one step with the row kernel of the
+ * energy function @p `f`, given the total energy @p `above` of the row above,
+ * or NULL in the top row, and record the neighbours taken in the bit planes
+ * @p `left` and @p `right` like `cumulative_row_dir_u32`.
+ */
+static void total_energy_row_u32(uint32_t *const out,
+                                 uint32_t const *const above,
+                                 struct image *const img, int const y,
+                                 int const w,
+                                 struct energy_function const *const f,
+                                 uint8_t *const left, uint8_t *const right) {
+  size_t row_size;
+  char const *const row = energy_row(img, y, &row_size);
+  f->total_energy_row_u32[energy_type(img)](
+      out, above, y > 0 ? row - row_size : row, row, (size_t)img->w * img->h,
+      w, left, right);
+}
+
+/**
+ * Like `total_energy_row_u32`, but for 16-bit images and 64-bit energies.
+ */
+static void total_energy_row_u64(uint64_t *const out,
+                                 uint64_t const *const above,
+                                 struct image *const img, int const y,
+                                 int const w,
+                                 struct energy_function const *const f,
+                                 uint8_t *const left, uint8_t *const right) {
+  size_t row_size;
+  char const *const row = energy_row(img, y, &row_size);
+  f->total_energy_row_u64[img->type](out, above, y > 0 ? row - row_size : row,
+                                     row, 0, w, left, right);
+}
+
+/**
+ * The representation of the total energy in use, see `seam_dp_select`.
+ */
+static enum seam_dp seam_dp = SEAM_DP_U32;
+
+/**
+ * Return whether the energy planes of @p `img` hold the energy of the energy
+ * function in use up to (excluding) column @p `w`: the local energy of every
+ * pixel if @p `exact` is not set, which does not depend on the columns to its
+ * right, and the total energy, which does, only if @p `w` is the width they
+ * were kept up to date for and the image has a total energy plane.
+ */
+static bool energy_plane_applies(struct image const *const img, int const w,
+                                 bool const exact) {
+  return img->energy != NULL &&
+         energy_active() == energy_get(ENERGY_GRADIENT) &&
+         (exact ? img->total != NULL && w == (int)img->energy_w
+                : w <= (int)img->energy_w);
+}
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of row @p `y` of the
+ * 8-bit image @p `img` into @p `out`. Energy functions other than the
+ * gradient take their own row kernel from @p `f`. The gradient takes the row
+ * kernel of @p `k` for the layout of the image if there is one; graymaps and
+ * images with a luma plane take the gray kernel, and the top row is left to
+ * the scalar code. Images with energy planes have the gradient copied from
+ * there.
+ */
+static void local_energy_row_u32(uint32_t *const out, struct image *const img,
+                                 int const y, int const w,
+                                 struct kernels const *const k,
+                                 struct energy_function const *const f) {
+  if (energy_plane_applies(img, w, false)) {
+    memcpy(out, &img->energy[yx_index(y, 0, img->w)], w * sizeof(uint32_t));
+    return;
+  }
+  if (f->local_energy_row_u32[energy_type(img)] != NULL) {
+    size_t row_size;
+    char const *const row = energy_row(img, y, &row_size);
+    f->local_energy_row_u32[energy_type(img)](
+        out, y > 0 ? row - row_size : row, row,
+        y < (int)img->h - 1 ? row + row_size : row, (size_t)img->w * img->h,
+        w);
+    return;
+  }
+  size_t const i = yx_index(y, 0, img->w);
+  if (img->type == PIXEL_GRAY8 || img->luma != NULL) {
+    uint8_t const *const gray = img->luma != NULL ? img->luma : img->gray;
+    if (y == 0 || k->local_energy_row_gray8 == NULL)
+      local_energy_row_gray8(out, &gray[i], y > 0 ? &gray[i - img->w] : NULL,
+                             w);
+    else
+      k->local_energy_row_gray8(out, &gray[i], &gray[i - img->w], w);
+  } else if (img->type == PIXEL_RGBX8) {
+    if (y == 0 || k->local_energy_row_rgbx8 == NULL)
+      local_energy_row_rgbx8(out, &img->pixelsx[i],
+                             y > 0 ? &img->pixelsx[i - img->w] : NULL, w);
+    else
+      k->local_energy_row_rgbx8(out, &img->pixelsx[i],
+                                &img->pixelsx[i - img->w], w);
+  } else if (img->type == PIXEL_PLANAR8) {
+    size_t const plane = (size_t)img->w * img->h;
+    if (y == 0 || k->local_energy_row_planar8 == NULL)
+      local_energy_row_planar8(out, &img->planes[i],
+                               y > 0 ? &img->planes[i - img->w] : NULL, plane,
+                               w);
+    else
+      k->local_energy_row_planar8(out, &img->planes[i],
+                                  &img->planes[i - img->w], plane, w);
+  } else if (y == 0 || k->local_energy_row_rgb8 == NULL) {
+    local_energy_row_rgb8(out, &img->pixels[i],
+                          y > 0 ? &img->pixels[i - img->w] : NULL, w);
+  } else {
+    k->local_energy_row_rgb8(out, &img->pixels[i], &img->pixels[i - img->w],
+                             w);
+  }
+}
+
+/**
+ * Return the local gradient energy of the pixel at index @p `i` of the 8-bit
+ * image @p `img`, whose neighbours above and on the left are at the indices
+ * @p `above` and @p `left`, which are @p `i` itself at the border.
+ */
+static uint32_t gradient_at(struct image const *const img, size_t const i,
+                            size_t const above, size_t const left) {
+  switch (energy_type(img)) {
+  case PIXEL_GRAY8: {
+    uint8_t const *const gray = img->luma != NULL ? img->luma : img->gray;
+    return diff_gray(gray[i], gray[above]) + diff_gray(gray[i], gray[left]);
+  }
+  case PIXEL_RGBX8:
+    return diff_colorx(img->pixelsx[i], img->pixelsx[above]) +
+           diff_colorx(img->pixelsx[i], img->pixelsx[left]);
+  case PIXEL_PLANAR8: {
+    size_t const plane = (size_t)img->w * img->h;
+    return diff_planar(&img->planes[i], &img->planes[above], plane) +
+           diff_planar(&img->planes[i], &img->planes[left], plane);
+  }
+  default:
+    return diff_color(img->pixels[i], img->pixels[above]) +
+           diff_color(img->pixels[i], img->pixels[left]);
+  }
+}
+
+/**
+ * Return the local gradient energy of the pixel in column @p `x` of row
+ * @p `y` of the 8-bit image @p `img`, like `local_energy_row_u32` does for a
+ * whole row. The pixels are found with `image_column`, so their compaction
+ * may be deferred.
+ */
+static uint32_t local_energy_at(struct image const *const img, int const x,
+                                int const y) {
+  size_t const i = yx_index(y, image_column(img, y, x), img->w);
+  size_t const above =
+      y > 0 ? yx_index(y - 1, image_column(img, y - 1, x), img->w) : i;
+  size_t const left =
+      x > 0 ? yx_index(y, image_column(img, y, x - 1), img->w) : i;
+  return gradient_at(img, i, above, left);
+}
+
+/**
+ * Calculate the local gradient energy of the @p `n` pixels of the 8-bit image
+ * @p `img` at the indices @p `base` plus @p `cols` into @p `out`, whose
+ * neighbours above are at @p `above_base` plus @p `above_cols` and on the
+ * left at @p `base` plus the column before each, `cols[-1]` for the first.
+ */
+static void gradient_band_row(uint32_t *const out,
+                              struct image const *const img, size_t const base,
+                              size_t const above_base,
+                              uint32_t const *const cols,
+                              uint32_t const *const above_cols, int const n) {
+  switch (energy_type(img)) {
+  case PIXEL_GRAY8: {
+    uint8_t const *const gray = img->luma != NULL ? img->luma : img->gray;
+    uint8_t const *const row = &gray[base], *const above = &gray[above_base];
+    for (int j = 0; j < n; j++)
+      out[j] = diff_gray(row[cols[j]], above[above_cols[j]]) +
+               diff_gray(row[cols[j]], row[cols[j - 1]]);
+    break;
+  }
+  case PIXEL_RGBX8: {
+    struct pixelx const *const row = &img->pixelsx[base];
+    struct pixelx const *const above = &img->pixelsx[above_base];
+    for (int j = 0; j < n; j++)
+      out[j] = diff_colorx(row[cols[j]], above[above_cols[j]]) +
+               diff_colorx(row[cols[j]], row[cols[j - 1]]);
+    break;
+  }
+  case PIXEL_PLANAR8: {
+    size_t const plane = (size_t)img->w * img->h;
+    uint8_t const *const row = &img->planes[base];
+    uint8_t const *const above = &img->planes[above_base];
+    for (int j = 0; j < n; j++)
+      out[j] = diff_planar(&row[cols[j]], &above[above_cols[j]], plane) +
+               diff_planar(&row[cols[j]], &row[cols[j - 1]], plane);
+    break;
+  }
+  default: {
+    struct pixel const *const row = &img->pixels[base];
+    struct pixel const *const above = &img->pixels[above_base];
+    for (int j = 0; j < n; j++)
+      out[j] = diff_color(row[cols[j]], above[above_cols[j]]) +
+               diff_color(row[cols[j]], row[cols[j - 1]]);
+  }
+  }
+}
+
+/**
+ * Like `local_energy_row_u32`, but for 16-bit images and 64-bit energies.
+ */
+static void local_energy_row_u64(uint64_t *const out, struct image *const img,
+                                 int const y, int const w,
+                                 struct kernels const *const k,
+                                 struct energy_function const *const f) {
+  if (f->local_energy_row_u64[img->type] != NULL) {
+    size_t row_size;
+    char const *const row = energy_row(img, y, &row_size);
+    f->local_energy_row_u64[img->type](
+        out, y > 0 ? row - row_size : row, row,
+        y < (int)img->h - 1 ? row + row_size : row, 0, w);
+    return;
+  }
+  size_t const i = yx_index(y, 0, img->w);
+  if (img->type == PIXEL_GRAY16) {
+    if (y == 0 || k->local_energy_row_gray16 == NULL)
+      local_energy_row_gray16(out, &img->gray16[i],
+                              y > 0 ? &img->gray16[i - img->w] : NULL, w);
+    else
+      k->local_energy_row_gray16(out, &img->gray16[i],
+                                 &img->gray16[i - img->w], w);
+  } else if (y == 0 || k->local_energy_row_rgb16 == NULL) {
+    local_energy_row_rgb16(out, &img->pixels16[i],
+                           y > 0 ? &img->pixels16[i - img->w] : NULL, w);
+  } else {
+    k->local_energy_row_rgb16(out, &img->pixels16[i],
+                              &img->pixels16[i - img->w], w);
+  }
+}
+
+/**
+ * Turn the local energy in the @p `w` left entries of the energy row @p `row`
+ * into the total energy by adding the least total energy of the (up to) three
+ * neighbours in the row @p `above`.
+ */
+static void cumulative_row_u32(uint32_t *const row, uint32_t const *const above,
+                               int const w) {
+  for (int x = 0; x < w; x++) {
+    uint32_t top = above[x];
+    if (x > 0) {
+      uint32_t top_left = above[x - 1];
+      if (top_left < top) {
+        top = top_left;
+      }
+    }
+    if (x < w - 1) {
+      uint32_t top_right = above[x + 1];
+      if (top_right < top) {
+        top = top_right;
+      }
+    }
+    row[x] += top;
+  }
+}
+
+/**
+ * Like `cumulative_row_u32`, but also return the index of the first least
+ * entry of the updated row.
+ */
+static int cumulative_row_min_u32(uint32_t *const row,
+                                  uint32_t const *const above, int const w) {
+  cumulative_row_u32(row, above, w);
+  return calculate_min_energy_column(row, w, w, 1);
+}
+
+/**
+ * Like `cumulative_row_u32`, but for 64-bit energies. The border columns are
+ * handled separately, so the inner loop takes the minimum of all three
+ * neighbours without branches.
+ */
+static void cumulative_row_u64(uint64_t *const row, uint64_t const *const above,
+                               int const w) {
+  if (w == 1) {
+    row[0] += above[0];
+    return;
+  }
+  row[0] += min64(above[0], above[1]);
+  for (int x = 1; x < w - 1; x++)
+    row[x] += min64(min64(above[x - 1], above[x]), above[x + 1]);
+  row[w - 1] += min64(above[w - 2], above[w - 1]);
+}
+
+/**
+ * Like `cumulative_row_u32`, but also record in bit `x` of the bit planes
+ * @p `left` and @p `right` whether entry `x` took its left or its right
+ * neighbour rather than the one straight above. Ties go to the one straight
+ * above, then to the left one, as in `calculate_optimal_path`. The
+ * `(w + 7) / 8` bytes of both planes are overwritten.
+ */
+static void cumulative_row_dir_u32(uint32_t *const row,
+                                   uint32_t const *const above, int const w,
+                                   uint8_t *const left, uint8_t *const right) {
+  memset(left, 0, ((size_t)w + 7) / 8);
+  memset(right, 0, ((size_t)w + 7) / 8);
+  for (int x = 0; x < w; x++) {
+    uint32_t top = above[x];
+    if (x > 0 && above[x - 1] < top) {
+      top = above[x - 1];
+      left[x / 8] |= 1 << x % 8;
+    }
+    if (x < w - 1 && above[x + 1] < top) {
+      top = above[x + 1];
+      left[x / 8] &= ~(1 << x % 8);
+      right[x / 8] |= 1 << x % 8;
+    }
+    row[x] += top;
+  }
+}
+
+/**
+ * Like `cumulative_row_dir_u32`, but for 64-bit energies. Like
+ * `cumulative_row_u64`, the border columns are handled separately, so the
+ * inner loop has no bounds checks.
+ */
+static void cumulative_row_dir_u64(uint64_t *const row,
+                                   uint64_t const *const above, int const w,
+                                   uint8_t *const left, uint8_t *const right) {
+  memset(left, 0, ((size_t)w + 7) / 8);
+  memset(right, 0, ((size_t)w + 7) / 8);
+  if (w == 1) {
+    row[0] += above[0];
+    return;
+  }
+  if (above[1] < above[0]) {
+    row[0] += above[1];
+    right[0] |= 1;
+  } else {
+    row[0] += above[0];
+  }
+  for (int x = 1; x < w - 1; x++) {
+    uint64_t top = above[x];
+    int from_left = 0, from_right = 0;
+    if (above[x - 1] < top) {
+      top = above[x - 1];
+      from_left = 1;
+    }
+    if (above[x + 1] < top) {
+      top = above[x + 1];
+      from_left = 0;
+      from_right = 1;
+    }
+    row[x] += top;
+    left[x / 8] |= from_left << x % 8;
+    right[x / 8] |= from_right << x % 8;
+  }
+  int const x = w - 1;
+  if (above[x - 1] < above[x]) {
+    row[x] += above[x - 1];
+    left[x / 8] |= 1 << x % 8;
+  } else {
+    row[x] += above[x];
+  }
+}
+
+/**
+ * Store the @p `w` left entries of the total energy row @p `total` less
+ * @p `least`, saturated to `UINT16_MAX`, in the 16-bit row @p `row`.
+ */
+static void rebase_row_u16(uint16_t *const row, uint32_t const *const total,
+                           uint32_t const least, int const w) {
+  for (int x = 0; x < w; x++) {
+    uint32_t const offset = total[x] - least;
+    row[x] = offset < UINT16_MAX ? offset : UINT16_MAX;
+  }
+}
+
+/**
+ * Add to each of the @p `w` left entries of the local energy row @p `local`
+ * the least of the (up to) three neighbours in the 16-bit total energy row
+ * @p `above`, which is relative to its least entry, and record the direction
+ * bits like `cumulative_row_dir_u32`. Stores the sums less the least one in
+ * @p `row` with `rebase_row_u16` and returns the least sum.
+ */
+static uint32_t cumulative_row_dir_u16(uint16_t *const row,
+                                       uint32_t *const local,
+                                       uint16_t const *const above,
+                                       int const w, uint8_t *const left,
+                                       uint8_t *const right) {
+  memset(left, 0, ((size_t)w + 7) / 8);
+  memset(right, 0, ((size_t)w + 7) / 8);
+  uint32_t least_row = UINT32_MAX;
+  for (int x = 0; x < w; x++) {
+    uint16_t top = above[x];
+    if (x > 0 && above[x - 1] < top) {
+      top = above[x - 1];
+      left[x / 8] |= 1 << x % 8;
+    }
+    if (x < w - 1 && above[x + 1] < top) {
+      top = above[x + 1];
+      left[x / 8] &= ~(1 << x % 8);
+      right[x / 8] |= 1 << x % 8;
+    }
+    local[x] += top;
+    if (local[x] < least_row)
+      least_row = local[x];
+  }
+  rebase_row_u16(row, local, least_row, w);
+  return least_row;
+}
+
+/**
+ * Calculate the total energy plane of @p `img` up to (excluding) column
+ * @p `w` from its local energy plane.
+ */
+static void total_energy_plane(struct image *const img, int const w) {
+  struct kernels const *const k = kernels_active();
+  void (*const cumulative_row)(uint32_t *, uint32_t const *, int) =
+      k->cumulative_row_u32 != NULL ? k->cumulative_row_u32
+                                    : cumulative_row_u32;
+  memcpy(img->total, img->energy, w * sizeof(uint32_t));
+  for (int y = 1; y < (int)img->h; y++) {
+    size_t const i = yx_index(y, 0, img->w);
+    memcpy(&img->total[i], &img->energy[i], w * sizeof(uint32_t));
+    cumulative_row(&img->total[i], &img->total[i - img->w], w);
+  }
+  img->energy_w = w;
+}
+
+/**
+ * Add the energy planes to the 8-bit image @p `img`: the local gradient
+ * energy of every pixel, calculated once, which `find_seam` copies rather
+ * than calculating it again for every seam, and the total energy, which it
+ * traces the seam in. `carve_path` keeps both up to date by recalculating
+ * only the local energy of the pixels next to the seam and the total energy
+ * that depends on it. Other energy functions calculate their own energy as
+ * before. Only the 32-bit DP rows of `SEAM_DP_U32` are traced in the total
+ * energy, so with the other representations, which run their own DP, the
+ * image gets the local energy plane alone. Add the luma plane first, if at
+ * all. 16-bit images, images that already have the planes and images whose
+ * seams are found with another energy function, which would never read
+ * them, are left as they are.
+ */
+void energy_add_plane(struct image *const img) {
+  if (img->type == PIXEL_RGB16 || img->type == PIXEL_GRAY16 ||
+      img->energy != NULL || energy_active() != energy_get(ENERGY_GRADIENT))
+    return;
+  size_t const size = (size_t)img->w * img->h * sizeof(uint32_t);
+  uint32_t *const energy = malloc(size);
+  img->total = seam_dp == SEAM_DP_U32 ? malloc(size) : NULL;
+  if (energy == NULL || (seam_dp == SEAM_DP_U32 && img->total == NULL)) {
+    fprintf(stderr, "Memory allocation failed for energy\n");
+    exit(EXIT_FAILURE);
+  }
+  struct kernels const *const k = kernels_active();
+  struct energy_function const *const gradient = energy_get(ENERGY_GRADIENT);
+  for (int y = 0; y < (int)img->h; y++)
+    local_energy_row_u32(&energy[yx_index(y, 0, img->w)], img, y, img->w, k,
+                         gradient);
+  img->energy = energy;
+  if (img->total != NULL)
+    total_energy_plane(img, img->w);
+  else
+    img->energy_w = img->w;
+}
+
+/**
+ * Carve the path @p `seam` out of the energy planes of @p `img` like
+ * `carve_path` does out of its pixels, which have been carved already, and
+ * recalculate the energy that changed.
+ * The local energy changes for the pixel that moved next to the seam, which
+ * has a new left neighbour, and where the seam moved sideways, for the pixels
+ * between its columns in this row and the row above, which have new upper
+ * neighbours. That is one or two pixels per row.
+ * The total energy changes where the local energy did, next to the seam,
+ * where the three upper neighbours of a pixel are no longer the ones it had,
+ * and below the total energy that changed in the row above. Only those
+ * entries are recalculated, and a row stops spreading the change where the
+ * new entries equal the old ones, so the totals are those of a full
+ * recalculation. If the planes were not kept up to date for @p `w` columns,
+ * the total energy is recalculated as a whole. Images without a total energy
+ * plane only have their local energy carved.
+ */
+void energy_carve_plane(struct image *const img, int const w,
+                        uint32_t const *const seam) {
+  bool const incremental = img->total != NULL && w == (int)img->energy_w;
+  // the columns of the row above whose total energy changed
+  int changed_from = 0, changed_to = -1;
+  for (int y = 0; y < (int)img->h; y++) {
+    int const x = seam[y];
+    size_t const i = yx_index(y, 0, img->w);
+    uint32_t *const row = &img->energy[i];
+    uint32_t *const total = img->total != NULL ? &img->total[i] : NULL;
+    memmove(&row[x], &row[x + 1], (w - 1 - x) * sizeof(uint32_t));
+    row[w - 1] = 0;
+    if (total != NULL) {
+      memmove(&total[x], &total[x + 1], (w - 1 - x) * sizeof(uint32_t));
+      total[w - 1] = 0;
+    }
+
+    int from = x, to = x;
+    if (y > 0 && (int)seam[y - 1] < from)
+      from = seam[y - 1];
+    if (y > 0 && (int)seam[y - 1] - 1 > to)
+      to = seam[y - 1] - 1;
+    if (to > w - 2)
+      to = w - 2;
+    for (int c = from; c <= to; c++)
+      row[c] = local_energy_at(img, c, y);
+    if (!incremental)
+      continue;
+
+    if (y > 0) {
+      // the upper neighbours of the pixels around both columns of the seam
+      // were shifted by different amounts
+      int const above = seam[y - 1];
+      from = (x < above ? x : above) - 1;
+      to = x > above ? x : above;
+      if (changed_from <= changed_to && changed_from - 1 < from)
+        from = changed_from - 1;
+      if (changed_from <= changed_to && changed_to + 1 > to)
+        to = changed_to + 1;
+    }
+    from = from > 0 ? from : 0;
+    to = to < w - 2 ? to : w - 2;
+    changed_from = 0;
+    changed_to = -1;
+    for (int c = from; c <= to; c++) {
+      uint32_t energy = row[c];
+      if (y > 0) {
+        uint32_t const *const up = total - img->w;
+        uint32_t least = up[c];
+        if (c > 0 && up[c - 1] < least)
+          least = up[c - 1];
+        if (c < w - 2 && up[c + 1] < least)
+          least = up[c + 1];
+        energy += least;
+      }
+      if (energy != total[c]) {
+        total[c] = energy;
+        if (changed_from > changed_to)
+          changed_from = c;
+        changed_to = c;
+      }
+    }
+  }
+  if (incremental || img->total == NULL)
+    img->energy_w = w - 1;
+  else
+    total_energy_plane(img, w - 1);
+}
+
 /**
  * Calculate the total energy at every pixel of the image @p `img`,
  * but only considering columns with index less than @p `w`.
- * To this end, first calculate the local energy and use it to calculate the
- * total energy.
+ * To this end, calculate the local energy of every row and use it to
+ * calculate the total energy.
  * @p `energy` is expected to have allocated enough space
  * to represent the energy for every pixel of the whole image @p `img.
  * @p `w` is the width up to (excluding) which column in the image the energy
  * should be calculated. The energy is expected to be stored exactly analogous
  * to the image, i.e. you should be able to access the energy of a pixel with
  * the same array index.
+ * Grayscale images use the squared difference of their gray values, which
+ * yields the same seams as the equivalent RGB image, whose energy is exactly
+ * three times as large.
+ * The energy function is the one selected with `energy_select`. The forward
+ * energy depends on the neighbour the path takes, so its paths have to be
+ * traced with `find_seam` rather than `calculate_optimal_path`.
  */
 void calculate_energy(uint32_t *const energy, struct image *const img,
                       int const w) {
-  // TODO implement (assignment 3.2)
-  for (int y = 0; y < img->h; y++) {      // height top to down
-    for (int x = 0; x < w; x++) {         // column left to right
-      int index = yx_index(y, x, img->w); // (y*w0+x)
-
-      uint32_t local_energy = 0;
-
-      struct pixel present = img->pixels[index];
+  calculate_energy_min_column(energy, img, w);
+}
 
-      if (x == 0 && y == 0) {
-        energy[index] = 0;
-        continue;
-      }
+/**
+ * Calculate the total energy like `calculate_energy` and return the column
+ * with the least energy in the bottom row like `calculate_min_energy_column`.
+ * The image is processed in a single pass: the local energy of every row is
+ * added to the total energy of the row above right away, while both rows are
+ * still in the cache. With the SIMD row kernels of `kernels_active`, the
+ * minimum is tracked while the bottom row is updated. Images with energy
+ * planes that hold the energy in use for @p `w` columns have the total energy
+ * copied from there.
+ */
+int calculate_energy_min_column(uint32_t *const energy,
+                                struct image *const img, int const w) {
+  struct kernels const *const k = kernels_active();
+  void (*const cumulative_row)(uint32_t *, uint32_t const *, int) =
+      k->cumulative_row_u32 != NULL ? k->cumulative_row_u32
+                                    : cumulative_row_u32;
+  int (*const cumulative_row_min)(uint32_t *, uint32_t const *, int) =
+      k->cumulative_row_min_u32 != NULL ? k->cumulative_row_min_u32
+                                        : cumulative_row_min_u32;
+  struct energy_function const *const f = energy_active();
+  int const w0 = img->w;
 
-      if (y > 0) {
-        struct pixel above =
-            img->pixels[yx_index(y - 1, x, img->w)]; // getting top value
-        local_energy +=
-            diff_color(present, above); // adding square of difference of main
-                                        // and the top tile to local.
-      }
-      if (x > 0) {
-        struct pixel left = img->pixels[yx_index(y, x - 1, img->w)];
-        local_energy += diff_color(present, left);
-      }
+  if (energy_plane_applies(img, w, true)) {
+    for (int y = 0; y < img->h; y++) {
+      size_t const i = yx_index(y, 0, w0);
+      memcpy(&energy[i], &img->total[i], w * sizeof(uint32_t));
+    }
+    return calculate_min_energy_column(energy, w0, w, img->h);
+  }
+  // other energy functions read whole rows of pixels
+  if (!energy_plane_applies(img, w, false))
+    image_compact(img);
 
-      energy[index] = local_energy;
+  if (f->total_energy_row_u32[energy_type(img)] != NULL) {
+    // the directions are not needed, but the kernel records them anyway
+    uint8_t *const dirs = malloc(2 * (((size_t)w + 7) / 8));
+    if (!dirs) {
+      fprintf(stderr, "Memory allocation failed for energy\n");
+      exit(EXIT_FAILURE);
+    }
+    total_energy_row_u32(energy, NULL, img, 0, w, f, NULL, NULL);
+    for (int y = 1; y < img->h; y++) {
+      uint32_t *const row = &energy[yx_index(y, 0, w0)];
+      total_energy_row_u32(row, row - w0, img, y, w, f, dirs,
+                           dirs + ((size_t)w + 7) / 8);
     }
+    free(dirs);
+    return calculate_min_energy_column(energy, w0, w, img->h);
   }
 
+  local_energy_row_u32(energy, img, 0, w, k, f);
   for (int y = 1; y < img->h; y++) {
-    for (int x = 0; x < w; x++) {
-      int index = yx_index(y, x, img->w);
-      uint32_t local_energy = energy[index];
-
-      uint32_t top = energy[yx_index(y - 1, x, img->w)];
-
-      if (x > 0) {
-        uint32_t top_left = energy[yx_index(y - 1, x - 1, img->w)];
-        if (top_left < top) {
-          top = top_left;
-        }
-      }
-      if (x < w - 1) {
-        uint32_t top_right = energy[yx_index(y - 1, x + 1, img->w)];
-        if (top_right < top) {
-          top = top_right;
-        }
-      }
-
-      energy[index] = local_energy + top;
-    }
+    uint32_t *const row = &energy[yx_index(y, 0, w0)];
+    local_energy_row_u32(row, img, y, w, k, f);
+    if (y == img->h - 1)
+      return cumulative_row_min(row, row - w0, w);
+    cumulative_row(row, row - w0, w);
   }
+  return calculate_min_energy_column(energy, w0, w, 1);
 }
 
 /**
@@ -169,3 +929,635 @@ void calculate_optimal_path(uint32_t const *const energy, int const w0,
     x = next;
   }
 }
+
+/**
+ * The number of rows ahead that `calculate_energy_band` prefetches the band
+ * of, as every row of the band is in another part of the image.
+ */
+#define BAND_PREFETCH_ROWS 8
+
+/**
+ * The number of columns on either side of the band of a row whose pixels
+ * `calculate_energy_band` finds along with it.
+ */
+#define BAND_MARGIN 3
+
+/**
+ * Prefetch the samples of the @p `n` pixels from column @p `x` of row @p `y`
+ * of the 8-bit image @p `img` and its gaps, see `image_column`, which may move
+ * them up to `n_gaps` columns to the right.
+ */
+static void prefetch_band_row(struct image const *const img, int const y,
+                              int const x, int const n) {
+  if (img->gaps != NULL) {
+    uint32_t const *const gaps = &img->gaps[(size_t)y * img->gap_capacity];
+    for (uint32_t j = 0; j < img->n_gaps; j += 64 / sizeof(uint32_t))
+      __builtin_prefetch(&gaps[j]);
+  }
+  enum pixel_type const type = energy_type(img);
+  size_t const size = type == PIXEL_PLANAR8 ? 1 : pixel_size(type);
+  size_t const plane = (size_t)img->w * img->h;
+  char const *const samples =
+      img->luma != NULL ? (char const *)img->luma : (char const *)img->pixels;
+  char const *const start = samples + yx_index(y, x, img->w) * size;
+  size_t const bytes = ((size_t)n + img->n_gaps) * size;
+  for (int c = 0; c < (type == PIXEL_PLANAR8 ? 3 : 1); c++) {
+    for (size_t b = 0; b < bytes + 63; b += 64)
+      __builtin_prefetch(start + c * plane + b);
+  }
+}
+
+/**
+ * Calculate the total energy of the pixels of the 8-bit image @p `img` in a
+ * band of up to @p `band_w` columns per row, from column @p `from[y]` of row
+ * `y` on, but not beyond column @p `w`, into @p `band_w` entries of
+ * @p `energy` per row, and return the column with the least energy in the
+ * bottom row. Only paths that stay within the band are considered: entries
+ * that no such path reaches, and those right of @p `w`, are `UINT32_MAX`.
+ * The energy is the local gradient energy of the pixels, found with
+ * `image_columns`, so their compaction may be deferred. With a band of the
+ * whole image, the energy and the column are those of
+ * `calculate_energy_min_column`.
+ */
+int calculate_energy_band(uint32_t *const energy, struct image *const img,
+                          int const w, uint32_t const *const from,
+                          int const band_w) {
+  // the columns of the pixels of the last two rows from `BAND_MARGIN` columns
+  // left of their band to as many right of it, which hold the pixels above
+  // the band of the next row unless it moves further, and of those above;
+  // each is preceded by its left neighbour, the first pixel itself in column 0
+  size_t const stride = 1 + band_w + 2 * BAND_MARGIN;
+  uint32_t *const cols = malloc(3 * stride * sizeof(uint32_t));
+  if (!cols) {
+    fprintf(stderr, "Memory allocation failed for energy\n");
+    exit(EXIT_FAILURE);
+  }
+  int col_from[2] = {0, 0}, col_to[2] = {0, 0};
+  for (int y = 0; y < BAND_PREFETCH_ROWS && y < img->h; y++)
+    prefetch_band_row(img, y, from[y], band_w);
+  for (int y = 0; y < img->h; y++) {
+    uint32_t *const row = &energy[(size_t)y * band_w];
+    int const f = from[y];
+    int const n = f + band_w < w ? band_w : w - f;
+    if (y + BAND_PREFETCH_ROWS < img->h)
+      prefetch_band_row(img, y + BAND_PREFETCH_ROWS,
+                        from[y + BAND_PREFETCH_ROWS], band_w);
+    int const cur = y % 2, prev = 1 - cur;
+    uint32_t *const row_cols = &cols[cur * stride + 1];
+    col_from[cur] = f > BAND_MARGIN ? f - BAND_MARGIN : 0;
+    col_to[cur] = f + n + BAND_MARGIN < w ? f + n + BAND_MARGIN : w;
+    image_columns(img, y, col_from[cur], col_to[cur] - col_from[cur],
+                  row_cols);
+    if (col_from[cur] == 0)
+      row_cols[-1] = row_cols[0];
+    uint32_t const *const band_cols = &row_cols[f - col_from[cur]];
+    uint32_t const *above_cols = band_cols;
+    if (y > 0 && f >= col_from[prev] && f + n <= col_to[prev]) {
+      above_cols = &cols[prev * stride + 1 + f - col_from[prev]];
+    } else if (y > 0) {
+      uint32_t *const spare = &cols[2 * stride];
+      image_columns(img, y - 1, f, n, spare);
+      above_cols = spare;
+    }
+    size_t const base = yx_index(y, 0, img->w);
+    gradient_band_row(row, img, base, y > 0 ? base - img->w : base, band_cols,
+                      above_cols, n);
+    if (y > 0) {
+      // the neighbours above within their band, like `cumulative_row_u32`;
+      // those right of `w` are `UINT32_MAX`
+      uint32_t const *const total_above = row - band_w;
+      int const shift = f - (int)from[y - 1];
+      for (int j = 0; j < n; j++) {
+        uint32_t top = UINT32_MAX;
+        for (int u = j + shift - 1; u <= j + shift + 1; u++) {
+          if (u >= 0 && u < band_w && total_above[u] < top)
+            top = total_above[u];
+        }
+        row[j] = top == UINT32_MAX ? UINT32_MAX : top + row[j];
+      }
+    }
+    for (int j = n; j < band_w; j++)
+      row[j] = UINT32_MAX;
+  }
+  free(cols);
+
+  uint32_t const *const bottom = &energy[(size_t)(img->h - 1) * band_w];
+  int index = 0;
+  for (int j = 1; j < band_w; j++) {
+    if (bottom[j] < bottom[index])
+      index = j;
+  }
+  return from[img->h - 1] + index;
+}
+
+/**
+ * Calculate the optimal path through the band of @p `band_w` columns per row
+ * from column @p `from[y]` of row `y` on, according to the total energy that
+ * `calculate_energy_band` stored in @p `energy`, like `calculate_optimal_path`
+ * does for the whole image of @p `w` columns and @p `h` rows. The path starts
+ * in column @p `x` of the bottom row and is stored in @p `seam`. Ties are
+ * broken the same way: the pixel straight above wins, then the one to the
+ * left.
+ */
+void calculate_optimal_path_band(uint32_t const *const energy, int const w,
+                                 int const h, uint32_t const *const from,
+                                 int const band_w, int x,
+                                 uint32_t *const seam) {
+  static int const steps[] = {0, -1, 1};
+  seam[h - 1] = x;
+  for (int y = h - 2; y >= 0; y--) {
+    uint32_t const *const row = &energy[(size_t)y * band_w];
+    int const f = from[y];
+    int next = -1;
+    uint32_t least = UINT32_MAX;
+    for (int i = 0; i < 3; i++) {
+      int const u = x + steps[i];
+      if (u >= 0 && u < w && u >= f && u < f + band_w &&
+          (next < 0 || row[u - f] < least)) {
+        next = u;
+        least = row[u - f];
+      }
+    }
+    seam[y] = next;
+    x = next;
+  }
+}
+
+/**
+ * Calculate the total energy of every pixel of the 16-bit image @p `img` like
+ * `calculate_energy`, but into the 64-bit entries of @p `energy`. Like
+ * `calculate_energy_min_column`, every row is finished in a single pass.
+ */
+void calculate_energy64(uint64_t *const energy, struct image *const img,
+                        int const w) {
+  struct energy_function const *const f = energy_active();
+  int const w0 = img->w;
+
+  if (f->total_energy_row_u64[img->type] != NULL) {
+    uint8_t *const dirs = malloc(2 * (((size_t)w + 7) / 8));
+    if (!dirs) {
+      fprintf(stderr, "Memory allocation failed for energy\n");
+      exit(EXIT_FAILURE);
+    }
+    total_energy_row_u64(energy, NULL, img, 0, w, f, NULL, NULL);
+    for (int y = 1; y < img->h; y++) {
+      uint64_t *const row = &energy[yx_index(y, 0, w0)];
+      total_energy_row_u64(row, row - w0, img, y, w, f, dirs,
+                           dirs + ((size_t)w + 7) / 8);
+    }
+    free(dirs);
+    return;
+  }
+
+  struct kernels const *const k = kernels_active();
+  local_energy_row_u64(energy, img, 0, w, k, f);
+  for (int y = 1; y < img->h; y++) {
+    uint64_t *const row = &energy[yx_index(y, 0, w0)];
+    local_energy_row_u64(row, img, y, w, k, f);
+    cumulative_row_u64(row, row - w0, w);
+  }
+}
+
+/**
+ * Like `calculate_min_energy_column`, but for 64-bit energies.
+ */
+int calculate_min_energy_column64(uint64_t const *const energy, int const w0,
+                                  int const w, int const h) {
+  uint64_t const *const row = &energy[yx_index(h - 1, 0, w0)];
+  int index = 0;
+  for (int x = 1; x < w; x++) {
+    if (row[x] < row[index])
+      index = x;
+  }
+  return index;
+}
+
+/**
+ * Like `calculate_optimal_path`, but for 64-bit energies. Ties are broken the
+ * same way: the pixel straight above wins, then the one to the left.
+ */
+void calculate_optimal_path64(uint64_t const *const energy, int const w0,
+                              int const w, int const h, int x,
+                              uint32_t *const seam) {
+  seam[h - 1] = x;
+  for (int y = h - 2; y >= 0; y--) {
+    uint64_t const *const row = &energy[yx_index(y, 0, w0)];
+    int next = x;
+    if (x > 0 && row[x - 1] < row[next])
+      next = x - 1;
+    if (x < w - 1 && row[x + 1] < row[next])
+      next = x + 1;
+    seam[y] = next;
+    x = next;
+  }
+}
+
+/**
+ * Return the index of row @p `y` of the image @p `img`, or if @p `stream` is
+ * not NULL, read that row from it into its window @p `img` and return its
+ * index there.
+ */
+static int next_row(struct image_stream *const stream, int const y) {
+  return stream != NULL ? image_stream_read_row(stream) : y;
+}
+
+/**
+ * The number of seams that `SEAM_DP_VERIFY` compared, and of those that
+ * differed.
+ */
+static size_t seams_verified = 0, seams_mismatched = 0;
+
+/**
+ * The names of the representations, indexed by `enum seam_dp`.
+ */
+static char const *const seam_dp_names[SEAM_DP_COUNT] = {
+    [SEAM_DP_U32] = "u32",
+    [SEAM_DP_U16] = "u16",
+    [SEAM_DP_VERIFY] = "verify",
+};
+
+/**
+ * Return the representation of the total energy called @p `name` (`u32`,
+ * `u16` or `verify`), or `SEAM_DP_COUNT` if there is none.
+ */
+enum seam_dp seam_dp_find(char const *const name) {
+  for (int dp = 0; dp < SEAM_DP_COUNT; dp++) {
+    if (strcmp(name, seam_dp_names[dp]) == 0)
+      return dp;
+  }
+  return SEAM_DP_COUNT;
+}
+
+/**
+ * Find the seams with the representation of the total energy @p `dp` from now
+ * on.
+ */
+void seam_dp_select(enum seam_dp const dp) { seam_dp = dp; }
+
+/**
+ * Return how many seams `SEAM_DP_VERIFY` compared so far, and store how many
+ * of them differed in @p `mismatches`.
+ */
+size_t seam_dp_verified(size_t *const mismatches) {
+  *mismatches = seams_mismatched;
+  return seams_verified;
+}
+
+/**
+ * Return whether the seams of @p `img` can be found with 16-bit rows: those of
+ * 8-bit images whose energy function has a local energy.
+ */
+static bool seam_dp_u16_applies(struct image const *const img) {
+  return img->type != PIXEL_RGB16 && img->type != PIXEL_GRAY16 &&
+         energy_active()->total_energy_row_u32[energy_type(img)] == NULL;
+}
+
+/**
+ * Calculate the total energy of the 8-bit image @p `img` of height @p `h` up
+ * to (excluding) column @p `w` row by row in the two rows @p `above` and
+ * @p `row`, and record which neighbour every entry below the top row took in
+ * the direction bits @p `dirs`: two planes of @p `stride` bytes per row. If
+ * @p `stream` is not NULL, the rows are read from it into its window @p `img`
+ * one at a time. Returns the column with the least energy in the bottom row
+ * and stores that energy in @p `energy`.
+ * Energy functions with a kernel for the total energy of a row take it in
+ * place of the local energy and the cumulative step.
+ */
+static int seam_directions_u32(struct image *const img,
+                               struct image_stream *const stream, int const w,
+                               int const h, uint32_t *above, uint32_t *row,
+                               uint8_t *const dirs, size_t const stride,
+                               uint64_t *const energy) {
+  struct kernels const *const k = kernels_active();
+  void (*const cumulative_row_dir)(uint32_t *, uint32_t const *, int,
+                                   uint8_t *, uint8_t *) =
+      k->cumulative_row_dir_u32 != NULL ? k->cumulative_row_dir_u32
+                                        : cumulative_row_dir_u32;
+
+  struct energy_function const *const f = energy_active();
+  bool const total = f->total_energy_row_u32[energy_type(img)] != NULL;
+
+  int i = next_row(stream, 0);
+  if (total)
+    total_energy_row_u32(above, NULL, img, i, w, f, NULL, NULL);
+  else
+    local_energy_row_u32(above, img, i, w, k, f);
+  for (int y = 1; y < h; y++) {
+    uint8_t *const left = &dirs[(y - 1) * 2 * stride];
+    i = next_row(stream, y);
+    if (total) {
+      total_energy_row_u32(row, above, img, i, w, f, left, left + stride);
+    } else {
+      local_energy_row_u32(row, img, i, w, k, f);
+      cumulative_row_dir(row, above, w, left, left + stride);
+    }
+    uint32_t *const tmp = above;
+    above = row;
+    row = tmp;
+  }
+  int const x = calculate_min_energy_column(above, w, w, 1);
+  *energy = above[x];
+  return x;
+}
+
+/**
+ * Like `seam_directions_u32`, but keep the total energy in the 16-bit rows
+ * @p `above` and @p `row` relative to their least entry, which saturate at
+ * `UINT16_MAX`, and calculate the local energy into the 32-bit row
+ * @p `local`. The least entries of the rows are summed up in 64 bits on the
+ * side, which yields the energy of the seam. As long as no seam runs through
+ * saturated entries, the seam is the one of `seam_directions_u32`, but the DP
+ * compares twice as many entries per vector.
+ */
+static int seam_directions_u16(struct image *const img,
+                               struct image_stream *const stream, int const w,
+                               int const h, uint32_t *const local,
+                               uint16_t *above, uint16_t *row,
+                               uint8_t *const dirs, size_t const stride,
+                               uint64_t *const energy) {
+  struct kernels const *const k = kernels_active();
+  uint32_t (*const cumulative_row_dir)(uint16_t *, uint32_t *,
+                                       uint16_t const *, int, uint8_t *,
+                                       uint8_t *) =
+      k->cumulative_row_dir_u16 != NULL ? k->cumulative_row_dir_u16
+                                        : cumulative_row_dir_u16;
+  struct energy_function const *const f = energy_active();
+
+  local_energy_row_u32(local, img, next_row(stream, 0), w, k, f);
+  uint32_t const least = local[calculate_min_energy_column(local, w, w, 1)];
+  rebase_row_u16(above, local, least, w);
+  uint64_t base = least;
+  for (int y = 1; y < h; y++) {
+    uint8_t *const left = &dirs[(y - 1) * 2 * stride];
+    local_energy_row_u32(local, img, next_row(stream, y), w, k, f);
+    base += cumulative_row_dir(row, local, above, w, left, left + stride);
+    uint16_t *const tmp = above;
+    above = row;
+    row = tmp;
+  }
+  *energy = base;
+  // the first least entry is the first one that is 0
+  int x = 0;
+  while (above[x] != 0)
+    x++;
+  return x;
+}
+
+/**
+ * Like `seam_directions_u32`, but for 16-bit images and 64-bit energies.
+ */
+static int seam_directions_u64(struct image *const img,
+                               struct image_stream *const stream, int const w,
+                               int const h, uint64_t *above, uint64_t *row,
+                               uint8_t *const dirs, size_t const stride,
+                               uint64_t *const energy) {
+  struct kernels const *const k = kernels_active();
+  void (*const cumulative_row_dir)(uint64_t *, uint64_t const *, int,
+                                   uint8_t *, uint8_t *) =
+      k->cumulative_row_dir_u64 != NULL ? k->cumulative_row_dir_u64
+                                        : cumulative_row_dir_u64;
+
+  struct energy_function const *const f = energy_active();
+  bool const total = f->total_energy_row_u64[img->type] != NULL;
+
+  int i = next_row(stream, 0);
+  if (total)
+    total_energy_row_u64(above, NULL, img, i, w, f, NULL, NULL);
+  else
+    local_energy_row_u64(above, img, i, w, k, f);
+  for (int y = 1; y < h; y++) {
+    uint8_t *const left = &dirs[(y - 1) * 2 * stride];
+    i = next_row(stream, y);
+    if (total) {
+      total_energy_row_u64(row, above, img, i, w, f, left, left + stride);
+    } else {
+      local_energy_row_u64(row, img, i, w, k, f);
+      cumulative_row_dir(row, above, w, left, left + stride);
+    }
+    uint64_t *const tmp = above;
+    above = row;
+    row = tmp;
+  }
+  int const x = calculate_min_energy_column64(above, w, w, 1);
+  *energy = above[x];
+  return x;
+}
+
+/**
+ * Find the optimal path up to (excluding) column @p `w` of the image @p `img`
+ * of height @p `h`, or of the image streamed into the window @p `img` by
+ * @p `stream`, with the representation of the total energy @p `dp` where it
+ * applies, and store it in @p `seam`; see `find_seam`. Returns the energy of
+ * the path.
+ */
+static uint64_t find_seam_rows(struct image *const img,
+                               struct image_stream *const stream, int const w,
+                               int const h, enum seam_dp const dp,
+                               uint32_t *const seam) {
+  bool const wide = img->type == PIXEL_RGB16 || img->type == PIXEL_GRAY16;
+  size_t const size = wide ? sizeof(uint64_t) : sizeof(uint32_t);
+  size_t const stride = ((size_t)w + 7) / 8;
+  // 16-bit rows fit the space of the second 32-bit row twice
+  void *const rows = malloc(2 * (size_t)w * size);
+  uint8_t *const dirs = malloc((size_t)(h - 1) * 2 * stride + 1);
+  if (!rows || !dirs) {
+    fprintf(stderr, "Memory allocation failed for energy\n");
+    exit(EXIT_FAILURE);
+  }
+
+  uint64_t energy;
+  int x;
+  if (wide) {
+    x = seam_directions_u64(img, stream, w, h, rows, (uint64_t *)rows + w,
+                            dirs, stride, &energy);
+  } else if (dp == SEAM_DP_U16 && seam_dp_u16_applies(img)) {
+    uint16_t *const rows16 = (uint16_t *)((uint32_t *)rows + w);
+    x = seam_directions_u16(img, stream, w, h, rows, rows16, rows16 + w, dirs,
+                            stride, &energy);
+  } else {
+    x = seam_directions_u32(img, stream, w, h, rows, (uint32_t *)rows + w,
+                            dirs, stride, &energy);
+  }
+  seam[h - 1] = x;
+  for (int y = h - 1; y > 0; y--) {
+    uint8_t const *const left = &dirs[(y - 1) * 2 * stride];
+    uint8_t const *const right = left + stride;
+    x += (right[x / 8] >> x % 8 & 1) - (left[x / 8] >> x % 8 & 1);
+    seam[y - 1] = x;
+  }
+
+  free(dirs);
+  free(rows);
+  return energy;
+}
+
+/**
+ * Find the optimal path of @p `img` up to (excluding) column @p `w` and store
+ * it in @p `seam`. The energy is calculated with 32-bit entries for 8-bit
+ * images and with 64-bit entries for 16-bit images, or with 16-bit entries
+ * relative to the least one of their row if `SEAM_DP_U16` is selected.
+ * Only two rows of energy are kept: for every pixel, the DP records with two
+ * bits whether the path to it comes from the left, from the right or from
+ * straight above, and the path is traced back along those bits. This takes
+ * 16 (32 for 16-bit images) times less memory than the whole energy matrix
+ * that `calculate_optimal_path` needs, and yields the same path.
+ * With `SEAM_DP_VERIFY`, the path is found both ways, and the 32-bit one is
+ * kept and counted as a mismatch if the 16-bit one or its energy differs.
+ * The 32-bit path of an image whose energy planes hold the energy in use for
+ * @p `w` columns is traced in the total energy plane right away, without a DP.
+ */
+void find_seam(struct image *const img, int const w, uint32_t *const seam) {
+  if (seam_dp == SEAM_DP_U32 && energy_plane_applies(img, w, true)) {
+    int const x = calculate_min_energy_column(img->total, img->w, w, img->h);
+    calculate_optimal_path(img->total, img->w, w, img->h, x, seam);
+    return;
+  }
+  // other energy functions read whole rows of pixels
+  if (!energy_plane_applies(img, w, false))
+    image_compact(img);
+  if (seam_dp != SEAM_DP_VERIFY || !seam_dp_u16_applies(img)) {
+    find_seam_rows(img, NULL, w, img->h, seam_dp, seam);
+    return;
+  }
+  uint32_t *const seam16 = malloc(img->h * sizeof(uint32_t));
+  if (!seam16) {
+    fprintf(stderr, "Memory allocation failed for seam\n");
+    exit(EXIT_FAILURE);
+  }
+  uint64_t const energy16 =
+      find_seam_rows(img, NULL, w, img->h, SEAM_DP_U16, seam16);
+  uint64_t const energy =
+      find_seam_rows(img, NULL, w, img->h, SEAM_DP_U32, seam);
+  seams_verified++;
+  if (energy16 != energy ||
+      memcmp(seam16, seam, img->h * sizeof(uint32_t)) != 0)
+    seams_mismatched++;
+  free(seam16);
+}
+
+/**
+ * Order the bottom entries of `find_seams`, which hold the total energy in
+ * their upper and the column in their lower 32 bits, by both.
+ */
+static int compare_candidates(void const *const a, void const *const b) {
+  uint64_t const x = *(uint64_t const *)a, y = *(uint64_t const *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Find up to @p `k` paths of @p `img` up to (excluding) column @p `w` from a
+ * single calculation of the total energy and store them one after another in
+ * @p `seams`, which has room for @p `k` paths. Returns the number of paths.
+ * The bottom entries are tried as starts in the order of their total energy,
+ * and each path is traced back like by `calculate_optimal_path`, but only
+ * through pixels that no path found before takes and without crossing one.
+ * A path that runs into the pixels of others is dropped. The first path is
+ * the optimal one, the others are the cheapest ones left, which no
+ * longer see the energy of the pixels the paths before them take away.
+ * The paths take different pixels and are stored from left to right in every
+ * row, as `carve_paths` expects them. 16-bit images and energy functions
+ * without a local energy get a single path from `find_seam`.
+ */
+int find_seams(struct image *const img, int const w, int const k,
+               uint32_t *const seams) {
+  int const h = img->h;
+  if (k <= 1 || w <= 1 || img->type == PIXEL_RGB16 ||
+      img->type == PIXEL_GRAY16 ||
+      energy_active()->total_energy_row_u32[energy_type(img)] != NULL) {
+    find_seam(img, w, seams);
+    return 1;
+  }
+
+  int const w0 = img->w;
+  uint32_t *const energy = malloc((size_t)w0 * h * sizeof(uint32_t));
+  // 0 for free pixels, otherwise 2 plus the step of the path that takes them
+  // to the row above
+  uint8_t *const taken = calloc((size_t)w0 * h, 1);
+  uint64_t *const candidates = malloc((size_t)w * sizeof(uint64_t));
+  uint32_t *const found_seams = malloc((size_t)k * h * sizeof(uint32_t));
+  if (!energy || !taken || !candidates || !found_seams) {
+    fprintf(stderr, "Memory allocation failed for energy\n");
+    exit(EXIT_FAILURE);
+  }
+  calculate_energy_min_column(energy, img, w);
+  uint32_t const *const bottom = &energy[yx_index(h - 1, 0, w0)];
+  for (int x = 0; x < w; x++)
+    candidates[x] = (uint64_t)bottom[x] << 32 | (uint32_t)x;
+  qsort(candidates, w, sizeof(uint64_t), compare_candidates);
+
+  static int const steps[] = {0, -1, 1};
+  int found = 0;
+  for (int c = 0; c < w && found < k; c++) {
+    uint32_t *const seam = &found_seams[(size_t)found * h];
+    int x = (uint32_t)candidates[c];
+    if (taken[yx_index(h - 1, x, w0)] != 0)
+      continue;
+    seam[h - 1] = x;
+    int y = h - 2;
+    for (; y >= 0; y--) {
+      uint8_t const *const below = &taken[yx_index(y + 1, 0, w0)];
+      int next = -1;
+      uint32_t least = 0;
+      for (int i = 0; i < 3; i++) {
+        int const u = x + steps[i];
+        // a diagonal step crosses the path that takes the other diagonal
+        if (u < 0 || u >= w || taken[yx_index(y, u, w0)] != 0 ||
+            (u != x && below[u] == 2 + x - u))
+          continue;
+        uint32_t const total = energy[yx_index(y, u, w0)];
+        if (next < 0 || total < least) {
+          next = u;
+          least = total;
+        }
+      }
+      if (next < 0)
+        break;
+      seam[y] = x = next;
+    }
+    if (y >= 0)
+      continue;
+    found++;
+    taken[yx_index(0, seam[0], w0)] = 2;
+    for (y = 1; y < h; y++)
+      taken[yx_index(y, seam[y], w0)] = 2 + seam[y - 1] - seam[y];
+  }
+
+  // paths that do not cross keep their order in every row
+  for (int i = 0; i < found; i++)
+    candidates[i] = (uint64_t)found_seams[(size_t)i * h + h - 1] << 32 | i;
+  qsort(candidates, found, sizeof(uint64_t), compare_candidates);
+  for (int i = 0; i < found; i++)
+    memcpy(&seams[(size_t)i * h],
+           &found_seams[(size_t)(uint32_t)candidates[i] * h],
+           h * sizeof(uint32_t));
+
+  free(found_seams);
+  free(candidates);
+  free(taken);
+  free(energy);
+  return found;
+}
+
+/**
+ * Find the optimal path of the image streamed by @p `stream` like `find_seam`
+ * and store it in @p `seam`, which has room for its height. Every row is read
+ * from the stream right before its energy is calculated, so besides the
+ * direction bits only two rows of pixels and energy are kept in memory. The
+ * rows of the stream have all been read afterwards. Ends the execution if the
+ * energy function in use reads the row below, which is not read yet, or if
+ * `SEAM_DP_VERIFY` is selected, which would have to read the rows twice.
+ */
+void find_seam_stream(struct image_stream *const stream, uint32_t *const seam) {
+  struct image *const window = image_stream_window(stream);
+  if (energy_active()->reads_below) {
+    fprintf(stderr, "The %s energy cannot be calculated on a stream\n",
+            energy_active()->name);
+    exit(EXIT_FAILURE);
+  }
+  if (seam_dp == SEAM_DP_VERIFY) {
+    fprintf(stderr, "Seams cannot be verified on a stream\n");
+    exit(EXIT_FAILURE);
+  }
+  find_seam_rows(window, stream, window->w, image_stream_height(stream),
+                 seam_dp, seam);
+}
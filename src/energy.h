@@ -2,6 +2,7 @@
 #define ENERGY_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "image.h"
@@ -15,6 +16,37 @@ struct image;
  * */
 uint32_t diff_color(struct pixel a, struct pixel b);
 
+/**
+ * Calculate the difference of two gray values @p a and @p b, i.e. the square
+ * of their difference.
+ */
+uint32_t diff_gray(uint8_t a, uint8_t b);
+
+/**
+ * Calculate the difference of two padded color values @p a and @p b like
+ * `diff_color`.
+ */
+uint32_t diff_colorx(struct pixelx a, struct pixelx b);
+
+/**
+ * Calculate the difference of the two planar color values at @p a and @p b,
+ * whose green and blue samples follow @p `plane` and `2 * plane` samples later,
+ * like `diff_color`.
+ */
+uint32_t diff_planar(uint8_t const* a, uint8_t const* b, size_t plane);
+
+/**
+ * Calculate the difference of two 16-bit color values @p a and @p b, i.e. the
+ * sum of the squares of the differences of their color components.
+ */
+uint64_t diff_color16(struct pixel16 a, struct pixel16 b);
+
+/**
+ * Calculate the difference of two 16-bit gray values @p a and @p b, i.e. the
+ * square of their difference.
+ */
+uint64_t diff_gray16(uint16_t a, uint16_t b);
+
 /**
  * Calculate the total energy at every pixel of the image @p `img`,
  * but only considering columns with index less than @p `w`.
@@ -22,9 +54,20 @@ uint32_t diff_color(struct pixel a, struct pixel b);
  * total energy.
  * @p `energy` is expected to have allocated enough space
  * to represent the energy for every pixel of the whole image @p `img.
+ * The energy function is the one selected with `energy_select`; paths of the
+ * forward energy have to be traced with `find_seam`.
  */
 void calculate_energy(uint32_t* energy, struct image* image, int w);
 
+/**
+ * Calculate the total energy like `calculate_energy` and return the index of
+ * the column with the least energy in the bottom row like
+ * `calculate_min_energy_column`, which the vectorized update of the bottom row
+ * finds without another pass. Images with energy planes have the total energy
+ * copied from there.
+ */
+int calculate_energy_min_column(uint32_t* energy, struct image* image, int w);
+
 /**
  * Calculate the index of the column with the least energy in bottom row.
  * Expects that @p `energy` holds the energy of every pixel of @p `img` up to
@@ -46,4 +89,139 @@ int calculate_min_energy_column(uint32_t const* energy, int w0, int w, int h);
 void calculate_optimal_path(uint32_t const* energy, int w0, int w, int h,
                             int min_x, uint32_t* seam);
 
+/**
+ * Calculate the total energy of the pixels of the 8-bit image @p `img` in a
+ * band of up to @p `band_w` columns per row, from column @p `from[y]` of row
+ * `y` on, but not beyond column @p `w`, into @p `band_w` entries of
+ * @p `energy` per row, and return the column with the least energy in the
+ * bottom row. Only paths that stay within the band are considered: entries
+ * that no such path reaches, and those right of @p `w`, are `UINT32_MAX`.
+ * The energy is the local gradient energy of the pixels, found with
+ * `image_columns`, so their compaction may be deferred. With a band of the
+ * whole image, the energy and the column are those of
+ * `calculate_energy_min_column`.
+ */
+int calculate_energy_band(uint32_t* energy, struct image* img, int w,
+                          uint32_t const* from, int band_w);
+
+/**
+ * Calculate the optimal path through the band of @p `band_w` columns per row
+ * from column @p `from[y]` of row `y` on, according to the total energy that
+ * `calculate_energy_band` stored in @p `energy`, like `calculate_optimal_path`
+ * does for the whole image of @p `w` columns and @p `h` rows. The path starts
+ * in column @p `x` of the bottom row and is stored in @p `seam`. Ties are
+ * broken the same way: the pixel straight above wins, then the one to the
+ * left.
+ */
+void calculate_optimal_path_band(uint32_t const* energy, int w, int h,
+                                 uint32_t const* from, int band_w, int x,
+                                 uint32_t* seam);
+
+/**
+ * Calculate the total energy of every pixel of the 16-bit image @p `img` like
+ * `calculate_energy`, but into the 64-bit entries of @p `energy`, as the
+ * squared differences of 16-bit samples quickly overflow 32 bits.
+ */
+void calculate_energy64(uint64_t* energy, struct image* image, int w);
+
+/**
+ * Like `calculate_min_energy_column`, but for 64-bit energies.
+ */
+int calculate_min_energy_column64(uint64_t const* energy, int w0, int w,
+                                  int h);
+
+/**
+ * Like `calculate_optimal_path`, but for 64-bit energies.
+ */
+void calculate_optimal_path64(uint64_t const* energy, int w0, int w, int h,
+                              int min_x, uint32_t* seam);
+
+/**
+ * Add the energy planes to the 8-bit image @p `img`: the local gradient
+ * energy of every pixel, which `find_seam` copies instead of calculating it
+ * for every seam, and the total energy, which it traces the seam in. Both are
+ * kept up to date by `carve_path`. Unless `SEAM_DP_U32` is selected, whose
+ * seams are the only ones traced in the total energy, the image only gets the
+ * local energy plane. Add the luma plane first, if at all. 16-bit images and
+ * energy functions other than the gradient are left as they are.
+ */
+void energy_add_plane(struct image* img);
+
+/**
+ * Carve the path @p `seam` out of the energy planes of @p `img`, where only
+ * the @p `w` left columns are considered, once its pixels have been carved,
+ * and recalculate the local energy of the one or two pixels per row next to
+ * the seam and the total energy that depends on it; see `carve_path`. The
+ * totals are exactly those of a full recalculation.
+ */
+void energy_carve_plane(struct image* img, int w, uint32_t const* seam);
+
+/**
+ * The representations of the total energy that `find_seam` can find the
+ * seams of 8-bit images with:
+ * - `SEAM_DP_U32`, 32-bit entries, the default,
+ * - `SEAM_DP_U16`, 16-bit entries relative to the least one of their row,
+ *   which saturate at `UINT16_MAX`; the least entries are summed up in 64 bits
+ *   on the side. Unless a seam runs through saturated entries, it is the
+ *   32-bit one,
+ * - `SEAM_DP_VERIFY`, both, keeping the 32-bit seam and counting the seams
+ *   that differ.
+ * 16-bit images and the forward energy, which has no local energy, always
+ * use the wide entries. `SEAM_DP_COUNT` stands for none.
+ */
+enum seam_dp {
+    SEAM_DP_U32,
+    SEAM_DP_U16,
+    SEAM_DP_VERIFY,
+    SEAM_DP_COUNT,
+};
+
+/**
+ * Return the representation of the total energy called @p `name` (`u32`,
+ * `u16` or `verify`), or `SEAM_DP_COUNT` if there is none.
+ */
+enum seam_dp seam_dp_find(char const* name);
+
+/**
+ * Find the seams with the representation of the total energy @p `dp` from now
+ * on.
+ */
+void seam_dp_select(enum seam_dp dp);
+
+/**
+ * Return how many seams `SEAM_DP_VERIFY` compared so far, and store how many
+ * of them differed in @p `mismatches`.
+ */
+size_t seam_dp_verified(size_t* mismatches);
+
+/**
+ * Find the optimal path of @p `img` up to (excluding) column @p `w` and store
+ * it in @p `seam`, which has an entry for every row. Works on images of every
+ * pixel type, with the representation of the total energy selected with
+ * `seam_dp_select`. The 32-bit path of an image with energy planes is traced
+ * in the total energy plane right away.
+ */
+void find_seam(struct image* img, int w, uint32_t* seam);
+
+/**
+ * Find up to @p `k` paths of @p `img` up to (excluding) column @p `w` from a
+ * single calculation of the total energy and store them one after another in
+ * @p `seams`, which has room for @p `k` paths. Returns the number of paths,
+ * the first of which is the optimal one. The others are the
+ * cheapest paths from the other bottom pixels that take none of the pixels of
+ * the paths before them and do not cross them. They are stored from left to
+ * right in every row, as `carve_paths` expects them. 16-bit images and
+ * energy functions without a local energy get a single path.
+ */
+int find_seams(struct image* img, int w, int k, uint32_t* seams);
+
+/**
+ * Find the optimal path of the image streamed by @p `stream` like `find_seam`
+ * and store it in @p `seam`, which has room for its height. Only two rows of
+ * the image are held in memory at a time; all rows of the stream have been
+ * read afterwards. Ends the execution if the energy function in use reads the
+ * row below or if `SEAM_DP_VERIFY` is selected.
+ */
+void find_seam_stream(struct image_stream* stream, uint32_t* seam);
+
 #endif
@@ -0,0 +1,263 @@
+#include "energy_functions.h"
+
+#include <string.h>
+
+/*
+ * How the row kernels read sample `c` of pixel `x` of a row `p` of every pixel
+ * type. Planar rows find their green and blue samples `plane` samples apart,
+ * which every kernel has as a parameter; gray rows have a single sample.
+ */
+#define RGB8_SAMPLE(p, x, c) ((uint8_t const *)(p))[3 * (x) + (c)]
+#define GRAY8_SAMPLE(p, x, c) ((uint8_t const *)(p))[x]
+#define RGBX8_SAMPLE(p, x, c) ((uint8_t const *)(p))[4 * (x) + (c)]
+#define PLANAR8_SAMPLE(p, x, c) ((uint8_t const *)(p))[(x) + (c) * plane]
+#define RGB16_SAMPLE(p, x, c) ((uint16_t const *)(p))[3 * (x) + (c)]
+#define GRAY16_SAMPLE(p, x, c) ((uint16_t const *)(p))[x]
+
+/*
+ * Define `NAME_ENERGY_row`, the row kernel of the local energy
+ * `NAME_ENERGY_at`, with the border columns taken out of the loop.
+ */
+#define DEFINE_LOCAL_ROW(NAME, ENERGY, energy_t)                               \
+  static void NAME##_##ENERGY##_row(                                           \
+      energy_t *const out, void const *const above, void const *const row,     \
+      void const *const below, size_t const plane, int const w) {              \
+    if (w == 1) {                                                              \
+      out[0] = NAME##_##ENERGY##_at(above, row, below, 0, 0, 0, plane);        \
+      return;                                                                  \
+    }                                                                          \
+    out[0] = NAME##_##ENERGY##_at(above, row, below, 0, 0, 1, plane);          \
+    for (int x = 1; x < w - 1; x++)                                            \
+      out[x] =                                                                 \
+          NAME##_##ENERGY##_at(above, row, below, x - 1, x, x + 1, plane);     \
+    out[w - 1] =                                                               \
+        NAME##_##ENERGY##_at(above, row, below, w - 2, w - 1, w - 1, plane);   \
+  }
+
+/*
+ * Define the row kernels of every energy function for the pixel type `NAME`,
+ * whose rows are read with `SAMPLE` and have `CHANNELS` samples per pixel.
+ * The energies are summed as `energy_t`, the differences of samples are taken
+ * as `diff_t`, which holds their squares. Every energy is defined by an
+ * inline function for a single pixel, which the kernels call with the columns
+ * of its neighbours, clamped to the row; the compiler expands it into each of
+ * them, and with the channel count known, unrolls the channels. Only the
+ * border columns are handled separately, so the inner loops have no branches.
+ *
+ * - `NAME_distance` is the squared distance of pixel `i` of row `a` and pixel
+ *   `j` of row `b`, summed over the channels like `diff_color`,
+ * - `NAME_dual_gradient_at` and `NAME_sobel_at` are the local energy of pixel
+ *   `x`, whose left and right neighbours are `l` and `r`,
+ * - `NAME_forward_at` is the total forward energy of pixel `x`, which it
+ *   stores with the neighbour it took: the pixels `l` and `r` become
+ *   neighbours whichever way the seam comes, the pixel above and `l` if it
+ *   comes from the left, the pixel above and `r` if it comes from the right,
+ *   and in the border columns, where `l` or `r` is `x`, there is no such way.
+ */
+#define DEFINE_ENERGY_ROWS(NAME, SAMPLE, CHANNELS, energy_t, diff_t)           \
+  static inline energy_t NAME##_distance(void const *const a, int const i,     \
+                                         void const *const b, int const j,     \
+                                         size_t const plane) {                 \
+    (void)plane;                                                               \
+    energy_t distance = 0;                                                     \
+    for (int c = 0; c < CHANNELS; c++) {                                       \
+      diff_t const diff = (diff_t)SAMPLE(a, i, c) - SAMPLE(b, j, c);           \
+      distance += (energy_t)(diff * diff);                                     \
+    }                                                                          \
+    return distance;                                                           \
+  }                                                                            \
+                                                                               \
+  static inline energy_t NAME##_dual_gradient_at(                              \
+      void const *const above, void const *const row,                          \
+      void const *const below, int const l, int const x, int const r,          \
+      size_t const plane) {                                                    \
+    return NAME##_distance(row, r, row, l, plane) +                            \
+           NAME##_distance(below, x, above, x, plane);                         \
+  }                                                                            \
+                                                                               \
+  static inline energy_t NAME##_sobel_at(                                      \
+      void const *const above, void const *const row,                          \
+      void const *const below, int const l, int const x, int const r,          \
+      size_t const plane) {                                                    \
+    (void)plane;                                                               \
+    energy_t energy = 0;                                                       \
+    for (int c = 0; c < CHANNELS; c++) {                                       \
+      diff_t const gx = (diff_t)SAMPLE(above, r, c) + 2 * SAMPLE(row, r, c) +  \
+                        SAMPLE(below, r, c) - SAMPLE(above, l, c) -            \
+                        2 * SAMPLE(row, l, c) - SAMPLE(below, l, c);           \
+      diff_t const gy = (diff_t)SAMPLE(below, l, c) +                          \
+                        2 * SAMPLE(below, x, c) + SAMPLE(below, r, c) -        \
+                        SAMPLE(above, l, c) - 2 * SAMPLE(above, x, c) -        \
+                        SAMPLE(above, r, c);                                   \
+      energy += (energy_t)(gx * gx + gy * gy);                                 \
+    }                                                                          \
+    return energy >> 4;                                                        \
+  }                                                                            \
+                                                                               \
+  DEFINE_LOCAL_ROW(NAME, dual_gradient, energy_t)                              \
+  DEFINE_LOCAL_ROW(NAME, sobel, energy_t)                                      \
+                                                                               \
+  static inline void NAME##_forward_at(                                        \
+      energy_t *const out, energy_t const *const total_above,                  \
+      void const *const above, void const *const row, int const l,             \
+      int const x, int const r, size_t const plane, uint8_t *const left,       \
+      uint8_t *const right) {                                                  \
+    energy_t const up = NAME##_distance(row, r, row, l, plane);                \
+    energy_t total = total_above[x] + up;                                      \
+    int from = 0;                                                              \
+    if (l < x) {                                                               \
+      energy_t const from_left =                                               \
+          total_above[l] + up + NAME##_distance(above, x, row, l, plane);      \
+      if (from_left < total) {                                                 \
+        total = from_left;                                                     \
+        from = -1;                                                             \
+      }                                                                        \
+    }                                                                          \
+    if (r > x) {                                                               \
+      energy_t const from_right =                                              \
+          total_above[r] + up + NAME##_distance(above, x, row, r, plane);      \
+      if (from_right < total) {                                                \
+        total = from_right;                                                    \
+        from = 1;                                                              \
+      }                                                                        \
+    }                                                                          \
+    out[x] = total;                                                            \
+    left[x / 8] |= (from < 0) << x % 8;                                        \
+    right[x / 8] |= (from > 0) << x % 8;                                       \
+  }                                                                            \
+                                                                               \
+  static void NAME##_forward_row(                                              \
+      energy_t *const out, energy_t const *const total_above,                  \
+      void const *const above, void const *const row, size_t const plane,      \
+      int const w, uint8_t *const left, uint8_t *const right) {                \
+    if (total_above == NULL) {                                                 \
+      for (int x = 0; x < w; x++)                                              \
+        out[x] = NAME##_distance(row, x < w - 1 ? x + 1 : x, row,              \
+                                 x > 0 ? x - 1 : 0, plane);                    \
+      return;                                                                  \
+    }                                                                          \
+    memset(left, 0, ((size_t)w + 7) / 8);                                      \
+    memset(right, 0, ((size_t)w + 7) / 8);                                     \
+    if (w == 1) {                                                              \
+      NAME##_forward_at(out, total_above, above, row, 0, 0, 0, plane, left,    \
+                        right);                                                \
+      return;                                                                  \
+    }                                                                          \
+    NAME##_forward_at(out, total_above, above, row, 0, 0, 1, plane, left,      \
+                      right);                                                  \
+    for (int x = 1; x < w - 1; x++)                                            \
+      NAME##_forward_at(out, total_above, above, row, x - 1, x, x + 1, plane,  \
+                        left, right);                                          \
+    NAME##_forward_at(out, total_above, above, row, w - 2, w - 1, w - 1,       \
+                      plane, left, right);                                     \
+  }
+
+DEFINE_ENERGY_ROWS(rgb8, RGB8_SAMPLE, 3, uint32_t, int)
+DEFINE_ENERGY_ROWS(gray8, GRAY8_SAMPLE, 1, uint32_t, int)
+DEFINE_ENERGY_ROWS(rgbx8, RGBX8_SAMPLE, 3, uint32_t, int)
+DEFINE_ENERGY_ROWS(planar8, PLANAR8_SAMPLE, 3, uint32_t, int)
+DEFINE_ENERGY_ROWS(rgb16, RGB16_SAMPLE, 3, uint64_t, int64_t)
+DEFINE_ENERGY_ROWS(gray16, GRAY16_SAMPLE, 1, uint64_t, int64_t)
+
+/**
+ * The row kernels of every energy function, indexed by `enum energy_kind`.
+ */
+static struct energy_function const energy_functions[ENERGY_COUNT] = {
+    [ENERGY_GRADIENT] = {.name = "gradient"},
+    [ENERGY_DUAL_GRADIENT] =
+        {
+            .name = "dual-gradient",
+            .reads_below = true,
+            .local_energy_row_u32 =
+                {
+                    [PIXEL_RGB8] = rgb8_dual_gradient_row,
+                    [PIXEL_GRAY8] = gray8_dual_gradient_row,
+                    [PIXEL_RGBX8] = rgbx8_dual_gradient_row,
+                    [PIXEL_PLANAR8] = planar8_dual_gradient_row,
+                },
+            .local_energy_row_u64 =
+                {
+                    [PIXEL_RGB16] = rgb16_dual_gradient_row,
+                    [PIXEL_GRAY16] = gray16_dual_gradient_row,
+                },
+        },
+    [ENERGY_SOBEL] =
+        {
+            .name = "sobel",
+            .reads_below = true,
+            .local_energy_row_u32 =
+                {
+                    [PIXEL_RGB8] = rgb8_sobel_row,
+                    [PIXEL_GRAY8] = gray8_sobel_row,
+                    [PIXEL_RGBX8] = rgbx8_sobel_row,
+                    [PIXEL_PLANAR8] = planar8_sobel_row,
+                },
+            .local_energy_row_u64 =
+                {
+                    [PIXEL_RGB16] = rgb16_sobel_row,
+                    [PIXEL_GRAY16] = gray16_sobel_row,
+                },
+        },
+    [ENERGY_FORWARD] =
+        {
+            .name = "forward",
+            .total_energy_row_u32 =
+                {
+                    [PIXEL_RGB8] = rgb8_forward_row,
+                    [PIXEL_GRAY8] = gray8_forward_row,
+                    [PIXEL_RGBX8] = rgbx8_forward_row,
+                    [PIXEL_PLANAR8] = planar8_forward_row,
+                },
+            .total_energy_row_u64 =
+                {
+                    [PIXEL_RGB16] = rgb16_forward_row,
+                    [PIXEL_GRAY16] = gray16_forward_row,
+                },
+        },
+};
+
+/**
+ * The energy function in use.
+ */
+static struct energy_function const *active =
+    &energy_functions[ENERGY_GRADIENT];
+
+/**
+ * Return the energy function called @p `name` (`gradient`, `dual-gradient`,
+ * `sobel` or `forward`), or `ENERGY_COUNT` if there is none.
+ */
+enum energy_kind energy_find(char const *const name) {
+  for (int kind = 0; kind < ENERGY_COUNT; kind++) {
+    if (strcmp(name, energy_functions[kind].name) == 0)
+      return kind;
+  }
+  return ENERGY_COUNT;
+}
+
+/**
+ * Return the name of the energy function @p `kind`, as accepted by
+ * `energy_find`.
+ */
+char const *energy_name(enum energy_kind const kind) {
+  return energy_functions[kind].name;
+}
+
+/**
+ * Return the row kernels of the energy function @p `kind`.
+ */
+struct energy_function const *energy_get(enum energy_kind const kind) {
+  return &energy_functions[kind];
+}
+
+/**
+ * Find the seams with the energy function @p `kind` from now on.
+ */
+void energy_select(enum energy_kind const kind) {
+  active = &energy_functions[kind];
+}
+
+/**
+ * Return the energy function in use, the gradient unless another one was
+ * selected with `energy_select`.
+ */
+struct energy_function const *energy_active(void) { return active; }
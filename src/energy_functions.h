@@ -0,0 +1,107 @@
+#ifndef ENERGY_FUNCTIONS_H
+#define ENERGY_FUNCTIONS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "image.h"
+
+/**
+ * The energy functions a seam can be found with:
+ * - `ENERGY_GRADIENT`, the color difference of every pixel to the pixel above
+ *   plus the one to the pixel on the left (`diff_color`), the default,
+ * - `ENERGY_DUAL_GRADIENT`, the difference of the right and the left
+ *   neighbour plus the one of the neighbours below and above,
+ * - `ENERGY_SOBEL`, the squared responses of the horizontal and the vertical
+ *   3x3 Sobel operator on every channel, divided by 16,
+ * - `ENERGY_FORWARD`, the forward energy: the differences of the pixels that
+ *   become neighbours when the seam takes a pixel, which depend on whether
+ *   it comes from the left, from above or from the right.
+ * Pixels outside of the image are taken from the nearest border, except for
+ * the gradient, which has no neighbour there. `ENERGY_COUNT` stands for none.
+ */
+enum energy_kind {
+    ENERGY_GRADIENT,
+    ENERGY_DUAL_GRADIENT,
+    ENERGY_SOBEL,
+    ENERGY_FORWARD,
+    ENERGY_COUNT,
+};
+
+/**
+ * The number of pixel types the row kernels are indexed by.
+ */
+#define ENERGY_PIXEL_TYPES (PIXEL_PLANAR8 + 1)
+
+/**
+ * The row kernels of an energy function, indexed by the pixel type of the
+ * rows they read. Every kernel is expanded from the definition of the energy
+ * for its pixel type, so none of them calls anything per pixel:
+ * - `local_energy_row_u32` calculates the local energy of the @p `w` left
+ *   pixels of the 8-bit @p `row` into @p `out` from the rows @p `above` and
+ *   @p `below`, which are @p `row` itself at the top and the bottom of the
+ *   image; planar rows point to the red samples, the green and blue ones
+ *   follow @p `plane` and `2 * plane` samples later,
+ * - `total_energy_row_u32` turns the 8-bit @p `row` straight into total
+ *   energy, for energies whose local energy depends on the neighbour in
+ *   @p `total_above`, the total energy of the row above, that the path takes.
+ *   It records the neighbour taken in the bit planes @p `left` and @p `right`
+ *   like `cumulative_row_dir_u32_sse41` and leaves the planes alone in the
+ *   top row, where @p `total_above` is NULL,
+ * - `local_energy_row_u64` and `total_energy_row_u64` do the same for 16-bit
+ *   rows and 64-bit energies.
+ * `reads_below` tells whether the kernels read the row below. An energy
+ * function without kernels is the gradient, which `energy.c` computes with
+ * its own and the SIMD kernels.
+ */
+struct energy_function {
+    char const* name;
+    bool reads_below;
+    void (*local_energy_row_u32[ENERGY_PIXEL_TYPES])(uint32_t* out,
+                                                     void const* above,
+                                                     void const* row,
+                                                     void const* below,
+                                                     size_t plane, int w);
+    void (*total_energy_row_u32[ENERGY_PIXEL_TYPES])(
+        uint32_t* out, uint32_t const* total_above, void const* above,
+        void const* row, size_t plane, int w, uint8_t* left, uint8_t* right);
+    void (*local_energy_row_u64[ENERGY_PIXEL_TYPES])(uint64_t* out,
+                                                     void const* above,
+                                                     void const* row,
+                                                     void const* below,
+                                                     size_t plane, int w);
+    void (*total_energy_row_u64[ENERGY_PIXEL_TYPES])(
+        uint64_t* out, uint64_t const* total_above, void const* above,
+        void const* row, size_t plane, int w, uint8_t* left, uint8_t* right);
+};
+
+/**
+ * Return the energy function called @p `name` (`gradient`, `dual-gradient`,
+ * `sobel` or `forward`), or `ENERGY_COUNT` if there is none.
+ */
+enum energy_kind energy_find(char const* name);
+
+/**
+ * Return the name of the energy function @p `kind`, as accepted by
+ * `energy_find`.
+ */
+char const* energy_name(enum energy_kind kind);
+
+/**
+ * Return the row kernels of the energy function @p `kind`.
+ */
+struct energy_function const* energy_get(enum energy_kind kind);
+
+/**
+ * Find the seams with the energy function @p `kind` from now on.
+ */
+void energy_select(enum energy_kind kind);
+
+/**
+ * Return the energy function in use, the gradient unless another one was
+ * selected with `energy_select`.
+ */
+struct energy_function const* energy_active(void);
+
+#endif
@@ -0,0 +1,1570 @@
+#include "energy_simd.h"
+
+#if ENERGY_SIMD_X86
+
+#include <immintrin.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "energy.h"
+
+static inline uint32_t min_u32(uint32_t const a, uint32_t const b) {
+  return a < b ? a : b;
+}
+
+/**
+ * Merge the least entries @p `lanes` found in the @p `n` lanes of a vector, at
+ * the columns @p `lane_xs`, into the least entry @p `best` found so far at
+ * column @p `best_x`, which lies before all of them. Ties go to the earlier
+ * column.
+ */
+static inline void merge_lanes(uint32_t const *const lanes,
+                               uint32_t const *const lane_xs, int const n,
+                               uint32_t *const best, int *const best_x) {
+  uint32_t lane_best = UINT32_MAX;
+  uint32_t lane_x = UINT32_MAX;
+  for (int i = 0; i < n; i++) {
+    if (lanes[i] < lane_best || (lanes[i] == lane_best && lane_xs[i] < lane_x)) {
+      lane_best = lanes[i];
+      lane_x = lane_xs[i];
+    }
+  }
+  // lanes that never saw an entry still hold UINT32_MAX and are never taken
+  if (lane_best < *best) {
+    *best = lane_best;
+    *best_x = (int)lane_x;
+  }
+}
+
+/**
+ * Update the entries of the energy row @p `row` from column @p `x` up to
+ * @p `w` one at a time, including the last one, whose right neighbour is
+ * clamped. With @p `track_min`, continue the search for the first least entry
+ * @p `best` at @p `best_x` and return its column, otherwise return 0.
+ */
+static inline int cumulative_row_tail(uint32_t *const row,
+                                      uint32_t const *const above, int x,
+                                      int const w, bool const track_min,
+                                      uint32_t best, int best_x) {
+  for (; x < w; x++) {
+    uint32_t least = min_u32(above[x - 1], above[x]);
+    if (x < w - 1)
+      least = min_u32(least, above[x + 1]);
+    row[x] += least;
+    if (track_min && row[x] < best) {
+      best = row[x];
+      best_x = x;
+    }
+  }
+  return track_min ? best_x : 0;
+}
+
+/**
+ * The `pshufb` masks that spread the 12 bytes of four RGB pixels to 16-bit
+ * samples, with a zero fourth sample per pixel: pixels 0 and 1 (`LO`) and
+ * pixels 2 and 3 (`HI`).
+ */
+#define SPREAD_LO 0, -1, 1, -1, 2, -1, -1, -1, 3, -1, 4, -1, 5, -1, -1, -1
+#define SPREAD_HI 6, -1, 7, -1, 8, -1, -1, -1, 9, -1, 10, -1, 11, -1, -1, -1
+
+/**
+ * Return the sum of the squared differences of the samples of the four pixels
+ * spread by @p `mask` from @p `a` and @p `b`, as pairs of 32-bit sums: red and
+ * green, blue.
+ */
+__attribute__((target("sse4.1"))) static inline __m128i
+squared_diff4(__m128i const a, __m128i const b, __m128i const mask) {
+  __m128i const diff =
+      _mm_sub_epi16(_mm_shuffle_epi8(a, mask), _mm_shuffle_epi8(b, mask));
+  return _mm_madd_epi16(diff, diff);
+}
+
+/**
+ * Return the local energy of the four pixels in the first 12 bytes of
+ * @p `cur`, given the pixels above them in @p `up` and those to their left in
+ * @p `left`.
+ */
+__attribute__((target("sse4.1"))) static inline __m128i
+local_energy4(__m128i const cur, __m128i const up, __m128i const left) {
+  __m128i const lo = _mm_setr_epi8(SPREAD_LO);
+  __m128i const hi = _mm_setr_epi8(SPREAD_HI);
+  __m128i const sum_lo =
+      _mm_add_epi32(squared_diff4(cur, up, lo), squared_diff4(cur, left, lo));
+  __m128i const sum_hi =
+      _mm_add_epi32(squared_diff4(cur, up, hi), squared_diff4(cur, left, hi));
+  return _mm_hadd_epi32(sum_lo, sum_hi);
+}
+
+/**
+ * Calculate the local energy of the pixels from column @p `x` up to @p `w`
+ * of @p `row` four at a time, and of the last few pixels one at a time.
+ */
+__attribute__((target("sse4.1"))) static inline void
+local_energy_tail(uint32_t *const out, struct pixel const *const row,
+                  struct pixel const *const above, int x, int const w) {
+  uint8_t const *const cur = (uint8_t const *)row;
+  uint8_t const *const up = (uint8_t const *)above;
+
+  // the loads read 16 bytes, one pixel and a byte more than the four pixels
+  for (; x + 6 <= w; x += 4) {
+    __m128i const c = _mm_loadu_si128((__m128i const *)(cur + 3 * x));
+    __m128i const u = _mm_loadu_si128((__m128i const *)(up + 3 * x));
+    __m128i const l = _mm_loadu_si128((__m128i const *)(cur + 3 * x - 3));
+    _mm_storeu_si128((__m128i *)(out + x), local_energy4(c, u, l));
+  }
+  for (; x < w; x++)
+    out[x] = diff_color(row[x], above[x]) + diff_color(row[x], row[x - 1]);
+}
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the RGB row @p `row`
+ * into @p `out`, given the row @p `above` it, four pixels at a time with
+ * SSE4.1.
+ */
+__attribute__((target("sse4.1"))) void
+local_energy_row_rgb8_sse41(uint32_t *const out, struct pixel const *const row,
+                            struct pixel const *const above, int const w) {
+  out[0] = diff_color(row[0], above[0]);
+  local_energy_tail(out, row, above, 1, w);
+}
+
+/**
+ * Load the four pixels at @p `p` into the lower and the four pixels after
+ * them into the upper lane, so that `pshufb` can spread each lane like
+ * `local_energy4`.
+ */
+__attribute__((target("avx2"))) static inline __m256i
+load_pixels8(uint8_t const *const p) {
+  __m128i const lo = _mm_loadu_si128((__m128i const *)p);
+  __m128i const hi = _mm_loadu_si128((__m128i const *)(p + 12));
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+/**
+ * Like `squared_diff4`, but for eight pixels loaded by `load_pixels8`.
+ */
+__attribute__((target("avx2"))) static inline __m256i
+squared_diff8(__m256i const a, __m256i const b, __m256i const mask) {
+  __m256i const diff = _mm256_sub_epi16(_mm256_shuffle_epi8(a, mask),
+                                        _mm256_shuffle_epi8(b, mask));
+  return _mm256_madd_epi16(diff, diff);
+}
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the RGB row @p `row`
+ * into @p `out`, given the row @p `above` it, eight pixels at a time with
+ * AVX2.
+ */
+__attribute__((target("avx2"))) void
+local_energy_row_rgb8_avx2(uint32_t *const out, struct pixel const *const row,
+                           struct pixel const *const above, int const w) {
+  uint8_t const *const cur = (uint8_t const *)row;
+  uint8_t const *const up = (uint8_t const *)above;
+  __m256i const lo = _mm256_setr_epi8(SPREAD_LO, SPREAD_LO);
+  __m256i const hi = _mm256_setr_epi8(SPREAD_HI, SPREAD_HI);
+
+  out[0] = diff_color(row[0], above[0]);
+  int x = 1;
+  // the upper lane reads one pixel and a byte more than the eight pixels
+  for (; x + 10 <= w; x += 8) {
+    __m256i const c = load_pixels8(cur + 3 * x);
+    __m256i const u = load_pixels8(up + 3 * x);
+    __m256i const l = load_pixels8(cur + 3 * x - 3);
+    __m256i const sum_lo =
+        _mm256_add_epi32(squared_diff8(c, u, lo), squared_diff8(c, l, lo));
+    __m256i const sum_hi =
+        _mm256_add_epi32(squared_diff8(c, u, hi), squared_diff8(c, l, hi));
+    // adds within the lanes, which yields the pixels in order
+    _mm256_storeu_si256((__m256i *)(out + x), _mm256_hadd_epi32(sum_lo, sum_hi));
+  }
+  local_energy_tail(out, row, above, x, w);
+}
+
+/**
+ * Add to each of the @p `w` left entries of the energy row @p `row` the least
+ * of the (up to) three neighbours in the row @p `above`. If @p `track_min` is
+ * set, also return the index of the first least entry of the updated row,
+ * otherwise 0. SSE4.1 version, which inlines into the wrappers below.
+ */
+__attribute__((target("sse4.1"))) static inline int
+cumulative_row_sse41(uint32_t *const row, uint32_t const *const above,
+                     int const w, bool const track_min) {
+  if (w == 1) {
+    row[0] += above[0];
+    return 0;
+  }
+  row[0] += min_u32(above[0], above[1]);
+  uint32_t best = row[0];
+  int best_x = 0;
+
+  __m128i best_v = _mm_set1_epi32(-1);
+  __m128i best_xv = _mm_setzero_si128();
+  __m128i xv = _mm_setr_epi32(1, 2, 3, 4);
+  int x = 1;
+  for (; x + 4 <= w - 1; x += 4) {
+    __m128i const left = _mm_loadu_si128((__m128i const *)(above + x - 1));
+    __m128i const top = _mm_loadu_si128((__m128i const *)(above + x));
+    __m128i const right = _mm_loadu_si128((__m128i const *)(above + x + 1));
+    __m128i const least = _mm_min_epu32(_mm_min_epu32(left, top), right);
+    __m128i const sum =
+        _mm_add_epi32(_mm_loadu_si128((__m128i const *)(row + x)), least);
+    _mm_storeu_si128((__m128i *)(row + x), sum);
+    if (track_min) {
+      // keep the earlier column unless the new entry is strictly less
+      __m128i const keep = _mm_cmpeq_epi32(_mm_max_epu32(sum, best_v), sum);
+      best_v = _mm_min_epu32(best_v, sum);
+      best_xv = _mm_blendv_epi8(xv, best_xv, keep);
+      xv = _mm_add_epi32(xv, _mm_set1_epi32(4));
+    }
+  }
+
+  if (track_min) {
+    uint32_t lanes[4], lane_xs[4];
+    _mm_storeu_si128((__m128i *)lanes, best_v);
+    _mm_storeu_si128((__m128i *)lane_xs, best_xv);
+    merge_lanes(lanes, lane_xs, 4, &best, &best_x);
+  }
+  return cumulative_row_tail(row, above, x, w, track_min, best, best_x);
+}
+
+/**
+ * Add to each of the @p `w` left entries of the energy row @p `row` the least
+ * of the (up to) three neighbours in the row @p `above`, four at a time with
+ * SSE4.1.
+ */
+__attribute__((target("sse4.1"))) void
+cumulative_row_u32_sse41(uint32_t *const row, uint32_t const *const above,
+                         int const w) {
+  cumulative_row_sse41(row, above, w, false);
+}
+
+/**
+ * Like `cumulative_row_u32_sse41`, but also return the index of the first
+ * least entry of the updated row.
+ */
+__attribute__((target("sse4.1"))) int
+cumulative_row_min_u32_sse41(uint32_t *const row, uint32_t const *const above,
+                             int const w) {
+  return cumulative_row_sse41(row, above, w, true);
+}
+
+/**
+ * Like `cumulative_row_sse41`, but eight entries at a time with AVX2.
+ */
+__attribute__((target("avx2"))) static inline int
+cumulative_row_avx2(uint32_t *const row, uint32_t const *const above,
+                    int const w, bool const track_min) {
+  if (w == 1) {
+    row[0] += above[0];
+    return 0;
+  }
+  row[0] += min_u32(above[0], above[1]);
+  uint32_t best = row[0];
+  int best_x = 0;
+
+  __m256i best_v = _mm256_set1_epi32(-1);
+  __m256i best_xv = _mm256_setzero_si256();
+  __m256i xv = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 8);
+  int x = 1;
+  for (; x + 8 <= w - 1; x += 8) {
+    __m256i const left = _mm256_loadu_si256((__m256i const *)(above + x - 1));
+    __m256i const top = _mm256_loadu_si256((__m256i const *)(above + x));
+    __m256i const right = _mm256_loadu_si256((__m256i const *)(above + x + 1));
+    __m256i const least = _mm256_min_epu32(_mm256_min_epu32(left, top), right);
+    __m256i const sum =
+        _mm256_add_epi32(_mm256_loadu_si256((__m256i const *)(row + x)), least);
+    _mm256_storeu_si256((__m256i *)(row + x), sum);
+    if (track_min) {
+      __m256i const keep =
+          _mm256_cmpeq_epi32(_mm256_max_epu32(sum, best_v), sum);
+      best_v = _mm256_min_epu32(best_v, sum);
+      best_xv = _mm256_blendv_epi8(xv, best_xv, keep);
+      xv = _mm256_add_epi32(xv, _mm256_set1_epi32(8));
+    }
+  }
+
+  if (track_min) {
+    uint32_t lanes[8], lane_xs[8];
+    _mm256_storeu_si256((__m256i *)lanes, best_v);
+    _mm256_storeu_si256((__m256i *)lane_xs, best_xv);
+    merge_lanes(lanes, lane_xs, 8, &best, &best_x);
+  }
+  return cumulative_row_tail(row, above, x, w, track_min, best, best_x);
+}
+
+/**
+ * Add to each of the @p `w` left entries of the energy row @p `row` the least
+ * of the (up to) three neighbours in the row @p `above`, eight at a time with
+ * AVX2.
+ */
+__attribute__((target("avx2"))) void
+cumulative_row_u32_avx2(uint32_t *const row, uint32_t const *const above,
+                        int const w) {
+  cumulative_row_avx2(row, above, w, false);
+}
+
+/**
+ * Like `cumulative_row_u32_avx2`, but also return the index of the first
+ * least entry of the updated row.
+ */
+__attribute__((target("avx2"))) int
+cumulative_row_min_u32_avx2(uint32_t *const row, uint32_t const *const above,
+                            int const w) {
+  return cumulative_row_avx2(row, above, w, true);
+}
+
+/**
+ * The `pshufb` masks that spread the 12 bytes of four RGB pixels to 16-bit
+ * samples such that `pmaddwd` yields the sums of their red and green (`RG`)
+ * and of their blue (`B`) squares in pixel order, which takes no horizontal
+ * add. AVX-512 has none.
+ */
+#define SPREAD_RG 0, -1, 1, -1, 3, -1, 4, -1, 6, -1, 7, -1, 9, -1, 10, -1
+#define SPREAD_B 2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1
+
+/**
+ * Load the four pixels at @p `p` and the twelve after them into the four
+ * lanes, so that `pshufb` can spread each lane like `local_energy4`.
+ */
+__attribute__((target("avx512f,avx512bw"))) static inline __m512i
+load_pixels16(uint8_t const *const p) {
+  __m512i v = _mm512_castsi128_si512(_mm_loadu_si128((__m128i const *)p));
+  v = _mm512_inserti32x4(v, _mm_loadu_si128((__m128i const *)(p + 12)), 1);
+  v = _mm512_inserti32x4(v, _mm_loadu_si128((__m128i const *)(p + 24)), 2);
+  return _mm512_inserti32x4(v, _mm_loadu_si128((__m128i const *)(p + 36)), 3);
+}
+
+/**
+ * Like `squared_diff4`, but for sixteen pixels loaded by `load_pixels16`.
+ */
+__attribute__((target("avx512f,avx512bw"))) static inline __m512i
+squared_diff16(__m512i const a, __m512i const b, __m512i const mask) {
+  __m512i const diff = _mm512_sub_epi16(_mm512_shuffle_epi8(a, mask),
+                                        _mm512_shuffle_epi8(b, mask));
+  return _mm512_madd_epi16(diff, diff);
+}
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the RGB row @p `row`
+ * into @p `out`, given the row @p `above` it, sixteen pixels at a time with
+ * AVX-512.
+ */
+__attribute__((target("avx512f,avx512bw"))) void
+local_energy_row_rgb8_avx512(uint32_t *const out, struct pixel const *const row,
+                             struct pixel const *const above, int const w) {
+  uint8_t const *const cur = (uint8_t const *)row;
+  uint8_t const *const up = (uint8_t const *)above;
+  __m512i const rg = _mm512_broadcast_i32x4(_mm_setr_epi8(SPREAD_RG));
+  __m512i const b = _mm512_broadcast_i32x4(_mm_setr_epi8(SPREAD_B));
+
+  out[0] = diff_color(row[0], above[0]);
+  int x = 1;
+  // the upper lane reads one pixel and a byte more than the sixteen pixels
+  for (; x + 18 <= w; x += 16) {
+    __m512i const c = load_pixels16(cur + 3 * x);
+    __m512i const u = load_pixels16(up + 3 * x);
+    __m512i const l = load_pixels16(cur + 3 * x - 3);
+    __m512i const sum_rg =
+        _mm512_add_epi32(squared_diff16(c, u, rg), squared_diff16(c, l, rg));
+    __m512i const sum_b =
+        _mm512_add_epi32(squared_diff16(c, u, b), squared_diff16(c, l, b));
+    _mm512_storeu_si512(out + x, _mm512_add_epi32(sum_rg, sum_b));
+  }
+  local_energy_tail(out, row, above, x, w);
+}
+
+/**
+ * Like `cumulative_row_sse41`, but sixteen entries at a time with AVX-512,
+ * whose compares yield masks that select the new least entries directly.
+ */
+__attribute__((target("avx512f"))) static inline int
+cumulative_row_avx512(uint32_t *const row, uint32_t const *const above,
+                      int const w, bool const track_min) {
+  if (w == 1) {
+    row[0] += above[0];
+    return 0;
+  }
+  row[0] += min_u32(above[0], above[1]);
+  uint32_t best = row[0];
+  int best_x = 0;
+
+  __m512i best_v = _mm512_set1_epi32(-1);
+  __m512i best_xv = _mm512_setzero_si512();
+  __m512i xv =
+      _mm512_setr_epi32(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+  int x = 1;
+  for (; x + 16 <= w - 1; x += 16) {
+    __m512i const left = _mm512_loadu_si512(above + x - 1);
+    __m512i const top = _mm512_loadu_si512(above + x);
+    __m512i const right = _mm512_loadu_si512(above + x + 1);
+    __m512i const least = _mm512_min_epu32(_mm512_min_epu32(left, top), right);
+    __m512i const sum = _mm512_add_epi32(_mm512_loadu_si512(row + x), least);
+    _mm512_storeu_si512(row + x, sum);
+    if (track_min) {
+      __mmask16 const less = _mm512_cmplt_epu32_mask(sum, best_v);
+      best_v = _mm512_mask_mov_epi32(best_v, less, sum);
+      best_xv = _mm512_mask_mov_epi32(best_xv, less, xv);
+      xv = _mm512_add_epi32(xv, _mm512_set1_epi32(16));
+    }
+  }
+
+  if (track_min) {
+    uint32_t lanes[16], lane_xs[16];
+    _mm512_storeu_si512(lanes, best_v);
+    _mm512_storeu_si512(lane_xs, best_xv);
+    merge_lanes(lanes, lane_xs, 16, &best, &best_x);
+  }
+  return cumulative_row_tail(row, above, x, w, track_min, best, best_x);
+}
+
+/**
+ * Add to each of the @p `w` left entries of the energy row @p `row` the least
+ * of the (up to) three neighbours in the row @p `above`, sixteen at a time
+ * with AVX-512.
+ */
+__attribute__((target("avx512f"))) void
+cumulative_row_u32_avx512(uint32_t *const row, uint32_t const *const above,
+                          int const w) {
+  cumulative_row_avx512(row, above, w, false);
+}
+
+/**
+ * Like `cumulative_row_u32_avx512`, but also return the index of the first
+ * least entry of the updated row.
+ */
+__attribute__((target("avx512f"))) int
+cumulative_row_min_u32_avx512(uint32_t *const row, uint32_t const *const above,
+                              int const w) {
+  return cumulative_row_avx512(row, above, w, true);
+}
+
+/**
+ * Update the entries of the energy row @p `row` from column @p `x`, a multiple
+ * of 8, up to @p `end` one at a time and write their direction bits to the
+ * planes @p `left` and @p `right`, see `cumulative_row_dir_u32_sse41`. Every
+ * byte of the planes that holds one of the columns is written as a whole.
+ */
+static inline void cumulative_row_dir_tail(uint32_t *const row,
+                                           uint32_t const *const above, int x,
+                                           int const end, int const w,
+                                           uint8_t *const left,
+                                           uint8_t *const right) {
+  uint8_t left_bits = 0, right_bits = 0;
+  for (; x < end; x++) {
+    uint32_t least = above[x];
+    int bit = x % 8;
+    if (x > 0 && above[x - 1] < least) {
+      least = above[x - 1];
+      left_bits |= 1 << bit;
+    }
+    if (x < w - 1 && above[x + 1] < least) {
+      least = above[x + 1];
+      left_bits &= ~(1 << bit);
+      right_bits |= 1 << bit;
+    }
+    row[x] += least;
+    if (bit == 7 || x == end - 1) {
+      left[x / 8] = left_bits;
+      right[x / 8] = right_bits;
+      left_bits = right_bits = 0;
+    }
+  }
+}
+
+/**
+ * Return the direction bits of the four entries whose least neighbours in
+ * the row above are @p `l`, @p `t` and @p `r`, and store the least one in
+ * @p `least`: bit `i` of the lower nibble is set if entry `i` comes from the
+ * left, of the upper nibble if it comes from the right.
+ */
+__attribute__((target("sse4.1"))) static inline int
+dir_bits4(__m128i const l, __m128i const t, __m128i const r,
+          __m128i *const least) {
+  // a >= b if max(a, b) == a, as there are no unsigned compares
+  __m128i const l_ge = _mm_cmpeq_epi32(_mm_max_epu32(l, t), l);
+  __m128i const best = _mm_min_epu32(l, t);
+  __m128i const r_ge = _mm_cmpeq_epi32(_mm_max_epu32(r, best), r);
+  *least = _mm_min_epu32(best, r);
+  int const from_left = ~_mm_movemask_ps(_mm_castsi128_ps(l_ge)) & 0xf;
+  int const from_right = ~_mm_movemask_ps(_mm_castsi128_ps(r_ge)) & 0xf;
+  return (from_left & ~from_right) | from_right << 4;
+}
+
+/**
+ * Add to each of the @p `w` left entries of the energy row @p `row` the least
+ * of the (up to) three neighbours in the row @p `above`, and record in bit `x`
+ * of the bit planes @p `left` and @p `right` whether entry `x` took the left
+ * or the right neighbour. Ties go to the neighbour straight above, then to the
+ * left one, as in `calculate_optimal_path`. Eight entries at a time with
+ * SSE4.1.
+ */
+__attribute__((target("sse4.1"))) void
+cumulative_row_dir_u32_sse41(uint32_t *const row, uint32_t const *const above,
+                             int const w, uint8_t *const left,
+                             uint8_t *const right) {
+  int x = w < 8 ? w : 8;
+  cumulative_row_dir_tail(row, above, 0, x, w, left, right);
+  for (; x + 8 <= w - 1; x += 8) {
+    int bits[2];
+    for (int i = 0; i < 2; i++) {
+      uint32_t const *const a = above + x + 4 * i;
+      __m128i least;
+      bits[i] = dir_bits4(_mm_loadu_si128((__m128i const *)(a - 1)),
+                          _mm_loadu_si128((__m128i const *)a),
+                          _mm_loadu_si128((__m128i const *)(a + 1)), &least);
+      __m128i *const out = (__m128i *)(row + x + 4 * i);
+      _mm_storeu_si128(out, _mm_add_epi32(_mm_loadu_si128(out), least));
+    }
+    left[x / 8] = (bits[0] & 0xf) | (bits[1] & 0xf) << 4;
+    right[x / 8] = bits[0] >> 4 | (bits[1] >> 4) << 4;
+  }
+  cumulative_row_dir_tail(row, above, x, w, w, left, right);
+}
+
+/**
+ * Like `cumulative_row_dir_u32_sse41`, but eight entries at a time with AVX2,
+ * which yields a whole byte of each plane per step.
+ */
+__attribute__((target("avx2"))) void
+cumulative_row_dir_u32_avx2(uint32_t *const row, uint32_t const *const above,
+                            int const w, uint8_t *const left,
+                            uint8_t *const right) {
+  int x = w < 8 ? w : 8;
+  cumulative_row_dir_tail(row, above, 0, x, w, left, right);
+  for (; x + 8 <= w - 1; x += 8) {
+    __m256i const l = _mm256_loadu_si256((__m256i const *)(above + x - 1));
+    __m256i const t = _mm256_loadu_si256((__m256i const *)(above + x));
+    __m256i const r = _mm256_loadu_si256((__m256i const *)(above + x + 1));
+    __m256i const l_ge = _mm256_cmpeq_epi32(_mm256_max_epu32(l, t), l);
+    __m256i const best = _mm256_min_epu32(l, t);
+    __m256i const r_ge = _mm256_cmpeq_epi32(_mm256_max_epu32(r, best), r);
+    __m256i const least = _mm256_min_epu32(best, r);
+    __m256i *const out = (__m256i *)(row + x);
+    _mm256_storeu_si256(out, _mm256_add_epi32(_mm256_loadu_si256(out), least));
+    int const from_left = ~_mm256_movemask_ps(_mm256_castsi256_ps(l_ge));
+    int const from_right = ~_mm256_movemask_ps(_mm256_castsi256_ps(r_ge));
+    left[x / 8] = (uint8_t)(from_left & ~from_right);
+    right[x / 8] = (uint8_t)from_right;
+  }
+  cumulative_row_dir_tail(row, above, x, w, w, left, right);
+}
+
+/**
+ * Like `cumulative_row_dir_u32_sse41`, but sixteen entries at a time with
+ * AVX-512, whose compare masks are two bytes of each plane.
+ */
+__attribute__((target("avx512f"))) void
+cumulative_row_dir_u32_avx512(uint32_t *const row, uint32_t const *const above,
+                              int const w, uint8_t *const left,
+                              uint8_t *const right) {
+  int x = w < 16 ? w : 16;
+  cumulative_row_dir_tail(row, above, 0, x, w, left, right);
+  for (; x + 16 <= w - 1; x += 16) {
+    __m512i const l = _mm512_loadu_si512(above + x - 1);
+    __m512i const t = _mm512_loadu_si512(above + x);
+    __m512i const r = _mm512_loadu_si512(above + x + 1);
+    __mmask16 const from_l = _mm512_cmplt_epu32_mask(l, t);
+    __m512i const best = _mm512_min_epu32(l, t);
+    __mmask16 const from_r = _mm512_cmplt_epu32_mask(r, best);
+    __m512i const least = _mm512_min_epu32(best, r);
+    _mm512_storeu_si512(row + x,
+                        _mm512_add_epi32(_mm512_loadu_si512(row + x), least));
+    uint16_t const left_bits = from_l & ~from_r;
+    memcpy(&left[x / 8], &left_bits, sizeof(left_bits));
+    memcpy(&right[x / 8], &from_r, sizeof(from_r));
+  }
+  cumulative_row_dir_tail(row, above, x, w, w, left, right);
+}
+
+/**
+ * Update the entries of the local energy row @p `local` from column @p `x`, a
+ * multiple of 8, up to @p `end` one at a time like
+ * `cumulative_row_dir_u16_sse41`, writing every byte of the planes that holds
+ * one of the columns as a whole. Returns the least updated entry, or
+ * `UINT32_MAX` if there are none.
+ */
+static inline uint32_t
+cumulative_row_dir_u16_tail(uint32_t *const local, uint16_t const *const above,
+                            int x, int const end, int const w,
+                            uint8_t *const left, uint8_t *const right) {
+  uint8_t left_bits = 0, right_bits = 0;
+  uint32_t least_row = UINT32_MAX;
+  for (; x < end; x++) {
+    uint16_t least = above[x];
+    int bit = x % 8;
+    if (x > 0 && above[x - 1] < least) {
+      least = above[x - 1];
+      left_bits |= 1 << bit;
+    }
+    if (x < w - 1 && above[x + 1] < least) {
+      least = above[x + 1];
+      left_bits &= ~(1 << bit);
+      right_bits |= 1 << bit;
+    }
+    local[x] += least;
+    least_row = min_u32(least_row, local[x]);
+    if (bit == 7 || x == end - 1) {
+      left[x / 8] = left_bits;
+      right[x / 8] = right_bits;
+      left_bits = right_bits = 0;
+    }
+  }
+  return least_row;
+}
+
+/**
+ * Store the entries of the total energy row @p `total` from column @p `x` up
+ * to @p `w` less @p `least`, saturated to `UINT16_MAX`, in @p `row`.
+ */
+static inline void rebase_row_u16_tail(uint16_t *const row,
+                                       uint32_t const *const total,
+                                       uint32_t const least, int x,
+                                       int const w) {
+  for (; x < w; x++) {
+    uint32_t const offset = total[x] - least;
+    row[x] = offset < UINT16_MAX ? offset : UINT16_MAX;
+  }
+}
+
+/**
+ * Return the least of the four 32-bit lanes of @p `v`.
+ */
+__attribute__((target("sse4.1"))) static inline uint32_t
+least_u32(__m128i const v) {
+  __m128i const half = _mm_min_epu32(v, _mm_shuffle_epi32(v, 0x4e));
+  return (uint32_t)_mm_cvtsi128_si32(
+      _mm_min_epu32(half, _mm_shuffle_epi32(half, 0xb1)));
+}
+
+/**
+ * Add to each of the @p `w` left entries of the local energy row @p `local`
+ * the least of the (up to) three neighbours in the 16-bit total energy row
+ * @p `above`, which is relative to its least entry, and record the direction
+ * bits in the planes @p `left` and @p `right` like
+ * `cumulative_row_dir_u32_sse41`. The sums less the least one, saturated to
+ * `UINT16_MAX`, go to @p `row`, and the least sum is returned. The neighbours
+ * are compared eight at a time with SSE4.1, twice as many as in 32-bit rows;
+ * the sums stay far below 2^31, so the signed pack saturates them right.
+ */
+__attribute__((target("sse4.1"))) uint32_t
+cumulative_row_dir_u16_sse41(uint16_t *const row, uint32_t *const local,
+                             uint16_t const *const above, int const w,
+                             uint8_t *const left, uint8_t *const right) {
+  int x = w < 8 ? w : 8;
+  uint32_t least_row =
+      cumulative_row_dir_u16_tail(local, above, 0, x, w, left, right);
+  __m128i const zero = _mm_setzero_si128();
+  __m128i least_lanes = _mm_set1_epi32(-1);
+  for (; x + 8 <= w - 1; x += 8) {
+    __m128i const l = _mm_loadu_si128((__m128i const *)(above + x - 1));
+    __m128i const t = _mm_loadu_si128((__m128i const *)(above + x));
+    __m128i const r = _mm_loadu_si128((__m128i const *)(above + x + 1));
+    // a >= b if max(a, b) == a, as there are no unsigned compares
+    __m128i const l_ge = _mm_cmpeq_epi16(_mm_max_epu16(l, t), l);
+    __m128i const best = _mm_min_epu16(l, t);
+    __m128i const r_ge = _mm_cmpeq_epi16(_mm_max_epu16(r, best), r);
+    __m128i const least = _mm_min_epu16(best, r);
+    int const from_left = ~_mm_movemask_epi8(_mm_packs_epi16(l_ge, l_ge));
+    int const from_right = ~_mm_movemask_epi8(_mm_packs_epi16(r_ge, r_ge));
+    left[x / 8] = (uint8_t)(from_left & ~from_right);
+    right[x / 8] = (uint8_t)from_right;
+
+    __m128i *const out = (__m128i *)(local + x);
+    __m128i const lo =
+        _mm_add_epi32(_mm_loadu_si128(out), _mm_unpacklo_epi16(least, zero));
+    __m128i const hi = _mm_add_epi32(_mm_loadu_si128(out + 1),
+                                     _mm_unpackhi_epi16(least, zero));
+    _mm_storeu_si128(out, lo);
+    _mm_storeu_si128(out + 1, hi);
+    least_lanes = _mm_min_epu32(least_lanes, _mm_min_epu32(lo, hi));
+  }
+  least_row = min_u32(least_row, least_u32(least_lanes));
+  least_row = min_u32(least_row, cumulative_row_dir_u16_tail(
+                                     local, above, x, w, w, left, right));
+
+  __m128i const base = _mm_set1_epi32(least_row);
+  for (x = 0; x + 8 <= w; x += 8) {
+    __m128i const *const in = (__m128i const *)(local + x);
+    _mm_storeu_si128(
+        (__m128i *)(row + x),
+        _mm_packus_epi32(_mm_sub_epi32(_mm_loadu_si128(in), base),
+                         _mm_sub_epi32(_mm_loadu_si128(in + 1), base)));
+  }
+  rebase_row_u16_tail(row, local, least_row, x, w);
+  return least_row;
+}
+
+/**
+ * Like `cumulative_row_dir_u16_sse41`, but sixteen entries at a time with
+ * AVX2.
+ */
+__attribute__((target("avx2"))) uint32_t
+cumulative_row_dir_u16_avx2(uint16_t *const row, uint32_t *const local,
+                            uint16_t const *const above, int const w,
+                            uint8_t *const left, uint8_t *const right) {
+  int x = w < 16 ? w : 16;
+  uint32_t least_row =
+      cumulative_row_dir_u16_tail(local, above, 0, x, w, left, right);
+  __m256i least_lanes = _mm256_set1_epi32(-1);
+  for (; x + 16 <= w - 1; x += 16) {
+    __m256i const l = _mm256_loadu_si256((__m256i const *)(above + x - 1));
+    __m256i const t = _mm256_loadu_si256((__m256i const *)(above + x));
+    __m256i const r = _mm256_loadu_si256((__m256i const *)(above + x + 1));
+    __m256i const l_ge = _mm256_cmpeq_epi16(_mm256_max_epu16(l, t), l);
+    __m256i const best = _mm256_min_epu16(l, t);
+    __m256i const r_ge = _mm256_cmpeq_epi16(_mm256_max_epu16(r, best), r);
+    __m256i const least = _mm256_min_epu16(best, r);
+    // the packs work within the 128-bit lanes, so pack the halves instead
+    int const from_left = ~_mm_movemask_epi8(
+        _mm_packs_epi16(_mm256_castsi256_si128(l_ge),
+                        _mm256_extracti128_si256(l_ge, 1)));
+    int const from_right = ~_mm_movemask_epi8(
+        _mm_packs_epi16(_mm256_castsi256_si128(r_ge),
+                        _mm256_extracti128_si256(r_ge, 1)));
+    uint16_t const left_bits = (uint16_t)(from_left & ~from_right);
+    uint16_t const right_bits = (uint16_t)from_right;
+    memcpy(&left[x / 8], &left_bits, sizeof(left_bits));
+    memcpy(&right[x / 8], &right_bits, sizeof(right_bits));
+
+    __m256i *const out = (__m256i *)(local + x);
+    __m256i const lo =
+        _mm256_add_epi32(_mm256_loadu_si256(out),
+                         _mm256_cvtepu16_epi32(_mm256_castsi256_si128(least)));
+    __m256i const hi = _mm256_add_epi32(
+        _mm256_loadu_si256(out + 1),
+        _mm256_cvtepu16_epi32(_mm256_extracti128_si256(least, 1)));
+    _mm256_storeu_si256(out, lo);
+    _mm256_storeu_si256(out + 1, hi);
+    least_lanes = _mm256_min_epu32(least_lanes, _mm256_min_epu32(lo, hi));
+  }
+  least_row = min_u32(least_row,
+                      least_u32(_mm_min_epu32(
+                          _mm256_castsi256_si128(least_lanes),
+                          _mm256_extracti128_si256(least_lanes, 1))));
+  least_row = min_u32(least_row, cumulative_row_dir_u16_tail(
+                                     local, above, x, w, w, left, right));
+
+  __m256i const base = _mm256_set1_epi32(least_row);
+  for (x = 0; x + 16 <= w; x += 16) {
+    __m256i const *const in = (__m256i const *)(local + x);
+    __m256i const packed = _mm256_packus_epi32(
+        _mm256_sub_epi32(_mm256_loadu_si256(in), base),
+        _mm256_sub_epi32(_mm256_loadu_si256(in + 1), base));
+    // the pack works within the 128-bit lanes, this puts them in order again
+    _mm256_storeu_si256((__m256i *)(row + x),
+                        _mm256_permute4x64_epi64(packed, 0xd8));
+  }
+  rebase_row_u16_tail(row, local, least_row, x, w);
+  return least_row;
+}
+
+/**
+ * Like `cumulative_row_dir_u16_sse41`, but thirty-two entries at a time with
+ * AVX-512, whose compare masks are four bytes of each plane.
+ */
+__attribute__((target("avx512f,avx512bw"))) uint32_t
+cumulative_row_dir_u16_avx512(uint16_t *const row, uint32_t *const local,
+                              uint16_t const *const above, int const w,
+                              uint8_t *const left, uint8_t *const right) {
+  int x = w < 32 ? w : 32;
+  uint32_t least_row =
+      cumulative_row_dir_u16_tail(local, above, 0, x, w, left, right);
+  __m512i least_lanes = _mm512_set1_epi32(-1);
+  for (; x + 32 <= w - 1; x += 32) {
+    __m512i const l = _mm512_loadu_si512(above + x - 1);
+    __m512i const t = _mm512_loadu_si512(above + x);
+    __m512i const r = _mm512_loadu_si512(above + x + 1);
+    __mmask32 const from_l = _mm512_cmplt_epu16_mask(l, t);
+    __m512i const best = _mm512_min_epu16(l, t);
+    __mmask32 const from_r = _mm512_cmplt_epu16_mask(r, best);
+    __m512i const least = _mm512_min_epu16(best, r);
+    uint32_t const left_bits = from_l & ~from_r;
+    uint32_t const right_bits = from_r;
+    memcpy(&left[x / 8], &left_bits, sizeof(left_bits));
+    memcpy(&right[x / 8], &right_bits, sizeof(right_bits));
+
+    __m512i const lo = _mm512_add_epi32(
+        _mm512_loadu_si512(local + x),
+        _mm512_cvtepu16_epi32(_mm512_castsi512_si256(least)));
+    __m512i const hi = _mm512_add_epi32(
+        _mm512_loadu_si512(local + x + 16),
+        _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(least, 1)));
+    _mm512_storeu_si512(local + x, lo);
+    _mm512_storeu_si512(local + x + 16, hi);
+    least_lanes = _mm512_min_epu32(least_lanes, _mm512_min_epu32(lo, hi));
+  }
+  least_row = min_u32(least_row, _mm512_reduce_min_epu32(least_lanes));
+  least_row = min_u32(least_row, cumulative_row_dir_u16_tail(
+                                     local, above, x, w, w, left, right));
+
+  __m512i const base = _mm512_set1_epi32(least_row);
+  // the pack works within the 128-bit lanes, this puts them in order again
+  __m512i const order = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+  for (x = 0; x + 32 <= w; x += 32) {
+    __m512i const packed = _mm512_packus_epi32(
+        _mm512_sub_epi32(_mm512_loadu_si512(local + x), base),
+        _mm512_sub_epi32(_mm512_loadu_si512(local + x + 16), base));
+    _mm512_storeu_si512(row + x, _mm512_permutexvar_epi64(order, packed));
+  }
+  rebase_row_u16_tail(row, local, least_row, x, w);
+  return least_row;
+}
+
+/**
+ * The `pshufb` masks that spread the samples of four padded RGB pixels to
+ * 16-bit samples like `SPREAD_RG` and `SPREAD_B`. Padded pixels fill one
+ * 32-bit lane each, so every 16-byte lane holds four whole pixels and the
+ * loads need neither inserts nor bytes beyond the pixels.
+ */
+#define SPREAD_X_RG 0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1, 12, -1, 13, -1
+#define SPREAD_X_B 2, -1, -1, -1, 6, -1, -1, -1, 10, -1, -1, -1, 14, -1, -1, -1
+
+/**
+ * Calculate the local energy of the padded pixels from column @p `x` up to
+ * @p `w` of @p `row` one at a time.
+ */
+static inline void local_energy_tail_rgbx(uint32_t *const out,
+                                          struct pixelx const *const row,
+                                          struct pixelx const *const above,
+                                          int x, int const w) {
+  for (; x < w; x++)
+    out[x] = diff_colorx(row[x], above[x]) + diff_colorx(row[x], row[x - 1]);
+}
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the padded RGB row
+ * @p `row` into @p `out`, given the row @p `above` it, four pixels at a time
+ * with SSE4.1.
+ */
+__attribute__((target("sse4.1"))) void
+local_energy_row_rgbx8_sse41(uint32_t *const out,
+                             struct pixelx const *const row,
+                             struct pixelx const *const above, int const w) {
+  __m128i const rg = _mm_setr_epi8(SPREAD_X_RG);
+  __m128i const b = _mm_setr_epi8(SPREAD_X_B);
+
+  out[0] = diff_colorx(row[0], above[0]);
+  int x = 1;
+  for (; x + 4 <= w; x += 4) {
+    __m128i const c = _mm_loadu_si128((__m128i const *)(row + x));
+    __m128i const u = _mm_loadu_si128((__m128i const *)(above + x));
+    __m128i const l = _mm_loadu_si128((__m128i const *)(row + x - 1));
+    __m128i const sum_rg =
+        _mm_add_epi32(squared_diff4(c, u, rg), squared_diff4(c, l, rg));
+    __m128i const sum_b =
+        _mm_add_epi32(squared_diff4(c, u, b), squared_diff4(c, l, b));
+    _mm_storeu_si128((__m128i *)(out + x), _mm_add_epi32(sum_rg, sum_b));
+  }
+  local_energy_tail_rgbx(out, row, above, x, w);
+}
+
+/**
+ * Like `local_energy_row_rgbx8_sse41`, but eight pixels at a time with AVX2.
+ */
+__attribute__((target("avx2"))) void
+local_energy_row_rgbx8_avx2(uint32_t *const out,
+                            struct pixelx const *const row,
+                            struct pixelx const *const above, int const w) {
+  __m256i const rg = _mm256_setr_epi8(SPREAD_X_RG, SPREAD_X_RG);
+  __m256i const b = _mm256_setr_epi8(SPREAD_X_B, SPREAD_X_B);
+
+  out[0] = diff_colorx(row[0], above[0]);
+  int x = 1;
+  for (; x + 8 <= w; x += 8) {
+    __m256i const c = _mm256_loadu_si256((__m256i const *)(row + x));
+    __m256i const u = _mm256_loadu_si256((__m256i const *)(above + x));
+    __m256i const l = _mm256_loadu_si256((__m256i const *)(row + x - 1));
+    __m256i const sum_rg =
+        _mm256_add_epi32(squared_diff8(c, u, rg), squared_diff8(c, l, rg));
+    __m256i const sum_b =
+        _mm256_add_epi32(squared_diff8(c, u, b), squared_diff8(c, l, b));
+    _mm256_storeu_si256((__m256i *)(out + x), _mm256_add_epi32(sum_rg, sum_b));
+  }
+  local_energy_tail_rgbx(out, row, above, x, w);
+}
+
+/**
+ * Like `local_energy_row_rgbx8_sse41`, but sixteen pixels at a time with
+ * AVX-512.
+ */
+__attribute__((target("avx512f,avx512bw"))) void
+local_energy_row_rgbx8_avx512(uint32_t *const out,
+                              struct pixelx const *const row,
+                              struct pixelx const *const above, int const w) {
+  __m512i const rg = _mm512_broadcast_i32x4(_mm_setr_epi8(SPREAD_X_RG));
+  __m512i const b = _mm512_broadcast_i32x4(_mm_setr_epi8(SPREAD_X_B));
+
+  out[0] = diff_colorx(row[0], above[0]);
+  int x = 1;
+  for (; x + 16 <= w; x += 16) {
+    __m512i const c = _mm512_loadu_si512(row + x);
+    __m512i const u = _mm512_loadu_si512(above + x);
+    __m512i const l = _mm512_loadu_si512(row + x - 1);
+    __m512i const sum_rg =
+        _mm512_add_epi32(squared_diff16(c, u, rg), squared_diff16(c, l, rg));
+    __m512i const sum_b =
+        _mm512_add_epi32(squared_diff16(c, u, b), squared_diff16(c, l, b));
+    _mm512_storeu_si512(out + x, _mm512_add_epi32(sum_rg, sum_b));
+  }
+  local_energy_tail_rgbx(out, row, above, x, w);
+}
+
+/**
+ * Calculate the local energy of the planar pixels from column @p `x` up to
+ * @p `w` of @p `row` one at a time.
+ */
+static inline void local_energy_tail_planar(uint32_t *const out,
+                                            uint8_t const *const row,
+                                            uint8_t const *const above,
+                                            size_t const plane, int x,
+                                            int const w) {
+  for (; x < w; x++)
+    out[x] = diff_planar(&row[x], &above[x], plane) +
+             diff_planar(&row[x], &row[x - 1], plane);
+}
+
+/**
+ * Add the squared differences of the eight samples at @p `cur` to the samples
+ * above them at @p `up` and to those on their left to the sums of the first
+ * four (@p `lo`) and the last four (@p `hi`) pixels. Interleaving both
+ * differences lets `pmaddwd` add them up, which a plain square could not,
+ * since it does not fit a signed 16-bit lane.
+ */
+__attribute__((target("sse4.1"))) static inline void
+planar_diff8(uint8_t const *const cur, uint8_t const *const up,
+             __m128i *const lo, __m128i *const hi) {
+  __m128i const c = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i const *)cur));
+  __m128i const u = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i const *)up));
+  __m128i const l =
+      _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i const *)(cur - 1)));
+  __m128i const d_up = _mm_sub_epi16(c, u);
+  __m128i const d_left = _mm_sub_epi16(c, l);
+  __m128i const d_lo = _mm_unpacklo_epi16(d_up, d_left);
+  __m128i const d_hi = _mm_unpackhi_epi16(d_up, d_left);
+  *lo = _mm_add_epi32(*lo, _mm_madd_epi16(d_lo, d_lo));
+  *hi = _mm_add_epi32(*hi, _mm_madd_epi16(d_hi, d_hi));
+}
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the planar RGB row
+ * @p `row` into @p `out`, given the row @p `above` it, eight pixels at a time
+ * with SSE4.1. The green and blue samples follow @p `plane` and `2 * plane`
+ * samples after the red ones. Each plane is a plain byte array, so the samples
+ * need no shuffles at all.
+ */
+__attribute__((target("sse4.1"))) void
+local_energy_row_planar8_sse41(uint32_t *const out, uint8_t const *const row,
+                               uint8_t const *const above, size_t const plane,
+                               int const w) {
+  out[0] = diff_planar(&row[0], &above[0], plane);
+  int x = 1;
+  for (; x + 8 <= w; x += 8) {
+    __m128i lo = _mm_setzero_si128();
+    __m128i hi = _mm_setzero_si128();
+    for (int c = 0; c < 3; c++)
+      planar_diff8(row + c * plane + x, above + c * plane + x, &lo, &hi);
+    _mm_storeu_si128((__m128i *)(out + x), lo);
+    _mm_storeu_si128((__m128i *)(out + x + 4), hi);
+  }
+  local_energy_tail_planar(out, row, above, plane, x, w);
+}
+
+/**
+ * Like `planar_diff8`, but for sixteen samples with AVX2. The unpacks work
+ * within the lanes, so @p `lo` holds pixels 0 to 3 and 8 to 11, @p `hi` the
+ * others.
+ */
+__attribute__((target("avx2"))) static inline void
+planar_diff16(uint8_t const *const cur, uint8_t const *const up,
+              __m256i *const lo, __m256i *const hi) {
+  __m256i const c =
+      _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i const *)cur));
+  __m256i const u = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i const *)up));
+  __m256i const l =
+      _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i const *)(cur - 1)));
+  __m256i const d_up = _mm256_sub_epi16(c, u);
+  __m256i const d_left = _mm256_sub_epi16(c, l);
+  __m256i const d_lo = _mm256_unpacklo_epi16(d_up, d_left);
+  __m256i const d_hi = _mm256_unpackhi_epi16(d_up, d_left);
+  *lo = _mm256_add_epi32(*lo, _mm256_madd_epi16(d_lo, d_lo));
+  *hi = _mm256_add_epi32(*hi, _mm256_madd_epi16(d_hi, d_hi));
+}
+
+/**
+ * Like `local_energy_row_planar8_sse41`, but sixteen pixels at a time with
+ * AVX2.
+ */
+__attribute__((target("avx2"))) void
+local_energy_row_planar8_avx2(uint32_t *const out, uint8_t const *const row,
+                              uint8_t const *const above, size_t const plane,
+                              int const w) {
+  out[0] = diff_planar(&row[0], &above[0], plane);
+  int x = 1;
+  for (; x + 16 <= w; x += 16) {
+    __m256i lo = _mm256_setzero_si256();
+    __m256i hi = _mm256_setzero_si256();
+    for (int c = 0; c < 3; c++)
+      planar_diff16(row + c * plane + x, above + c * plane + x, &lo, &hi);
+    _mm256_storeu_si256((__m256i *)(out + x),
+                        _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + x + 8),
+                        _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  local_energy_tail_planar(out, row, above, plane, x, w);
+}
+
+/**
+ * Like `planar_diff16`, but for 32 samples with AVX-512, so @p `lo` holds the
+ * pixels 0 to 3, 8 to 11, 16 to 19 and 24 to 27, @p `hi` the others.
+ */
+__attribute__((target("avx512f,avx512bw"))) static inline void
+planar_diff32(uint8_t const *const cur, uint8_t const *const up,
+              __m512i *const lo, __m512i *const hi) {
+  __m512i const c =
+      _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i const *)cur));
+  __m512i const u =
+      _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i const *)up));
+  __m512i const l =
+      _mm512_cvtepu8_epi16(_mm256_loadu_si256((__m256i const *)(cur - 1)));
+  __m512i const d_up = _mm512_sub_epi16(c, u);
+  __m512i const d_left = _mm512_sub_epi16(c, l);
+  __m512i const d_lo = _mm512_unpacklo_epi16(d_up, d_left);
+  __m512i const d_hi = _mm512_unpackhi_epi16(d_up, d_left);
+  *lo = _mm512_add_epi32(*lo, _mm512_madd_epi16(d_lo, d_lo));
+  *hi = _mm512_add_epi32(*hi, _mm512_madd_epi16(d_hi, d_hi));
+}
+
+/**
+ * Like `local_energy_row_planar8_sse41`, but 32 pixels at a time with
+ * AVX-512.
+ */
+__attribute__((target("avx512f,avx512bw"))) void
+local_energy_row_planar8_avx512(uint32_t *const out, uint8_t const *const row,
+                                uint8_t const *const above, size_t const plane,
+                                int const w) {
+  // the 64-bit halves of the lanes of lo and hi in pixel order
+  __m512i const first = _mm512_setr_epi64(0, 1, 8, 9, 2, 3, 10, 11);
+  __m512i const second = _mm512_setr_epi64(4, 5, 12, 13, 6, 7, 14, 15);
+
+  out[0] = diff_planar(&row[0], &above[0], plane);
+  int x = 1;
+  for (; x + 32 <= w; x += 32) {
+    __m512i lo = _mm512_setzero_si512();
+    __m512i hi = _mm512_setzero_si512();
+    for (int c = 0; c < 3; c++)
+      planar_diff32(row + c * plane + x, above + c * plane + x, &lo, &hi);
+    _mm512_storeu_si512(out + x, _mm512_permutex2var_epi64(lo, first, hi));
+    _mm512_storeu_si512(out + x + 16,
+                        _mm512_permutex2var_epi64(lo, second, hi));
+  }
+  local_energy_tail_planar(out, row, above, plane, x, w);
+}
+
+/**
+ * Calculate the local energy of the gray pixels from column @p `x` up to
+ * @p `w` of @p `row` one at a time.
+ */
+static inline void local_energy_tail_gray(uint32_t *const out,
+                                          uint8_t const *const row,
+                                          uint8_t const *const above, int x,
+                                          int const w) {
+  for (; x < w; x++)
+    out[x] = diff_gray(row[x], above[x]) + diff_gray(row[x], row[x - 1]);
+}
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the gray row
+ * @p `row` into @p `out`, given the row @p `above` it, eight pixels at a time
+ * with SSE4.1. A gray row is a single plane of a planar row.
+ */
+__attribute__((target("sse4.1"))) void
+local_energy_row_gray8_sse41(uint32_t *const out, uint8_t const *const row,
+                             uint8_t const *const above, int const w) {
+  out[0] = diff_gray(row[0], above[0]);
+  int x = 1;
+  for (; x + 8 <= w; x += 8) {
+    __m128i lo = _mm_setzero_si128();
+    __m128i hi = _mm_setzero_si128();
+    planar_diff8(row + x, above + x, &lo, &hi);
+    _mm_storeu_si128((__m128i *)(out + x), lo);
+    _mm_storeu_si128((__m128i *)(out + x + 4), hi);
+  }
+  local_energy_tail_gray(out, row, above, x, w);
+}
+
+/**
+ * Like `local_energy_row_gray8_sse41`, but sixteen pixels at a time with AVX2.
+ */
+__attribute__((target("avx2"))) void
+local_energy_row_gray8_avx2(uint32_t *const out, uint8_t const *const row,
+                            uint8_t const *const above, int const w) {
+  out[0] = diff_gray(row[0], above[0]);
+  int x = 1;
+  for (; x + 16 <= w; x += 16) {
+    __m256i lo = _mm256_setzero_si256();
+    __m256i hi = _mm256_setzero_si256();
+    planar_diff16(row + x, above + x, &lo, &hi);
+    _mm256_storeu_si256((__m256i *)(out + x),
+                        _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + x + 8),
+                        _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  local_energy_tail_gray(out, row, above, x, w);
+}
+
+/**
+ * Like `local_energy_row_gray8_sse41`, but 32 pixels at a time with AVX-512.
+ */
+__attribute__((target("avx512f,avx512bw"))) void
+local_energy_row_gray8_avx512(uint32_t *const out, uint8_t const *const row,
+                              uint8_t const *const above, int const w) {
+  __m512i const first = _mm512_setr_epi64(0, 1, 8, 9, 2, 3, 10, 11);
+  __m512i const second = _mm512_setr_epi64(4, 5, 12, 13, 6, 7, 14, 15);
+
+  out[0] = diff_gray(row[0], above[0]);
+  int x = 1;
+  for (; x + 32 <= w; x += 32) {
+    __m512i lo = _mm512_setzero_si512();
+    __m512i hi = _mm512_setzero_si512();
+    planar_diff32(row + x, above + x, &lo, &hi);
+    _mm512_storeu_si512(out + x, _mm512_permutex2var_epi64(lo, first, hi));
+    _mm512_storeu_si512(out + x + 16,
+                        _mm512_permutex2var_epi64(lo, second, hi));
+  }
+  local_energy_tail_gray(out, row, above, x, w);
+}
+
+/**
+ * The `pshufb` masks that gather the samples of four 16-bit RGB pixels from
+ * their first 16 bytes (`A`) and from the 16 bytes after their first 8
+ * (`B`): the red samples followed by the green ones (`RG`), and the blue ones
+ * followed by zeros (`BL`).
+ */
+#define PICK_RG_A 0, 1, 6, 7, 12, 13, -1, -1, 2, 3, 8, 9, 14, 15, -1, -1
+#define PICK_RG_B -1, -1, -1, -1, -1, -1, 10, 11, -1, -1, -1, -1, -1, -1, 12, 13
+#define PICK_BL_A 4, 5, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+#define PICK_BL_B -1, -1, -1, -1, 8, 9, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1
+
+/**
+ * Gather the samples of the four 16-bit RGB pixels at @p `p` into @p `rg` and
+ * @p `bl`, see `PICK_RG_A`. The loads read exactly the 24 bytes of the four
+ * pixels.
+ */
+__attribute__((target("sse4.1"))) static inline void
+gather_rgb16(struct pixel16 const *const p, __m128i *const rg,
+             __m128i *const bl) {
+  uint8_t const *const bytes = (uint8_t const *)p;
+  __m128i const a = _mm_loadu_si128((__m128i const *)bytes);
+  __m128i const b = _mm_loadu_si128((__m128i const *)(bytes + 8));
+  *rg = _mm_or_si128(_mm_shuffle_epi8(a, _mm_setr_epi8(PICK_RG_A)),
+                     _mm_shuffle_epi8(b, _mm_setr_epi8(PICK_RG_B)));
+  *bl = _mm_or_si128(_mm_shuffle_epi8(a, _mm_setr_epi8(PICK_BL_A)),
+                     _mm_shuffle_epi8(b, _mm_setr_epi8(PICK_BL_B)));
+}
+
+/**
+ * Return the absolute differences of the unsigned 16-bit samples of @p `a`
+ * and @p `b`, which would not fit a signed difference.
+ */
+__attribute__((target("sse4.1"))) static inline __m128i
+absdiff_u16(__m128i const a, __m128i const b) {
+  return _mm_sub_epi16(_mm_max_epu16(a, b), _mm_min_epu16(a, b));
+}
+
+/**
+ * Return the sums of the squares of the 16-bit samples 0 and 4, and of the
+ * samples 1 and 5, of @p `d` as two 64-bit lanes. A square of a 16-bit sample
+ * fits `pmuludq`, which multiplies the 32-bit halves of 64-bit lanes.
+ */
+__attribute__((target("sse4.1"))) static inline __m128i
+square_sum2(__m128i const d) {
+  __m128i const lo = _mm_cvtepu16_epi64(d);
+  __m128i const hi = _mm_cvtepu16_epi64(_mm_srli_si128(d, 8));
+  return _mm_add_epi64(_mm_mul_epu32(lo, lo), _mm_mul_epu32(hi, hi));
+}
+
+/**
+ * Calculate the local energy of the 16-bit RGB pixels from column @p `x` up
+ * to @p `w` of @p `row` one at a time.
+ */
+static inline void local_energy_tail_rgb16(uint64_t *const out,
+                                           struct pixel16 const *const row,
+                                           struct pixel16 const *const above,
+                                           int x, int const w) {
+  for (; x < w; x++)
+    out[x] = diff_color16(row[x], above[x]) + diff_color16(row[x], row[x - 1]);
+}
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the 16-bit RGB row
+ * @p `row` into @p `out`, given the row @p `above` it, four pixels at a time
+ * with SSE4.1. The blue differences to both neighbours share a vector, so
+ * every vector of differences yields two squares per pixel.
+ */
+__attribute__((target("sse4.1"))) void
+local_energy_row_rgb16_sse41(uint64_t *const out,
+                             struct pixel16 const *const row,
+                             struct pixel16 const *const above, int const w) {
+  out[0] = diff_color16(row[0], above[0]);
+  int x = 1;
+  for (; x + 4 <= w; x += 4) {
+    __m128i c_rg, c_bl, u_rg, u_bl, l_rg, l_bl;
+    gather_rgb16(row + x, &c_rg, &c_bl);
+    gather_rgb16(above + x, &u_rg, &u_bl);
+    gather_rgb16(row + x - 1, &l_rg, &l_bl);
+    __m128i const up = absdiff_u16(c_rg, u_rg);
+    __m128i const left = absdiff_u16(c_rg, l_rg);
+    __m128i const bl = absdiff_u16(_mm_unpacklo_epi64(c_bl, c_bl),
+                                   _mm_unpacklo_epi64(u_bl, l_bl));
+    __m128i const lo = _mm_add_epi64(
+        _mm_add_epi64(square_sum2(up), square_sum2(left)), square_sum2(bl));
+    __m128i const hi =
+        _mm_add_epi64(_mm_add_epi64(square_sum2(_mm_srli_si128(up, 4)),
+                                    square_sum2(_mm_srli_si128(left, 4))),
+                      square_sum2(_mm_srli_si128(bl, 4)));
+    _mm_storeu_si128((__m128i *)(out + x), lo);
+    _mm_storeu_si128((__m128i *)(out + x + 2), hi);
+  }
+  local_energy_tail_rgb16(out, row, above, x, w);
+}
+
+/**
+ * Like `square_sum2`, but the sums of the samples 0 to 3 and 4 to 7 as four
+ * 64-bit lanes with AVX2.
+ */
+__attribute__((target("avx2"))) static inline __m256i
+square_sum4(__m128i const d) {
+  __m256i const lo = _mm256_cvtepu16_epi64(d);
+  __m256i const hi = _mm256_cvtepu16_epi64(_mm_srli_si128(d, 8));
+  return _mm256_add_epi64(_mm256_mul_epu32(lo, lo), _mm256_mul_epu32(hi, hi));
+}
+
+/**
+ * Like `local_energy_row_rgb16_sse41`, but squares and sums four pixels at a
+ * time with AVX2.
+ */
+__attribute__((target("avx2"))) void
+local_energy_row_rgb16_avx2(uint64_t *const out,
+                            struct pixel16 const *const row,
+                            struct pixel16 const *const above, int const w) {
+  out[0] = diff_color16(row[0], above[0]);
+  int x = 1;
+  for (; x + 4 <= w; x += 4) {
+    __m128i c_rg, c_bl, u_rg, u_bl, l_rg, l_bl;
+    gather_rgb16(row + x, &c_rg, &c_bl);
+    gather_rgb16(above + x, &u_rg, &u_bl);
+    gather_rgb16(row + x - 1, &l_rg, &l_bl);
+    __m128i const up = absdiff_u16(c_rg, u_rg);
+    __m128i const left = absdiff_u16(c_rg, l_rg);
+    __m128i const bl = absdiff_u16(_mm_unpacklo_epi64(c_bl, c_bl),
+                                   _mm_unpacklo_epi64(u_bl, l_bl));
+    __m256i const sum = _mm256_add_epi64(
+        _mm256_add_epi64(square_sum4(up), square_sum4(left)), square_sum4(bl));
+    _mm256_storeu_si256((__m256i *)(out + x), sum);
+  }
+  local_energy_tail_rgb16(out, row, above, x, w);
+}
+
+/**
+ * The `vpermw` indices that gather the 24 samples of eight 16-bit RGB pixels
+ * into the red, the green and the blue ones, one 128-bit lane each.
+ */
+static uint16_t const gather_rgb16x8[32] = {
+    0, 3, 6, 9,  12, 15, 18, 21, 1, 4, 7, 10, 13, 16, 19, 22,
+    2, 5, 8, 11, 14, 17, 20, 23, 0, 0, 0, 0,  0,  0,  0,  0,
+};
+
+/**
+ * Load the eight 16-bit RGB pixels at @p `p` gathered by @p `idx`, see
+ * `gather_rgb16x8`. The masked load reads no byte past them.
+ */
+__attribute__((target("avx512f,avx512bw"))) static inline __m512i
+load_rgb16x8(struct pixel16 const *const p, __m512i const idx) {
+  return _mm512_permutexvar_epi16(idx, _mm512_maskz_loadu_epi16(0xffffff, p));
+}
+
+/**
+ * Return the sums of the squares of the red, the green and the blue
+ * differences of the eight pixels in @p `d` as eight 64-bit lanes.
+ */
+__attribute__((target("avx512f,avx512bw"))) static inline __m512i
+square_sum_rgb16x8(__m512i const d) {
+  __m512i const r = _mm512_cvtepu16_epi64(_mm512_castsi512_si128(d));
+  __m512i const g = _mm512_cvtepu16_epi64(_mm512_extracti32x4_epi32(d, 1));
+  __m512i const b = _mm512_cvtepu16_epi64(_mm512_extracti32x4_epi32(d, 2));
+  return _mm512_add_epi64(
+      _mm512_add_epi64(_mm512_mul_epu32(r, r), _mm512_mul_epu32(g, g)),
+      _mm512_mul_epu32(b, b));
+}
+
+/**
+ * Like `local_energy_row_rgb16_sse41`, but eight pixels at a time with
+ * AVX-512, which gathers the samples across lanes with `vpermw`.
+ */
+__attribute__((target("avx512f,avx512bw"))) void
+local_energy_row_rgb16_avx512(uint64_t *const out,
+                              struct pixel16 const *const row,
+                              struct pixel16 const *const above, int const w) {
+  __m512i const idx = _mm512_loadu_si512(gather_rgb16x8);
+
+  out[0] = diff_color16(row[0], above[0]);
+  int x = 1;
+  for (; x + 8 <= w; x += 8) {
+    __m512i const c = load_rgb16x8(row + x, idx);
+    __m512i const u = load_rgb16x8(above + x, idx);
+    __m512i const l = load_rgb16x8(row + x - 1, idx);
+    __m512i const up =
+        _mm512_sub_epi16(_mm512_max_epu16(c, u), _mm512_min_epu16(c, u));
+    __m512i const left =
+        _mm512_sub_epi16(_mm512_max_epu16(c, l), _mm512_min_epu16(c, l));
+    _mm512_storeu_si512(out + x, _mm512_add_epi64(square_sum_rgb16x8(up),
+                                                  square_sum_rgb16x8(left)));
+  }
+  local_energy_tail_rgb16(out, row, above, x, w);
+}
+
+/**
+ * Calculate the local energy of the 16-bit gray pixels from column @p `x` up
+ * to @p `w` of @p `row` one at a time.
+ */
+static inline void local_energy_tail_gray16(uint64_t *const out,
+                                            uint16_t const *const row,
+                                            uint16_t const *const above, int x,
+                                            int const w) {
+  for (; x < w; x++)
+    out[x] = diff_gray16(row[x], above[x]) + diff_gray16(row[x], row[x - 1]);
+}
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the 16-bit gray row
+ * @p `row` into @p `out`, given the row @p `above` it, eight pixels at a time
+ * with SSE4.1. Pairing the differences to both neighbours of four pixels in
+ * one vector lets `square_sum2` add them up.
+ */
+__attribute__((target("sse4.1"))) void
+local_energy_row_gray16_sse41(uint64_t *const out, uint16_t const *const row,
+                              uint16_t const *const above, int const w) {
+  out[0] = diff_gray16(row[0], above[0]);
+  int x = 1;
+  for (; x + 8 <= w; x += 8) {
+    __m128i const c = _mm_loadu_si128((__m128i const *)(row + x));
+    __m128i const u = _mm_loadu_si128((__m128i const *)(above + x));
+    __m128i const l = _mm_loadu_si128((__m128i const *)(row + x - 1));
+    __m128i const up = absdiff_u16(c, u);
+    __m128i const left = absdiff_u16(c, l);
+    __m128i const lo = _mm_unpacklo_epi64(up, left);
+    __m128i const hi = _mm_unpackhi_epi64(up, left);
+    _mm_storeu_si128((__m128i *)(out + x), square_sum2(lo));
+    _mm_storeu_si128((__m128i *)(out + x + 2),
+                     square_sum2(_mm_srli_si128(lo, 4)));
+    _mm_storeu_si128((__m128i *)(out + x + 4), square_sum2(hi));
+    _mm_storeu_si128((__m128i *)(out + x + 6),
+                     square_sum2(_mm_srli_si128(hi, 4)));
+  }
+  local_energy_tail_gray16(out, row, above, x, w);
+}
+
+/**
+ * Like `local_energy_row_gray16_sse41`, but squares and sums four pixels at a
+ * time with AVX2.
+ */
+__attribute__((target("avx2"))) void
+local_energy_row_gray16_avx2(uint64_t *const out, uint16_t const *const row,
+                             uint16_t const *const above, int const w) {
+  out[0] = diff_gray16(row[0], above[0]);
+  int x = 1;
+  for (; x + 8 <= w; x += 8) {
+    __m128i const c = _mm_loadu_si128((__m128i const *)(row + x));
+    __m128i const u = _mm_loadu_si128((__m128i const *)(above + x));
+    __m128i const l = _mm_loadu_si128((__m128i const *)(row + x - 1));
+    __m128i const up = absdiff_u16(c, u);
+    __m128i const left = absdiff_u16(c, l);
+    _mm256_storeu_si256((__m256i *)(out + x),
+                        square_sum4(_mm_unpacklo_epi64(up, left)));
+    _mm256_storeu_si256((__m256i *)(out + x + 4),
+                        square_sum4(_mm_unpackhi_epi64(up, left)));
+  }
+  local_energy_tail_gray16(out, row, above, x, w);
+}
+
+/**
+ * Return the squares of the eight 16-bit samples in @p `d` as eight 64-bit
+ * lanes.
+ */
+__attribute__((target("avx512f"))) static inline __m512i
+square8(__m128i const d) {
+  __m512i const wide = _mm512_cvtepu16_epi64(d);
+  return _mm512_mul_epu32(wide, wide);
+}
+
+/**
+ * Like `local_energy_row_gray16_sse41`, but sixteen pixels at a time with
+ * AVX-512.
+ */
+__attribute__((target("avx512f,avx512bw"))) void
+local_energy_row_gray16_avx512(uint64_t *const out, uint16_t const *const row,
+                               uint16_t const *const above, int const w) {
+  out[0] = diff_gray16(row[0], above[0]);
+  int x = 1;
+  for (; x + 16 <= w; x += 16) {
+    __m256i const c = _mm256_loadu_si256((__m256i const *)(row + x));
+    __m256i const u = _mm256_loadu_si256((__m256i const *)(above + x));
+    __m256i const l = _mm256_loadu_si256((__m256i const *)(row + x - 1));
+    __m256i const up =
+        _mm256_sub_epi16(_mm256_max_epu16(c, u), _mm256_min_epu16(c, u));
+    __m256i const left =
+        _mm256_sub_epi16(_mm256_max_epu16(c, l), _mm256_min_epu16(c, l));
+    _mm512_storeu_si512(
+        out + x, _mm512_add_epi64(square8(_mm256_castsi256_si128(up)),
+                                  square8(_mm256_castsi256_si128(left))));
+    _mm512_storeu_si512(
+        out + x + 8,
+        _mm512_add_epi64(square8(_mm256_extracti128_si256(up, 1)),
+                         square8(_mm256_extracti128_si256(left, 1))));
+  }
+  local_energy_tail_gray16(out, row, above, x, w);
+}
+
+/**
+ * Like `cumulative_row_dir_tail`, but for 64-bit energies.
+ */
+static inline void cumulative_row_dir_u64_tail(uint64_t *const row,
+                                               uint64_t const *const above,
+                                               int x, int const end,
+                                               int const w, uint8_t *const left,
+                                               uint8_t *const right) {
+  uint8_t left_bits = 0, right_bits = 0;
+  for (; x < end; x++) {
+    uint64_t least = above[x];
+    int bit = x % 8;
+    if (x > 0 && above[x - 1] < least) {
+      least = above[x - 1];
+      left_bits |= 1 << bit;
+    }
+    if (x < w - 1 && above[x + 1] < least) {
+      least = above[x + 1];
+      left_bits &= ~(1 << bit);
+      right_bits |= 1 << bit;
+    }
+    row[x] += least;
+    if (bit == 7 || x == end - 1) {
+      left[x / 8] = left_bits;
+      right[x / 8] = right_bits;
+      left_bits = right_bits = 0;
+    }
+  }
+}
+
+/**
+ * Like `dir_bits4`, but for two 64-bit entries: bits 0 and 1 are set if they
+ * come from the left, bits 2 and 3 if they come from the right. SSE4.1 has no
+ * 64-bit compares, but as the entries stay below 2^63, `a < b` exactly if
+ * `a - b` is negative, and `blendvpd` and `movmskpd` read that sign bit.
+ */
+__attribute__((target("sse4.1"))) static inline int
+dir_bits2(__m128i const l, __m128i const t, __m128i const r,
+          __m128i *const least) {
+  __m128d const l_lt = _mm_castsi128_pd(_mm_sub_epi64(l, t));
+  __m128d const best =
+      _mm_blendv_pd(_mm_castsi128_pd(t), _mm_castsi128_pd(l), l_lt);
+  __m128d const r_lt =
+      _mm_castsi128_pd(_mm_sub_epi64(r, _mm_castpd_si128(best)));
+  *least = _mm_castpd_si128(_mm_blendv_pd(best, _mm_castsi128_pd(r), r_lt));
+  int const from_left = _mm_movemask_pd(l_lt);
+  int const from_right = _mm_movemask_pd(r_lt);
+  return (from_left & ~from_right) | from_right << 2;
+}
+
+/**
+ * Like `cumulative_row_dir_u32_sse41`, but for 64-bit energies, which have to
+ * stay below 2^63, see `dir_bits2`. The total energy of 16-bit samples always
+ * does.
+ */
+__attribute__((target("sse4.1"))) void
+cumulative_row_dir_u64_sse41(uint64_t *const row, uint64_t const *const above,
+                             int const w, uint8_t *const left,
+                             uint8_t *const right) {
+  int x = w < 8 ? w : 8;
+  cumulative_row_dir_u64_tail(row, above, 0, x, w, left, right);
+  for (; x + 8 <= w - 1; x += 8) {
+    int left_bits = 0, right_bits = 0;
+    for (int i = 0; i < 4; i++) {
+      uint64_t const *const a = above + x + 2 * i;
+      __m128i least;
+      int const bits =
+          dir_bits2(_mm_loadu_si128((__m128i const *)(a - 1)),
+                    _mm_loadu_si128((__m128i const *)a),
+                    _mm_loadu_si128((__m128i const *)(a + 1)), &least);
+      __m128i *const out = (__m128i *)(row + x + 2 * i);
+      _mm_storeu_si128(out, _mm_add_epi64(_mm_loadu_si128(out), least));
+      left_bits |= (bits & 3) << 2 * i;
+      right_bits |= (bits >> 2) << 2 * i;
+    }
+    left[x / 8] = (uint8_t)left_bits;
+    right[x / 8] = (uint8_t)right_bits;
+  }
+  cumulative_row_dir_u64_tail(row, above, x, w, w, left, right);
+}
+
+/**
+ * Like `cumulative_row_dir_u64_sse41`, but four entries per vector with AVX2,
+ * whose signed 64-bit compares are exact below 2^63.
+ */
+__attribute__((target("avx2"))) void
+cumulative_row_dir_u64_avx2(uint64_t *const row, uint64_t const *const above,
+                            int const w, uint8_t *const left,
+                            uint8_t *const right) {
+  int x = w < 8 ? w : 8;
+  cumulative_row_dir_u64_tail(row, above, 0, x, w, left, right);
+  for (; x + 8 <= w - 1; x += 8) {
+    int left_bits = 0, right_bits = 0;
+    for (int i = 0; i < 2; i++) {
+      uint64_t const *const a = above + x + 4 * i;
+      __m256i const l = _mm256_loadu_si256((__m256i const *)(a - 1));
+      __m256i const t = _mm256_loadu_si256((__m256i const *)a);
+      __m256i const r = _mm256_loadu_si256((__m256i const *)(a + 1));
+      __m256i const l_lt = _mm256_cmpgt_epi64(t, l);
+      __m256i const best = _mm256_blendv_epi8(t, l, l_lt);
+      __m256i const r_lt = _mm256_cmpgt_epi64(best, r);
+      __m256i const least = _mm256_blendv_epi8(best, r, r_lt);
+      __m256i *const out = (__m256i *)(row + x + 4 * i);
+      _mm256_storeu_si256(out,
+                          _mm256_add_epi64(_mm256_loadu_si256(out), least));
+      int const from_left = _mm256_movemask_pd(_mm256_castsi256_pd(l_lt));
+      int const from_right = _mm256_movemask_pd(_mm256_castsi256_pd(r_lt));
+      left_bits |= (from_left & ~from_right) << 4 * i;
+      right_bits |= from_right << 4 * i;
+    }
+    left[x / 8] = (uint8_t)left_bits;
+    right[x / 8] = (uint8_t)right_bits;
+  }
+  cumulative_row_dir_u64_tail(row, above, x, w, w, left, right);
+}
+
+/**
+ * Like `cumulative_row_dir_u64_sse41`, but eight entries at a time with
+ * AVX-512, whose unsigned compare masks are a byte of each plane.
+ */
+__attribute__((target("avx512f"))) void
+cumulative_row_dir_u64_avx512(uint64_t *const row, uint64_t const *const above,
+                              int const w, uint8_t *const left,
+                              uint8_t *const right) {
+  int x = w < 8 ? w : 8;
+  cumulative_row_dir_u64_tail(row, above, 0, x, w, left, right);
+  for (; x + 8 <= w - 1; x += 8) {
+    __m512i const l = _mm512_loadu_si512(above + x - 1);
+    __m512i const t = _mm512_loadu_si512(above + x);
+    __m512i const r = _mm512_loadu_si512(above + x + 1);
+    __mmask8 const from_l = _mm512_cmplt_epu64_mask(l, t);
+    __m512i const best = _mm512_min_epu64(l, t);
+    __mmask8 const from_r = _mm512_cmplt_epu64_mask(r, best);
+    __m512i const least = _mm512_min_epu64(best, r);
+    _mm512_storeu_si512(row + x,
+                        _mm512_add_epi64(_mm512_loadu_si512(row + x), least));
+    left[x / 8] = from_l & ~from_r;
+    right[x / 8] = from_r;
+  }
+  cumulative_row_dir_u64_tail(row, above, x, w, w, left, right);
+}
+
+#endif
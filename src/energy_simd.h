@@ -0,0 +1,251 @@
+#ifndef ENERGY_SIMD_H
+#define ENERGY_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "image.h"
+
+/**
+ * Whether the SIMD kernels are available, i.e. whether we compile for x86.
+ * They are compiled for their instruction sets with target attributes, so the
+ * rest of the program does not require them; callers have to check that the
+ * CPU supports them before calling them, or pick them from `kernels_active`.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define ENERGY_SIMD_X86 1
+#else
+#define ENERGY_SIMD_X86 0
+#endif
+
+#if ENERGY_SIMD_X86
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the RGB row @p `row`
+ * into @p `out`, i.e. the color difference to the pixel in @p `above`, the row
+ * above, plus the difference to the pixel on the left. The results are
+ * identical to those of `diff_color`. Uses SSE4.1.
+ */
+void local_energy_row_rgb8_sse41(uint32_t* out, struct pixel const* row,
+                                 struct pixel const* above, int w);
+
+/**
+ * Like `local_energy_row_rgb8_sse41`, but uses AVX2.
+ */
+void local_energy_row_rgb8_avx2(uint32_t* out, struct pixel const* row,
+                                struct pixel const* above, int w);
+
+/**
+ * Add to each of the @p `w` left entries of the energy row @p `row` the least
+ * of the (up to) three neighbours in the row @p `above`, clamped at column 0
+ * and column `w - 1`, with unsigned compares (`min_epu32`). The results are
+ * identical to those of the scalar update in `calculate_energy`. Uses SSE4.1.
+ */
+void cumulative_row_u32_sse41(uint32_t* row, uint32_t const* above, int w);
+
+/**
+ * Like `cumulative_row_u32_sse41`, but also return the index of the first
+ * least entry of the updated row, as `calculate_min_energy_column` would.
+ */
+int cumulative_row_min_u32_sse41(uint32_t* row, uint32_t const* above, int w);
+
+/**
+ * Like `cumulative_row_u32_sse41`, but uses AVX2.
+ */
+void cumulative_row_u32_avx2(uint32_t* row, uint32_t const* above, int w);
+
+/**
+ * Like `cumulative_row_min_u32_sse41`, but uses AVX2.
+ */
+int cumulative_row_min_u32_avx2(uint32_t* row, uint32_t const* above, int w);
+
+/**
+ * Like `local_energy_row_rgb8_sse41`, but uses AVX-512 (F and BW).
+ */
+void local_energy_row_rgb8_avx512(uint32_t* out, struct pixel const* row,
+                                  struct pixel const* above, int w);
+
+/**
+ * Like `cumulative_row_u32_sse41`, but uses AVX-512 (F).
+ */
+void cumulative_row_u32_avx512(uint32_t* row, uint32_t const* above, int w);
+
+/**
+ * Like `cumulative_row_min_u32_sse41`, but uses AVX-512 (F).
+ */
+int cumulative_row_min_u32_avx512(uint32_t* row, uint32_t const* above, int w);
+
+/**
+ * Like `cumulative_row_u32_sse41`, but also record in bit `x` of the bit
+ * planes @p `left` and @p `right` (`(w + 7) / 8` bytes each, which are
+ * overwritten) whether entry `x` took its left or its right neighbour rather
+ * than the one straight above. Ties go to the one straight above, then to the
+ * left one, as in `calculate_optimal_path`. Uses SSE4.1.
+ */
+void cumulative_row_dir_u32_sse41(uint32_t* row, uint32_t const* above, int w,
+                                  uint8_t* left, uint8_t* right);
+
+/**
+ * Like `cumulative_row_dir_u32_sse41`, but uses AVX2.
+ */
+void cumulative_row_dir_u32_avx2(uint32_t* row, uint32_t const* above, int w,
+                                 uint8_t* left, uint8_t* right);
+
+/**
+ * Like `cumulative_row_dir_u32_sse41`, but uses AVX-512 (F).
+ */
+void cumulative_row_dir_u32_avx512(uint32_t* row, uint32_t const* above, int w,
+                                   uint8_t* left, uint8_t* right);
+
+/**
+ * Add to each of the @p `w` left entries of the local energy row @p `local`
+ * the least of the (up to) three neighbours in the 16-bit total energy row
+ * @p `above`, which is relative to its least entry, and record the direction
+ * bits like `cumulative_row_dir_u32_sse41`. Stores the sums less the least
+ * one, saturated to `UINT16_MAX`, in @p `row` and returns the least sum.
+ * @p `local` is left holding the sums. Uses SSE4.1.
+ */
+uint32_t cumulative_row_dir_u16_sse41(uint16_t* row, uint32_t* local,
+                                      uint16_t const* above, int w,
+                                      uint8_t* left, uint8_t* right);
+
+/**
+ * Like `cumulative_row_dir_u16_sse41`, but uses AVX2.
+ */
+uint32_t cumulative_row_dir_u16_avx2(uint16_t* row, uint32_t* local,
+                                     uint16_t const* above, int w,
+                                     uint8_t* left, uint8_t* right);
+
+/**
+ * Like `cumulative_row_dir_u16_sse41`, but uses AVX-512 (F and BW).
+ */
+uint32_t cumulative_row_dir_u16_avx512(uint16_t* row, uint32_t* local,
+                                       uint16_t const* above, int w,
+                                       uint8_t* left, uint8_t* right);
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the padded RGB row
+ * @p `row` into @p `out` like `local_energy_row_rgb8_sse41`. Every pixel fills
+ * one 32-bit lane, so no load straddles pixels. Uses SSE4.1.
+ */
+void local_energy_row_rgbx8_sse41(uint32_t* out, struct pixelx const* row,
+                                  struct pixelx const* above, int w);
+
+/**
+ * Like `local_energy_row_rgbx8_sse41`, but uses AVX2.
+ */
+void local_energy_row_rgbx8_avx2(uint32_t* out, struct pixelx const* row,
+                                 struct pixelx const* above, int w);
+
+/**
+ * Like `local_energy_row_rgbx8_sse41`, but uses AVX-512 (F and BW).
+ */
+void local_energy_row_rgbx8_avx512(uint32_t* out, struct pixelx const* row,
+                                   struct pixelx const* above, int w);
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the planar RGB row
+ * whose red samples are at @p `row` into @p `out` like
+ * `local_energy_row_rgb8_sse41`. The green and blue samples follow @p `plane`
+ * and `2 * plane` samples later, in @p `above` as well. Uses SSE4.1.
+ */
+void local_energy_row_planar8_sse41(uint32_t* out, uint8_t const* row,
+                                    uint8_t const* above, size_t plane, int w);
+
+/**
+ * Like `local_energy_row_planar8_sse41`, but uses AVX2.
+ */
+void local_energy_row_planar8_avx2(uint32_t* out, uint8_t const* row,
+                                   uint8_t const* above, size_t plane, int w);
+
+/**
+ * Like `local_energy_row_planar8_sse41`, but uses AVX-512 (F and BW).
+ */
+void local_energy_row_planar8_avx512(uint32_t* out, uint8_t const* row,
+                                     uint8_t const* above, size_t plane,
+                                     int w);
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the gray row
+ * @p `row` (of a graymap or a luma plane) into @p `out`, given the row
+ * @p `above` it, like `local_energy_row_rgb8_sse41` with `diff_gray`. Uses
+ * SSE4.1.
+ */
+void local_energy_row_gray8_sse41(uint32_t* out, uint8_t const* row,
+                                  uint8_t const* above, int w);
+
+/**
+ * Like `local_energy_row_gray8_sse41`, but uses AVX2.
+ */
+void local_energy_row_gray8_avx2(uint32_t* out, uint8_t const* row,
+                                 uint8_t const* above, int w);
+
+/**
+ * Like `local_energy_row_gray8_sse41`, but uses AVX-512 (F and BW).
+ */
+void local_energy_row_gray8_avx512(uint32_t* out, uint8_t const* row,
+                                   uint8_t const* above, int w);
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the 16-bit RGB row
+ * @p `row` into @p `out`, given the row @p `above` it, like
+ * `local_energy_row_rgb8_sse41` with `diff_color16`. Uses SSE4.1.
+ */
+void local_energy_row_rgb16_sse41(uint64_t* out, struct pixel16 const* row,
+                                  struct pixel16 const* above, int w);
+
+/**
+ * Like `local_energy_row_rgb16_sse41`, but uses AVX2.
+ */
+void local_energy_row_rgb16_avx2(uint64_t* out, struct pixel16 const* row,
+                                 struct pixel16 const* above, int w);
+
+/**
+ * Like `local_energy_row_rgb16_sse41`, but uses AVX-512 (F and BW).
+ */
+void local_energy_row_rgb16_avx512(uint64_t* out, struct pixel16 const* row,
+                                   struct pixel16 const* above, int w);
+
+/**
+ * Calculate the local energy of the @p `w` left pixels of the 16-bit gray row
+ * @p `row` into @p `out`, given the row @p `above` it, like
+ * `local_energy_row_gray8_sse41` with `diff_gray16`. Uses SSE4.1.
+ */
+void local_energy_row_gray16_sse41(uint64_t* out, uint16_t const* row,
+                                   uint16_t const* above, int w);
+
+/**
+ * Like `local_energy_row_gray16_sse41`, but uses AVX2.
+ */
+void local_energy_row_gray16_avx2(uint64_t* out, uint16_t const* row,
+                                  uint16_t const* above, int w);
+
+/**
+ * Like `local_energy_row_gray16_sse41`, but uses AVX-512 (F and BW).
+ */
+void local_energy_row_gray16_avx512(uint64_t* out, uint16_t const* row,
+                                    uint16_t const* above, int w);
+
+/**
+ * Like `cumulative_row_dir_u32_sse41`, but for 64-bit energies, which have to
+ * stay below 2^63, as the total energy of 16-bit samples always does. Uses
+ * SSE4.1.
+ */
+void cumulative_row_dir_u64_sse41(uint64_t* row, uint64_t const* above, int w,
+                                  uint8_t* left, uint8_t* right);
+
+/**
+ * Like `cumulative_row_dir_u64_sse41`, but uses AVX2.
+ */
+void cumulative_row_dir_u64_avx2(uint64_t* row, uint64_t const* above, int w,
+                                 uint8_t* left, uint8_t* right);
+
+/**
+ * Like `cumulative_row_dir_u64_sse41`, but uses AVX-512 (F).
+ */
+void cumulative_row_dir_u64_avx512(uint64_t* row, uint64_t const* above,
+                                   int w, uint8_t* left, uint8_t* right);
+
+#endif
+
+#endif
@@ -1,139 +1,1560 @@
 #include "image.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include "energy.h"
 #include "indexing.h"
+#include "kernels.h"
+#include "qoi.h"
 #include "util.h"
 
+/**
+ * Return the size in bytes of a pixel of type @p `type`. The three samples of
+ * a planar pixel are not adjacent, but still take three bytes.
+ */
+size_t pixel_size(enum pixel_type const type) {
+  switch (type) {
+  case PIXEL_GRAY8:
+    return sizeof(uint8_t);
+  case PIXEL_RGB16:
+    return sizeof(struct pixel16);
+  case PIXEL_GRAY16:
+    return sizeof(uint16_t);
+  case PIXEL_RGBX8:
+    return sizeof(struct pixelx);
+  default:
+    return sizeof(struct pixel);
+  }
+}
+
+/**
+ * Return the number of samples of a pixel of type @p `type`, i.e. 1 for gray
+ * and 3 for RGB pixels.
+ */
+int pixel_channels(enum pixel_type const type) {
+  return type == PIXEL_GRAY8 || type == PIXEL_GRAY16 ? 1 : 3;
+}
+
+/**
+ * Return whether pixels of type @p `type` have 16-bit samples.
+ */
+static bool is_wide(enum pixel_type const type) {
+  return type == PIXEL_RGB16 || type == PIXEL_GRAY16;
+}
+
+/**
+ * Return whether @p `type` is one of the 8-bit RGB layouts.
+ */
+bool pixel_is_rgb8(enum pixel_type const type) {
+  return type == PIXEL_RGB8 || type == PIXEL_RGBX8 || type == PIXEL_PLANAR8;
+}
+
+/**
+ * Return the pixel type called @p `name`: `packed` (`PIXEL_RGB8`), `rgbx`
+ * (`PIXEL_RGBX8`) or `planar` (`PIXEL_PLANAR8`). Returns false if there is
+ * none.
+ */
+bool pixel_layout_find(char const *const name, enum pixel_type *const type) {
+  if (strcmp(name, "packed") == 0)
+    *type = PIXEL_RGB8;
+  else if (strcmp(name, "rgbx") == 0)
+    *type = PIXEL_RGBX8;
+  else if (strcmp(name, "planar") == 0)
+    *type = PIXEL_PLANAR8;
+  else
+    return false;
+  return true;
+}
+
 /**
  * Initialize the image @p `img` with width @p `w` and height @p `h`.
  */
 struct image *image_init(int const w, int const h) {
-  // DO NOT EDIT
+  return image_init_type(w, h, PIXEL_RGB8);
+}
+
+/**
+ * Initialize the image @p `img` with width @p `w`, height @p `h` and pixels of
+ * type @p `type`, all set to zero. The maximum value is 255 for 8-bit and
+ * 65535 for 16-bit pixel types.
+ */
+struct image *image_init_type(int const w, int const h,
+                              enum pixel_type const type) {
   struct image *img = malloc(sizeof(struct image));
   img->w = w;
   img->h = h;
-  img->pixels = malloc(w * h * sizeof(*img->pixels));
-  memset(img->pixels, 0, w * h * sizeof(*img->pixels));
+  img->type = type;
+  img->maxval = is_wide(type) ? UINT16_MAX : UINT8_MAX;
+  img->pixels = calloc((size_t)w * h, pixel_size(type));
+  img->map = NULL;
+  img->map_size = 0;
+  img->luma = NULL;
+  img->energy = NULL;
+  img->total = NULL;
+  img->energy_w = 0;
+  img->gaps = NULL;
+  img->n_gaps = 0;
+  img->gap_capacity = 0;
   return img;
 }
 
 /**
- * Destroy the image @p `img` by freeing its pixels field and by freeing @p
- * `img` itself. Don't use @p img afterwards.
+ * Destroy the image @p `img` by freeing (or unmapping) its pixels field and by
+ * freeing @p `img` itself. Don't use @p img afterwards.
  */
 void image_destroy(struct image *img) {
-  free(img->pixels);
+  if (img->map != NULL)
+    munmap(img->map, img->map_size);
+  else
+    free(img->pixels);
+  free(img->luma);
+  free(img->energy);
+  free(img->total);
+  free(img->gaps);
   free(img);
 }
 
 /**
- * Read an image from the file at @p `filename` in the portable pixmap (P3)
- * format. See http://en.wikipedia.org/wiki/Netpbm_format for details on the
- * file format.
+ * Return the @p `w` left pixels of row @p `y` of the 8-bit RGB image @p `img`
+ * as packed pixels, converted into @p `tmp` unless the image already stores
+ * them that way.
+ */
+struct pixel const *image_row_rgb8(struct image const *const img, int const y,
+                                   int const w, struct pixel *const tmp) {
+  size_t const i = yx_index(y, 0, img->w);
+  if (img->type == PIXEL_RGBX8) {
+    struct pixelx const *const row = &img->pixelsx[i];
+    for (int x = 0; x < w; x++)
+      tmp[x] = (struct pixel){row[x].r, row[x].g, row[x].b};
+    return tmp;
+  }
+  if (img->type == PIXEL_PLANAR8) {
+    size_t const plane = (size_t)img->w * img->h;
+    uint8_t const *const r = &img->planes[i];
+    uint8_t const *const g = r + plane;
+    uint8_t const *const b = g + plane;
+    for (int x = 0; x < w; x++)
+      tmp[x] = (struct pixel){r[x], g[x], b[x]};
+    return tmp;
+  }
+  return &img->pixels[i];
+}
+
+/**
+ * Return the 8-bit luma of the RGB pixel @p `p`, (77 R + 150 G + 29 B) / 256
+ * rounded to the nearest integer. The weights add up to 256, so white stays
+ * 255.
+ */
+static inline uint8_t luma_of(struct pixel const p) {
+  return (uint8_t)((77 * p.r + 150 * p.g + 29 * p.b + 128) >> 8);
+}
+
+/**
+ * Calculate the luma of row @p `y` of the 8-bit RGB image @p `img` into its
+ * luma plane, with @p `tmp` as room for a row of packed pixels.
+ */
+static void luma_row(struct image *const img, int const y,
+                     struct pixel *const tmp) {
+  struct pixel const *const row = image_row_rgb8(img, y, img->w, tmp);
+  uint8_t *const out = &img->luma[yx_index(y, 0, img->w)];
+  for (int x = 0; x < img->w; x++)
+    out[x] = luma_of(row[x]);
+}
+
+/**
+ * Add the luma plane to the 8-bit RGB image @p `img`: the luma of every pixel,
+ * (77 R + 150 G + 29 B + 128) / 256, i.e. BT.601 in 8 bits. From then on, the
+ * energy is calculated on the luma plane like on a graymap, which reads a
+ * third of the bytes, and `carve_path` carves it along with the pixels, so it
+ * is never recomputed. Images of other types and images that already have a
+ * luma plane are left as they are.
+ */
+void image_add_luma(struct image *const img) {
+  if (!pixel_is_rgb8(img->type) || img->luma != NULL)
+    return;
+  img->luma = malloc((size_t)img->w * img->h);
+  struct pixel *const tmp = malloc(img->w * sizeof(struct pixel));
+  if (img->luma == NULL || tmp == NULL)
+    exit(EXIT_FAILURE);
+  for (int y = 0; y < img->h; y++)
+    luma_row(img, y, tmp);
+  free(tmp);
+}
+
+/**
+ * Convert the 8-bit RGB image @p `img` to the layout @p `type`, which is one of
+ * `PIXEL_RGB8`, `PIXEL_RGBX8` and `PIXEL_PLANAR8`. Images of other types are
+ * left as they are. If the pixels were mapped, they are copied and unmapped.
+ */
+void image_convert(struct image *const img, enum pixel_type const type) {
+  if (!pixel_is_rgb8(img->type) || !pixel_is_rgb8(type) || img->type == type)
+    return;
+
+  struct image *const out = image_init_type(img->w, img->h, type);
+  if (out->pixels == NULL)
+    exit(EXIT_FAILURE);
+  size_t const plane = (size_t)img->w * img->h;
+  struct pixel *const tmp = malloc(img->w * sizeof(struct pixel));
+  if (tmp == NULL)
+    exit(EXIT_FAILURE);
+  for (int y = 0; y < img->h; y++) {
+    size_t const i = yx_index(y, 0, img->w);
+    struct pixel const *const row = image_row_rgb8(img, y, img->w, tmp);
+    if (type == PIXEL_RGB8) {
+      memcpy(&out->pixels[i], row, img->w * sizeof(struct pixel));
+    } else if (type == PIXEL_RGBX8) {
+      struct pixelx *const dst = &out->pixelsx[i];
+      for (int x = 0; x < img->w; x++)
+        dst[x] = (struct pixelx){row[x].r, row[x].g, row[x].b, 0};
+    } else {
+      uint8_t *const r = &out->planes[i];
+      for (int x = 0; x < img->w; x++) {
+        r[x] = row[x].r;
+        r[plane + x] = row[x].g;
+        r[2 * plane + x] = row[x].b;
+      }
+    }
+  }
+  free(tmp);
+
+  if (img->map != NULL)
+    munmap(img->map, img->map_size);
+  else
+    free(img->pixels);
+  img->pixels = out->pixels;
+  img->type = type;
+  img->map = NULL;
+  img->map_size = 0;
+  free(out);
+}
+
+/**
+ * The maximum number of threads used to decode and encode ASCII images.
+ */
+#define MAX_IO_THREADS 64
+
+/**
+ * The minimum number of payload bytes decoded or encoded by each thread.
+ */
+#define ASCII_MIN_CHUNK (256 << 10)
+
+/**
+ * Return whether @p `c` is whitespace in the sense of the netpbm formats.
+ */
+static inline bool is_space(int const c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/**
+ * Skip whitespace starting at @p `p`. The buffer is expected to be terminated
+ * by a NUL byte, which is not whitespace.
+ */
+static inline char const *skip_space(char const *p) {
+  while (is_space(*p))
+    ++p;
+  return p;
+}
+
+/**
+ * Parse an unsigned decimal number of at most @p `max` starting at @p `*pp`.
+ * The number has to be followed by whitespace or the end of the buffer.
+ * On success, @p `*pp` points behind the number and true is returned.
+ */
+static inline bool scan_uint(char const **const pp, uint32_t const max,
+                             uint32_t *const out) {
+  char const *p = *pp;
+  uint32_t value = 0;
+  if ((unsigned)(*p - '0') > 9)
+    return false;
+  do {
+    value = value * 10 + (uint32_t)(*p++ - '0');
+    if (value > max)
+      return false;
+  } while ((unsigned)(*p - '0') <= 9);
+  if (*p != '\0' && !is_space(*p))
+    return false;
+  *pp = p;
+  *out = value;
+  return true;
+}
+
+/**
+ * Return the number of bytes left in @p `f` after the current position, or
+ * -1 if the stream is not seekable.
+ */
+static long remaining_bytes(FILE *const f) {
+  long const pos = ftell(f);
+  if (pos < 0 || fseek(f, 0, SEEK_END) != 0)
+    return -1;
+  long const end = ftell(f);
+  if (fseek(f, pos, SEEK_SET) != 0 || end < pos)
+    return -1;
+  return end - pos;
+}
+
+/**
+ * Read the rest of the file @p `f` into a freshly allocated buffer that is
+ * terminated by a NUL byte. The length without terminator is stored in
+ * @p `len`. Returns NULL on failure.
+ */
+static char *read_rest_of_file(FILE *const f, size_t *const len) {
+  size_t cap = 1 << 16;
+  size_t size = 0;
+  long const remaining = remaining_bytes(f);
+  if (remaining >= 0)
+    cap = (size_t)remaining + 1;
+
+  char *buf = malloc(cap);
+  if (buf == NULL)
+    return NULL;
+  for (;;) {
+    size += fread(buf + size, 1, cap - size, f);
+    if (size < cap) {
+      if (ferror(f)) {
+        free(buf);
+        return NULL;
+      }
+      break;
+    }
+    cap *= 2;
+    char *const grown = realloc(buf, cap);
+    if (grown == NULL) {
+      free(buf);
+      return NULL;
+    }
+    buf = grown;
+  }
+  buf[size] = '\0';
+  *len = size;
+  return buf;
+}
+
+/**
+ * The header of a portable pixmap or graymap: whether the samples are binary
+ * (P6, P5) or ASCII (P3, P2), the type of pixels (RGB for pixmaps, gray for
+ * graymaps, 16-bit for a maximum value above 255), the dimensions and the
+ * maximum sample value.
+ */
+struct pnm_header {
+  bool binary;
+  enum pixel_type type;
+  uint32_t w, h, maxval;
+};
+
+/**
+ * Return the number of samples in the image described by @p `hdr`.
+ */
+static uint64_t header_samples(struct pnm_header const *const hdr) {
+  return (uint64_t)hdr->w * hdr->h * pixel_channels(hdr->type);
+}
+
+/**
+ * Allocate the image described by @p `hdr`.
+ */
+static struct image *header_image(struct pnm_header const *const hdr) {
+  struct image *const img = image_init_type(hdr->w, hdr->h, hdr->type);
+  img->maxval = (uint16_t)hdr->maxval;
+  return img;
+}
+
+/**
+ * Read an unsigned decimal number of at most @p `max` from the header in
+ * @p `f`, skipping leading whitespace and consuming the single whitespace
+ * character that has to follow it.
+ */
+static bool read_header_uint(FILE *const f, uint32_t const max,
+                             uint32_t *const out) {
+  int c;
+  do {
+    c = getc(f);
+  } while (is_space(c));
+  if (c < '0' || c > '9')
+    return false;
+
+  uint32_t value = 0;
+  do {
+    value = value * 10 + (uint32_t)(c - '0');
+    if (value > max)
+      return false;
+    c = getc(f);
+  } while (c >= '0' && c <= '9');
+  if (!is_space(c))
+    return false;
+  *out = value;
+  return true;
+}
+
+/**
+ * Read the header of a P2, P3, P5 or P6 image from @p `f` into @p `hdr`.
+ * Afterwards @p `f` is positioned directly behind the whitespace following
+ * the maximum value, which has to be between 1 and 65535.
+ */
+static bool read_header(FILE *const f, struct pnm_header *const hdr) {
+  if (getc(f) != 'P')
+    return false;
+  int const format = getc(f);
+  if (format != '2' && format != '3' && format != '5' && format != '6')
+    return false;
+  if (!is_space(getc(f)))
+    return false;
+
+  hdr->binary = format == '5' || format == '6';
+  if (!read_header_uint(f, INT32_MAX, &hdr->w) ||
+      !read_header_uint(f, INT32_MAX, &hdr->h) ||
+      !read_header_uint(f, UINT16_MAX, &hdr->maxval) || hdr->maxval == 0)
+    return false;
+
+  bool const gray = format == '2' || format == '5';
+  if (hdr->maxval > UINT8_MAX)
+    hdr->type = gray ? PIXEL_GRAY16 : PIXEL_RGB16;
+  else
+    hdr->type = gray ? PIXEL_GRAY8 : PIXEL_RGB8;
+  return hdr->w > 0 && hdr->h > 0 && (uint64_t)hdr->w * hdr->h <= INT32_MAX;
+}
+
+/**
+ * The number of threads used to decode and encode ASCII images, 0 means one
+ * per online processor.
+ */
+static int io_threads = 0;
+
+/**
+ * Set the number of threads used to decode and encode ASCII images; 0 (the
+ * default) uses one thread per online processor.
+ */
+void image_set_io_threads(int const n) { io_threads = n < 0 ? 0 : n; }
+
+/**
+ * Return the number of threads to use for a payload of @p `len` bytes, such
+ * that every thread gets at least @p `min_chunk` bytes.
+ */
+static int threads_for(size_t const len, size_t const min_chunk) {
+  long n = io_threads;
+  if (n == 0)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n > MAX_IO_THREADS)
+    n = MAX_IO_THREADS;
+  if ((size_t)n > len / min_chunk)
+    n = (long)(len / min_chunk);
+  return n < 1 ? 1 : (int)n;
+}
+
+/**
+ * Store the sample @p `value` at index @p `i` of @p `samples`, which holds
+ * `uint16_t` samples if @p `maxval` exceeds 255 and `uint8_t` samples
+ * otherwise.
+ */
+static inline void store_sample(void *const samples, uint64_t const i,
+                                uint32_t const maxval, uint32_t const value) {
+  if (maxval > UINT8_MAX)
+    ((uint16_t *)samples)[i] = (uint16_t)value;
+  else
+    ((uint8_t *)samples)[i] = (uint8_t)value;
+}
+
+/**
+ * Decode the @p `n` whitespace separated samples in the NUL-terminated buffer
+ * @p `buf` of length @p `len` into @p `samples`. Fails if a sample is missing
+ * or greater than @p `maxval`, or there is anything but whitespace after the
+ * last sample.
+ */
+static bool parse_ascii_samples(char const *const buf, size_t const len,
+                                void *const samples, uint64_t const n,
+                                uint32_t const maxval) {
+  char const *p = buf;
+  for (uint64_t i = 0; i < n; ++i) {
+    uint32_t value;
+    p = skip_space(p);
+    if (!scan_uint(&p, maxval, &value))
+      return false;
+    store_sample(samples, i, maxval, value);
+  }
+  return skip_space(p) == buf + len;
+}
+
+/**
+ * A chunk of the ASCII payload that is decoded by one thread. Chunks start and
+ * end at whitespace, so no sample is split between two chunks.
+ */
+struct ascii_chunk {
+  char const *begin, *end;
+  uint64_t n_tokens;
+  uint64_t offset;
+  void *samples;
+  uint32_t maxval;
+  bool ok;
+};
+
+/**
+ * Count the whitespace separated tokens of a chunk.
+ */
+static void *count_ascii_chunk(void *const arg) {
+  struct ascii_chunk *const chunk = arg;
+  uint64_t n = 0;
+  bool in_token = false;
+  for (char const *p = chunk->begin; p != chunk->end; ++p) {
+    bool const space = is_space(*p);
+    n += !space && !in_token;
+    in_token = !space;
+  }
+  chunk->n_tokens = n;
+  return NULL;
+}
+
+/**
+ * Decode the tokens of a chunk into its destination, starting at the sample
+ * index given by its offset.
+ */
+static void *parse_ascii_chunk(void *const arg) {
+  struct ascii_chunk *const chunk = arg;
+  uint64_t i = chunk->offset;
+  char const *p = chunk->begin;
+  chunk->ok = true;
+  for (;;) {
+    while (p != chunk->end && is_space(*p))
+      ++p;
+    if (p == chunk->end)
+      break;
+    uint32_t value;
+    if (!scan_uint(&p, chunk->maxval, &value)) {
+      chunk->ok = false;
+      break;
+    }
+    store_sample(chunk->samples, i++, chunk->maxval, value);
+  }
+  return NULL;
+}
+
+/**
+ * Run @p `fun` on each of the @p `n` items of size @p `size` in @p `items`,
+ * the first one on the calling thread and the others on threads of their own.
+ */
+static void run_on_threads(void *(*fun)(void *), void *const items,
+                           size_t const size, int const n) {
+  pthread_t threads[MAX_IO_THREADS];
+  char *const base = items;
+  int started = 1;
+  for (; started < n; started++) {
+    if (pthread_create(&threads[started], NULL, fun,
+                       base + (size_t)started * size) != 0)
+      break;
+  }
+  // items whose thread could not be started are handled here
+  fun(base);
+  for (int i = started; i < n; i++)
+    fun(base + (size_t)i * size);
+  for (int i = 1; i < started; i++)
+    pthread_join(threads[i], NULL);
+}
+
+/**
+ * Decode the ASCII samples like `parse_ascii_samples`, but on @p `n_threads`
+ * threads. The payload is split into chunks at whitespace, the tokens in every
+ * chunk are counted, and a prefix sum over the counts gives the index of the
+ * first sample of every chunk, so that all chunks can be decoded concurrently
+ * directly into @p `samples`.
+ */
+static bool parse_ascii_samples_parallel(char const *const buf,
+                                         size_t const len, void *const samples,
+                                         uint64_t const n,
+                                         uint32_t const maxval,
+                                         int const n_threads) {
+  struct ascii_chunk chunks[MAX_IO_THREADS] = {0};
+  char const *begin = buf;
+  for (int i = 0; i < n_threads; i++) {
+    char const *end = buf + len * (i + 1) / n_threads;
+    if (end < begin)
+      end = begin;
+    while (end != buf + len && !is_space(*end))
+      ++end;
+    chunks[i].begin = begin;
+    chunks[i].end = end;
+    chunks[i].samples = samples;
+    chunks[i].maxval = maxval;
+    begin = end;
+  }
+
+  run_on_threads(count_ascii_chunk, chunks, sizeof(*chunks), n_threads);
+  uint64_t offset = 0;
+  for (int i = 0; i < n_threads; i++) {
+    chunks[i].offset = offset;
+    offset += chunks[i].n_tokens;
+  }
+  // too few samples, or extra data after the last one
+  if (offset != n)
+    return false;
+
+  run_on_threads(parse_ascii_chunk, chunks, sizeof(*chunks), n_threads);
+  for (int i = 0; i < n_threads; i++) {
+    if (!chunks[i].ok)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Parse the ASCII samples of a P3 or P2 image following @p `hdr` from @p `f`.
+ * The rest of the file is read into a single buffer and decoded in place,
+ * on several threads if it is large enough.
+ * Returns NULL if a sample is missing or out of range, or there is anything
+ * but whitespace after the last pixel.
+ */
+static struct image *read_ascii_body(FILE *const f,
+                                  struct pnm_header const *const hdr) {
+  size_t len;
+  char *const buf = read_rest_of_file(f, &len);
+  if (buf == NULL)
+    return NULL;
+
+  // every sample takes at least one digit and one separator, so reject
+  // headers that promise more samples than the file can hold before
+  // allocating anything
+  uint64_t const n_samples = header_samples(hdr);
+  if (n_samples > (uint64_t)len / 2 + 1) {
+    free(buf);
+    return NULL;
+  }
+
+  struct image *img = header_image(hdr);
+  int const n_threads = threads_for(len, ASCII_MIN_CHUNK);
+  bool const ok =
+      n_threads > 1
+          ? parse_ascii_samples_parallel(buf, len, img->pixels, n_samples,
+                                         hdr->maxval, n_threads)
+          : parse_ascii_samples(buf, len, img->pixels, n_samples, hdr->maxval);
+  free(buf);
+  if (!ok) {
+    image_destroy(img);
+    return NULL;
+  }
+  return img;
+}
+
+/**
+ * Convert the @p `n` big-endian 16-bit samples in @p `samples` to the byte
+ * order of the machine, or back.
+ */
+static void swap_samples16(uint16_t *const samples, size_t const n) {
+  for (size_t i = 0; i < n; i++) {
+    uint8_t const *const bytes = (uint8_t const *)&samples[i];
+    samples[i] = (uint16_t)(bytes[0] << 8 | bytes[1]);
+  }
+}
+
+/**
+ * Convert the @p `n` binary samples just read into @p `samples` from
+ * big-endian if they take 16 bits, and check that none of them is greater
+ * than @p `maxval`.
+ */
+static bool convert_binary_samples(void *const samples, size_t const n,
+                                   uint32_t const maxval) {
+  uint32_t max_sample = 0;
+  if (maxval > UINT8_MAX) {
+    uint16_t *const samples16 = samples;
+    swap_samples16(samples16, n);
+    for (size_t i = 0; i < n; i++)
+      max_sample = samples16[i] > max_sample ? samples16[i] : max_sample;
+  } else if (maxval < UINT8_MAX) {
+    uint8_t const *const samples8 = samples;
+    for (size_t i = 0; i < n; i++)
+      max_sample = samples8[i] > max_sample ? samples8[i] : max_sample;
+  }
+  return max_sample <= maxval;
+}
+
+/**
+ * Read the binary samples of a P6 or P5 image following @p `hdr` from @p `f`
+ * with a single `fread` directly into the pixel array; 16-bit samples are
+ * converted from big-endian afterwards. Returns NULL if the file is too short,
+ * has data after the last pixel or a sample is greater than the maximum value.
+ */
+static struct image *read_binary_body(FILE *const f,
+                                      struct pnm_header const *const hdr) {
+  size_t const n_samples = header_samples(hdr);
+  size_t const n_bytes = n_samples * (hdr->maxval > UINT8_MAX ? 2 : 1);
+  long const remaining = remaining_bytes(f);
+  if (remaining >= 0 && (size_t)remaining != n_bytes)
+    return NULL;
+
+  struct image *img = header_image(hdr);
+  if (fread(img->pixels, 1, n_bytes, f) != n_bytes || getc(f) != EOF) {
+    image_destroy(img);
+    return NULL;
+  }
+
+  if (!convert_binary_samples(img->pixels, n_samples, hdr->maxval)) {
+    image_destroy(img);
+    return NULL;
+  }
+  return img;
+}
+
+/**
+ * The size of the buffers of the standard streams when images are read from
+ * or written to them.
+ */
+#define STREAM_BUFFER_SIZE (1 << 20)
+
+/**
+ * Return whether @p `filename` stands for the standard input or output.
+ */
+static bool image_is_stdio(char const *const filename) {
+  return strcmp(filename, "-") == 0;
+}
+
+/**
+ * Open the file at @p `filename` for reading or writing, depending on
+ * @p `mode`, or return the fully buffered standard input or output if
+ * @p `filename` is `-`. Ends the execution on failure.
+ */
+static FILE *open_image_file(char const *const filename,
+                             char const *const mode) {
+  if (!image_is_stdio(filename)) {
+    FILE *const f = fopen(filename, mode);
+    if (f == NULL)
+      exit(EXIT_FAILURE);
+    return f;
+  }
+
+  static char buffers[2][STREAM_BUFFER_SIZE];
+  bool const reading = mode[0] == 'r';
+  FILE *const f = reading ? stdin : stdout;
+  setvbuf(f, buffers[reading], _IOFBF, STREAM_BUFFER_SIZE);
+  return f;
+}
+
+/**
+ * Close the file @p `f` opened with `open_image_file`; the standard streams
+ * are only flushed. Returns false if buffered data could not be written.
+ */
+static bool close_image_file(FILE *const f) {
+  if (f == stdin)
+    return true;
+  if (f == stdout)
+    return fflush(f) == 0 && !ferror(f);
+  return fclose(f) == 0;
+}
+
+/**
+ * Read an image from the file at @p `filename` in the portable pixmap format,
+ * either ASCII (P3) or binary (P6), in the portable graymap format, either
+ * ASCII (P2) or binary (P5), or in the QOI format, detected by the magic
+ * number. If @p `filename` is `-`, the image is read from the standard input.
+ * Graymaps are read into grayscale images, and images with a maximum value
+ * above 255 into 16-bit images. See http://en.wikipedia.org/wiki/Netpbm_format
+ * for details on the file format.
  * @returns the image that was read.
  */
 struct image *image_read_from_file(const char *filename) {
-  // DO NOT EDIT
-  FILE *f = fopen(filename, "r");
+  FILE *f = open_image_file(filename, "rb");
+
+  struct pnm_header hdr;
+  struct image *img = NULL;
+  int const magic = getc(f);
+  ungetc(magic, f);
+  if (magic == QOI_MAGIC[0])
+    img = qoi_read(f);
+  else if (read_header(f, &hdr))
+    img = hdr.binary ? read_binary_body(f, &hdr) : read_ascii_body(f, &hdr);
+  close_image_file(f);
+
+  if (img == NULL)
+    exit(EXIT_FAILURE);
+  return img;
+}
+
+/**
+ * Map the binary (P6 or P5) image file at @p `filename` into memory with a
+ * private copy-on-write mapping and let the pixels of the returned image point
+ * directly into it, so that the pixels are neither copied on reading nor
+ * written back to the file on changes. Other formats, 16-bit images and the
+ * standard input (`-`) are read with `image_read_from_file`.
+ * @returns the image that was mapped.
+ */
+struct image *image_map_file(const char *filename) {
+  if (image_is_stdio(filename))
+    return image_read_from_file(filename);
+
+  FILE *f = fopen(filename, "rb");
   if (f == NULL)
     exit(EXIT_FAILURE);
 
-  if (fscanf(f, "P3") == EOF) {
+  int const magic = getc(f);
+  ungetc(magic, f);
+  if (magic == QOI_MAGIC[0]) {
     fclose(f);
-    exit(EXIT_FAILURE);
+    return image_read_from_file(filename);
   }
 
-  int w, h;
-  if (fscanf(f, "%d %d 255 ", &w, &h) == EOF) {
+  struct pnm_header hdr;
+  if (!read_header(f, &hdr)) {
     fclose(f);
     exit(EXIT_FAILURE);
   }
-  if (w <= 0 || h <= 0) {
+  if (!hdr.binary || hdr.maxval != UINT8_MAX) {
+    fclose(f);
+    return image_read_from_file(filename);
+  }
+
+  long const offset = ftell(f);
+  long const remaining = remaining_bytes(f);
+  size_t const n_bytes = header_samples(&hdr);
+  if (offset < 0 || remaining < 0 || (size_t)remaining != n_bytes) {
     fclose(f);
     exit(EXIT_FAILURE);
   }
 
-  struct image *img = image_init(w, h);
-  struct pixel *pixels = img->pixels;
+  size_t const map_size = (size_t)offset + n_bytes;
+  void *const map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                         fileno(f), 0);
+  fclose(f);
+  if (map == MAP_FAILED)
+    exit(EXIT_FAILURE);
+
+  struct image *img = malloc(sizeof(struct image));
+  img->w = hdr.w;
+  img->h = hdr.h;
+  img->type = hdr.type;
+  img->maxval = (uint16_t)hdr.maxval;
+  img->pixels = (struct pixel *)((char *)map + offset);
+  img->map = map;
+  img->map_size = map_size;
+  img->luma = NULL;
+  img->energy = NULL;
+  img->total = NULL;
+  img->energy_w = 0;
+  img->gaps = NULL;
+  img->n_gaps = 0;
+  img->gap_capacity = 0;
+  return img;
+}
+
+/**
+ * The initial size of the buffer the ASCII samples of a streamed image are
+ * read into. It grows if a single sample does not fit.
+ */
+#define ASCII_STREAM_BUFFER_SIZE (64 << 10)
 
-  for (int y = 0; y < img->h; ++y) {
-    unsigned int r, g, b;
-    for (int x = 0; x < img->w; ++x, ++pixels) {
-      if (fscanf(f, "%u %u %u ", &r, &g, &b) == EOF) {
-        image_destroy(img);
-        fclose(f);
+/**
+ * An image that is read one row at a time. `window` holds the last two rows
+ * read, `y` counts them and `h` is the height of the whole image. QOI images
+ * are decoded by `qoi`, portable pixmaps and graymaps described by `hdr` are
+ * read directly from `f`, with the ASCII samples buffered in `buf`: the bytes
+ * from `pos` to `len` have not been parsed yet and `buf[len]` is a NUL byte.
+ */
+struct image_stream {
+  FILE *f;
+  struct image *window;
+  uint32_t h, y;
+  struct qoi_decoder *qoi;
+  struct pnm_header hdr;
+  char *buf;
+  size_t pos, len, cap;
+  bool eof;
+};
+
+/**
+ * Move the unparsed ASCII samples of @p `s` to the front of its buffer, grow
+ * it if they fill it, and read more of the file behind them.
+ * @returns false if the file has no more data.
+ */
+static bool stream_fill(struct image_stream *const s) {
+  if (s->eof)
+    return false;
+  memmove(s->buf, s->buf + s->pos, s->len - s->pos);
+  s->len -= s->pos;
+  s->pos = 0;
+  if (s->len + 1 == s->cap) {
+    s->cap *= 2;
+    s->buf = realloc(s->buf, s->cap);
+    if (s->buf == NULL)
+      exit(EXIT_FAILURE);
+  }
+  size_t const want = s->cap - 1 - s->len;
+  size_t const got = fread(s->buf + s->len, 1, want, s->f);
+  s->len += got;
+  s->buf[s->len] = '\0';
+  s->eof = got < want;
+  return got > 0;
+}
+
+/**
+ * Parse the next ASCII sample of @p `s` into @p `value`, reading more of the
+ * file whenever the sample might go on behind the buffered part.
+ * @returns false if the sample is missing or greater than the maximum value.
+ */
+static bool stream_ascii_sample(struct image_stream *const s,
+                                uint32_t *const value) {
+  for (;;) {
+    char const *p = skip_space(s->buf + s->pos);
+    char const *end = p;
+    while ((unsigned)(*end - '0') <= 9)
+      ++end;
+    s->pos = p - s->buf;
+    if (end == s->buf + s->len && !s->eof) {
+      stream_fill(s);
+      continue;
+    }
+    if (!scan_uint(&p, s->hdr.maxval, value))
+      return false;
+    s->pos = p - s->buf;
+    return true;
+  }
+}
+
+/**
+ * Read the next row of the portable pixmap or graymap @p `s` into @p `row`.
+ * @returns false if samples are missing or out of range.
+ */
+static bool stream_pnm_row(struct image_stream *const s, void *const row) {
+  size_t const n = (size_t)s->hdr.w * pixel_channels(s->hdr.type);
+  uint32_t const maxval = s->hdr.maxval;
+  if (s->hdr.binary) {
+    size_t const n_bytes = n * (maxval > UINT8_MAX ? 2 : 1);
+    return fread(row, 1, n_bytes, s->f) == n_bytes &&
+           convert_binary_samples(row, n, maxval);
+  }
+  for (size_t i = 0; i < n; i++) {
+    uint32_t value;
+    if (!stream_ascii_sample(s, &value))
+      return false;
+    store_sample(row, i, maxval, value);
+  }
+  return true;
+}
+
+/**
+ * Check that nothing but whitespace (ASCII) or nothing at all (binary) follows
+ * the last row of the portable pixmap or graymap @p `s`.
+ */
+static bool stream_pnm_end(struct image_stream *const s) {
+  if (s->hdr.binary)
+    return getc(s->f) == EOF;
+  do {
+    if (skip_space(s->buf + s->pos) != s->buf + s->len)
+      return false;
+    s->pos = s->len;
+  } while (stream_fill(s));
+  return true;
+}
+
+/**
+ * Open the image file at @p `filename` (`-` for the standard input) in any of
+ * the formats `image_read_from_file` reads, but only read its header, so that
+ * its rows can be read one at a time with `image_stream_read_row`. Ends the
+ * execution if the header is invalid.
+ */
+struct image_stream *image_stream_open(const char *filename) {
+  struct image_stream *const s = calloc(1, sizeof(struct image_stream));
+  if (s == NULL)
+    exit(EXIT_FAILURE);
+  s->f = open_image_file(filename, "rb");
+
+  uint32_t w;
+  int const magic = getc(s->f);
+  ungetc(magic, s->f);
+  if (magic == QOI_MAGIC[0]) {
+    s->qoi = qoi_decoder_open(s->f, &w, &s->h);
+    if (s->qoi == NULL)
+      exit(EXIT_FAILURE);
+    s->window = image_init(w, 2);
+    return s;
+  }
+
+  if (!read_header(s->f, &s->hdr))
+    exit(EXIT_FAILURE);
+  s->h = s->hdr.h;
+  s->window = image_init_type(s->hdr.w, 2, s->hdr.type);
+  s->window->maxval = (uint16_t)s->hdr.maxval;
+  if (!s->hdr.binary) {
+    s->cap = ASCII_STREAM_BUFFER_SIZE;
+    s->buf = malloc(s->cap);
+    if (s->buf == NULL)
+      exit(EXIT_FAILURE);
+    s->buf[0] = '\0';
+  }
+  return s;
+}
+
+/**
+ * Return the image of width and type of the stream @p `s` that holds the last
+ * two rows read: the row read last is its row 1, the one before its row 0.
+ */
+struct image *image_stream_window(struct image_stream *const s) {
+  return s->window;
+}
+
+/**
+ * Return the height of the whole image streamed by @p `s`.
+ */
+uint32_t image_stream_height(struct image_stream const *const s) {
+  return s->h;
+}
+
+/**
+ * Read the next row of the image streamed by @p `s` into its window. The
+ * first row is read into row 0 of the window; every later row is read into
+ * row 1, after the row there has been moved to row 0. Ends the execution if
+ * the row is malformed or missing.
+ * @returns the index of the row in the window.
+ */
+int image_stream_read_row(struct image_stream *const s) {
+  struct image *const window = s->window;
+  size_t const row_size = window->w * pixel_size(window->type);
+  char *const rows = (char *)window->pixels;
+  int const i = s->y == 0 ? 0 : 1;
+  if (s->y >= 2)
+    memcpy(rows, rows + row_size, row_size);
+
+  void *const row = rows + i * row_size;
+  if (s->y >= s->h || !(s->qoi != NULL ? qoi_decoder_row(s->qoi, row)
+                                       : stream_pnm_row(s, row)))
+    exit(EXIT_FAILURE);
+  if (window->luma != NULL) {
+    if (s->y >= 2)
+      memcpy(window->luma, window->luma + window->w, window->w);
+    uint8_t *const luma = &window->luma[i * window->w];
+    for (uint32_t x = 0; x < window->w; x++)
+      luma[x] = luma_of(window->pixels[i * window->w + x]);
+  }
+  s->y++;
+  return i;
+}
+
+/**
+ * Close the stream @p `s`, whose rows have to have been read completely.
+ * Ends the execution if anything but whitespace (for ASCII samples) follows
+ * the last row.
+ */
+void image_stream_close(struct image_stream *const s) {
+  bool ok = s->y == s->h;
+  if (s->qoi != NULL)
+    ok = qoi_decoder_close(s->qoi) && ok;
+  else
+    ok = ok && stream_pnm_end(s);
+  close_image_file(s->f);
+  image_destroy(s->window);
+  free(s->buf);
+  free(s);
+  if (!ok)
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * The decimal representation of every sample value followed by a space,
+ * padded to four bytes so it can be copied with a fixed-size `memcpy`.
+ */
+struct sample_string {
+  char s[4];
+  uint8_t len;
+};
+
+/**
+ * Return the lookup table that maps sample values to their strings.
+ */
+static struct sample_string const *sample_strings(void) {
+  static struct sample_string lut[256];
+  static bool initialized = false;
+  if (!initialized) {
+    for (int v = 0; v < 256; v++) {
+      char tmp[8];
+      lut[v].len = (uint8_t)snprintf(tmp, sizeof(tmp), "%d ", v);
+      memcpy(lut[v].s, tmp, lut[v].len);
+    }
+    initialized = true;
+  }
+  return lut;
+}
+
+/**
+ * The size of the buffer the ASCII samples are formatted into before they are
+ * written out in one block.
+ */
+#define ASCII_BUFFER_SIZE (1 << 20)
+
+/**
+ * The maximum length of a formatted pixel: three samples `"255 "` and the
+ * newline.
+ */
+#define ASCII_MAX_PIXEL_LEN 13
+
+/**
+ * The maximum length of a formatted 16-bit pixel: three samples `"65535 "` and
+ * the newline.
+ */
+#define ASCII_MAX_PIXEL_LEN16 19
+
+/**
+ * The maximum size of the block of formatted rows each thread produces per
+ * round when writing in parallel.
+ */
+#define ASCII_BLOCK_SIZE (4 << 20)
+
+/**
+ * Return the maximum length of @p `w` pixels of @p `img` formatted as ASCII.
+ */
+static size_t ascii_row_len(struct image const *const img, int const w) {
+  return (size_t)w *
+         (is_wide(img->type) ? ASCII_MAX_PIXEL_LEN16 : ASCII_MAX_PIXEL_LEN);
+}
+
+/**
+ * Format the 16-bit sample @p `v` followed by a space into @p `p`. Values
+ * below 256 are taken from @p `lut`, the others are converted digit by digit.
+ * @returns the end of the formatted text.
+ */
+static inline char *format_sample16(uint16_t v,
+                                    struct sample_string const *const lut,
+                                    char *p) {
+  if (v < 256) {
+    memcpy(p, lut[v].s, sizeof(lut[v].s));
+    return p + lut[v].len;
+  }
+  char digits[5];
+  int n = 0;
+  do {
+    digits[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v != 0);
+  while (n > 0)
+    *p++ = digits[--n];
+  *p++ = ' ';
+  return p;
+}
+
+/**
+ * Format the 8-bit RGB pixel with the samples @p `r`, @p `g` and @p `b`
+ * followed by a newline into @p `p`, taking the samples from @p `lut`.
+ * @returns the end of the formatted text.
+ */
+static inline char *format_rgb8(uint8_t const r, uint8_t const g,
+                                uint8_t const b,
+                                struct sample_string const *const lut,
+                                char *p) {
+  memcpy(p, lut[r].s, sizeof(lut[r].s));
+  p += lut[r].len;
+  memcpy(p, lut[g].s, sizeof(lut[g].s));
+  p += lut[g].len;
+  memcpy(p, lut[b].s, sizeof(lut[b].s));
+  p += lut[b].len;
+  *p++ = '\n';
+  return p;
+}
+
+/**
+ * Format the pixels of row @p `y` of @p `img` as ASCII samples, one pixel per
+ * line, into @p `p`. Only the @p `w` left columns are formatted.
+ * @returns the end of the formatted text.
+ */
+static inline char *format_ascii_row(struct image *const img, int const w,
+                                     int const y,
+                                     struct sample_string const *const lut,
+                                     char *p) {
+  if (img->type == PIXEL_GRAY16) {
+    uint16_t const *const row = &img->gray16[yx_index(y, 0, img->w)];
+    for (int x = 0; x < w; x++) {
+      p = format_sample16(row[x], lut, p);
+      *p++ = '\n';
+    }
+    return p;
+  }
+
+  if (img->type == PIXEL_RGB16) {
+    struct pixel16 const *const row = &img->pixels16[yx_index(y, 0, img->w)];
+    for (int x = 0; x < w; x++) {
+      p = format_sample16(row[x].r, lut, p);
+      p = format_sample16(row[x].g, lut, p);
+      p = format_sample16(row[x].b, lut, p);
+      *p++ = '\n';
+    }
+    return p;
+  }
+
+  if (img->type == PIXEL_GRAY8) {
+    uint8_t const *const row = &img->gray[yx_index(y, 0, img->w)];
+    for (int x = 0; x < w; x++) {
+      memcpy(p, lut[row[x]].s, sizeof(lut[row[x]].s));
+      p += lut[row[x]].len;
+      *p++ = '\n';
+    }
+    return p;
+  }
+
+  size_t const i = yx_index(y, 0, img->w);
+  if (img->type == PIXEL_RGBX8) {
+    struct pixelx const *const row = &img->pixelsx[i];
+    for (int x = 0; x < w; x++)
+      p = format_rgb8(row[x].r, row[x].g, row[x].b, lut, p);
+    return p;
+  }
+
+  if (img->type == PIXEL_PLANAR8) {
+    size_t const plane = (size_t)img->w * img->h;
+    uint8_t const *const r = &img->planes[i];
+    for (int x = 0; x < w; x++)
+      p = format_rgb8(r[x], r[plane + x], r[2 * plane + x], lut, p);
+    return p;
+  }
+
+  struct pixel const *const row = &img->pixels[i];
+  for (int x = 0; x < w; x++)
+    p = format_rgb8(row[x].r, row[x].g, row[x].b, lut, p);
+  return p;
+}
+
+/**
+ * Write the pixels of @p `img` to @p `f` as ASCII samples (P3 or P2), one
+ * pixel per line. Only the @p `w` left columns are written.
+ */
+static void write_ascii_body_serial(struct image *const img, int const w,
+                                    FILE *const f) {
+  struct sample_string const *const lut = sample_strings();
+  size_t const row_len = ascii_row_len(img, w);
+  size_t const size = row_len > ASCII_BUFFER_SIZE ? row_len : ASCII_BUFFER_SIZE;
+  char *const buf = malloc(size);
+  if (buf == NULL)
+    exit(EXIT_FAILURE);
+
+  char *p = buf;
+  for (int y = 0; y < img->h; y++) {
+    if (p > buf + size - row_len) {
+      if (fwrite(buf, 1, p - buf, f) != (size_t)(p - buf))
         exit(EXIT_FAILURE);
-      }
-      pixels->r = r;
-      pixels->g = g;
-      pixels->b = b;
+      p = buf;
     }
+    p = format_ascii_row(img, w, y, lut, p);
   }
+  if (fwrite(buf, 1, p - buf, f) != (size_t)(p - buf))
+    exit(EXIT_FAILURE);
+  free(buf);
+}
 
-  if (fgetc(f) != EOF) {
-    image_destroy(img);
-    fclose(f);
+/**
+ * A block of rows that is formatted by one thread into its own buffer.
+ */
+struct ascii_block {
+  struct image *img;
+  int w;
+  int y0, y1;
+  char *buf;
+  size_t len;
+};
+
+/**
+ * Format the rows of a block into its buffer.
+ */
+static void *format_ascii_block(void *const arg) {
+  struct ascii_block *const block = arg;
+  struct sample_string const *const lut = sample_strings();
+  char *p = block->buf;
+  for (int y = block->y0; y < block->y1; y++)
+    p = format_ascii_row(block->img, block->w, y, lut, p);
+  block->len = p - block->buf;
+  return NULL;
+}
+
+/**
+ * Write all @p `n` buffers in @p `iov` to @p `fd`, retrying on partial
+ * writes.
+ */
+static void writev_all(int const fd, struct iovec *iov, int n) {
+  while (n > 0) {
+    ssize_t written = writev(fd, iov, n);
+    if (written < 0)
+      exit(EXIT_FAILURE);
+    while (n > 0 && (size_t)written >= iov->iov_len) {
+      written -= iov->iov_len;
+      ++iov;
+      --n;
+    }
+    if (n > 0) {
+      iov->iov_base = (char *)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+}
+
+/**
+ * Write the pixels of @p `img` to @p `f` like `write_ascii_body_serial`, but
+ * formatted on @p `n_threads` threads. In every round, each thread formats a
+ * block of rows into its own buffer and the buffers are then written in order
+ * with a single `writev`.
+ */
+static void write_ascii_body_parallel(struct image *const img, int const w,
+                                      FILE *const f, int const n_threads) {
+  // the header is still buffered in the stream
+  if (fflush(f) != 0)
     exit(EXIT_FAILURE);
+  sample_strings();
+
+  // spread the rows over all threads, but bound the buffer sizes
+  size_t const row_len = ascii_row_len(img, w);
+  int rows = (img->h + n_threads - 1) / n_threads;
+  if ((size_t)rows > ASCII_BLOCK_SIZE / row_len)
+    rows = (int)(ASCII_BLOCK_SIZE / row_len);
+  if (rows < 1)
+    rows = 1;
+
+  struct ascii_block blocks[MAX_IO_THREADS];
+  for (int i = 0; i < n_threads; i++) {
+    blocks[i].img = img;
+    blocks[i].w = w;
+    blocks[i].buf = malloc(rows * row_len);
+    if (blocks[i].buf == NULL)
+      exit(EXIT_FAILURE);
   }
 
-  fclose(f);
-  return img;
+  for (int y = 0; y < img->h;) {
+    int n = 0;
+    for (; n < n_threads && y < img->h; n++) {
+      blocks[n].y0 = y;
+      y = y + rows < img->h ? y + rows : img->h;
+      blocks[n].y1 = y;
+    }
+    run_on_threads(format_ascii_block, blocks, sizeof(*blocks), n);
+
+    struct iovec iov[MAX_IO_THREADS];
+    for (int i = 0; i < n; i++) {
+      iov[i].iov_base = blocks[i].buf;
+      iov[i].iov_len = blocks[i].len;
+    }
+    writev_all(fileno(f), iov, n);
+  }
+
+  for (int i = 0; i < n_threads; i++)
+    free(blocks[i].buf);
 }
 
 /**
- * Write the image @p `img` to file at @p `filename` in the portable pixmap (P3)
- * format. See http://en.wikipedia.org/wiki/Netpbm_format for details on the
- *
- * file format.
+ * Write the pixels of @p `img` to @p `f` as ASCII samples (P3 or P2), one
+ * pixel per line, on several threads if the image is large enough. Only the
+ * @p `w` left columns are written.
  */
-void image_write_to_file(struct image *img, const char *filename) {
-  // TODO implement (assignment 3.3)
-  FILE *f = fopen(filename, "w");
+static void write_ascii_body(struct image *const img, int const w,
+                             FILE *const f) {
+  int const n_threads =
+      threads_for(ascii_row_len(img, w) * img->h, ASCII_MIN_CHUNK);
+  if (n_threads > 1)
+    write_ascii_body_parallel(img, w, f, n_threads);
+  else
+    write_ascii_body_serial(img, w, f);
+}
 
-  if (f == NULL)
+/**
+ * Write the 16-bit pixels of @p `img` to @p `f` as big-endian binary samples.
+ * The rows are converted in a buffer of up to `ASCII_BUFFER_SIZE` bytes, which
+ * is written with one `fwrite` whenever it is full. Only the @p `w` left
+ * columns are written.
+ */
+static void write_binary_body16(struct image *const img, int const w,
+                                FILE *const f) {
+  size_t const row_samples = (size_t)w * pixel_channels(img->type);
+  size_t const row_size = row_samples * sizeof(uint16_t);
+  size_t const size = row_size > ASCII_BUFFER_SIZE ? row_size : ASCII_BUFFER_SIZE;
+  uint16_t *const buf = malloc(size);
+  if (buf == NULL)
+    exit(EXIT_FAILURE);
+
+  size_t const stride = (size_t)img->w * pixel_channels(img->type);
+  size_t n = 0;
+  for (int y = 0; y < img->h; y++) {
+    if ((n + row_samples) * sizeof(uint16_t) > size) {
+      if (fwrite(buf, sizeof(uint16_t), n, f) != n)
+        exit(EXIT_FAILURE);
+      n = 0;
+    }
+    memcpy(buf + n, img->gray16 + y * stride, row_size);
+    swap_samples16(buf + n, row_samples);
+    n += row_samples;
+  }
+  if (fwrite(buf, sizeof(uint16_t), n, f) != n)
     exit(EXIT_FAILURE);
+  free(buf);
+}
 
-  fprintf(f, "P3 \n");
-  fprintf(f, "%d %d \n", img->w, img->h);
-  fprintf(f, "255\n");
+/**
+ * Write the padded or planar 8-bit RGB pixels of @p `img` to @p `f` as packed
+ * binary samples. The rows are packed into a buffer of up to
+ * `ASCII_BUFFER_SIZE` bytes, which is written with one `fwrite` whenever it is
+ * full. Only the @p `w` left columns are written.
+ */
+static void write_binary_body_unpacked(struct image *const img, int const w,
+                                       FILE *const f) {
+  size_t const row_size = (size_t)w * sizeof(struct pixel);
+  size_t const size =
+      row_size > ASCII_BUFFER_SIZE ? row_size : ASCII_BUFFER_SIZE;
+  struct pixel *const buf = malloc(size);
+  if (buf == NULL)
+    exit(EXIT_FAILURE);
 
-  for (int y = 0; y < img->h; y++) {   // height
-    for (int x = 0; x < img->w; x++) { // weight
-      struct pixel pix =
-          img->pixels[yx_index(y, x, img->w)]; // getting position of every tile
-      fprintf(f, "%u %u %u \n", pix.r, pix.g,
-              pix.b); // writing red,blue,green in every tile
+  size_t n = 0;
+  for (int y = 0; y < img->h; y++) {
+    if ((n + w) * sizeof(struct pixel) > size) {
+      if (fwrite(buf, sizeof(struct pixel), n, f) != n)
+        exit(EXIT_FAILURE);
+      n = 0;
     }
+    image_row_rgb8(img, y, w, buf + n);
+    n += w;
   }
+  if (fwrite(buf, sizeof(struct pixel), n, f) != n)
+    exit(EXIT_FAILURE);
+  free(buf);
+}
 
-  fclose(f);
+/**
+ * Write the pixels of @p `img` to @p `f` as binary samples (P6 or P5), one
+ * `fwrite` per row. Only the @p `w` left columns are written; if that is the
+ * whole width, the rows are contiguous and written with a single `fwrite`.
+ */
+static void write_binary_body(struct image *const img, int const w,
+                              FILE *const f) {
+  if (is_wide(img->type)) {
+    write_binary_body16(img, w, f);
+    return;
+  }
+  if (img->type == PIXEL_RGBX8 || img->type == PIXEL_PLANAR8) {
+    write_binary_body_unpacked(img, w, f);
+    return;
+  }
+
+  size_t const size = pixel_size(img->type);
+  if (w == img->w) {
+    size_t const n = (size_t)img->w * img->h;
+    if (fwrite(img->pixels, size, n, f) != n)
+      exit(EXIT_FAILURE);
+    return;
+  }
+  for (int y = 0; y < img->h; y++) {
+    char const *const row = (char *)img->pixels + (size_t)y * img->w * size;
+    if (fwrite(row, size, w, f) != (size_t)w)
+      exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * Write the image @p `img` to file at @p `filename` in the format @p `format`,
+ * i.e. either ASCII (P3) or binary (P6) portable pixmap or QOI; grayscale
+ * images are written as graymaps (P2 or P5), and as RGB in QOI. The maximum
+ * value is the one of the image. Only the @p `w` left columns are written, so
+ * the result is @p `w` pixels wide. If @p `filename` is `-`, the image is
+ * written to the standard output. See
+ * http://en.wikipedia.org/wiki/Netpbm_format for details on the file format.
+ */
+void image_write_to_file_format(struct image *const img,
+                                const char *const filename,
+                                enum image_format const format, int const w) {
+  FILE *f = open_image_file(filename, "wb");
+
+  bool const gray = pixel_channels(img->type) == 1;
+  if (format == IMAGE_FORMAT_QOI) {
+    qoi_write(img, w, f);
+  } else if (format == IMAGE_FORMAT_P6) {
+    fprintf(f, "%s\n%d %u\n%u\n", gray ? "P5" : "P6", w, img->h,
+            img->maxval);
+    write_binary_body(img, w, f);
+  } else {
+    fprintf(f, "%s \n", gray ? "P2" : "P3");
+    fprintf(f, "%d %d \n", w, img->h);
+    fprintf(f, "%u\n", img->maxval);
+    write_ascii_body(img, w, f);
+  }
+
+  if (!close_image_file(f))
+    exit(EXIT_FAILURE);
 }
 
 /**
- * Compute the brightness of the image @p `img`.
+ * Write the image @p `img` to file at @p `filename` in the portable pixmap (P3)
+ * format, or in the QOI format if @p `filename` ends with `.qoi`. See
+ * http://en.wikipedia.org/wiki/Netpbm_format for details on the file format.
+ */
+void image_write_to_file(struct image *img, const char *filename) {
+  enum image_format const format =
+      qoi_is_filename(filename) ? IMAGE_FORMAT_QOI : IMAGE_FORMAT_P3;
+  image_write_to_file_format(img, filename, format, img->w);
+}
+
+/**
+ * Compute the brightness of the image @p `img`. For images with a maximum
+ * value other than 255, the brightness is scaled to the range 0 to 255. RGB
+ * pixels are summed with the brightness kernel of `kernels_active`.
  */
 uint8_t image_brightness(struct image *img) {
   // TODO implement (assignment 3.1)
   uint64_t total = 0;
   int size = img->w * img->h;
 
-  for (int i = 0; i < size; i++) {
-    struct pixel p = img->pixels[i];
+  if (size == 0) {
+    return 0;
+  }
+
+  switch (img->type) {
+  case PIXEL_GRAY8:
+    for (int i = 0; i < size; i++)
+      total += img->gray[i];
+    break;
+  case PIXEL_GRAY16:
+    for (int i = 0; i < size; i++)
+      total += img->gray16[i];
+    break;
+  case PIXEL_RGB16:
+    for (int i = 0; i < size; i++) {
+      struct pixel16 p = img->pixels16[i];
+      total += (p.r + p.g + p.b) / 3;
+    }
+    break;
+  case PIXEL_RGBX8:
+    for (int i = 0; i < size; i++) {
+      struct pixelx p = img->pixelsx[i];
+      total += (p.r + p.g + p.b) / 3;
+    }
+    break;
+  case PIXEL_PLANAR8:
+    for (int i = 0; i < size; i++) {
+      uint8_t const *const r = &img->planes[i];
+      total += (r[0] + r[size] + r[2 * size]) / 3;
+    }
+    break;
+  default:
+    if (kernels_active()->brightness_sum_rgb8 != NULL) {
+      total = kernels_active()->brightness_sum_rgb8(img->pixels, size);
+      break;
+    }
+    for (int i = 0; i < size; i++) {
+      struct pixel p = img->pixels[i];
 
-    uint8_t brightness = (p.r + p.g + p.b) / 3;
+      uint8_t brightness = (p.r + p.g + p.b) / 3;
 
-    total += brightness;
+      total += brightness;
+    }
   }
-  if (size == 0) {
-    return total;
+
+  uint64_t const mean = total / size;
+  return img->maxval == 255 ? mean : mean * 255 / img->maxval;
+}
+
+/**
+ * Carve out the path @p `seam` from the plane of bytes @p `plane` of the size
+ * of the image @p `img` like `carve_path` carves it from a graymap.
+ */
+static void carve_plane(struct image const *const img, uint8_t *const plane,
+                        int const w, uint32_t const *const seam) {
+  for (int y = 0; y < img->h; y++) {
+    int const x = seam[y];
+    uint8_t *const row = &plane[yx_index(y, 0, img->w)];
+    memmove(row + x, row + x + 1, w - 1 - x);
+    row[w - 1] = 0;
   }
-  return total / size;
 }
 
 /**
@@ -141,23 +1562,207 @@ uint8_t image_brightness(struct image *img) {
  * where only the @p `w` left columns are considered.
  * Move all pixels right of it one to the left and fill the rightmost row with
  * black (0,0,0). Columns with index >= `w` are not considered as part of the
- * image.
+ * image. Works on pixels of every type, and carves the luma plane along and
+ * updates the energy planes. Images whose compaction is deferred only have
+ * the pixels of the path recorded; see `image_defer_compaction`.
  */
 void carve_path(struct image *const img, int const w,
                 uint32_t const *const seam) {
-  // TODO implement (assignment 3.3)
-  for (int y = 0; y < img->h; y++) { // carving we go down to top so img->h
-    int x = seam[y];
+  if (img->luma != NULL && img->gaps == NULL)
+    carve_plane(img, img->luma, w, seam);
+  if (img->gaps != NULL) {
+    // the pixels stay where they are until the image is compacted
+    for (int y = 0; y < img->h; y++) {
+      uint32_t *const gaps = &img->gaps[(size_t)y * img->gap_capacity];
+      uint32_t const col = image_column(img, y, seam[y]);
+      uint32_t const gap = col - seam[y];
+      memmove(&gaps[gap + 1], &gaps[gap],
+              (img->n_gaps - gap) * sizeof(uint32_t));
+      gaps[gap] = col;
+    }
+    img->n_gaps++;
+  } else if (img->type == PIXEL_PLANAR8) {
+    // every plane is carved like a graymap
+    size_t const plane = (size_t)img->w * img->h;
+    for (int c = 0; c < 3; c++)
+      carve_plane(img, &img->planes[c * plane], w, seam);
+  } else {
+    size_t const size = pixel_size(img->type);
+    for (int y = 0; y < img->h; y++) { // carving we go down to top so img->h
+      int x = seam[y];
+      char *const row = (char *)img->pixels + (size_t)y * img->w * size;
 
-    for (int i = x; i < w - 1; i++) {
-      img->pixels[yx_index(y, i, img->w)] = img->pixels[yx_index(
-          y, i + 1,
-          img->w)]; // shift to left i.e. img->w, till second last w-1
+      // shift to left, till second last w-1
+      memmove(row + x * size, row + (x + 1) * size, (w - 1 - x) * size);
+      memset(row + (w - 1) * size, 0, size); // fill the last column with black
+    }
+  }
+  // the energy next to the seam depends on the pixels carved above
+  if (img->energy != NULL)
+    energy_carve_plane(img, w, seam);
+  if (img->gaps != NULL && img->n_gaps == img->gap_capacity)
+    image_compact(img);
+}
+
+/**
+ * Carve out @p `k` columns of every row from the plane of @p `size`-byte pixels
+ * @p `pixels` of the size of the image @p `img`, where only the @p `w` left
+ * columns are considered, in one sweep over every row: the pixels between the
+ * columns are moved to the left by the number of columns left of them. Column
+ * `j` of row `y` is `cols[j * path_stride + y * row_stride]`, and the columns
+ * of a row are ordered from left to right.
+ */
+static void carve_rows(struct image const *const img, char *const pixels,
+                       size_t const size, int const w, int const k,
+                       uint32_t const *const cols, size_t const path_stride,
+                       size_t const row_stride) {
+  for (int y = 0; y < img->h; y++) {
+    char *const row = pixels + (size_t)y * img->w * size;
+    uint32_t const *const col = &cols[y * row_stride];
+    for (int j = 0; j < k; j++) {
+      int const from = col[j * path_stride] + 1;
+      int const to = j + 1 < k ? (int)col[(j + 1) * path_stride] : w;
+      memmove(row + (from - j - 1) * size, row + from * size,
+              (to - from) * size);
     }
-    struct pixel *black =
-        &img->pixels[yx_index(y, w - 1, img->w)]; // filling her up, so we use &
-    black->r = 0;
-    black->b = 0;
-    black->g = 0;
+    memset(row + (w - k) * size, 0, k * size);
   }
 }
+
+/**
+ * Carve @p `k` columns of every row out of the pixels of @p `img` and its luma
+ * plane like `carve_rows`.
+ */
+static void carve_pixel_rows(struct image *const img, int const w, int const k,
+                             uint32_t const *const cols,
+                             size_t const path_stride,
+                             size_t const row_stride) {
+  if (img->luma != NULL)
+    carve_rows(img, (char *)img->luma, 1, w, k, cols, path_stride,
+               row_stride);
+  if (img->type == PIXEL_PLANAR8) {
+    size_t const plane = (size_t)img->w * img->h;
+    for (int c = 0; c < 3; c++)
+      carve_rows(img, (char *)&img->planes[c * plane], 1, w, k, cols,
+                 path_stride, row_stride);
+  } else {
+    carve_rows(img, (char *)img->pixels, pixel_size(img->type), w, k, cols,
+               path_stride, row_stride);
+  }
+}
+
+/**
+ * Carve out the @p `k` paths @p `seams` from the image @p `img`, where only the
+ * @p `w` left columns are considered, like `carve_path` carves them one after
+ * another, but in a single pass over the pixels. The paths are stored one
+ * after another, take different pixels and are ordered from left to right in
+ * every row, as `find_seams` finds them. Images with energy planes, which are
+ * updated seam by seam, have the paths carved one after another.
+ */
+void carve_paths(struct image *const img, int const w, int const k,
+                 uint32_t const *const seams) {
+  if (k == 1) {
+    carve_path(img, w, seams);
+    return;
+  }
+  if (img->energy != NULL) {
+    uint32_t *const seam = malloc(img->h * sizeof(uint32_t));
+    if (!seam) {
+      fprintf(stderr, "Memory allocation failed for seam\n");
+      exit(EXIT_FAILURE);
+    }
+    // every path left of another one moves it to the left by one column
+    for (int j = 0; j < k; j++) {
+      for (int y = 0; y < img->h; y++)
+        seam[y] = seams[(size_t)j * img->h + y] - j;
+      carve_path(img, w - j, seam);
+    }
+    free(seam);
+    return;
+  }
+  carve_pixel_rows(img, w, k, seams, img->h, 1);
+}
+
+/**
+ * Defer the compaction of @p `img` until `carve_path` has carved
+ * @p `capacity` paths out of it: rather than moving the pixels right of a
+ * path to the left, it records the columns the path takes in `gaps`, and
+ * `image_column` finds where a pixel is while they are there. `find_seam`
+ * compacts images without energy planes before it reads whole rows of
+ * pixels. Call `image_compact` before reading the pixels.
+ */
+void image_defer_compaction(struct image *const img, uint32_t const capacity) {
+  if (img->gaps != NULL || capacity == 0)
+    return;
+  img->gaps = malloc((size_t)img->h * capacity * sizeof(uint32_t));
+  if (!img->gaps) {
+    fprintf(stderr, "Memory allocation failed for gaps\n");
+    exit(EXIT_FAILURE);
+  }
+  img->gap_capacity = capacity;
+  img->n_gaps = 0;
+}
+
+/**
+ * Return the column of the pixels (and of the luma plane) of @p `img` where
+ * the pixel in column @p `x` of row @p `y` is while its compaction is
+ * deferred: @p `x` plus the number of carved pixels left of it.
+ */
+uint32_t image_column(struct image const *const img, uint32_t const y,
+                      uint32_t const x) {
+  if (img->gaps == NULL)
+    return x;
+  uint32_t const *const gaps = &img->gaps[(size_t)y * img->gap_capacity];
+  // `gaps[j] - j` grows with `j`, and is at most `x` for the gaps left of it
+  uint32_t lo = 0, hi = img->n_gaps;
+  while (lo < hi) {
+    uint32_t const mid = lo + (hi - lo) / 2;
+    if (gaps[mid] - mid <= x)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return x + lo;
+}
+
+/**
+ * Store the columns of the pixels (and of the luma plane) of @p `img` where the
+ * @p `n` pixels from column @p `x` of row @p `y` on are while its compaction
+ * is deferred in @p `cols`, like `image_column` does for a single pixel.
+ */
+void image_columns(struct image const *const img, uint32_t const y,
+                   uint32_t const x, uint32_t const n, uint32_t *const cols) {
+  if (n == 0)
+    return;
+  uint32_t col = image_column(img, y, x);
+  cols[0] = col;
+  if (img->gaps == NULL) {
+    for (uint32_t i = 1; i < n; i++)
+      cols[i] = col + i;
+    return;
+  }
+  uint32_t const *const gaps = &img->gaps[(size_t)y * img->gap_capacity];
+  // the gaps right of the first pixel
+  uint32_t j = col - x;
+  for (uint32_t i = 1; i < n; i++) {
+    col++;
+    while (j < img->n_gaps && gaps[j] == col) {
+      col++;
+      j++;
+    }
+    cols[i] = col;
+  }
+}
+
+/**
+ * Compact @p `img` if its compaction is deferred: carve the pixels recorded
+ * in `gaps` out of the pixels and the luma plane in one sweep over every row,
+ * with the result of `carve_path` without deferring. The compaction stays
+ * deferred for the next paths.
+ */
+void image_compact(struct image *const img) {
+  if (img->gaps == NULL || img->n_gaps == 0)
+    return;
+  carve_pixel_rows(img, img->w, img->n_gaps, img->gaps, 1, img->gap_capacity);
+  img->n_gaps = 0;
+}
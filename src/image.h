@@ -1,6 +1,7 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -12,43 +13,266 @@ struct pixel {
     uint8_t r, g, b;
 };
 
+_Static_assert(sizeof(struct pixel) == 3,
+               "pixels are read and written as packed RGB triples");
+
+/**
+ * A pixel of an image with more than 8 bits per channel is represented by
+ * three `uint16_t` (0-65535) values for red (`r`), green (`g`) and blue (`b`).
+ */
+struct pixel16 {
+    uint16_t r, g, b;
+};
+
+_Static_assert(sizeof(struct pixel16) == 6,
+               "pixels are read and written as packed RGB triples");
+
+/**
+ * An 8-bit RGB pixel padded to four bytes, so that every pixel fills one
+ * aligned 32-bit lane. The padding sample `x` is always zero.
+ */
+struct pixelx {
+    uint8_t r, g, b, x;
+};
+
+_Static_assert(sizeof(struct pixelx) == 4,
+               "padded pixels fill exactly one 32-bit lane");
+
+/**
+ * The formats an image can be written as: portable pixmaps with ASCII (`P3`)
+ * or binary (`P6`) samples, or the compressed Quite OK Image format (`QOI`).
+ * Grayscale images are written as the corresponding graymap variants `P2` and
+ * `P5`, and as RGB in QOI.
+ */
+enum image_format {
+    IMAGE_FORMAT_P3,
+    IMAGE_FORMAT_P6,
+    IMAGE_FORMAT_QOI,
+};
+
+/**
+ * The types of pixels an image can hold: RGB triples (`struct pixel`) or
+ * single `uint8_t` gray values, and their 16-bit counterparts for images with
+ * a maximum value above 255. 8-bit RGB images can also be stored in one of two
+ * other layouts: padded to four bytes per pixel (`PIXEL_RGBX8`, see
+ * `struct pixelx`) or planar (`PIXEL_PLANAR8`), i.e. all red samples, then all
+ * green samples, then all blue samples, each plane holding `w * h` samples in
+ * rows. Images are read as `PIXEL_RGB8` and converted with `image_convert`.
+ */
+enum pixel_type {
+    PIXEL_RGB8,
+    PIXEL_GRAY8,
+    PIXEL_RGB16,
+    PIXEL_GRAY16,
+    PIXEL_RGBX8,
+    PIXEL_PLANAR8,
+};
+
 /**
  * An image contains its width `w`, its height `h` and an array that holds its
- * pixels, row by row.
+ * pixels, row by row. Depending on the pixel `type`, the array is accessed as
+ * `pixels`, `gray`, `pixels16`, `gray16`, `pixelsx` or, for the three planes,
+ * `planes`. `maxval` is the maximum value of
+ * a sample as stated in the image file.
+ * If the pixels live inside a private mapping of the image file, `map` and
+ * `map_size` describe that mapping, otherwise `map` is NULL.
+ * If `luma` is not NULL, it holds the 8-bit luma of every pixel in `w * h`
+ * samples, and the energy is calculated on it instead of on the pixels; see
+ * `image_add_luma`.
+ * If `energy` is not NULL, it holds the local gradient energy of every pixel
+ * of an 8-bit image in `w * h` entries and `total`, unless it is NULL, its
+ * total energy, which `carve_path` keeps up to date for the `energy_w` left
+ * columns; see `energy_add_plane`.
+ * If `gaps` is not NULL, the compaction of the image is deferred: the pixels
+ * that the last `n_gaps` paths took are still in the pixels and the luma
+ * plane, and `gaps` holds their columns, from left to right, in
+ * `gap_capacity` entries per row; see `image_defer_compaction`.
  */
 struct image {
     uint32_t w, h;
-    struct pixel* pixels;
+    union {
+        struct pixel* pixels;
+        uint8_t* gray;
+        struct pixel16* pixels16;
+        uint16_t* gray16;
+        struct pixelx* pixelsx;
+        uint8_t* planes;
+    };
+    enum pixel_type type;
+    uint16_t maxval;
+    void* map;
+    size_t map_size;
+    uint8_t* luma;
+    uint32_t* energy;
+    uint32_t* total;
+    uint32_t energy_w;
+    uint32_t* gaps;
+    uint32_t n_gaps;
+    uint32_t gap_capacity;
 };
 
+/**
+ * Return the size in bytes of a pixel of type @p `type`. The three samples of
+ * a planar pixel are not adjacent, but still take three bytes.
+ */
+size_t pixel_size(enum pixel_type type);
+
+/**
+ * Return the number of samples of a pixel of type @p `type`, i.e. 1 for gray
+ * and 3 for RGB pixels.
+ */
+int pixel_channels(enum pixel_type type);
+
+/**
+ * Return whether @p `type` is one of the 8-bit RGB layouts.
+ */
+bool pixel_is_rgb8(enum pixel_type type);
+
+/**
+ * Return the pixel type called @p `name`: `packed` (`PIXEL_RGB8`), `rgbx`
+ * (`PIXEL_RGBX8`) or `planar` (`PIXEL_PLANAR8`). Returns false if there is
+ * none.
+ */
+bool pixel_layout_find(char const* name, enum pixel_type* type);
+
 /**
  * Initialize the image @p `img` with width @p `w` and height @p `h`.
  */
 struct image* image_init(int w, int h);
 
 /**
- * Destroy the image @p `img` by freeing its pixels field and by freeing @p
- * `img` itself. Don't use @p img afterwards.
+ * Initialize the image @p `img` with width @p `w`, height @p `h` and pixels of
+ * type @p `type`, all set to zero. The maximum value is 255 for 8-bit and
+ * 65535 for 16-bit pixel types.
+ */
+struct image* image_init_type(int w, int h, enum pixel_type type);
+
+/**
+ * Destroy the image @p `img` by freeing (or unmapping) its pixels field and by
+ * freeing @p `img` itself. Don't use @p img afterwards.
  */
 void image_destroy(struct image* img);
 
 /**
- * Read an image from the file at @p `filename` in the portable pixmap (P3)
- * format. See http://en.wikipedia.org/wiki/Netpbm_format for details on the
- * file format.
+ * Return the @p `w` left pixels of row @p `y` of the 8-bit RGB image @p `img`
+ * as packed pixels, converted into @p `tmp` unless the image already stores
+ * them that way.
+ */
+struct pixel const* image_row_rgb8(struct image const* img, int y, int w,
+                                   struct pixel* tmp);
+
+/**
+ * Convert the 8-bit RGB image @p `img` to the layout @p `type`, which is one of
+ * `PIXEL_RGB8`, `PIXEL_RGBX8` and `PIXEL_PLANAR8`. Images of other types are
+ * left as they are. If the pixels were mapped, they are copied and unmapped.
+ */
+void image_convert(struct image* img, enum pixel_type type);
+
+/**
+ * Add the luma plane to the 8-bit RGB image @p `img`: the luma of every pixel,
+ * (77 R + 150 G + 29 B + 128) / 256, i.e. BT.601 in 8 bits. From then on, the
+ * energy is calculated on the luma plane like on a graymap, which reads a
+ * third of the bytes, and `carve_path` carves it along with the pixels, so it
+ * is never recomputed. Images of other types and images that already have a
+ * luma plane are left as they are.
+ */
+void image_add_luma(struct image* img);
+
+/**
+ * Read an image from the file at @p `filename` in the portable pixmap format,
+ * either ASCII (P3) or binary (P6), in the portable graymap format, either
+ * ASCII (P2) or binary (P5), or in the QOI format, detected by the magic
+ * number. If @p `filename` is `-`, the image is read from the standard input.
+ * Graymaps are read into grayscale images, and images with a maximum
+ * value above 255 into 16-bit images. See
+ * http://en.wikipedia.org/wiki/Netpbm_format and https://qoiformat.org for
+ * details on the file formats.
  * @returns the image that was read.
  */
 struct image* image_read_from_file(const char* filename);
 
+/**
+ * Set the number of threads used to decode and encode ASCII images; 0 (the
+ * default) uses one thread per online processor.
+ */
+void image_set_io_threads(int n);
+
+/**
+ * Map the binary (P6 or P5) image file at @p `filename` into memory with a
+ * private copy-on-write mapping and let the pixels of the returned image point
+ * directly into it, so that the pixels are neither copied on reading nor
+ * written back to the file on changes. Other formats, 16-bit images whose
+ * big-endian samples have to be converted anyway, and the standard input
+ * (`-`) are read with `image_read_from_file`.
+ * @returns the image that was mapped.
+ */
+struct image* image_map_file(const char* filename);
+
+/**
+ * An image that is read one row at a time, so that only two of its rows are
+ * held in memory.
+ */
+struct image_stream;
+
+/**
+ * Open the image file at @p `filename` (`-` for the standard input) in any of
+ * the formats `image_read_from_file` reads, but only read its header, so that
+ * its rows can be read one at a time with `image_stream_read_row`. Ends the
+ * execution if the header is invalid.
+ */
+struct image_stream* image_stream_open(const char* filename);
+
+/**
+ * Return the image of the width and pixel type of the stream @p `s` that
+ * holds the last two rows read: the row read last is its row 1, the one
+ * before its row 0.
+ */
+struct image* image_stream_window(struct image_stream* s);
+
+/**
+ * Return the height of the whole image streamed by @p `s`.
+ */
+uint32_t image_stream_height(struct image_stream const* s);
+
+/**
+ * Read the next row of the image streamed by @p `s` into its window. The
+ * first row is read into row 0 of the window; every later row is read into
+ * row 1, after the row there has been moved to row 0. Ends the execution if
+ * the row is malformed or missing.
+ * @returns the index of the row in the window.
+ */
+int image_stream_read_row(struct image_stream* s);
+
+/**
+ * Close the stream @p `s`, whose rows have to have been read completely.
+ * Ends the execution if anything but whitespace (for ASCII samples) follows
+ * the last row.
+ */
+void image_stream_close(struct image_stream* s);
+
 /**
  * Write the image @p `img` to file at @p `filename` in the portable pixmap (P3)
- * format. See http://en.wikipedia.org/wiki/Netpbm_format for details on the
- * file format.
+ * format, or in the QOI format if @p `filename` ends with `.qoi`. See
+ * http://en.wikipedia.org/wiki/Netpbm_format for details on the file format.
  */
 void image_write_to_file(struct image* img, const char* filename);
 
 /**
- * Compute the brightness of the image @p `img`.
+ * Write the image @p `img` to file at @p `filename` in the format @p `format`,
+ * i.e. either ASCII (P3) or binary (P6) portable pixmap or QOI; grayscale
+ * images are written as graymaps (P2 or P5), with the maximum value of the
+ * image, and as RGB in QOI.
+ * Only the @p `w` left columns are written, so the result is @p `w` pixels
+ * wide. If @p `filename` is `-`, the image is written to the standard output.
+ * See http://en.wikipedia.org/wiki/Netpbm_format for details on the
+ * file format.
+ */
+void image_write_to_file_format(struct image* img, const char* filename,
+                                enum image_format format, int w);
+
+/**
+ * Compute the brightness of the image @p `img`, scaled to the range 0-255 for
+ * images with a maximum value other than 255.
  */
 uint8_t image_brightness(struct image* img);
 
@@ -57,8 +281,60 @@ uint8_t image_brightness(struct image* img);
  * where only the @p `w` left columns are considered.
  * Move all pixels right of it one to the left and fill the rightmost row with
  * black (0,0,0). Columns with index >= `w` are not considered as part of the
- * image.
+ * image. Works on pixels of every type, and carves the luma plane along and
+ * updates the energy planes. Images whose compaction is deferred only have
+ * the pixels of the path recorded; see `image_defer_compaction`.
  */
 void carve_path(struct image* image, int w, uint32_t const* seam);
 
+/**
+ * The number of paths carved out of an image with a pyramid before it is
+ * compacted; see `image_defer_compaction` and `pyramid_init`.
+ */
+#ifndef COMPACTION_SEAMS
+#define COMPACTION_SEAMS 64
+#endif
+
+/**
+ * Defer the compaction of @p `img` until `carve_path` has carved
+ * @p `capacity` paths out of it: rather than moving the pixels right of a
+ * path to the left, it records the columns the path takes in `gaps`, and
+ * `image_column` finds where a pixel is while they are there. `find_seam`
+ * compacts images without energy planes before it reads whole rows of
+ * pixels. Call `image_compact` before reading the pixels.
+ */
+void image_defer_compaction(struct image* img, uint32_t capacity);
+
+/**
+ * Return the column of the pixels (and of the luma plane) of @p `img` where
+ * the pixel in column @p `x` of row @p `y` is while its compaction is
+ * deferred: @p `x` plus the number of carved pixels left of it.
+ */
+uint32_t image_column(struct image const* img, uint32_t y, uint32_t x);
+
+/**
+ * Store the columns of the pixels (and of the luma plane) of @p `img` where the
+ * @p `n` pixels from column @p `x` of row @p `y` on are while its compaction
+ * is deferred in @p `cols`, like `image_column` does for a single pixel.
+ */
+void image_columns(struct image const* img, uint32_t y, uint32_t x, uint32_t n,
+                   uint32_t* cols);
+
+/**
+ * Compact @p `img` if its compaction is deferred: carve the pixels recorded
+ * in `gaps` out of the pixels and the luma plane in one sweep over every row,
+ * with the result of `carve_path` without deferring. The compaction stays
+ * deferred for the next paths.
+ */
+void image_compact(struct image* img);
+
+/**
+ * Carve out the @p `k` paths @p `seams` from the image @p `img`, where only the
+ * @p `w` left columns are considered, like `carve_path` carves them one after
+ * another, but in a single pass over the pixels. The paths are stored one
+ * after another, take different pixels and are ordered from left to right in
+ * every row, as `find_seams` finds them.
+ */
+void carve_paths(struct image* img, int w, int k, uint32_t const* seams);
+
 #endif
@@ -0,0 +1,139 @@
+#include "image_simd.h"
+
+#if ENERGY_SIMD_X86
+
+#include <immintrin.h>
+
+/**
+ * The `pshufb` mask that spreads the 12 bytes of four RGB pixels to four
+ * bytes per pixel with a zero fourth byte, so that `pmaddubsw` and `pmaddwd`
+ * sum the samples of each pixel into a 32-bit lane.
+ */
+#define SPREAD_RGB0 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1
+
+/**
+ * Dividing the sum of three samples, at most 765, by 3 is the same as
+ * multiplying it with `BRIGHTNESS_DIV3` and shifting it right by 17 bits.
+ */
+#define BRIGHTNESS_DIV3 43691
+
+/**
+ * The number of vectors whose brightness is summed in 32-bit lanes before the
+ * lanes are added to the 64-bit total; each vector adds at most 255 per lane.
+ */
+#define BRIGHTNESS_BLOCK (1 << 20)
+
+/**
+ * Return the brightness of the pixels from index @p `i` up to @p `n` one at a
+ * time.
+ */
+static inline uint64_t brightness_tail(struct pixel const *const pixels,
+                                       size_t i, size_t const n) {
+  uint64_t total = 0;
+  for (; i < n; i++)
+    total += (pixels[i].r + pixels[i].g + pixels[i].b) / 3;
+  return total;
+}
+
+/**
+ * Return the brightness of the four pixels in the first 12 bytes of @p `v`.
+ */
+__attribute__((target("sse4.1"))) static inline __m128i
+brightness4(__m128i const v) {
+  __m128i const spread = _mm_shuffle_epi8(v, _mm_setr_epi8(SPREAD_RGB0));
+  __m128i const pairs = _mm_maddubs_epi16(spread, _mm_set1_epi8(1));
+  __m128i const sum = _mm_madd_epi16(pairs, _mm_set1_epi16(1));
+  return _mm_srli_epi32(_mm_mullo_epi32(sum, _mm_set1_epi32(BRIGHTNESS_DIV3)),
+                        17);
+}
+
+/**
+ * Return the sum of the brightness of the @p `n` RGB pixels at @p `pixels`,
+ * four pixels at a time with SSE4.1.
+ */
+__attribute__((target("sse4.1"))) uint64_t
+brightness_sum_rgb8_sse41(struct pixel const *const pixels, size_t const n) {
+  uint8_t const *const p = (uint8_t const *)pixels;
+  uint64_t total = 0;
+  size_t i = 0;
+  // the loads read 16 bytes, one pixel and a byte more than the four pixels
+  while (i + 6 <= n) {
+    __m128i acc = _mm_setzero_si128();
+    for (size_t k = 0; k < BRIGHTNESS_BLOCK && i + 6 <= n; k++, i += 4)
+      acc = _mm_add_epi32(
+          acc, brightness4(_mm_loadu_si128((__m128i const *)(p + 3 * i))));
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    total += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+  return total + brightness_tail(pixels, i, n);
+}
+
+/**
+ * Return the sum of the brightness of the @p `n` RGB pixels at @p `pixels`,
+ * eight pixels at a time with AVX2.
+ */
+__attribute__((target("avx2"))) uint64_t
+brightness_sum_rgb8_avx2(struct pixel const *const pixels, size_t const n) {
+  uint8_t const *const p = (uint8_t const *)pixels;
+  __m256i const spread = _mm256_setr_epi8(SPREAD_RGB0, SPREAD_RGB0);
+  __m256i const div3 = _mm256_set1_epi32(BRIGHTNESS_DIV3);
+  uint64_t total = 0;
+  size_t i = 0;
+  // the upper lane reads one pixel and a byte more than the eight pixels
+  while (i + 10 <= n) {
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t k = 0; k < BRIGHTNESS_BLOCK && i + 10 <= n; k++, i += 8) {
+      __m256i const v = _mm256_inserti128_si256(
+          _mm256_castsi128_si256(
+              _mm_loadu_si128((__m128i const *)(p + 3 * i))),
+          _mm_loadu_si128((__m128i const *)(p + 3 * i + 12)), 1);
+      __m256i const pairs = _mm256_maddubs_epi16(
+          _mm256_shuffle_epi8(v, spread), _mm256_set1_epi8(1));
+      __m256i const sum = _mm256_madd_epi16(pairs, _mm256_set1_epi16(1));
+      acc = _mm256_add_epi32(
+          acc, _mm256_srli_epi32(_mm256_mullo_epi32(sum, div3), 17));
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    for (int j = 0; j < 8; j++)
+      total += lanes[j];
+  }
+  return total + brightness_tail(pixels, i, n);
+}
+
+/**
+ * Return the sum of the brightness of the @p `n` RGB pixels at @p `pixels`,
+ * sixteen pixels at a time with AVX-512.
+ */
+__attribute__((target("avx512f,avx512bw"))) uint64_t
+brightness_sum_rgb8_avx512(struct pixel const *const pixels, size_t const n) {
+  uint8_t const *const p = (uint8_t const *)pixels;
+  __m512i const spread = _mm512_broadcast_i32x4(_mm_setr_epi8(SPREAD_RGB0));
+  __m512i const div3 = _mm512_set1_epi32(BRIGHTNESS_DIV3);
+  uint64_t total = 0;
+  size_t i = 0;
+  // the upper lane reads one pixel and a byte more than the sixteen pixels
+  while (i + 18 <= n) {
+    __m512i acc = _mm512_setzero_si512();
+    for (size_t k = 0; k < BRIGHTNESS_BLOCK && i + 18 <= n; k++, i += 16) {
+      uint8_t const *const q = p + 3 * i;
+      __m512i v = _mm512_castsi128_si512(_mm_loadu_si128((__m128i const *)q));
+      v = _mm512_inserti32x4(v, _mm_loadu_si128((__m128i const *)(q + 12)), 1);
+      v = _mm512_inserti32x4(v, _mm_loadu_si128((__m128i const *)(q + 24)), 2);
+      v = _mm512_inserti32x4(v, _mm_loadu_si128((__m128i const *)(q + 36)), 3);
+      __m512i const pairs = _mm512_maddubs_epi16(
+          _mm512_shuffle_epi8(v, spread), _mm512_set1_epi8(1));
+      __m512i const sum = _mm512_madd_epi16(pairs, _mm512_set1_epi16(1));
+      acc = _mm512_add_epi32(
+          acc, _mm512_srli_epi32(_mm512_mullo_epi32(sum, div3), 17));
+    }
+    uint32_t lanes[16];
+    _mm512_storeu_si512(lanes, acc);
+    for (int j = 0; j < 16; j++)
+      total += lanes[j];
+  }
+  return total + brightness_tail(pixels, i, n);
+}
+
+#endif
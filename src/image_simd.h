@@ -0,0 +1,30 @@
+#ifndef IMAGE_SIMD_H
+#define IMAGE_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "energy_simd.h"
+#include "image.h"
+
+#if ENERGY_SIMD_X86
+
+/**
+ * Return the sum of the brightness `(r + g + b) / 3` of the @p `n` RGB pixels
+ * at @p `pixels`, rounded down per pixel like `image_brightness`. Uses SSE4.1.
+ */
+uint64_t brightness_sum_rgb8_sse41(struct pixel const* pixels, size_t n);
+
+/**
+ * Like `brightness_sum_rgb8_sse41`, but uses AVX2.
+ */
+uint64_t brightness_sum_rgb8_avx2(struct pixel const* pixels, size_t n);
+
+/**
+ * Like `brightness_sum_rgb8_sse41`, but uses AVX-512 (F and BW).
+ */
+uint64_t brightness_sum_rgb8_avx512(struct pixel const* pixels, size_t n);
+
+#endif
+
+#endif
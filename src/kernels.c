@@ -0,0 +1,155 @@
+#include "kernels.h"
+
+#include <string.h>
+
+#include "energy_simd.h"
+#include "image_simd.h"
+
+/**
+ * The kernels of every instruction set, indexed by `enum kernel_isa`. The
+ * SIMD sets are empty unless we compile for x86.
+ */
+static struct kernels const kernel_sets[KERNEL_COUNT] = {
+    [KERNEL_SCALAR] = {.name = "scalar"},
+#if ENERGY_SIMD_X86
+    [KERNEL_SSE41] =
+        {
+            .name = "sse4.1",
+            .local_energy_row_rgb8 = local_energy_row_rgb8_sse41,
+            .local_energy_row_rgbx8 = local_energy_row_rgbx8_sse41,
+            .local_energy_row_planar8 = local_energy_row_planar8_sse41,
+            .local_energy_row_gray8 = local_energy_row_gray8_sse41,
+            .local_energy_row_rgb16 = local_energy_row_rgb16_sse41,
+            .local_energy_row_gray16 = local_energy_row_gray16_sse41,
+            .cumulative_row_u32 = cumulative_row_u32_sse41,
+            .cumulative_row_min_u32 = cumulative_row_min_u32_sse41,
+            .cumulative_row_dir_u32 = cumulative_row_dir_u32_sse41,
+            .cumulative_row_dir_u16 = cumulative_row_dir_u16_sse41,
+            .cumulative_row_dir_u64 = cumulative_row_dir_u64_sse41,
+            .brightness_sum_rgb8 = brightness_sum_rgb8_sse41,
+        },
+    [KERNEL_AVX2] =
+        {
+            .name = "avx2",
+            .local_energy_row_rgb8 = local_energy_row_rgb8_avx2,
+            .local_energy_row_rgbx8 = local_energy_row_rgbx8_avx2,
+            .local_energy_row_planar8 = local_energy_row_planar8_avx2,
+            .local_energy_row_gray8 = local_energy_row_gray8_avx2,
+            .local_energy_row_rgb16 = local_energy_row_rgb16_avx2,
+            .local_energy_row_gray16 = local_energy_row_gray16_avx2,
+            .cumulative_row_u32 = cumulative_row_u32_avx2,
+            .cumulative_row_min_u32 = cumulative_row_min_u32_avx2,
+            .cumulative_row_dir_u32 = cumulative_row_dir_u32_avx2,
+            .cumulative_row_dir_u16 = cumulative_row_dir_u16_avx2,
+            .cumulative_row_dir_u64 = cumulative_row_dir_u64_avx2,
+            .brightness_sum_rgb8 = brightness_sum_rgb8_avx2,
+        },
+    [KERNEL_AVX512] =
+        {
+            .name = "avx512",
+            .local_energy_row_rgb8 = local_energy_row_rgb8_avx512,
+            .local_energy_row_rgbx8 = local_energy_row_rgbx8_avx512,
+            .local_energy_row_planar8 = local_energy_row_planar8_avx512,
+            .local_energy_row_gray8 = local_energy_row_gray8_avx512,
+            .local_energy_row_rgb16 = local_energy_row_rgb16_avx512,
+            .local_energy_row_gray16 = local_energy_row_gray16_avx512,
+            .cumulative_row_u32 = cumulative_row_u32_avx512,
+            .cumulative_row_min_u32 = cumulative_row_min_u32_avx512,
+            .cumulative_row_dir_u32 = cumulative_row_dir_u32_avx512,
+            .cumulative_row_dir_u16 = cumulative_row_dir_u16_avx512,
+            .cumulative_row_dir_u64 = cumulative_row_dir_u64_avx512,
+            .brightness_sum_rgb8 = brightness_sum_rgb8_avx512,
+        },
+#else
+    [KERNEL_SSE41] = {.name = "sse4.1"},
+    [KERNEL_AVX2] = {.name = "avx2"},
+    [KERNEL_AVX512] = {.name = "avx512"},
+#endif
+};
+
+/**
+ * The kernels in use, or NULL until the first call of `kernels_active` or
+ * `kernels_select`.
+ */
+static struct kernels const *active = NULL;
+
+/**
+ * Return whether the CPU supports the instruction set @p `isa`. This queries
+ * the CPU features that the runtime read with `cpuid` once at startup.
+ */
+static bool kernels_supported(enum kernel_isa const isa) {
+  switch (isa) {
+  case KERNEL_SCALAR:
+    return true;
+#if ENERGY_SIMD_X86
+  case KERNEL_SSE41:
+    return __builtin_cpu_supports("sse4.1");
+  case KERNEL_AVX2:
+    return __builtin_cpu_supports("avx2");
+  case KERNEL_AVX512:
+    return __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512bw");
+#endif
+  default:
+    return false;
+  }
+}
+
+/**
+ * Return the instruction set called @p `name` (`scalar`, `sse4.1`, `avx2` or
+ * `avx512`), `KERNEL_AUTO` for `auto`, or `KERNEL_COUNT` if there is none.
+ */
+enum kernel_isa kernels_find(char const *const name) {
+  if (strcmp(name, "auto") == 0)
+    return KERNEL_AUTO;
+  for (int isa = 0; isa < KERNEL_COUNT; isa++) {
+    if (strcmp(name, kernel_sets[isa].name) == 0)
+      return isa;
+  }
+  return KERNEL_COUNT;
+}
+
+/**
+ * Return the name of the instruction set @p `isa`, as accepted by
+ * `kernels_find`.
+ */
+char const *kernels_name(enum kernel_isa const isa) {
+  return isa == KERNEL_AUTO ? "auto" : kernel_sets[isa].name;
+}
+
+/**
+ * Return the kernels for the instruction set @p `isa`, or NULL if the CPU does
+ * not support it.
+ */
+struct kernels const *kernels_get(enum kernel_isa const isa) {
+  return kernels_supported(isa) ? &kernel_sets[isa] : NULL;
+}
+
+/**
+ * Use the kernels for the instruction set @p `isa` from now on, or the best
+ * ones the CPU supports for `KERNEL_AUTO`.
+ * @returns false if the CPU does not support @p `isa`.
+ */
+bool kernels_select(enum kernel_isa const isa) {
+  if (isa == KERNEL_AUTO) {
+    int best = KERNEL_COUNT - 1;
+    while (!kernels_supported(best))
+      best--;
+    active = &kernel_sets[best];
+    return true;
+  }
+  if (!kernels_supported(isa))
+    return false;
+  active = &kernel_sets[isa];
+  return true;
+}
+
+/**
+ * Return the kernels in use. Unless some were selected with `kernels_select`,
+ * the best ones the CPU supports are selected on the first call.
+ */
+struct kernels const *kernels_active(void) {
+  if (active == NULL)
+    kernels_select(KERNEL_AUTO);
+  return active;
+}
@@ -0,0 +1,106 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "image.h"
+
+/**
+ * The instruction sets the hot kernels are available for. `KERNEL_AUTO`
+ * stands for the best one the CPU supports, `KERNEL_COUNT` for none.
+ */
+enum kernel_isa {
+    KERNEL_AUTO = -1,
+    KERNEL_SCALAR,
+    KERNEL_SSE41,
+    KERNEL_AVX2,
+    KERNEL_AVX512,
+    KERNEL_COUNT,
+};
+
+/**
+ * The hot kernels compiled for one instruction set:
+ * - `local_energy_row_rgb8` calculates the local energy of an RGB row, see
+ *   `local_energy_row_rgb8_sse41`,
+ * - `local_energy_row_rgbx8` and `local_energy_row_planar8` do the same for
+ *   the padded and the planar layout, see `local_energy_row_rgbx8_sse41`,
+ *   and `local_energy_row_gray8` for graymaps and luma planes, see
+ *   `local_energy_row_gray8_sse41`,
+ * - `local_energy_row_rgb16` and `local_energy_row_gray16` do the same for
+ *   16-bit rows with 64-bit energies, see `local_energy_row_rgb16_sse41`,
+ * - `cumulative_row_u32` and `cumulative_row_min_u32` add the least
+ *   neighbours of the row above to an energy row, see
+ *   `cumulative_row_u32_sse41`,
+ * - `cumulative_row_dir_u32` does the same and records which neighbour each
+ *   entry took in two bit planes, see `cumulative_row_dir_u32_sse41`,
+ * - `cumulative_row_dir_u16` does the same on 16-bit rows relative to their
+ *   least entry, see `cumulative_row_dir_u16_sse41`, and
+ *   `cumulative_row_dir_u64` on 64-bit rows, see
+ *   `cumulative_row_dir_u64_sse41`,
+ * - `brightness_sum_rgb8` sums the brightness of RGB pixels, see
+ *   `brightness_sum_rgb8_sse41`.
+ * A NULL kernel means that the caller runs its own scalar code instead, which
+ * is all the scalar set consists of. Carving has no kernels, since `memmove`
+ * already picks the best way to copy for the CPU.
+ */
+struct kernels {
+    char const* name;
+    void (*local_energy_row_rgb8)(uint32_t* out, struct pixel const* row,
+                                  struct pixel const* above, int w);
+    void (*local_energy_row_rgbx8)(uint32_t* out, struct pixelx const* row,
+                                   struct pixelx const* above, int w);
+    void (*local_energy_row_planar8)(uint32_t* out, uint8_t const* row,
+                                     uint8_t const* above, size_t plane,
+                                     int w);
+    void (*local_energy_row_gray8)(uint32_t* out, uint8_t const* row,
+                                   uint8_t const* above, int w);
+    void (*local_energy_row_rgb16)(uint64_t* out, struct pixel16 const* row,
+                                   struct pixel16 const* above, int w);
+    void (*local_energy_row_gray16)(uint64_t* out, uint16_t const* row,
+                                    uint16_t const* above, int w);
+    void (*cumulative_row_u32)(uint32_t* row, uint32_t const* above, int w);
+    int (*cumulative_row_min_u32)(uint32_t* row, uint32_t const* above, int w);
+    void (*cumulative_row_dir_u32)(uint32_t* row, uint32_t const* above, int w,
+                                   uint8_t* left, uint8_t* right);
+    uint32_t (*cumulative_row_dir_u16)(uint16_t* row, uint32_t* local,
+                                       uint16_t const* above, int w,
+                                       uint8_t* left, uint8_t* right);
+    void (*cumulative_row_dir_u64)(uint64_t* row, uint64_t const* above, int w,
+                                   uint8_t* left, uint8_t* right);
+    uint64_t (*brightness_sum_rgb8)(struct pixel const* pixels, size_t n);
+};
+
+/**
+ * Return the instruction set called @p `name` (`scalar`, `sse4.1`, `avx2` or
+ * `avx512`), `KERNEL_AUTO` for `auto`, or `KERNEL_COUNT` if there is none.
+ */
+enum kernel_isa kernels_find(char const* name);
+
+/**
+ * Return the name of the instruction set @p `isa`, as accepted by
+ * `kernels_find`.
+ */
+char const* kernels_name(enum kernel_isa isa);
+
+/**
+ * Return the kernels for the instruction set @p `isa`, or NULL if the CPU does
+ * not support it.
+ */
+struct kernels const* kernels_get(enum kernel_isa isa);
+
+/**
+ * Use the kernels for the instruction set @p `isa` from now on, or the best
+ * ones the CPU supports for `KERNEL_AUTO`.
+ * @returns false if the CPU does not support @p `isa`.
+ */
+bool kernels_select(enum kernel_isa isa);
+
+/**
+ * Return the kernels in use. Unless some were selected with `kernels_select`,
+ * the best ones the CPU supports are selected on the first call.
+ */
+struct kernels const* kernels_active(void);
+
+#endif
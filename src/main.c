@@ -4,7 +4,10 @@
 
 #include "argparser.h"
 #include "energy.h"
+#include "energy_functions.h"
 #include "image.h"
+#include "kernels.h"
+#include "pyramid.h"
 #include "util.h"
 
 /**
@@ -22,9 +25,11 @@ void statistics(struct image *img) {
 }
 
 /**
- * Find & print the minimal path of @p `img`.
+ * Find & print the minimal path of the image at @p `filename`, on the luma of
+ * its pixels if @p `luma` is set. The image is streamed: its rows are decoded
+ * right when the energy needs them, so it is never held in memory as a whole.
  */
-void find_print_min_path(struct image *img) {
+void find_print_min_path(char const *const filename, bool const luma) {
   // TODO implement (assignment 3.2)
   /* implement and use the functions:
    * - `calculate_energy`
@@ -33,81 +38,124 @@ void find_print_min_path(struct image *img) {
    * in `energy.c`
    */
 
-  uint32_t *energy =
-      malloc(img->w * img->h * sizeof(uint32_t)); // w+y*x ->energy[h*w]
-  if (!energy) {
-    fprintf(stderr, "Memory allocation failed for energy\n");
-    exit(EXIT_FAILURE);
-  }
-  calculate_energy(energy, img, img->w); // local and total fuck
-
-  int x = calculate_min_energy_column(
-      energy, img->w, img->w,
-      img->h); // get x i.e. the index of the minimum tile
-
+  struct image_stream *const stream = image_stream_open(filename);
+  if (luma)
+    image_add_luma(image_stream_window(stream));
+  uint32_t const h = image_stream_height(stream);
   uint32_t *seam =
-      malloc(img->h * sizeof(uint32_t)); // seam[y]=x seam needs just the height
+      malloc(h * sizeof(uint32_t)); // seam[y]=x seam needs just the height
   if (!seam) {
     fprintf(stderr, "Memory allocation failed for seam\n");
-    free(energy);
     exit(EXIT_FAILURE);
   }
 
-  calculate_optimal_path(energy, img->w, img->w, img->h, x, seam);
+  find_seam_stream(stream, seam);
+  // Only print the path once the whole file turned out to be valid.
+  image_stream_close(stream);
 
-  for (int i = 0; i < img->h; i++) { // itirate over the height and not width
+  for (uint32_t i = 0; i < h; i++) { // itirate over the height and not width
                                      // as we only need vertical seam;
     printf("%u\n", seam[i]);
   }
 
-  free(energy);
   free(seam);
 }
 
 /**
- * Find & carve out @p `n` minimal paths in @p `img`.
- * The image size stays the same, instead for every carved out path there is a
- * column of black pixels appended to the right.
+ * Find & print the minimal path of @p `img`, which is read already, for
+ * energy functions that cannot stream the image.
+ */
+void print_min_path(struct image *const img) {
+  uint32_t *const seam = malloc(img->h * sizeof(uint32_t));
+  if (!seam) {
+    fprintf(stderr, "Memory allocation failed for seam\n");
+    exit(EXIT_FAILURE);
+  }
+  find_seam(img, img->w, seam);
+  for (uint32_t i = 0; i < img->h; i++)
+    printf("%u\n", seam[i]);
+  free(seam);
+}
+
+/**
+ * Report on the standard error how many of the seams found so far differed
+ * between the 16-bit and the 32-bit total energy.
+ */
+void report_seam_dp(void) {
+  size_t mismatches;
+  size_t const seams = seam_dp_verified(&mismatches);
+  fprintf(stderr, "u16 seams: %zu of %zu differ from the u32 ones\n",
+          mismatches, seams);
+}
+
+/**
+ * Find & carve out @p `n` minimal paths in @p `img` and write the result to
+ * @p `output` (`-` for the standard output) in the format @p `format`.
+ * Unless @p `trim` is set, the image size stays the same, instead for every
+ * carved out path there is a column of black pixels appended to the right.
+ * With @p `trim`, only the remaining columns are written.
+ * Up to @p `seams_per_pass` paths are found from one calculation of the
+ * energy and carved out together; see `find_seams`. With a @p `pyramid_band`
+ * other than 0, paths that are carved one at a time are found coarse to fine
+ * within bands of that many columns on either side; see `pyramid_init`.
+ * Paths found along the energy planes leave the pixels in place for up to
+ * @p `defer_seams` paths before the image is compacted; see
+ * `image_defer_compaction`.
  */
-void find_and_carve_path(struct image *const img, int n) {
+void find_and_carve_path(struct image *const img, int n,
+                         char const *const output,
+                         enum image_format const format, bool const trim,
+                         int const seams_per_pass, int const pyramid_band,
+                         int const defer_seams) {
   // TODO implement (assignment 3.3)
   /* implement and use the functions from assignment 3.2 and:
    * - `carve_path`
    * - `image_write_to_file`
    * in `image.c`.
    */
+  int width = img->w;
   if (n >= 0 && n <= img->w) {
-    int width = img->w;
-    for (int i = 0; i < n; i++) {
-      uint32_t *energy = malloc(img->w * img->h * sizeof(uint32_t));
-      if (!energy) {
-        fprintf(stderr, "Memory allocation failed for energy\n");
-        exit(EXIT_FAILURE);
-      }
-
-      calculate_energy(energy, img, width);
-
-      int x = calculate_min_energy_column(energy, img->w, width, img->h);
+    int const per_pass = seams_per_pass < n ? seams_per_pass : n;
+    uint32_t *seams = malloc((per_pass > 0 ? per_pass : 1) * img->h *
+                             sizeof(uint32_t));
+    if (!seams) {
+      fprintf(stderr, "Memory allocation failed for seam\n");
+      exit(EXIT_FAILURE);
+    }
+    // either the seams are found on a pyramid, or the energy is calculated
+    // once and updated along every seam; then the seams are found without
+    // reading whole rows of pixels, so their compaction may be deferred
+    struct pyramid *pyr = NULL;
+    if (n > 1 && per_pass == 1) {
+      if (pyramid_band > 0)
+        pyr = pyramid_init(img, pyramid_band);
+      if (pyr == NULL)
+        energy_add_plane(img);
+      if (pyr == NULL && img->energy != NULL)
+        image_defer_compaction(img, defer_seams);
+    }
 
-      uint32_t *seam = malloc(img->h * sizeof(uint32_t));
-      if (!seam) {
-        fprintf(stderr, "Memory allocation failed for seam\n");
-        free(energy);
-        exit(EXIT_FAILURE);
+    while (n > 0) {
+      int k = 1;
+      if (pyr != NULL) {
+        pyramid_find_seam(pyr, width, seams);
+        pyramid_carve_path(pyr, width, seams);
+      } else {
+        k = find_seams(img, width, per_pass < n ? per_pass : n, seams);
+        carve_paths(img, width, k, seams);
       }
 
-      calculate_optimal_path(energy, img->w, width, img->h, x, seam);
-
-      carve_path(img, width, seam);
-
-      width--;
-
-      free(energy);
-      free(seam);
+      width -= k;
+      n -= k;
     }
+
+    if (pyr != NULL)
+      pyramid_destroy(pyr);
+    free(seams);
+    image_compact(img);
   }
 
-  image_write_to_file(img, "out.ppm");
+  image_write_to_file_format(img, output, format, trim ? width : img->w);
 }
 
 /**
@@ -115,33 +163,64 @@ void find_and_carve_path(struct image *const img, int n) {
  * arguments.
  */
 int main(int const argc, char **const argv) {
-  // DO NOT EDIT
-  bool show_min_path = false;
-  bool show_statistics = false;
-  int n_steps = -1;
-
-  char const *const filename =
-      parse_arguments(argc, argv, &show_min_path, &show_statistics, &n_steps);
+  struct arguments args = {
+      .n_steps = -1,
+      .format = IMAGE_FORMAT_P3,
+      .output = "out.ppm",
+      .kernel = KERNEL_AUTO,
+      .layout = PIXEL_RGB8,
+      .energy = ENERGY_GRADIENT,
+      .dp = SEAM_DP_U32,
+      .seams_per_pass = 1,
+  };
+
+  char const *const filename = parse_arguments(argc, argv, &args);
   if (!filename)
     return EXIT_FAILURE;
 
-  struct image *img = image_read_from_file(filename);
+  kernels_select(args.kernel);
+  energy_select(args.energy);
+  seam_dp_select(args.dp);
+  image_set_io_threads(args.threads);
+  // energies that read the row below need the whole image, and verifying
+  // finds every seam twice
+  bool const stream =
+      !energy_get(args.energy)->reads_below && args.dp != SEAM_DP_VERIFY;
+  if (args.show_min_path && !args.show_statistics && stream) {
+    find_print_min_path(filename, args.luma);
+    return EXIT_SUCCESS;
+  }
 
-  if (show_statistics) {
+  struct image *img =
+      args.map ? image_map_file(filename) : image_read_from_file(filename);
+  image_convert(img, args.layout);
+  if (args.luma)
+    image_add_luma(img);
+
+  if (args.show_statistics) {
     statistics(img);
     image_destroy(img);
     return EXIT_SUCCESS;
   }
 
-  if (show_min_path) {
-    find_print_min_path(img);
-  } else {
-    if (n_steps < 0 || n_steps > img->w)
-      n_steps = img->w;
-
-    find_and_carve_path(img, n_steps);
+  if (args.show_min_path) {
+    print_min_path(img);
+    if (args.dp == SEAM_DP_VERIFY)
+      report_seam_dp();
+    image_destroy(img);
+    return EXIT_SUCCESS;
   }
 
+  int n_steps = args.n_steps;
+  if (n_steps < 0 || n_steps > img->w)
+    n_steps = img->w;
+
+  find_and_carve_path(img, n_steps, args.output, args.format, args.trim,
+                      args.seams_per_pass, args.pyramid_band,
+                      args.defer_seams);
+  if (args.dp == SEAM_DP_VERIFY)
+    report_seam_dp();
+
   image_destroy(img);
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,202 @@
+#include "pyramid.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "energy.h"
+#include "energy_functions.h"
+#include "indexing.h"
+
+/**
+ * The number of levels a pyramid has at most, the image included.
+ */
+#define PYRAMID_LEVELS 32
+
+/**
+ * A pyramid of the image `levels[0]` and `n_levels - 1` ever coarser copies of
+ * it, which it owns. Level `l` is considered up to (excluding) column `w[l]`
+ * and `paths[l]` holds the path last found on it, except for the image, whose
+ * path the caller keeps. `from` and `energy` hold the band of every row and
+ * its total energy for the largest level, which every level reuses.
+ */
+struct pyramid {
+  struct image *levels[PYRAMID_LEVELS];
+  int w[PYRAMID_LEVELS];
+  uint32_t *paths[PYRAMID_LEVELS];
+  int n_levels;
+  int band;
+  uint32_t *from;
+  uint32_t *energy;
+};
+
+/**
+ * Return a copy of the 8-bit image @p `img` halved in both directions, where
+ * every pixel is the rounded mean of a block of 2x2 pixels; an odd last column
+ * or row is repeated. Graymaps and images with a luma plane are halved into
+ * graymaps of the samples their energy is calculated on, others into packed
+ * RGB images.
+ */
+static struct image *halve(struct image const *const img) {
+  int const w0 = img->w, h0 = img->h;
+  int const w = (w0 + 1) / 2, h = (h0 + 1) / 2;
+  bool const gray = img->luma != NULL || img->type == PIXEL_GRAY8;
+  struct image *const half =
+      image_init_type(w, h, gray ? PIXEL_GRAY8 : PIXEL_RGB8);
+  struct pixel *const tmp = malloc(2 * (size_t)w0 * sizeof(struct pixel));
+  if (!tmp) {
+    fprintf(stderr, "Memory allocation failed for pyramid\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int y = 0; y < h; y++) {
+    int const y0 = 2 * y, y1 = y0 + 1 < h0 ? y0 + 1 : y0;
+    if (gray) {
+      uint8_t const *const samples =
+          img->luma != NULL ? img->luma : img->gray;
+      uint8_t const *const a = &samples[yx_index(y0, 0, w0)];
+      uint8_t const *const b = &samples[yx_index(y1, 0, w0)];
+      uint8_t *const out = &half->gray[yx_index(y, 0, w)];
+      for (int x = 0; x < w; x++) {
+        int const x0 = 2 * x, x1 = x0 + 1 < w0 ? x0 + 1 : x0;
+        out[x] = (a[x0] + a[x1] + b[x0] + b[x1] + 2) / 4;
+      }
+      continue;
+    }
+    struct pixel const *const a = image_row_rgb8(img, y0, w0, tmp);
+    struct pixel const *const b = image_row_rgb8(img, y1, w0, tmp + w0);
+    struct pixel *const out = &half->pixels[yx_index(y, 0, w)];
+    for (int x = 0; x < w; x++) {
+      int const x0 = 2 * x, x1 = x0 + 1 < w0 ? x0 + 1 : x0;
+      out[x] = (struct pixel){
+          (a[x0].r + a[x1].r + b[x0].r + b[x1].r + 2) / 4,
+          (a[x0].g + a[x1].g + b[x0].g + b[x1].g + 2) / 4,
+          (a[x0].b + a[x1].b + b[x0].b + b[x1].b + 2) / 4,
+      };
+    }
+  }
+  free(tmp);
+  return half;
+}
+
+/**
+ * Return a pyramid of the 8-bit image @p `img`, which is halved until its
+ * coarsest level has at most `PYRAMID_PIXELS` pixels, and whose finer levels
+ * search @p `band` columns on either side of the path of the level above.
+ * The image is compacted first, then its compaction is deferred by
+ * `COMPACTION_SEAMS` paths unless it is already, and the levels defer theirs
+ * like it, except for the coarsest, which `find_seam` reads as a whole.
+ * Returns NULL for 16-bit images, energy functions other than the gradient
+ * and images that have at most `PYRAMID_PIXELS` pixels already, and leaves
+ * those images as they are.
+ */
+struct pyramid *pyramid_init(struct image *const img, int const band) {
+  if (img->type == PIXEL_RGB16 || img->type == PIXEL_GRAY16 ||
+      energy_active() != energy_get(ENERGY_GRADIENT) ||
+      (size_t)img->w * img->h <= PYRAMID_PIXELS)
+    return NULL;
+  struct pyramid *const pyr = malloc(sizeof(struct pyramid));
+  if (!pyr) {
+    fprintf(stderr, "Memory allocation failed for pyramid\n");
+    exit(EXIT_FAILURE);
+  }
+  image_compact(img);
+  image_defer_compaction(img, COMPACTION_SEAMS);
+  pyr->levels[0] = img;
+  pyr->w[0] = img->w;
+  pyr->paths[0] = NULL;
+  pyr->n_levels = 1;
+  // no level has more columns than the image
+  pyr->band = band < (int)img->w ? band : (int)img->w;
+  for (struct image *level = img;
+       (size_t)level->w * level->h > PYRAMID_PIXELS &&
+       pyr->n_levels < PYRAMID_LEVELS;
+       pyr->n_levels++) {
+    level = halve(level);
+    pyr->levels[pyr->n_levels] = level;
+    pyr->w[pyr->n_levels] = level->w;
+    pyr->paths[pyr->n_levels] = malloc(level->h * sizeof(uint32_t));
+    if (!pyr->paths[pyr->n_levels]) {
+      fprintf(stderr, "Memory allocation failed for pyramid\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (int l = 1; l < pyr->n_levels - 1; l++)
+    image_defer_compaction(pyr->levels[l], img->gap_capacity);
+
+  size_t const band_w = 2 * (size_t)pyr->band + 2 < img->w
+                            ? 2 * (size_t)pyr->band + 2
+                            : img->w;
+  pyr->from = malloc(img->h * sizeof(uint32_t));
+  pyr->energy = malloc(img->h * band_w * sizeof(uint32_t));
+  if (!pyr->from || !pyr->energy) {
+    fprintf(stderr, "Memory allocation failed for pyramid\n");
+    exit(EXIT_FAILURE);
+  }
+  return pyr;
+}
+
+/**
+ * Find the path of the image of @p `pyr` up to (excluding) column @p `w`
+ * coarse to fine and store it in @p `seam`, which has an entry for every row.
+ * The coarsest level is searched with `find_seam`. Every finer level is only
+ * searched within the band of `2 * band + 2` columns around the path of the
+ * level above, scaled up to it: row `y` looks at the two columns that the
+ * column of the path in row `y / 2` above became, and `band` columns on
+ * either side; bands that would stick out of the image are moved into it.
+ */
+void pyramid_find_seam(struct pyramid *const pyr, int const w,
+                       uint32_t *const seam) {
+  int const top = pyr->n_levels - 1;
+  pyr->w[0] = w;
+  find_seam(pyr->levels[top], pyr->w[top], pyr->paths[top]);
+  for (int l = top - 1; l >= 0; l--) {
+    struct image *const level = pyr->levels[l];
+    uint32_t const *const coarse = pyr->paths[l + 1];
+    uint32_t *const path = l > 0 ? pyr->paths[l] : seam;
+    int const lw = pyr->w[l];
+    int const band_w = 2 * pyr->band + 2 < lw ? 2 * pyr->band + 2 : lw;
+    for (uint32_t y = 0; y < level->h; y++) {
+      int from = 2 * (int)coarse[y / 2] - pyr->band;
+      if (from > lw - band_w)
+        from = lw - band_w;
+      pyr->from[y] = from > 0 ? from : 0;
+    }
+    int const x =
+        calculate_energy_band(pyr->energy, level, lw, pyr->from, band_w);
+    calculate_optimal_path_band(pyr->energy, lw, level->h, pyr->from,
+                                band_w, x, path);
+  }
+}
+
+/**
+ * Carve the path @p `seam` that `pyramid_find_seam` found last out of the
+ * image of @p `pyr`, where only the @p `w` left columns are considered, like
+ * `carve_path` does, and carve the paths it found on the coarser levels out
+ * of those that are now wider than half the level below, rounded up. So every
+ * level keeps half the width of the one below, and loses the pixels of the
+ * path that the seams of the finer levels were found around.
+ */
+void pyramid_carve_path(struct pyramid *const pyr, int const w,
+                        uint32_t const *const seam) {
+  carve_path(pyr->levels[0], w, seam);
+  pyr->w[0] = w - 1;
+  for (int l = 1; l < pyr->n_levels; l++) {
+    if (pyr->w[l] <= (pyr->w[l - 1] + 1) / 2)
+      break;
+    carve_path(pyr->levels[l], pyr->w[l], pyr->paths[l]);
+    pyr->w[l]--;
+  }
+}
+
+/**
+ * Destroy the pyramid @p `pyr` and its coarser levels, but not its image.
+ */
+void pyramid_destroy(struct pyramid *const pyr) {
+  for (int l = 1; l < pyr->n_levels; l++) {
+    image_destroy(pyr->levels[l]);
+    free(pyr->paths[l]);
+  }
+  free(pyr->from);
+  free(pyr->energy);
+  free(pyr);
+}
@@ -0,0 +1,54 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <stdint.h>
+
+#include "image.h"
+
+/**
+ * The number of pixels the coarsest level of a pyramid has at most.
+ */
+#define PYRAMID_PIXELS (1 << 16)
+
+/**
+ * A pyramid of ever coarser copies of an 8-bit image, each halved in both
+ * directions, that finds the seams of the image coarse to fine: the optimal
+ * path of the coarsest level is found with `find_seam`, and every finer level
+ * only searches a narrow band of columns around the path of the level above,
+ * scaled up to its own size. The levels are carved along with the image.
+ */
+struct pyramid;
+
+/**
+ * Return a pyramid of the 8-bit image @p `img`, which is halved until its
+ * coarsest level has at most `PYRAMID_PIXELS` pixels, and whose finer levels
+ * search @p `band` columns on either side of the path of the level above.
+ * @p `img` defers its compaction by `COMPACTION_SEAMS` paths unless it does
+ * already, and the levels defer theirs like it. Returns NULL for 16-bit
+ * images, energy functions other than the gradient and images that have at
+ * most `PYRAMID_PIXELS` pixels already.
+ */
+struct pyramid* pyramid_init(struct image* img, int band);
+
+/**
+ * Find the path of the image of @p `pyr` up to (excluding) column @p `w`
+ * coarse to fine and store it in @p `seam`, which has an entry for every row.
+ * Only paths that stay within the bands of every level are considered, so it
+ * can differ from the optimal path of `find_seam`.
+ */
+void pyramid_find_seam(struct pyramid* pyr, int w, uint32_t* seam);
+
+/**
+ * Carve the path @p `seam` that `pyramid_find_seam` found last out of the
+ * image of @p `pyr`, where only the @p `w` left columns are considered, like
+ * `carve_path` does, and carve the paths it found on the coarser levels out
+ * of those that are now wider than half the level below.
+ */
+void pyramid_carve_path(struct pyramid* pyr, int w, uint32_t const* seam);
+
+/**
+ * Destroy the pyramid @p `pyr` and its coarser levels, but not its image.
+ */
+void pyramid_destroy(struct pyramid* pyr);
+
+#endif
@@ -0,0 +1,382 @@
+#include "qoi.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "indexing.h"
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_OP_RGBA 0xff
+#define QOI_MASK 0xc0
+
+/**
+ * The size of the header: magic, width, height, channels and colorspace.
+ */
+#define QOI_HEADER_SIZE 14
+
+/**
+ * The longest operation, `QOI_OP_RGBA`, takes five bytes.
+ */
+#define QOI_MAX_OP_SIZE 5
+
+/**
+ * The longest run a single `QOI_OP_RUN` can encode.
+ */
+#define QOI_MAX_RUN 62
+
+/**
+ * The size of the buffer the encoded data is read into or written from.
+ */
+#define QOI_BUFFER_SIZE (64 << 10)
+
+static uint8_t const qoi_padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+/**
+ * A pixel as seen by the codec, which always tracks the alpha channel.
+ */
+struct qoi_rgba {
+  uint8_t r, g, b, a;
+};
+
+static inline int qoi_hash(struct qoi_rgba const px) {
+  return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+}
+
+static inline bool qoi_equal(struct qoi_rgba const a, struct qoi_rgba const b) {
+  return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+static uint32_t read_be32(uint8_t const *const p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+         p[3];
+}
+
+static void write_be32(uint8_t *const p, uint32_t const v) {
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+}
+
+/**
+ * A buffered view of the encoded data in a file: the bytes from `pos` to `len`
+ * of `buf` have been read, but not yet decoded.
+ */
+struct qoi_input {
+  FILE *f;
+  uint8_t *buf;
+  size_t pos, len;
+};
+
+/**
+ * Make sure that at least @p `n` undecoded bytes are buffered in @p `in`,
+ * reading more from the file if necessary. Returns false if the file ends
+ * before.
+ */
+static bool qoi_fill(struct qoi_input *const in, size_t const n) {
+  if (in->len - in->pos >= n)
+    return true;
+  memmove(in->buf, in->buf + in->pos, in->len - in->pos);
+  in->len -= in->pos;
+  in->pos = 0;
+  in->len += fread(in->buf + in->len, 1, QOI_BUFFER_SIZE - in->len, in->f);
+  return in->len >= n;
+}
+
+/**
+ * The state of the decoder between two rows: the buffered input, the index of
+ * recently seen pixels, the previous pixel and the length of the current run.
+ */
+struct qoi_decoder {
+  struct qoi_input in;
+  struct qoi_rgba index[64];
+  struct qoi_rgba px;
+  int run;
+  uint32_t w, h;
+};
+
+/**
+ * Read the header of a QOI image from @p `f` and return a decoder for its
+ * rows, or NULL if the header is invalid. The dimensions are stored in
+ * @p `w` and @p `h`.
+ */
+struct qoi_decoder *qoi_decoder_open(FILE *const f, uint32_t *const w,
+                                     uint32_t *const h) {
+  uint8_t header[QOI_HEADER_SIZE];
+  if (fread(header, 1, sizeof(header), f) != sizeof(header) ||
+      memcmp(header, QOI_MAGIC, 4) != 0)
+    return NULL;
+  *w = read_be32(header + 4);
+  *h = read_be32(header + 8);
+  uint8_t const channels = header[12];
+  uint8_t const colorspace = header[13];
+  if (*w == 0 || *h == 0 || (uint64_t)*w * *h > INT32_MAX ||
+      (channels != 3 && channels != 4) || colorspace > 1)
+    return NULL;
+
+  struct qoi_decoder *const dec = malloc(sizeof(struct qoi_decoder));
+  uint8_t *const buf = malloc(QOI_BUFFER_SIZE);
+  if (dec == NULL || buf == NULL)
+    exit(EXIT_FAILURE);
+  *dec = (struct qoi_decoder){
+      .in = {.f = f, .buf = buf},
+      .px = {0, 0, 0, 255},
+      .w = *w,
+      .h = *h,
+  };
+  return dec;
+}
+
+/**
+ * Decode the next row of pixels from @p `dec` into @p `row`. Returns false if
+ * the data ends before.
+ */
+bool qoi_decoder_row(struct qoi_decoder *const dec, struct pixel *const row) {
+  struct qoi_input *const in = &dec->in;
+  struct qoi_rgba px = dec->px;
+  int run = dec->run;
+
+  for (uint32_t x = 0; x < dec->w; x++) {
+    if (run > 0) {
+      run--;
+    } else {
+      // every operation is followed by at least the end marker
+      if (!qoi_fill(in, QOI_MAX_OP_SIZE))
+        return false;
+      uint8_t const *const p = in->buf + in->pos;
+      uint8_t const op = p[0];
+      if (op == QOI_OP_RGB) {
+        px.r = p[1];
+        px.g = p[2];
+        px.b = p[3];
+        in->pos += 4;
+      } else if (op == QOI_OP_RGBA) {
+        px.r = p[1];
+        px.g = p[2];
+        px.b = p[3];
+        px.a = p[4];
+        in->pos += 5;
+      } else if ((op & QOI_MASK) == QOI_OP_INDEX) {
+        px = dec->index[op];
+        in->pos += 1;
+      } else if ((op & QOI_MASK) == QOI_OP_DIFF) {
+        px.r += ((op >> 4) & 0x03) - 2;
+        px.g += ((op >> 2) & 0x03) - 2;
+        px.b += (op & 0x03) - 2;
+        in->pos += 1;
+      } else if ((op & QOI_MASK) == QOI_OP_LUMA) {
+        int const vg = (op & 0x3f) - 32;
+        px.r += vg - 8 + ((p[1] >> 4) & 0x0f);
+        px.g += vg;
+        px.b += vg - 8 + (p[1] & 0x0f);
+        in->pos += 2;
+      } else {
+        run = op & 0x3f;
+        in->pos += 1;
+      }
+      dec->index[qoi_hash(px)] = px;
+    }
+    row[x].r = px.r;
+    row[x].g = px.g;
+    row[x].b = px.b;
+  }
+
+  dec->px = px;
+  dec->run = run;
+  return true;
+}
+
+/**
+ * Check that the rows decoded by @p `dec` are followed by the end marker and
+ * nothing else, and free the decoder. Returns false otherwise.
+ */
+bool qoi_decoder_close(struct qoi_decoder *const dec) {
+  struct qoi_input *const in = &dec->in;
+  bool ok = dec->run == 0 && qoi_fill(in, sizeof(qoi_padding)) &&
+            memcmp(in->buf + in->pos, qoi_padding, sizeof(qoi_padding)) == 0;
+  if (ok) {
+    in->pos += sizeof(qoi_padding);
+    ok = !qoi_fill(in, 1);
+  }
+  free(in->buf);
+  free(dec);
+  return ok;
+}
+
+/**
+ * Read a QOI image from @p `f`, decoding it row by row directly into the
+ * pixels of a new RGB image. The alpha channel of RGBA images is dropped.
+ * Returns NULL if the image is malformed, truncated or followed by other data.
+ */
+struct image *qoi_read(FILE *const f) {
+  uint32_t w, h;
+  struct qoi_decoder *const dec = qoi_decoder_open(f, &w, &h);
+  if (dec == NULL)
+    return NULL;
+
+  struct image *img = image_init(w, h);
+  bool ok = true;
+  for (uint32_t y = 0; y < h && ok; y++)
+    ok = qoi_decoder_row(dec, &img->pixels[yx_index(y, 0, w)]);
+  if (!qoi_decoder_close(dec) || !ok) {
+    image_destroy(img);
+    img = NULL;
+  }
+  return img;
+}
+
+/**
+ * Scale the sample @p `v` of an image with maximum value @p `maxval` to 8 bits.
+ */
+static inline uint8_t qoi_sample(uint32_t const v, uint32_t const maxval) {
+  return (uint8_t)((v * 255 + maxval / 2) / maxval);
+}
+
+/**
+ * Return the @p `w` left pixels of row @p `y` of @p `img` as 8-bit RGB pixels,
+ * converted into @p `tmp` unless the image already stores them that way.
+ */
+static struct pixel const *qoi_row(struct image *const img, int const w,
+                                   int const y, struct pixel *const tmp) {
+  size_t const i = yx_index(y, 0, img->w);
+  uint32_t const maxval = img->maxval;
+  switch (img->type) {
+  case PIXEL_GRAY8:
+    for (int x = 0; x < w; x++) {
+      uint8_t const v = maxval == 255 ? img->gray[i + x]
+                                      : qoi_sample(img->gray[i + x], maxval);
+      tmp[x] = (struct pixel){v, v, v};
+    }
+    return tmp;
+  case PIXEL_GRAY16:
+    for (int x = 0; x < w; x++) {
+      uint8_t const v = qoi_sample(img->gray16[i + x], maxval);
+      tmp[x] = (struct pixel){v, v, v};
+    }
+    return tmp;
+  case PIXEL_RGB16:
+    for (int x = 0; x < w; x++) {
+      struct pixel16 const p = img->pixels16[i + x];
+      tmp[x] = (struct pixel){qoi_sample(p.r, maxval), qoi_sample(p.g, maxval),
+                              qoi_sample(p.b, maxval)};
+    }
+    return tmp;
+  default: {
+    // packed, padded or planar 8-bit RGB
+    struct pixel const *const row = image_row_rgb8(img, y, w, tmp);
+    if (maxval == 255)
+      return row;
+    for (int x = 0; x < w; x++) {
+      struct pixel const p = row[x];
+      tmp[x] = (struct pixel){qoi_sample(p.r, maxval), qoi_sample(p.g, maxval),
+                              qoi_sample(p.b, maxval)};
+    }
+    return tmp;
+  }
+  }
+}
+
+/**
+ * Write the @p `n` bytes in @p `buf` to @p `f`, ending the execution on
+ * failure.
+ */
+static void qoi_flush(uint8_t const *const buf, size_t const n, FILE *const f) {
+  if (fwrite(buf, 1, n, f) != n)
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Write the @p `w` left columns of the image @p `img` to @p `f` as an RGB QOI
+ * image. Every row is encoded into a buffer that is written out whenever it is
+ * full, so the pixels are neither copied nor converted as a whole.
+ */
+void qoi_write(struct image *const img, int const w, FILE *const f) {
+  uint8_t *const buf = malloc(QOI_BUFFER_SIZE);
+  struct pixel *const tmp = malloc((size_t)w * sizeof(struct pixel));
+  if (buf == NULL || tmp == NULL)
+    exit(EXIT_FAILURE);
+
+  memcpy(buf, QOI_MAGIC, 4);
+  write_be32(buf + 4, w);
+  write_be32(buf + 8, img->h);
+  buf[12] = 3; // RGB
+  buf[13] = 0; // sRGB with linear alpha
+  size_t n = QOI_HEADER_SIZE;
+
+  struct qoi_rgba index[64] = {{0}};
+  struct qoi_rgba prev = {0, 0, 0, 255};
+  int run = 0;
+
+  for (int y = 0; y < img->h; y++) {
+    struct pixel const *const row = qoi_row(img, w, y, tmp);
+    for (int x = 0; x < w; x++) {
+      struct qoi_rgba const px = {row[x].r, row[x].g, row[x].b, 255};
+      if (n > QOI_BUFFER_SIZE - QOI_MAX_OP_SIZE) {
+        qoi_flush(buf, n, f);
+        n = 0;
+      }
+
+      if (qoi_equal(px, prev)) {
+        if (++run == QOI_MAX_RUN) {
+          buf[n++] = QOI_OP_RUN | (run - 1);
+          run = 0;
+        }
+        continue;
+      }
+      if (run > 0) {
+        buf[n++] = QOI_OP_RUN | (run - 1);
+        run = 0;
+      }
+
+      int const hash = qoi_hash(px);
+      if (qoi_equal(index[hash], px)) {
+        buf[n++] = QOI_OP_INDEX | hash;
+      } else {
+        index[hash] = px;
+        int8_t const vr = (int8_t)(px.r - prev.r);
+        int8_t const vg = (int8_t)(px.g - prev.g);
+        int8_t const vb = (int8_t)(px.b - prev.b);
+        int8_t const vg_r = (int8_t)(vr - vg);
+        int8_t const vg_b = (int8_t)(vb - vg);
+        if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+          buf[n++] = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+        } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 &&
+                   vg_b < 8) {
+          buf[n++] = QOI_OP_LUMA | (vg + 32);
+          buf[n++] = (vg_r + 8) << 4 | (vg_b + 8);
+        } else {
+          buf[n++] = QOI_OP_RGB;
+          buf[n++] = px.r;
+          buf[n++] = px.g;
+          buf[n++] = px.b;
+        }
+      }
+      prev = px;
+    }
+  }
+
+  if (n > QOI_BUFFER_SIZE - 1 - sizeof(qoi_padding)) {
+    qoi_flush(buf, n, f);
+    n = 0;
+  }
+  if (run > 0)
+    buf[n++] = QOI_OP_RUN | (run - 1);
+  memcpy(buf + n, qoi_padding, sizeof(qoi_padding));
+  qoi_flush(buf, n + sizeof(qoi_padding), f);
+
+  free(tmp);
+  free(buf);
+}
+
+/**
+ * Return whether @p `filename` has the extension `.qoi`.
+ */
+bool qoi_is_filename(char const *const filename) {
+  size_t const len = strlen(filename);
+  return len >= 4 && strcmp(filename + len - 4, ".qoi") == 0;
+}
@@ -0,0 +1,59 @@
+#ifndef QOI_H
+#define QOI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "image.h"
+
+/**
+ * The magic number at the start of every QOI image.
+ */
+#define QOI_MAGIC "qoif"
+
+/**
+ * Read a QOI image from @p `f`, decoding it row by row directly into the
+ * pixels of a new RGB image. The alpha channel of RGBA images is dropped.
+ * Returns NULL if the image is malformed, truncated or followed by other data.
+ * See https://qoiformat.org/qoi-specification.pdf for the format.
+ */
+struct image* qoi_read(FILE* f);
+
+/**
+ * A QOI image that is decoded one row at a time.
+ */
+struct qoi_decoder;
+
+/**
+ * Read the header of a QOI image from @p `f` and return a decoder for its
+ * rows, or NULL if the header is invalid. The dimensions are stored in
+ * @p `w` and @p `h`.
+ */
+struct qoi_decoder* qoi_decoder_open(FILE* f, uint32_t* w, uint32_t* h);
+
+/**
+ * Decode the next row of pixels from @p `dec` into @p `row`, which has room
+ * for the width of the image. Returns false if the data ends before.
+ */
+bool qoi_decoder_row(struct qoi_decoder* dec, struct pixel* row);
+
+/**
+ * Check that the rows decoded by @p `dec` are followed by the end marker and
+ * nothing else, and free the decoder. Returns false otherwise.
+ */
+bool qoi_decoder_close(struct qoi_decoder* dec);
+
+/**
+ * Write the @p `w` left columns of the image @p `img` to @p `f` as an RGB QOI
+ * image, encoding it row by row. Grayscale pixels are written as RGB and
+ * samples of images whose maximum value is not 255 are scaled to 8 bits.
+ */
+void qoi_write(struct image* img, int w, FILE* f);
+
+/**
+ * Return whether @p `filename` has the extension `.qoi`.
+ */
+bool qoi_is_filename(char const* filename);
+
+#endif
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -15,6 +16,10 @@ typedef result_t (*test_fun_t)(const char *);
 // function that searches for a test of the given name
 test_fun_t get_test(const char *name);
 
+// runs every set of kernels the CPU supports against the scalar code, printing
+// the result of every set if verbose is set
+result_t run_kernel_conformance(bool verbose);
+
 // macro for defining a new unit test, to be used in the get_test function
 // takes a string test name and the identifier of a unit test function
 #define TEST(name, func)                                \
@@ -3,11 +3,16 @@
 #include "test_common.h"
 
 int main(int argc, char *argv[]) {
+  if (argc == 2 && strcmp(argv[1], "--conformance") == 0)
+    return run_kernel_conformance(true) == SUCCESS ? 0 : 2;
+
   if ((argc > 1 && argv[1][0] == '-') || argc == 1) {
     fprintf(stderr,
             "Usage:\n"
-            "\t%s <testname>\tto execute a specific test by name\n",
-            argv[0]);
+            "\t%s <testname>\tto execute a specific test by name\n"
+            "\t%s --conformance\tto compare every set of kernels the CPU "
+            "supports with the scalar code\n",
+            argv[0], argv[0]);
     return 3;
   }
 
@@ -1,9 +1,15 @@
+#include <inttypes.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "energy.h"
+#include "energy_functions.h"
 #include "image.h"
 #include "indexing.h"
+#include "kernels.h"
+#include "pyramid.h"
 #include "test_common.h"
 
 struct image *create_small2() {
@@ -411,6 +417,1598 @@ result_t carve_path_small2_test(const char *test) {
   return res;
 }
 
+/**
+ * Compare the pixels of @p `img` with those of @p `exp_img`, printing the
+ * first mismatch.
+ */
+result_t compare_images(struct image *img, struct image *exp_img) {
+  if (img->w != exp_img->w || img->h != exp_img->h) {
+    printf("expected a %ux%u image, but got %ux%u\n", exp_img->w, exp_img->h,
+           img->w, img->h);
+    return FAILURE;
+  }
+  for (uint32_t i = 0; i < img->w * img->h; i++) {
+    struct pixel p = img->pixels[i];
+    struct pixel exp_p = exp_img->pixels[i];
+    if (p.r != exp_p.r || p.g != exp_p.g || p.b != exp_p.b) {
+      printf("at pixel %u: expected %d %d %d, but got %d %d %d\n", i, exp_p.r,
+             exp_p.g, exp_p.b, p.r, p.g, p.b);
+      return FAILURE;
+    }
+  }
+  return SUCCESS;
+}
+
+result_t p6_read_write_test(const char *test) {
+  (void)test;
+  char filename[] = "/tmp/carve_test_XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd < 0) {
+    printf("could not create a temporary file\n");
+    return FAILURE;
+  }
+  close(fd);
+
+  struct image *img = create_small2();
+  image_write_to_file_format(img, filename, IMAGE_FORMAT_P6, img->w);
+  struct image *read = image_read_from_file(filename);
+  result_t res = compare_images(read, img);
+
+  unlink(filename);
+  image_destroy(read);
+  image_destroy(img);
+  return res;
+}
+
+result_t p6_map_carve_test(const char *test) {
+  (void)test;
+  char filename[] = "/tmp/carve_test_XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd < 0) {
+    printf("could not create a temporary file\n");
+    return FAILURE;
+  }
+  close(fd);
+
+  struct image *img = create_small2();
+  image_write_to_file_format(img, filename, IMAGE_FORMAT_P6, img->w);
+  struct image *mapped = image_map_file(filename);
+  uint32_t *seam = seam_init(3);
+  seam[0] = 0;
+  seam[1] = 0;
+  seam[2] = 1;
+  carve_path(mapped, 3, seam);
+
+  // the carved pixels are visible in the mapping, but not in the file
+  struct image *exp_img = create_carved_small2();
+  result_t res = compare_images(mapped, exp_img);
+  struct image *read = image_read_from_file(filename);
+  if (res == SUCCESS)
+    res = compare_images(read, img);
+
+  unlink(filename);
+  image_destroy(read);
+  image_destroy(exp_img);
+  image_destroy(mapped);
+  image_destroy(img);
+  free(seam);
+  return res;
+}
+
+result_t qoi_read_write_test(const char *test) {
+  (void)test;
+  char filename[] = "/tmp/carve_test_XXXXXX.qoi";
+  int fd = mkstemps(filename, 4);
+  if (fd < 0) {
+    printf("could not create a temporary file\n");
+    return FAILURE;
+  }
+  close(fd);
+
+  // runs, small and larger differences and repeated colors use every operation
+  struct image *img = image_init(70, 5);
+  for (uint32_t i = 0; i < img->w * img->h; i++) {
+    uint32_t x = i % img->w;
+    img->pixels[i].r = x < 10 ? 0 : x < 20 ? x : x < 40 ? x * 5 : x * 47;
+    img->pixels[i].g = x < 40 ? x * 3 : (x + i / img->w) % 3 * 80;
+    img->pixels[i].b = x < 20 ? 7 : x * 11 + i / img->w;
+  }
+  image_write_to_file(img, filename);
+  struct image *read = image_read_from_file(filename);
+  result_t res = compare_images(read, img);
+
+  unlink(filename);
+  image_destroy(read);
+  image_destroy(img);
+  return res;
+}
+
+/**
+ * Compare the local energy of the rows of a pseudo-random RGB image computed
+ * by @p `kernel` with the one computed with `diff_color`, for many widths.
+ */
+result_t check_local_energy_kernel(
+    const char *name, void (*kernel)(uint32_t *, struct pixel const *,
+                                     struct pixel const *, int)) {
+  const int w0 = 45;
+  struct image *img = image_init(w0, 2);
+  uint32_t seed = 12345;
+  for (int i = 0; i < w0 * 2; i++) {
+    seed = seed * 1103515245 + 12345;
+    img->pixels[i].r = seed >> 24;
+    img->pixels[i].g = seed >> 16;
+    img->pixels[i].b = i % 7 == 0 ? 255 : 0;
+  }
+  struct pixel const *above = img->pixels;
+  struct pixel const *row = img->pixels + w0;
+
+  result_t res = SUCCESS;
+  uint32_t out[45];
+  for (int w = 1; w <= w0 && res == SUCCESS; w++) {
+    kernel(out, row, above, w);
+    for (int x = 0; x < w; x++) {
+      uint32_t exp = diff_color(row[x], above[x]);
+      if (x > 0)
+        exp += diff_color(row[x], row[x - 1]);
+      if (out[x] != exp) {
+        printf("%s, width %d, column %d: expected %u, but got %u\n", name, w,
+               x, exp, out[x]);
+        res = FAILURE;
+        break;
+      }
+    }
+  }
+  image_destroy(img);
+  return res;
+}
+
+/**
+ * Compare the DP row updates of @p `row_fn` and @p `row_min_fn` with the scalar
+ * update for many widths, on rows with many ties and on rows near
+ * `UINT32_MAX`, where the sums wrap around.
+ */
+result_t check_cumulative_kernel(
+    const char *name, void (*row_fn)(uint32_t *, uint32_t const *, int),
+    int (*row_min_fn)(uint32_t *, uint32_t const *, int)) {
+  enum { W0 = 40 };
+  uint32_t above[W0], row[W0], exp[W0], out[W0];
+  uint32_t seed = 4321;
+  for (int round = 0; round < 40; round++) {
+    for (int x = 0; x < W0; x++) {
+      seed = seed * 1103515245 + 12345;
+      above[x] = round % 2 ? UINT32_MAX - (seed >> 28) : (seed >> 28) + 5;
+      row[x] = (seed >> 20) % 4;
+    }
+    for (int w = 1; w <= W0; w++) {
+      int exp_min = 0;
+      for (int x = 0; x < w; x++) {
+        uint32_t least = above[x];
+        if (x > 0 && above[x - 1] < least)
+          least = above[x - 1];
+        if (x < w - 1 && above[x + 1] < least)
+          least = above[x + 1];
+        exp[x] = row[x] + least;
+        if (exp[x] < exp[exp_min])
+          exp_min = x;
+      }
+
+      memcpy(out, row, sizeof(row));
+      row_fn(out, above, w);
+      int different = memcmp(out, exp, w * sizeof(uint32_t));
+      memcpy(out, row, sizeof(row));
+      int min = row_min_fn(out, above, w);
+      if (different || memcmp(out, exp, w * sizeof(uint32_t)) ||
+          min != exp_min) {
+        printf("%s, width %d: wrong row update or minimum %d instead of %d\n",
+               name, w, min, exp_min);
+        return FAILURE;
+      }
+    }
+  }
+  return SUCCESS;
+}
+result_t local_energy_simd_test(const char *test) {
+  (void)test;
+  result_t res = SUCCESS;
+  for (int isa = KERNEL_SCALAR + 1; isa < KERNEL_COUNT; isa++) {
+    struct kernels const *k = kernels_get(isa);
+    if (k != NULL && k->local_energy_row_rgb8 != NULL &&
+        check_local_energy_kernel(k->name, k->local_energy_row_rgb8) !=
+            SUCCESS)
+      res = FAILURE;
+  }
+  return res;
+}
+
+result_t cumulative_simd_test(const char *test) {
+  (void)test;
+  result_t res = SUCCESS;
+  for (int isa = KERNEL_SCALAR + 1; isa < KERNEL_COUNT; isa++) {
+    struct kernels const *k = kernels_get(isa);
+    if (k != NULL && k->cumulative_row_u32 != NULL &&
+        check_cumulative_kernel(k->name, k->cumulative_row_u32,
+                                k->cumulative_row_min_u32) != SUCCESS)
+      res = FAILURE;
+  }
+  return res;
+}
+
+/**
+ * Create a 16-bit copy of @p `img` that uses the whole range of 16-bit samples,
+ * i.e. every sample is multiplied by 257.
+ */
+struct image *widen_image(struct image *img) {
+  struct image *wide = image_init_type(img->w, img->h, PIXEL_RGB16);
+  for (uint32_t i = 0; i < img->w * img->h; i++) {
+    wide->pixels16[i].r = img->pixels[i].r * 257;
+    wide->pixels16[i].g = img->pixels[i].g * 257;
+    wide->pixels16[i].b = img->pixels[i].b * 257;
+  }
+  return wide;
+}
+
+/**
+ * Create a pseudo-random @p `w` x @p `h` RGB image from @p `seed`. With
+ * @p `levels` below 256, the samples take only that many values, so there are
+ * many ties between the energies.
+ */
+struct image *create_random(int w, int h, uint32_t seed, int levels) {
+  struct image *img = image_init(w, h);
+  for (int i = 0; i < w * h; i++) {
+    seed = seed * 1103515245 + 12345;
+    img->pixels[i].r = (seed >> 24) % levels * (255 / (levels - 1));
+    img->pixels[i].g = (seed >> 16) % levels * (255 / (levels - 1));
+    img->pixels[i].b = (seed >> 8) % levels * (255 / (levels - 1));
+  }
+  return img;
+}
+
+result_t brightness_simd_test(const char *test) {
+  (void)test;
+  struct image *img = create_random(100, 1, 777, 256);
+  result_t res = SUCCESS;
+  for (int isa = KERNEL_SCALAR + 1; isa < KERNEL_COUNT; isa++) {
+    struct kernels const *k = kernels_get(isa);
+    if (k == NULL || k->brightness_sum_rgb8 == NULL)
+      continue;
+    uint64_t exp = 0;
+    for (int n = 0; n <= 100; n++) {
+      uint64_t sum = k->brightness_sum_rgb8(img->pixels, n);
+      if (sum != exp) {
+        printf("%s, %d pixels: expected %" PRIu64 ", but got %" PRIu64 "\n",
+               k->name, n, exp, sum);
+        res = FAILURE;
+        break;
+      }
+      if (n < 100) {
+        struct pixel p = img->pixels[n];
+        exp += (p.r + p.g + p.b) / 3;
+      }
+    }
+  }
+  image_destroy(img);
+  return res;
+}
+
+/**
+ * Compare the row updates and direction bits of @p `dir_fn` with the scalar
+ * rules for many widths, on rows with many ties.
+ */
+result_t check_direction_kernel(const char *name,
+                                void (*dir_fn)(uint32_t *, uint32_t const *,
+                                               int, uint8_t *, uint8_t *)) {
+  enum { W0 = 70 };
+  uint32_t above[W0], row[W0];
+  uint8_t left[(W0 + 7) / 8], right[(W0 + 7) / 8];
+  uint32_t seed = 99;
+  for (int round = 0; round < 20; round++) {
+    for (int x = 0; x < W0; x++) {
+      seed = seed * 1103515245 + 12345;
+      above[x] = (seed >> 28) % 3 + (round % 2 ? UINT32_MAX - 3 : 0);
+      row[x] = (seed >> 20) % 4;
+    }
+    for (int w = 1; w <= W0; w++) {
+      uint32_t out[W0];
+      memcpy(out, row, sizeof(row));
+      memset(left, 0xff, sizeof(left));
+      memset(right, 0xff, sizeof(right));
+      dir_fn(out, above, w, left, right);
+      for (int x = 0; x < w; x++) {
+        int exp = 0; // -1: left, 0: straight above, 1: right
+        if (x > 0 && above[x - 1] < above[x])
+          exp = -1;
+        if (x < w - 1 && above[x + 1] < above[x + exp])
+          exp = 1;
+        int dir = (right[x / 8] >> x % 8 & 1) - (left[x / 8] >> x % 8 & 1);
+        if (dir != exp || out[x] != row[x] + above[x + exp]) {
+          printf("%s, width %d, column %d: direction %d instead of %d\n",
+                 name, w, x, dir, exp);
+          return FAILURE;
+        }
+      }
+    }
+  }
+  return SUCCESS;
+}
+
+/**
+ * Like `check_direction_kernel`, but for the 64-bit @p `dir_fn`, on entries
+ * beyond 32 bits as well.
+ */
+result_t check_direction_kernel64(const char *name,
+                                  void (*dir_fn)(uint64_t *, uint64_t const *,
+                                                 int, uint8_t *, uint8_t *)) {
+  enum { W0 = 70 };
+  uint64_t above[W0], row[W0];
+  uint8_t left[(W0 + 7) / 8], right[(W0 + 7) / 8];
+  uint32_t seed = 98;
+  for (int round = 0; round < 20; round++) {
+    for (int x = 0; x < W0; x++) {
+      seed = seed * 1103515245 + 12345;
+      above[x] = (seed >> 28) % 3 + (round % 2 ? (uint64_t)1 << 62 : 0) +
+                 (round % 4 == 2 ? (uint64_t)(seed >> 24 & 1) << 32 : 0);
+      row[x] = (seed >> 20) % 4;
+    }
+    for (int w = 1; w <= W0; w++) {
+      uint64_t out[W0];
+      memcpy(out, row, sizeof(row));
+      memset(left, 0xff, sizeof(left));
+      memset(right, 0xff, sizeof(right));
+      dir_fn(out, above, w, left, right);
+      for (int x = 0; x < w; x++) {
+        int exp = 0; // -1: left, 0: straight above, 1: right
+        if (x > 0 && above[x - 1] < above[x])
+          exp = -1;
+        if (x < w - 1 && above[x + 1] < above[x + exp])
+          exp = 1;
+        int dir = (right[x / 8] >> x % 8 & 1) - (left[x / 8] >> x % 8 & 1);
+        if (dir != exp || out[x] != row[x] + above[x + exp]) {
+          printf("%s, 64 bits, width %d, column %d: direction %d instead of "
+                 "%d\n",
+                 name, w, x, dir, exp);
+          return FAILURE;
+        }
+      }
+    }
+  }
+  return SUCCESS;
+}
+
+result_t direction_bits_test(const char *test) {
+  (void)test;
+  result_t res = SUCCESS;
+  for (int isa = KERNEL_SCALAR + 1; isa < KERNEL_COUNT; isa++) {
+    struct kernels const *k = kernels_get(isa);
+    if (k != NULL && k->cumulative_row_dir_u32 != NULL &&
+        check_direction_kernel(k->name, k->cumulative_row_dir_u32) != SUCCESS)
+      res = FAILURE;
+    if (k != NULL && k->cumulative_row_dir_u64 != NULL &&
+        check_direction_kernel64(k->name, k->cumulative_row_dir_u64) !=
+            SUCCESS)
+      res = FAILURE;
+  }
+
+  // the seams traced along the direction bits are those of the whole matrix
+  for (int i = 0; i < 12 && res == SUCCESS; i++) {
+    int w = 1 + i * 11 % 40, h = 1 + i * 7 % 23;
+    struct image *img = create_random(w, h, 50 + i, i % 3 ? 3 : 256);
+    struct image *wide = widen_image(img);
+    uint32_t *energy = energy_init(w, h);
+    uint64_t *wide_energy = calloc(w * h, sizeof(uint64_t));
+    uint32_t *exp = seam_init(h), *seam = seam_init(h);
+    uint32_t *wide_exp = seam_init(h), *wide_seam = seam_init(h);
+    for (int cols = w; cols > 0 && res == SUCCESS; cols -= 3) {
+      int x = calculate_energy_min_column(energy, img, cols);
+      calculate_optimal_path(energy, w, cols, h, x, exp);
+      find_seam(img, cols, seam);
+      calculate_energy64(wide_energy, wide, cols);
+      x = calculate_min_energy_column64(wide_energy, w, cols, h);
+      calculate_optimal_path64(wide_energy, w, cols, h, x, wide_exp);
+      find_seam(wide, cols, wide_seam);
+      if (memcmp(seam, exp, h * sizeof(uint32_t)) != 0 ||
+          memcmp(wide_seam, wide_exp, h * sizeof(uint32_t)) != 0) {
+        printf("%dx%d image %d, %d columns: seam differs from the one traced "
+               "in the energy matrix\n",
+               w, h, i, cols);
+        res = FAILURE;
+      }
+    }
+    free(wide_seam);
+    free(wide_exp);
+    free(seam);
+    free(exp);
+    free(wide_energy);
+    free(energy);
+    image_destroy(wide);
+    image_destroy(img);
+  }
+  return res;
+}
+
+/**
+ * The results of carving an image with one set of kernels: the brightness of
+ * the image, the total energy of the first pass (in `energy64` for 16-bit
+ * layouts), every seam found and the carved image.
+ */
+struct conformance_run {
+  uint8_t brightness;
+  uint32_t *energy;
+  uint64_t *energy64;
+  uint32_t *seams;
+  struct image *img;
+};
+
+/**
+ * Return the 16-bit sample for the 8-bit sample @p `v`. The two bytes differ,
+ * so that mixing them up shows, but equal samples stay equal.
+ */
+static uint16_t conformance_sample16(uint8_t const v) {
+  return v << 8 | (v ^ 0x5a);
+}
+
+/**
+ * Carve half of the columns out of a copy of @p `src` converted to the layout
+ * @p `layout` with the kernels in use and record the results in @p `run`. The
+ * carved image is converted back to packed pixels, unless it has 16-bit
+ * samples; a 16-bit graymap takes the green samples.
+ */
+void conformance_carve(struct image *src, enum pixel_type layout,
+                       struct conformance_run *run) {
+  int w = src->w, h = src->h, n = (w + 1) / 2;
+  bool wide = layout == PIXEL_RGB16 || layout == PIXEL_GRAY16;
+  run->img = image_init_type(w, h, wide ? layout : PIXEL_RGB8);
+  for (int i = 0; i < w * h; i++) {
+    struct pixel p = src->pixels[i];
+    if (layout == PIXEL_GRAY16)
+      run->img->gray16[i] = conformance_sample16(p.g);
+    else if (layout == PIXEL_RGB16)
+      run->img->pixels16[i] = (struct pixel16){conformance_sample16(p.r),
+                                               conformance_sample16(p.g),
+                                               conformance_sample16(p.b)};
+    else
+      run->img->pixels[i] = p;
+  }
+  image_convert(run->img, layout);
+  run->brightness = image_brightness(run->img);
+  run->energy = wide ? NULL : energy_init(w, h);
+  run->energy64 = wide ? calloc(w * h, sizeof(uint64_t)) : NULL;
+  run->seams = calloc(n * h, sizeof(uint32_t));
+  if (wide)
+    calculate_energy64(run->energy64, run->img, w);
+  else
+    calculate_energy(run->energy, run->img, w);
+  for (int i = 0; i < n; i++) {
+    find_seam(run->img, w - i, &run->seams[i * h]);
+    carve_path(run->img, w - i, &run->seams[i * h]);
+  }
+  image_convert(run->img, PIXEL_RGB8);
+}
+
+void conformance_free(struct conformance_run *run) {
+  image_destroy(run->img);
+  free(run->energy);
+  free(run->energy64);
+  free(run->seams);
+}
+
+/**
+ * Run every set of kernels the CPU supports on pseudo-random images of many
+ * shapes, with and without many ties, in every pixel layout, and compare the
+ * brightness, the energy, the seams and the carved images with those of the
+ * scalar code: on packed pixels for the 8-bit RGB layouts, on the same layout
+ * for the 16-bit ones. With @p `verbose`, report the result of every set and
+ * layout. Selects the best kernels again at the end.
+ */
+result_t run_kernel_conformance(bool verbose) {
+  static const int shapes[][2] = {{1, 1},  {1, 9},   {9, 1},  {2, 2},
+                                  {17, 5}, {45, 13}, {67, 3}, {130, 40}};
+  static const enum pixel_type layouts[] = {
+      PIXEL_RGB8, PIXEL_RGBX8, PIXEL_PLANAR8, PIXEL_RGB16, PIXEL_GRAY16};
+  static const char *const layout_names[] = {"packed", "rgbx", "planar",
+                                             "rgb16", "gray16"};
+  // the index of the layout whose scalar run each layout is compared with
+  static const int ref_layouts[] = {0, 0, 0, 3, 4};
+  enum {
+    N_SHAPES = sizeof(shapes) / sizeof(shapes[0]),
+    N_IMAGES = 2 * N_SHAPES,
+    N_LAYOUTS = sizeof(layouts) / sizeof(layouts[0])
+  };
+  struct image *src[N_IMAGES];
+  struct conformance_run ref[N_LAYOUTS][N_IMAGES];
+
+  kernels_select(KERNEL_SCALAR);
+  for (int i = 0; i < N_IMAGES; i++) {
+    src[i] = create_random(shapes[i / 2][0], shapes[i / 2][1], 1000 + i,
+                           i % 2 ? 256 : 4);
+    for (int l = 0; l < N_LAYOUTS; l++) {
+      if (ref_layouts[l] == l)
+        conformance_carve(src[i], layouts[l], &ref[l][i]);
+    }
+  }
+
+  result_t res = SUCCESS;
+  for (int isa = KERNEL_SCALAR; isa < KERNEL_COUNT; isa++) {
+    if (!kernels_select(isa)) {
+      if (verbose)
+        printf("%s: not supported by this CPU\n", kernels_name(isa));
+      continue;
+    }
+    for (int l = 0; l < N_LAYOUTS; l++) {
+      if (isa == KERNEL_SCALAR && ref_layouts[l] == l)
+        continue;
+      result_t isa_res = SUCCESS;
+      for (int i = 0; i < N_IMAGES; i++) {
+        int w = src[i]->w, h = src[i]->h, n = (w + 1) / 2;
+        struct conformance_run run;
+        struct conformance_run const *exp = &ref[ref_layouts[l]][i];
+        conformance_carve(src[i], layouts[l], &run);
+        char const *diff = NULL;
+        if (run.brightness != exp->brightness)
+          diff = "brightness";
+        else if (run.energy != NULL &&
+                 memcmp(run.energy, exp->energy, w * h * sizeof(uint32_t)))
+          diff = "energy";
+        else if (run.energy64 != NULL &&
+                 memcmp(run.energy64, exp->energy64, w * h * sizeof(uint64_t)))
+          diff = "energy";
+        else if (memcmp(run.seams, exp->seams, n * h * sizeof(uint32_t)))
+          diff = "seams";
+        else if (memcmp(run.img->pixels, exp->img->pixels,
+                        w * h * pixel_size(run.img->type)))
+          diff = "carved image";
+        if (diff != NULL) {
+          printf("%s, %s, %dx%d image %d: %s differs from the scalar code\n",
+                 kernels_name(isa), layout_names[l], w, h, i, diff);
+          isa_res = FAILURE;
+        }
+        conformance_free(&run);
+      }
+      if (verbose)
+        printf("%s, %s: %s\n", kernels_name(isa), layout_names[l],
+               isa_res == SUCCESS ? "conforms" : "FAILED");
+      if (isa_res != SUCCESS)
+        res = FAILURE;
+    }
+  }
+
+  for (int i = 0; i < N_IMAGES; i++) {
+    for (int l = 0; l < N_LAYOUTS; l++) {
+      if (ref_layouts[l] == l)
+        conformance_free(&ref[l][i]);
+    }
+    image_destroy(src[i]);
+  }
+  kernels_select(KERNEL_AUTO);
+  return res;
+}
+
+result_t kernel_conformance_test(const char *test) {
+  (void)test;
+  return run_kernel_conformance(false);
+}
+
+result_t rgb16_read_write_test(const char *test) {
+  (void)test;
+  char filename[] = "/tmp/carve_test_XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd < 0) {
+    printf("could not create a temporary file\n");
+    return FAILURE;
+  }
+  close(fd);
+
+  struct image *small2 = create_small2();
+  struct image *img = widen_image(small2);
+  img->pixels16[1].g = 1000;
+  result_t res = SUCCESS;
+  enum image_format formats[] = {IMAGE_FORMAT_P3, IMAGE_FORMAT_P6};
+  for (int f = 0; f < 2 && res == SUCCESS; f++) {
+    image_write_to_file_format(img, filename, formats[f], img->w);
+    struct image *read = image_read_from_file(filename);
+    if (read->type != PIXEL_RGB16 || read->maxval != 65535 ||
+        memcmp(read->pixels16, img->pixels16,
+               img->w * img->h * sizeof(struct pixel16)) != 0) {
+      printf("16-bit image in format %d read back differently\n", f);
+      res = FAILURE;
+    }
+    image_destroy(read);
+  }
+
+  unlink(filename);
+  image_destroy(img);
+  image_destroy(small2);
+  return res;
+}
+
+result_t layout_read_write_test(const char *test) {
+  (void)test;
+  char filename[] = "/tmp/carve_test_XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd < 0) {
+    printf("could not create a temporary file\n");
+    return FAILURE;
+  }
+  close(fd);
+
+  struct image *img = create_random(37, 9, 99, 256);
+  img->maxval = 250;
+  for (int i = 0; i < 37 * 9; i++) {
+    img->pixels[i].r = img->pixels[i].r * 250 / 255;
+    img->pixels[i].g = img->pixels[i].g * 250 / 255;
+    img->pixels[i].b = img->pixels[i].b * 250 / 255;
+  }
+  enum pixel_type layouts[] = {PIXEL_RGBX8, PIXEL_PLANAR8};
+  enum image_format formats[] = {IMAGE_FORMAT_P3, IMAGE_FORMAT_P6,
+                                 IMAGE_FORMAT_QOI};
+  result_t res = SUCCESS;
+  for (int f = 0; f < 3 && res == SUCCESS; f++) {
+    image_write_to_file_format(img, filename, formats[f], 30);
+    struct image *ref = image_read_from_file(filename);
+    for (int l = 0; l < 2 && res == SUCCESS; l++) {
+      struct image *copy = image_init(img->w, img->h);
+      memcpy(copy->pixels, img->pixels, 37 * 9 * sizeof(struct pixel));
+      copy->maxval = img->maxval;
+      image_convert(copy, layouts[l]);
+      image_write_to_file_format(copy, filename, formats[f], 30);
+      struct image *read = image_read_from_file(filename);
+      if (read->w != 30 || read->maxval != ref->maxval ||
+          memcmp(read->pixels, ref->pixels, 30 * 9 * sizeof(struct pixel))) {
+        printf("layout %d in format %d written differently\n", layouts[l], f);
+        res = FAILURE;
+      }
+      image_destroy(read);
+      image_destroy(copy);
+    }
+    image_destroy(ref);
+  }
+
+  unlink(filename);
+  image_destroy(img);
+  return res;
+}
+
+/**
+ * Check that the luma plane of @p `img` holds the luma of its first @p `w`
+ * columns, in whatever 8-bit RGB layout the pixels are.
+ */
+static bool check_luma(struct image *img, int w) {
+  struct pixel *tmp = malloc(img->w * sizeof(struct pixel));
+  bool ok = true;
+  for (int y = 0; y < img->h; y++) {
+    struct pixel const *row = image_row_rgb8(img, y, w, tmp);
+    for (int x = 0; x < w; x++) {
+      struct pixel p = row[x];
+      if (img->luma[yx_index(y, x, img->w)] !=
+          (77 * p.r + 150 * p.g + 29 * p.b + 128) >> 8)
+        ok = false;
+    }
+  }
+  free(tmp);
+  return ok;
+}
+
+result_t luma_test(const char *test) {
+  (void)test;
+  static const enum pixel_type layouts[] = {PIXEL_RGB8, PIXEL_RGBX8,
+                                            PIXEL_PLANAR8};
+  enum { W = 45, H = 13, N = 20 };
+  struct image *src = create_random(W, H, 77, 256);
+
+  // the seams of the graymap of the luma, found by the scalar code
+  kernels_select(KERNEL_SCALAR);
+  struct image *gray = image_init_type(W, H, PIXEL_GRAY8);
+  for (int i = 0; i < W * H; i++) {
+    struct pixel p = src->pixels[i];
+    gray->gray[i] = (77 * p.r + 150 * p.g + 29 * p.b + 128) >> 8;
+  }
+  uint32_t ref[N][H];
+  for (int i = 0; i < N; i++) {
+    find_seam(gray, W - i, ref[i]);
+    carve_path(gray, W - i, ref[i]);
+  }
+  image_destroy(gray);
+
+  result_t res = SUCCESS;
+  for (int isa = KERNEL_SCALAR; isa < KERNEL_COUNT; isa++) {
+    if (!kernels_select(isa))
+      continue;
+    for (int l = 0; l < 3; l++) {
+      struct image *img = image_init(W, H);
+      memcpy(img->pixels, src->pixels, W * H * sizeof(struct pixel));
+      image_convert(img, layouts[l]);
+      image_add_luma(img);
+      if (img->luma == NULL || !check_luma(img, W)) {
+        printf("%s, layout %d: wrong luma plane\n", kernels_name(isa),
+               layouts[l]);
+        res = FAILURE;
+      }
+      // carving keeps the luma plane in step with the pixels
+      uint32_t seam[H];
+      for (int i = 0; i < N && res == SUCCESS; i++) {
+        find_seam(img, W - i, seam);
+        if (memcmp(seam, ref[i], sizeof(seam)) != 0) {
+          printf("%s, layout %d: seam %d differs from the graymap's\n",
+                 kernels_name(isa), layouts[l], i);
+          res = FAILURE;
+        }
+        carve_path(img, W - i, seam);
+        if (!check_luma(img, W - i - 1)) {
+          printf("%s, layout %d: luma plane out of step after seam %d\n",
+                 kernels_name(isa), layouts[l], i);
+          res = FAILURE;
+        }
+      }
+      image_destroy(img);
+    }
+  }
+  kernels_select(KERNEL_AUTO);
+  image_destroy(src);
+  return res;
+}
+
+/**
+ * Return sample @p `c` of the pixel in column @p `x` and row @p `y` of
+ * @p `img`, or of its luma plane if it has one, with the coordinates clamped
+ * to the @p `w` left columns and to the rows of the image.
+ */
+static int64_t ref_sample(struct image *img, int w, int x, int y, int c) {
+  x = x < 0 ? 0 : x >= w ? w - 1 : x;
+  y = y < 0 ? 0 : y >= (int)img->h ? (int)img->h - 1 : y;
+  size_t i = yx_index(y, x, img->w);
+  if (img->luma != NULL)
+    return img->luma[i];
+  switch (img->type) {
+  case PIXEL_GRAY8:
+    return img->gray[i];
+  case PIXEL_GRAY16:
+    return img->gray16[i];
+  case PIXEL_RGB16:
+    return c == 0 ? img->pixels16[i].r
+                  : c == 1 ? img->pixels16[i].g : img->pixels16[i].b;
+  case PIXEL_RGBX8:
+    return c == 0 ? img->pixelsx[i].r
+                  : c == 1 ? img->pixelsx[i].g : img->pixelsx[i].b;
+  case PIXEL_PLANAR8:
+    return img->planes[i + c * (size_t)img->w * img->h];
+  default:
+    return c == 0 ? img->pixels[i].r
+                  : c == 1 ? img->pixels[i].g : img->pixels[i].b;
+  }
+}
+
+/**
+ * Return the squared distance of the pixels (@p `x0`, @p `y0`) and
+ * (@p `x1`, @p `y1`) of @p `img` with @p `w` columns, see `ref_sample`.
+ */
+static uint64_t ref_distance(struct image *img, int w, int x0, int y0, int x1,
+                             int y1) {
+  int channels = img->luma != NULL ? 1 : pixel_channels(img->type);
+  uint64_t d = 0;
+  for (int c = 0; c < channels; c++) {
+    int64_t diff =
+        ref_sample(img, w, x0, y0, c) - ref_sample(img, w, x1, y1, c);
+    d += diff * diff;
+  }
+  return d;
+}
+
+/**
+ * Calculate the total energy of @p `img` with @p `w` columns and the energy
+ * function @p `kind` straight from its definition into @p `total` and the
+ * path into @p `seam`, with the ties broken like `find_seam`.
+ */
+static void ref_energy_seam(enum energy_kind kind, struct image *img, int w,
+                            uint64_t *total, uint32_t *seam) {
+  int h = img->h, channels = img->luma ? 1 : pixel_channels(img->type);
+  int8_t *from = calloc(w * h, 1);
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      uint64_t e = 0, cost[3] = {0, 0, 0};
+      if (kind == ENERGY_FORWARD) {
+        uint64_t up = ref_distance(img, w, x + 1, y, x - 1, y);
+        cost[0] = up + ref_distance(img, w, x, y - 1, x - 1, y);
+        cost[1] = up;
+        cost[2] = up + ref_distance(img, w, x, y - 1, x + 1, y);
+        e = up;
+      } else if (kind == ENERGY_DUAL_GRADIENT) {
+        e = ref_distance(img, w, x + 1, y, x - 1, y) +
+            ref_distance(img, w, x, y + 1, x, y - 1);
+      } else {
+        for (int c = 0; c < channels; c++) {
+          int64_t s[3][3];
+          for (int dy = 0; dy < 3; dy++)
+            for (int dx = 0; dx < 3; dx++)
+              s[dy][dx] = ref_sample(img, w, x + dx - 1, y + dy - 1, c);
+          int64_t gx = s[0][2] + 2 * s[1][2] + s[2][2] - s[0][0] -
+                       2 * s[1][0] - s[2][0];
+          int64_t gy = s[2][0] + 2 * s[2][1] + s[2][2] - s[0][0] -
+                       2 * s[0][1] - s[0][2];
+          e += gx * gx + gy * gy;
+        }
+        e >>= 4;
+      }
+      if (y == 0) {
+        total[x] = e;
+        continue;
+      }
+      uint64_t const *above = &total[(y - 1) * w];
+      uint64_t best = above[x] + cost[1];
+      if (x > 0 && above[x - 1] + cost[0] < best) {
+        best = above[x - 1] + cost[0];
+        from[y * w + x] = -1;
+      }
+      if (x < w - 1 && above[x + 1] + cost[2] < best) {
+        best = above[x + 1] + cost[2];
+        from[y * w + x] = 1;
+      }
+      total[y * w + x] = best + (kind == ENERGY_FORWARD ? 0 : e);
+    }
+  }
+  int x = 0;
+  for (int i = 1; i < w; i++)
+    if (total[(h - 1) * w + i] < total[(h - 1) * w + x])
+      x = i;
+  for (int y = h - 1; y >= 0; y--) {
+    seam[y] = x;
+    x += from[y * w + x];
+  }
+  free(from);
+}
+
+result_t energy_functions_test(const char *test) {
+  (void)test;
+  static const int shapes[][2] = {{1, 1}, {1, 7}, {7, 1}, {2, 2}, {23, 11}};
+  result_t res = SUCCESS;
+  for (int s = 0; s < 5; s++) {
+    int w0 = shapes[s][0], h = shapes[s][1];
+    struct image *rgb = create_random(w0, h, 300 + s, s % 2 ? 256 : 3);
+    struct image *imgs[7];
+    for (int i = 0; i < 7; i++) {
+      static const enum pixel_type types[] = {
+          PIXEL_RGB8,  PIXEL_RGBX8,  PIXEL_PLANAR8, PIXEL_GRAY8,
+          PIXEL_RGB16, PIXEL_GRAY16, PIXEL_RGB8};
+      imgs[i] = image_init_type(w0, h, types[i]);
+      for (int j = 0; j < w0 * h; j++) {
+        struct pixel p = rgb->pixels[j];
+        // 16-bit samples that are no multiples of 257
+        uint16_t r = p.r * 257 ^ j * 97, g = p.g * 257 ^ j, b = p.b * 251;
+        if (types[i] == PIXEL_GRAY8)
+          imgs[i]->gray[j] = p.g;
+        else if (types[i] == PIXEL_RGB16)
+          imgs[i]->pixels16[j] = (struct pixel16){r, g, b};
+        else if (types[i] == PIXEL_GRAY16)
+          imgs[i]->gray16[j] = r;
+        else
+          imgs[i]->pixels[j] = p;
+      }
+      if (i == 1 || i == 2)
+        image_convert(imgs[i], types[i]);
+    }
+    image_add_luma(imgs[6]);
+
+    uint64_t *ref = malloc(w0 * h * sizeof(uint64_t));
+    uint32_t *energy = malloc(w0 * h * sizeof(uint32_t));
+    uint64_t *energy64 = malloc(w0 * h * sizeof(uint64_t));
+    uint32_t seam[11], ref_seam[11];
+    for (int kind = ENERGY_DUAL_GRADIENT; kind < ENERGY_COUNT; kind++) {
+      energy_select(kind);
+      for (int i = 0; i < 7; i++) {
+        bool wide = imgs[i]->type == PIXEL_RGB16 ||
+                    imgs[i]->type == PIXEL_GRAY16;
+        // all columns, then all but the last two, as after carving
+        for (int w = w0; w > 0 && w >= w0 - 2; w -= 2) {
+          ref_energy_seam(kind, imgs[i], w, ref, ref_seam);
+          find_seam(imgs[i], w, seam);
+          bool same = true;
+          if (wide)
+            calculate_energy64(energy64, imgs[i], w);
+          else
+            calculate_energy(energy, imgs[i], w);
+          for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+              same &= ref[y * w + x] == (wide ? energy64[y * w0 + x]
+                                              : energy[y * w0 + x]);
+          if (!same || memcmp(seam, ref_seam, h * sizeof(uint32_t)) != 0) {
+            printf("%s energy, image %d (%dx%d of %dx%d): %s differs\n",
+                   energy_name(kind), i, w, h, w0, h,
+                   same ? "seam" : "energy");
+            res = FAILURE;
+          }
+        }
+      }
+    }
+    energy_select(ENERGY_GRADIENT);
+    free(energy64);
+    free(energy);
+    free(ref);
+    for (int i = 0; i < 7; i++)
+      image_destroy(imgs[i]);
+    image_destroy(rgb);
+  }
+  return res;
+}
+
+/**
+ * Check the 16-bit direction DP kernel @p `dp_fn` against the definition on
+ * random rows, whose offsets saturate in every other round.
+ */
+result_t check_dp16_kernel(const char *name,
+                           uint32_t (*dp_fn)(uint16_t *, uint32_t *,
+                                             uint16_t const *, int, uint8_t *,
+                                             uint8_t *)) {
+  enum { W0 = 100 };
+  uint32_t local[W0], sums[W0];
+  uint16_t above[W0], row[W0];
+  uint8_t left[(W0 + 7) / 8], right[(W0 + 7) / 8];
+  uint32_t seed = 17;
+  for (int round = 0; round < 20; round++) {
+    for (int x = 0; x < W0; x++) {
+      seed = seed * 1103515245 + 12345;
+      above[x] = (seed >> 28) % 3 + (round % 4 == 1 ? UINT16_MAX - 3 : 0);
+      local[x] = (seed >> 20) % 4 + (round % 2 ? (seed >> 8) % 390150 : 0);
+    }
+    for (int w = 1; w <= W0; w++) {
+      int dirs[W0]; // -1: left, 0: straight above, 1: right
+      uint32_t least_sum = UINT32_MAX;
+      for (int x = 0; x < w; x++) {
+        dirs[x] = 0;
+        if (x > 0 && above[x - 1] < above[x])
+          dirs[x] = -1;
+        if (x < w - 1 && above[x + 1] < above[x + dirs[x]])
+          dirs[x] = 1;
+        if (local[x] + above[x + dirs[x]] < least_sum)
+          least_sum = local[x] + above[x + dirs[x]];
+      }
+      memcpy(sums, local, sizeof(local));
+      memset(row, 0xff, sizeof(row));
+      memset(left, 0xff, sizeof(left));
+      memset(right, 0xff, sizeof(right));
+      uint32_t least = dp_fn(row, sums, above, w, left, right);
+      if (least != least_sum) {
+        printf("%s, round %d, width %d: least sum %u instead of %u\n", name,
+               round, w, least, least_sum);
+        return FAILURE;
+      }
+      for (int x = 0; x < w; x++) {
+        uint32_t sum = local[x] + above[x + dirs[x]];
+        uint32_t offset = sum - least_sum < UINT16_MAX ? sum - least_sum
+                                                       : UINT16_MAX;
+        int dir = (right[x / 8] >> x % 8 & 1) - (left[x / 8] >> x % 8 & 1);
+        if (dir != dirs[x] || sums[x] != sum || row[x] != offset) {
+          printf("%s, round %d, width %d, column %d: direction %d, sum %u, "
+                 "offset %u instead of %d, %u, %u\n",
+                 name, round, w, x, dir, sums[x], row[x], dirs[x], sum,
+                 offset);
+          return FAILURE;
+        }
+      }
+    }
+  }
+  return SUCCESS;
+}
+
+result_t seam_dp_test(const char *test) {
+  (void)test;
+  result_t res = SUCCESS;
+  for (int isa = KERNEL_SCALAR + 1; isa < KERNEL_COUNT; isa++) {
+    struct kernels const *k = kernels_get(isa);
+    if (k != NULL && k->cumulative_row_dir_u16 != NULL &&
+        check_dp16_kernel(k->name, k->cumulative_row_dir_u16) != SUCCESS)
+      res = FAILURE;
+  }
+
+  // without saturation, the 16-bit rows yield the 32-bit seams with every set
+  // of kernels, which verifying confirms
+  size_t mismatches;
+  size_t const verified = seam_dp_verified(&mismatches);
+  int seams = 0;
+  for (int i = 0; i < 8 && res == SUCCESS; i++) {
+    int w = 1 + i * 13 % 90, h = 1 + i * 7 % 23;
+    // samples of at most 15 keep the offsets far below the saturation
+    struct image *img = create_random(w, h, 70 + i, 256);
+    for (int j = 0; j < w * h; j++) {
+      img->pixels[j].r >>= 4;
+      img->pixels[j].g >>= 4;
+      img->pixels[j].b >>= 4;
+    }
+    energy_select(i % 2 ? ENERGY_GRADIENT : ENERGY_DUAL_GRADIENT);
+    uint32_t *exp = seam_init(h), *seam = seam_init(h);
+    for (int isa = 0; isa < KERNEL_COUNT; isa++) {
+      if (!kernels_select(isa))
+        continue;
+      for (int cols = w; cols > 0; cols -= 5) {
+        seam_dp_select(SEAM_DP_U32);
+        find_seam(img, cols, exp);
+        seam_dp_select(SEAM_DP_U16);
+        find_seam(img, cols, seam);
+        seam_dp_select(SEAM_DP_VERIFY);
+        find_seam(img, cols, seam);
+        seams++;
+        if (memcmp(seam, exp, h * sizeof(uint32_t)) != 0) {
+          printf("%dx%d image %d, %d columns, %s kernels: 16-bit seam "
+                 "differs\n",
+                 w, h, i, cols, kernels_name(isa));
+          res = FAILURE;
+        }
+      }
+    }
+    free(seam);
+    free(exp);
+    image_destroy(img);
+  }
+  kernels_select(KERNEL_AUTO);
+  energy_select(ENERGY_GRADIENT);
+  seam_dp_select(SEAM_DP_U32);
+  if (res == SUCCESS &&
+      (seam_dp_verified(&mismatches) != verified + seams || mismatches != 0)) {
+    printf("verifying counted %zu mismatches in %zu seams\n", mismatches,
+           seam_dp_verified(&mismatches) - verified);
+    res = FAILURE;
+  }
+  return res;
+}
+
+result_t energy_plane_test(const char *test) {
+  (void)test;
+  enum { W0 = 37, H = 13, SEAMS = 30 };
+  static const enum pixel_type types[] = {PIXEL_RGB8, PIXEL_RGBX8,
+                                          PIXEL_PLANAR8, PIXEL_GRAY8,
+                                          PIXEL_RGB8,    PIXEL_RGB8};
+  result_t res = SUCCESS;
+  for (int i = 0; i < 6 && res == SUCCESS; i++) {
+    // the plane is carved along the seams of an image without one
+    struct image *imgs[2];
+    for (int j = 0; j < 2; j++) {
+      struct image *rgb = create_random(W0, H, 400 + i, i % 2 ? 3 : 256);
+      if (types[i] == PIXEL_GRAY8) {
+        imgs[j] = image_init_type(W0, H, PIXEL_GRAY8);
+        for (int p = 0; p < W0 * H; p++)
+          imgs[j]->gray[p] = rgb->pixels[p].g;
+        image_destroy(rgb);
+      } else {
+        imgs[j] = rgb;
+        image_convert(rgb, types[i]);
+      }
+      if (i == 4)
+        image_add_luma(imgs[j]);
+    }
+    struct image *img = imgs[0];
+    // the 16-bit DP rows keep the local energy plane alone
+    seam_dp_select(i == 5 ? SEAM_DP_U16 : SEAM_DP_U32);
+    energy_add_plane(img);
+    if ((img->total == NULL) != (i == 5)) {
+      printf("image %d: total energy plane %s\n", i,
+             img->total == NULL ? "missing" : "kept for 16-bit DP rows");
+      res = FAILURE;
+    }
+    uint32_t *exp = seam_init(H), *seam = seam_init(H);
+    for (int s = 0, w = W0; s < SEAMS && res == SUCCESS; s++, w--) {
+      find_seam(imgs[1], w, exp);
+      find_seam(img, w, seam);
+      if (s % 7 == 6) {
+        // seams that jump sideways change more upper neighbours
+        for (int y = 0; y < H; y++)
+          exp[y] = seam[y] = (y * 5 + s) % w;
+      }
+      if (memcmp(seam, exp, H * sizeof(uint32_t)) != 0) {
+        printf("image %d, seam %d: differs with the local energy plane\n", i,
+               s);
+        res = FAILURE;
+      }
+      carve_path(imgs[1], w, exp);
+      carve_path(img, w, exp);
+      for (int y = 0; y < H && res == SUCCESS; y++) {
+        for (int x = 0; x < w - 1; x++) {
+          uint64_t ref = ref_distance(img, w - 1, x, y, x, y - 1) +
+                         ref_distance(img, w - 1, x, y, x - 1, y);
+          if (img->energy[yx_index(y, x, W0)] != ref) {
+            printf("image %d, seam %d: energy %u at (%d, %d) instead of "
+                   "%" PRIu64 "\n",
+                   i, s, img->energy[yx_index(y, x, W0)], x, y, ref);
+            res = FAILURE;
+            break;
+          }
+        }
+      }
+    }
+    free(seam);
+    free(exp);
+    image_destroy(imgs[1]);
+    image_destroy(img);
+  }
+  seam_dp_select(SEAM_DP_U32);
+  return res;
+}
+
+result_t total_plane_test(const char *test) {
+  (void)test;
+  enum { W0 = 41, H = 17, SEAMS = 34 };
+  static const enum pixel_type types[] = {PIXEL_RGB8, PIXEL_GRAY8,
+                                          PIXEL_PLANAR8, PIXEL_RGB8};
+  result_t res = SUCCESS;
+  for (int i = 0; i < 4 && res == SUCCESS; i++) {
+    // the twin without planes has its totals calculated from scratch
+    struct image *imgs[2];
+    for (int j = 0; j < 2; j++) {
+      struct image *rgb = create_random(W0, H, 500 + i, i % 2 ? 2 : 256);
+      if (types[i] == PIXEL_GRAY8) {
+        imgs[j] = image_init_type(W0, H, PIXEL_GRAY8);
+        for (int p = 0; p < W0 * H; p++)
+          imgs[j]->gray[p] = rgb->pixels[p].g;
+        image_destroy(rgb);
+      } else {
+        imgs[j] = rgb;
+        image_convert(rgb, types[i]);
+      }
+      if (i == 3)
+        image_add_luma(imgs[j]);
+    }
+    struct image *img = imgs[0];
+    energy_add_plane(img);
+    uint32_t *energy = energy_init(W0, H);
+    uint32_t *exp = seam_init(H), *seam = seam_init(H);
+    for (int s = 0, w = W0; s < SEAMS && res == SUCCESS; s++, w--) {
+      find_seam(imgs[1], w, exp);
+      find_seam(img, w, seam);
+      if (memcmp(seam, exp, H * sizeof(uint32_t)) != 0) {
+        printf("image %d, seam %d: differs with the total energy plane\n", i,
+               s);
+        res = FAILURE;
+      }
+      if (s % 5 == 4) {
+        // seams that jump sideways change the totals below them most
+        for (int y = 0; y < H; y++)
+          exp[y] = (y * 7 + s) % w;
+      }
+      if (s == 20) {
+        // the planes were kept for one column more, which takes a full
+        // recalculation
+        w--;
+        for (int y = 0; y < H; y++)
+          exp[y] = exp[y] < (uint32_t)w ? exp[y] : (uint32_t)w - 1;
+      }
+      carve_path(imgs[1], w, exp);
+      carve_path(img, w, exp);
+      calculate_energy(energy, imgs[1], w - 1);
+      for (int y = 0; y < H && res == SUCCESS; y++) {
+        size_t const row = yx_index(y, 0, W0);
+        if (memcmp(&img->total[row], &energy[row],
+                   (w - 1) * sizeof(uint32_t)) != 0) {
+          printf("image %d, seam %d: total energy of row %d differs\n", i, s,
+                 y);
+          res = FAILURE;
+        }
+      }
+    }
+    free(seam);
+    free(exp);
+    free(energy);
+    image_destroy(imgs[1]);
+    image_destroy(img);
+  }
+  return res;
+}
+
+result_t seams_per_pass_test(const char *test) {
+  (void)test;
+  enum { W0 = 43, H = 19, PASSES = 4 };
+  static const enum pixel_type types[] = {PIXEL_RGB8, PIXEL_GRAY8,
+                                          PIXEL_PLANAR8, PIXEL_RGB8};
+  static const int ks[] = {2, 5, 64};
+  result_t res = SUCCESS;
+  for (int i = 0; i < 12 && res == SUCCESS; i++) {
+    int const k = ks[i % 3];
+    // carved with `carve_paths`, with `carve_path` and with energy planes
+    struct image *imgs[3];
+    for (int j = 0; j < 3; j++) {
+      struct image *rgb = create_random(W0, H, 600 + i, i % 2 ? 4 : 256);
+      if (types[i / 3] == PIXEL_GRAY8) {
+        imgs[j] = image_init_type(W0, H, PIXEL_GRAY8);
+        for (int p = 0; p < W0 * H; p++)
+          imgs[j]->gray[p] = rgb->pixels[p].g;
+        image_destroy(rgb);
+      } else {
+        imgs[j] = rgb;
+        image_convert(rgb, types[i / 3]);
+      }
+      if (i / 3 == 3)
+        image_add_luma(imgs[j]);
+    }
+    energy_add_plane(imgs[2]);
+    uint32_t *const seams = calloc((size_t)k * H, sizeof(uint32_t));
+    uint32_t *const best = seam_init(H), *const seam = seam_init(H);
+    for (int pass = 0, w = W0; pass < PASSES && res == SUCCESS; pass++) {
+      find_seam(imgs[0], w, best);
+      int const found = find_seams(imgs[0], w, k, seams);
+      if (found < 1 || found > k || found > w) {
+        printf("image %d, pass %d: %d paths found\n", i, pass, found);
+        res = FAILURE;
+        break;
+      }
+      bool optimal = false;
+      for (int j = 0; j < found && res == SUCCESS; j++) {
+        uint32_t const *const path = &seams[(size_t)j * H];
+        optimal |= memcmp(path, best, H * sizeof(uint32_t)) == 0;
+        for (int y = 0; y < H; y++) {
+          // left to right in every row, so they neither meet nor cross
+          if (path[y] >= (uint32_t)w ||
+              (y > 0 && abs((int)path[y] - (int)path[y - 1]) > 1) ||
+              (j > 0 && path[y] <= path[y - H])) {
+            printf("image %d, pass %d: path %d is invalid in row %d\n", i,
+                   pass, j, y);
+            res = FAILURE;
+            break;
+          }
+        }
+      }
+      if (res == SUCCESS && !optimal) {
+        printf("image %d, pass %d: the optimal path is missing\n", i, pass);
+        res = FAILURE;
+      }
+      if (res != SUCCESS)
+        break;
+
+      carve_paths(imgs[0], w, found, seams);
+      carve_paths(imgs[2], w, found, seams);
+      for (int j = 0; j < found; j++) {
+        for (int y = 0; y < H; y++)
+          seam[y] = seams[(size_t)j * H + y] - j;
+        carve_path(imgs[1], w - j, seam);
+      }
+      w -= found;
+      size_t const size = (size_t)W0 * H * pixel_size(types[i / 3]);
+      for (int j = 0; j < 3; j += 2) {
+        if (memcmp(imgs[j]->pixels, imgs[1]->pixels, size) != 0 ||
+            (imgs[1]->luma != NULL &&
+             memcmp(imgs[j]->luma, imgs[1]->luma, W0 * H) != 0)) {
+          printf("image %d, pass %d: carving %d paths at once differs\n", i,
+                 pass, found);
+          res = FAILURE;
+        }
+      }
+      if (w <= 1)
+        break;
+    }
+    free(seam);
+    free(best);
+    free(seams);
+    for (int j = 0; j < 3; j++)
+      image_destroy(imgs[j]);
+  }
+  return res;
+}
+
+result_t deferred_compaction_test(const char *test) {
+  (void)test;
+  enum { W0 = 37, H = 13, SEAMS = 30 };
+  static const enum pixel_type types[] = {PIXEL_RGB8, PIXEL_GRAY8,
+                                          PIXEL_PLANAR8, PIXEL_RGBX8,
+                                          PIXEL_RGB8};
+  static const uint32_t capacities[] = {1, 4, 11};
+  result_t res = SUCCESS;
+  for (int i = 0; i < 15 && res == SUCCESS; i++) {
+    enum pixel_type const type = types[i / 3];
+    // the twin is compacted along every path
+    struct image *imgs[2];
+    for (int j = 0; j < 2; j++) {
+      struct image *rgb = create_random(W0, H, 700 + i, i % 2 ? 3 : 256);
+      if (type == PIXEL_GRAY8) {
+        imgs[j] = image_init_type(W0, H, PIXEL_GRAY8);
+        for (int p = 0; p < W0 * H; p++)
+          imgs[j]->gray[p] = rgb->pixels[p].g;
+        image_destroy(rgb);
+      } else {
+        imgs[j] = rgb;
+        image_convert(rgb, type);
+      }
+      if (i / 3 == 4)
+        image_add_luma(imgs[j]);
+      energy_add_plane(imgs[j]);
+    }
+    struct image *img = imgs[0];
+    image_defer_compaction(img, capacities[i % 3]);
+    uint32_t *exp = seam_init(H), *seam = seam_init(H);
+    size_t const size = (size_t)W0 * H * pixel_size(type);
+    for (int s = 0, w = W0; s < SEAMS && res == SUCCESS; s++, w--) {
+      find_seam(imgs[1], w, exp);
+      find_seam(img, w, seam);
+      if (memcmp(seam, exp, H * sizeof(uint32_t)) != 0) {
+        printf("image %d, seam %d: differs with deferred compaction\n", i, s);
+        res = FAILURE;
+      }
+      if (s % 6 == 5) {
+        // seams that jump sideways pass between the recorded ones
+        for (int y = 0; y < H; y++)
+          exp[y] = (y * 3 + s) % w;
+      }
+      carve_path(imgs[1], w, exp);
+      carve_path(img, w, exp);
+      if (s % 4 == 3 || s == SEAMS - 1) {
+        image_compact(img);
+        if (memcmp(img->pixels, imgs[1]->pixels, size) != 0 ||
+            (img->luma != NULL &&
+             memcmp(img->luma, imgs[1]->luma, W0 * H) != 0)) {
+          printf("image %d, seam %d: the compacted pixels differ\n", i, s);
+          res = FAILURE;
+        }
+      }
+    }
+    free(seam);
+    free(exp);
+    for (int j = 0; j < 2; j++)
+      image_destroy(imgs[j]);
+  }
+  return res;
+}
+
+/**
+ * Create a random image of @p `w` x @p `h` pixels of the 8-bit @p `type`,
+ * with a luma plane if @p `luma` is set.
+ */
+static struct image *create_random_type(int w, int h, uint32_t seed,
+                                        enum pixel_type type, bool luma) {
+  struct image *const rgb = create_random(w, h, seed, 256);
+  struct image *img = rgb;
+  if (type == PIXEL_GRAY8) {
+    img = image_init_type(w, h, PIXEL_GRAY8);
+    for (int p = 0; p < w * h; p++)
+      img->gray[p] = rgb->pixels[p].g;
+    image_destroy(rgb);
+  } else {
+    image_convert(img, type);
+  }
+  if (luma)
+    image_add_luma(img);
+  return img;
+}
+
+result_t pyramid_test(const char *test) {
+  (void)test;
+  // three levels, so the middle one defers its compaction
+  enum { W0 = 600, H = 480, SEAMS = 6 };
+  static const enum pixel_type types[] = {PIXEL_RGB8, PIXEL_GRAY8,
+                                          PIXEL_PLANAR8, PIXEL_RGBX8,
+                                          PIXEL_RGB8};
+  result_t res = SUCCESS;
+  for (int i = 0; i < 10 && res == SUCCESS; i++) {
+    enum pixel_type const type = types[i / 2];
+    // the twin is carved along every path without a pyramid
+    struct image *const img =
+        create_random_type(W0, H, 900 + i, type, i / 2 == 4);
+    struct image *const twin =
+        create_random_type(W0, H, 900 + i, type, i / 2 == 4);
+    image_defer_compaction(img, 4);
+    // a band as wide as the image finds the optimal paths, and wider ones
+    // are taken as wide as the image
+    int const band = i % 2 ? INT_MAX : 1;
+    struct pyramid *const pyr = pyramid_init(img, band);
+    uint32_t *exp = seam_init(H), *seam = seam_init(H);
+    size_t const size = (size_t)W0 * H * pixel_size(type);
+    for (int s = 0, w = W0; s < SEAMS && res == SUCCESS; s++, w--) {
+      pyramid_find_seam(pyr, w, seam);
+      find_seam(twin, w, exp);
+      for (uint32_t y = 0; y < H; y++) {
+        if (seam[y] >= (uint32_t)w ||
+            (y > 0 && seam[y] + 1 < seam[y - 1]) ||
+            (y > 0 && seam[y] > seam[y - 1] + 1)) {
+          printf("image %d, seam %d: invalid in row %u\n", i, s, y);
+          res = FAILURE;
+          break;
+        }
+      }
+      if (band > 1 && memcmp(seam, exp, H * sizeof(uint32_t)) != 0) {
+        printf("image %d, seam %d: differs from find_seam\n", i, s);
+        res = FAILURE;
+      }
+      pyramid_carve_path(pyr, w, seam);
+      carve_path(twin, w, seam);
+    }
+    image_compact(img);
+    if (memcmp(img->pixels, twin->pixels, size) != 0 ||
+        (img->luma != NULL && memcmp(img->luma, twin->luma, W0 * H) != 0)) {
+      printf("image %d: the carved pixels differ\n", i);
+      res = FAILURE;
+    }
+    pyramid_destroy(pyr);
+    free(seam);
+    free(exp);
+    image_destroy(twin);
+    image_destroy(img);
+  }
+
+  // small images and other energy functions find their seams without one
+  struct image *const img = create_random(300, 300, 999, 256);
+  struct image *const small = create_random(256, 256, 999, 256);
+  if (pyramid_init(small, 4) != NULL) {
+    printf("a pyramid for an image of %d pixels\n", PYRAMID_PIXELS);
+    res = FAILURE;
+  }
+  energy_select(ENERGY_SOBEL);
+  if (pyramid_init(img, 4) != NULL) {
+    printf("a pyramid for the sobel energy\n");
+    res = FAILURE;
+  }
+  energy_select(ENERGY_GRADIENT);
+  image_destroy(small);
+  image_destroy(img);
+  return res;
+}
+
+result_t energy_rgb16_test(const char *test) {
+  (void)test;
+  struct image *img = create_small2();
+  struct image *wide = widen_image(img);
+  uint32_t *energy = energy_init(img->w, img->h);
+  uint64_t *wide_energy = calloc(img->w * img->h, sizeof(uint64_t));
+  calculate_energy(energy, img, img->w);
+  calculate_energy64(wide_energy, wide, wide->w);
+
+  // scaling the samples by 257 scales their squared differences by 257 * 257
+  result_t res = SUCCESS;
+  for (uint32_t i = 0; i < img->w * img->h; i++) {
+    if (wide_energy[i] != (uint64_t)energy[i] * 257 * 257) {
+      printf("energy at %u: %" PRIu64 "\nref energy: %u * 257 * 257\n", i,
+             wide_energy[i], energy[i]);
+      res = FAILURE;
+    }
+  }
+  image_destroy(wide);
+  image_destroy(img);
+  free(wide_energy);
+  free(energy);
+  return res;
+}
+
+/**
+ * Create a grayscale image and the RGB image with the same gray values.
+ */
+void create_gray_and_rgb(struct image **gray, struct image **rgb) {
+  const int w = 5;
+  const int h = 4;
+  *gray = image_init_type(w, h, PIXEL_GRAY8);
+  *rgb = image_init(w, h);
+  for (int i = 0; i < w * h; i++) {
+    uint8_t v = (uint8_t)(i * 37 % 251);
+    (*gray)->gray[i] = v;
+    (*rgb)->pixels[i].r = v;
+    (*rgb)->pixels[i].g = v;
+    (*rgb)->pixels[i].b = v;
+  }
+}
+
+result_t energy_gray_test(const char *test) {
+  (void)test;
+  struct image *gray, *rgb;
+  create_gray_and_rgb(&gray, &rgb);
+  uint32_t *energy = energy_init(gray->w, gray->h);
+  uint32_t *ref_energy = energy_init(rgb->w, rgb->h);
+  calculate_energy(energy, gray, gray->w - 1);
+  calculate_energy(ref_energy, rgb, rgb->w - 1);
+
+  // the RGB energy of gray pixels is three times the gray energy
+  result_t res = SUCCESS;
+  for (uint32_t y = 0; y < gray->h; y++) {
+    for (uint32_t x = 0; x < gray->w - 1; x++) {
+      int i = yx_index(y, x, gray->w);
+      if (3 * energy[i] != ref_energy[i]) {
+        printf("energy at %d: %u\nref energy: %u / 3\n", i, energy[i],
+               ref_energy[i]);
+        res = FAILURE;
+      }
+    }
+  }
+  image_destroy(gray);
+  image_destroy(rgb);
+  free(energy);
+  free(ref_energy);
+  return res;
+}
+
+result_t carve_path_gray_test(const char *test) {
+  (void)test;
+  struct image *gray, *rgb;
+  create_gray_and_rgb(&gray, &rgb);
+  uint32_t *seam = seam_init(gray->h);
+  seam[0] = 4;
+  seam[1] = 2;
+  seam[2] = 0;
+  seam[3] = 1;
+  carve_path(gray, gray->w, seam);
+  carve_path(rgb, rgb->w, seam);
+
+  result_t res = SUCCESS;
+  for (uint32_t i = 0; i < gray->w * gray->h; i++) {
+    if (gray->gray[i] != rgb->pixels[i].r) {
+      printf("at pixel %u: expected %d, but got %d\n", i, rgb->pixels[i].r,
+             gray->gray[i]);
+      res = FAILURE;
+    }
+  }
+  image_destroy(gray);
+  image_destroy(rgb);
+  free(seam);
+  return res;
+}
+
+/**
+ * Compare the rows and the path streamed from the file @p `filename` with those
+ * of the whole image read from it.
+ */
+result_t check_stream(const char *filename) {
+  struct image *img = image_read_from_file(filename);
+  struct image_stream *stream = image_stream_open(filename);
+  struct image *window = image_stream_window(stream);
+  size_t row_size = img->w * pixel_size(img->type);
+  result_t res = SUCCESS;
+  if (window->type != img->type || window->w != img->w ||
+      window->maxval != img->maxval || image_stream_height(stream) != img->h) {
+    printf("stream of type %d has a different window or height\n",
+           img->type);
+    res = FAILURE;
+  }
+  for (uint32_t y = 0; y < img->h && res == SUCCESS; y++) {
+    int row = image_stream_read_row(stream);
+    if (memcmp((char *)window->pixels + row * row_size,
+               (char *)img->pixels + y * row_size, row_size) != 0) {
+      printf("row %u of type %d streamed differently\n", y, img->type);
+      res = FAILURE;
+    }
+  }
+  image_stream_close(stream);
+
+  uint32_t *seam = calloc(img->h, sizeof(uint32_t));
+  uint32_t *stream_seam = calloc(img->h, sizeof(uint32_t));
+  stream = image_stream_open(filename);
+  find_seam_stream(stream, stream_seam);
+  image_stream_close(stream);
+  find_seam(img, img->w, seam);
+  if (res == SUCCESS &&
+      memcmp(seam, stream_seam, img->h * sizeof(uint32_t)) != 0) {
+    printf("path of type %d streamed differently\n", img->type);
+    res = FAILURE;
+  }
+  free(stream_seam);
+  free(seam);
+  image_destroy(img);
+  return res;
+}
+
+result_t stream_rows_test(const char *test) {
+  (void)test;
+  char filename[] = "/tmp/carve_test_XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd < 0) {
+    printf("could not create a temporary file\n");
+    return FAILURE;
+  }
+  close(fd);
+
+  struct image *gray, *rgb;
+  create_gray_and_rgb(&gray, &rgb);
+  struct image *random = create_random(37, 9, 4242, 4);
+  struct image *imgs[] = {random, widen_image(random), gray};
+  enum image_format formats[] = {IMAGE_FORMAT_P3, IMAGE_FORMAT_P6,
+                                 IMAGE_FORMAT_QOI};
+  result_t res = SUCCESS;
+  for (int i = 0; i < 3 && res == SUCCESS; i++) {
+    for (int f = 0; f < 3 && res == SUCCESS; f++) {
+      image_write_to_file_format(imgs[i], filename, formats[f], imgs[i]->w);
+      res = check_stream(filename);
+      // the forward energy only reads the row above as well
+      energy_select(ENERGY_FORWARD);
+      if (res == SUCCESS)
+        res = check_stream(filename);
+      energy_select(ENERGY_GRADIENT);
+    }
+  }
+
+  unlink(filename);
+  for (int i = 0; i < 3; i++)
+    image_destroy(imgs[i]);
+  image_destroy(rgb);
+  return res;
+}
+
 test_fun_t get_test(const char *test) {
   TEST("public.statistics.brightness_small2", brightness_small2_test);
   TEST("public.min_path.diff_color", diff_color_test);
@@ -419,5 +2017,27 @@ test_fun_t get_test(const char *test) {
   TEST("public.min_path.min_energy_wide_1", min_energy_wide_1_test);
   TEST("public.min_path.optimal_path_tall", optimal_path_tall_test);
   TEST("public.carve.carve_path_small2", carve_path_small2_test);
+  TEST("public.formats.p6_read_write", p6_read_write_test);
+  TEST("public.formats.p6_map_carve", p6_map_carve_test);
+  TEST("public.min_path.energy_gray", energy_gray_test);
+  TEST("public.carve.carve_path_gray", carve_path_gray_test);
+  TEST("public.formats.rgb16_read_write", rgb16_read_write_test);
+  TEST("public.formats.qoi_read_write", qoi_read_write_test);
+  TEST("public.min_path.energy_rgb16", energy_rgb16_test);
+  TEST("public.min_path.local_energy_simd", local_energy_simd_test);
+  TEST("public.min_path.cumulative_simd", cumulative_simd_test);
+  TEST("public.statistics.brightness_simd", brightness_simd_test);
+  TEST("public.carve.kernel_conformance", kernel_conformance_test);
+  TEST("public.min_path.direction_bits", direction_bits_test);
+  TEST("public.min_path.stream_rows", stream_rows_test);
+  TEST("public.formats.layout_read_write", layout_read_write_test);
+  TEST("public.min_path.luma", luma_test);
+  TEST("public.min_path.energy_functions", energy_functions_test);
+  TEST("public.min_path.seam_dp", seam_dp_test);
+  TEST("public.carve.energy_plane", energy_plane_test);
+  TEST("public.carve.total_plane", total_plane_test);
+  TEST("public.carve.seams_per_pass", seams_per_pass_test);
+  TEST("public.carve.deferred_compaction", deferred_compaction_test);
+  TEST("public.carve.pyramid", pyramid_test);
   return NULL;
 }
@@ -0,0 +1,113 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/energy.h"
+#include "../../src/image.h"
+
+#include "bench_common.h"
+
+// Add color definitions
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+// A run of carving seams with up to k seams per pass.
+struct batch_run {
+    struct image* img; // the carved image
+    double secs;       // finding and carving the seams
+    uint64_t cost;     // the local energy the seams took away
+    int passes;        // the number of energy calculations
+};
+
+// Carve @p n seams out of a copy of @p src with up to @p k seams per pass,
+// like `find_and_carve_path` does.
+static struct batch_run carve(struct image* src, int n, int k) {
+    struct batch_run run = {copy_image(src), 0, 0, 0};
+    struct image* img = run.img;
+    uint32_t* seams = malloc((size_t)k * img->h * sizeof(uint32_t));
+    int w = img->w;
+    double start = now_secs();
+    if (k == 1) energy_add_plane(img);
+    run.secs += now_secs() - start;
+    while (n > 0) {
+        start = now_secs();
+        int found = find_seams(img, w, k < n ? k : n, seams);
+        run.secs += now_secs() - start;
+        // the costs of a batch are those of the image it was found in
+        for (int j = 0; j < found; j++)
+            run.cost += seam_cost(img, &seams[(size_t)j * img->h]);
+        start = now_secs();
+        carve_paths(img, w, found, seams);
+        run.secs += now_secs() - start;
+        w -= found;
+        n -= found;
+        run.passes++;
+    }
+    free(seams);
+    return run;
+}
+
+// Report the quality and the speed of carving a quarter of the columns out of
+// @p img, which is called @p name, with several seams per pass against one.
+static void report(char const* name, struct image* img) {
+    static int const ks[] = {1, 2, 4, 8, 16, 32, 64};
+    int n = img->w / 4 > 0 ? img->w / 4 : 1;
+    struct batch_run exact = carve(img, n, 1);
+    size_t px = (size_t)img->w * img->h;
+    for (size_t i = 0; i < sizeof(ks) / sizeof(ks[0]); i++) {
+        struct batch_run run = i == 0 ? exact : carve(img, n, ks[i]);
+        size_t differing = 0;
+        double sq = 0;
+        for (size_t p = 0; p < px; p++) {
+            struct pixel a = run.img->pixels[p], b = exact.img->pixels[p];
+            differing += memcmp(&a, &b, sizeof(a)) != 0;
+            sq += diff_color(a, b);
+        }
+        double psnr = sq ? 10 * log10(255.0 * 255.0 * 3 * px / sq) : INFINITY;
+        printf("%-22s %5d %3d %6d %8.3f %8.2f%% %6.1fdB %8.1fms %7.2fx\n",
+               name, n, ks[i], run.passes, (double)run.cost / exact.cost,
+               100.0 * differing / px, psnr, run.secs * 1e3,
+               exact.secs / run.secs);
+        if (i > 0) image_destroy(run.img);
+    }
+    image_destroy(exact.img);
+}
+
+int main(int argc, char** argv) {
+    static char const* const corpus[] = {"test/data/owl.ppm",
+                                         "test/data/owl2.ppm",
+                                         "test/data/small2.ppm"};
+    int n_files = argc > 1 ? argc - 1 : 3;
+    char const* const* files =
+        argc > 1 ? (char const* const*)argv + 1 : corpus;
+
+    printf("Seams per pass, carving a quarter of the columns\n");
+    printf("%-22s %5s %3s %6s %8s %9s %8s %10s %8s\n", "image", "seams", "k",
+           "passes", "cost", "differ", "PSNR", "time", "speedup");
+    for (int i = 0; i < n_files; i++) {
+        struct image* img = image_read_from_file(files[i]);
+        if (!pixel_is_rgb8(img->type)) {
+            printf("%-22s skipped, not an 8-bit RGB image\n", files[i]);
+            image_destroy(img);
+            continue;
+        }
+        char const* slash = strrchr(files[i], '/');
+        report(slash ? slash + 1 : files[i], img);
+        if (i == 0) {
+            struct image* big = tile(img, 1920, 1080);
+            char name[64];
+            snprintf(name, sizeof(name), "%s 1920x1080",
+                     slash ? slash + 1 : files[i]);
+            report(name, big);
+            image_destroy(big);
+        }
+        image_destroy(img);
+    }
+    printf("cost: local energy the seams take away over that of one seam per "
+           "pass;\ndiffer/PSNR: output against one seam per pass\n");
+
+    printf("%sPASSED%s Batch benchmark\n", GREEN, RESET);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "bench_common.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "../../src/energy.h"
+#include "../../src/indexing.h"
+
+double now_secs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct image* tile(struct image* src, int w, int h) {
+    struct image* img = image_init(w, h);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            img->pixels[(size_t)y * w + x] =
+                src->pixels[(y % src->h) * src->w + x % src->w];
+        }
+    }
+    return img;
+}
+
+struct image* copy_image(struct image* src) {
+    struct image* img = image_init(src->w, src->h);
+    memcpy(img->pixels, src->pixels,
+           (size_t)src->w * src->h * sizeof(struct pixel));
+    return img;
+}
+
+// The pixel of @p img in column @p x of row @p y, counted without the gaps.
+static struct pixel pixel_at(struct image* img, uint32_t y, uint32_t x) {
+    return img->pixels[yx_index(y, image_column(img, y, x), img->w)];
+}
+
+uint64_t seam_cost(struct image* img, uint32_t const* seam) {
+    uint64_t cost = 0;
+    for (uint32_t y = 0; y < img->h; y++) {
+        uint32_t x = seam[y];
+        struct pixel p = pixel_at(img, y, x);
+        if (y > 0) cost += diff_color(p, pixel_at(img, y - 1, x));
+        if (x > 0) cost += diff_color(p, pixel_at(img, y, x - 1));
+    }
+    return cost;
+}
@@ -0,0 +1,23 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <stdint.h>
+
+#include "../../src/image.h"
+
+// The time of a monotonic clock in seconds.
+double now_secs(void);
+
+// Tile the packed RGB image @p src to a @p w x @p h image.
+struct image* tile(struct image* src, int w, int h);
+
+// A copy of the packed RGB image @p src.
+struct image* copy_image(struct image* src);
+
+// The RGB energy of @p seam through the packed RGB image @p img: the sum of
+// the local energies with diff_color along it, which is what the exact seam
+// minimizes and carving it takes away. The pixels are found through the gaps
+// of a deferred compaction.
+uint64_t seam_cost(struct image* img, uint32_t const* seam);
+
+#endif
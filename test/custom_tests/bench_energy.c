@@ -0,0 +1,529 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/energy.h"
+#include "../../src/energy_functions.h"
+#include "../../src/image.h"
+#include "../../src/indexing.h"
+#include "../../src/kernels.h"
+
+#include "bench_common.h"
+
+// Add color definitions
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+// The original local-energy loop of calculate_energy, kept as the baseline to
+// compare to.
+static void legacy_local_energy(uint32_t* energy, struct image* img, int w) {
+    for (int y = 0; y < img->h; y++) {
+        for (int x = 0; x < w; x++) {
+            int index = yx_index(y, x, img->w);
+            uint32_t local_energy = 0;
+            struct pixel present = img->pixels[index];
+            if (x == 0 && y == 0) {
+                energy[index] = 0;
+                continue;
+            }
+            if (y > 0) {
+                struct pixel above = img->pixels[yx_index(y - 1, x, img->w)];
+                local_energy += diff_color(present, above);
+            }
+            if (x > 0) {
+                struct pixel left = img->pixels[yx_index(y, x - 1, img->w)];
+                local_energy += diff_color(present, left);
+            }
+            energy[index] = local_energy;
+        }
+    }
+}
+
+// The original cumulative loop of calculate_energy followed by the search of
+// the bottom row, kept as the baseline to compare to.
+static int legacy_cumulative(uint32_t* energy, int w0, int w, int h) {
+    for (int y = 1; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            int index = yx_index(y, x, w0);
+            uint32_t top = energy[yx_index(y - 1, x, w0)];
+            if (x > 0) {
+                uint32_t top_left = energy[yx_index(y - 1, x - 1, w0)];
+                if (top_left < top) top = top_left;
+            }
+            if (x < w - 1) {
+                uint32_t top_right = energy[yx_index(y - 1, x + 1, w0)];
+                if (top_right < top) top = top_right;
+            }
+            energy[index] += top;
+        }
+    }
+    return calculate_min_energy_column(energy, w0, w, h);
+}
+
+typedef void (*row_kernel)(uint32_t*, struct pixel const*,
+                           struct pixel const*, int);
+
+// Run @p kernel on every row below the first one; the first row is the same
+// for all variants and left to the legacy loop.
+static void rows_local_energy(uint32_t* energy, struct image* img,
+                              row_kernel kernel) {
+    for (int y = 1; y < img->h; y++) {
+        struct pixel const* row = &img->pixels[yx_index(y, 0, img->w)];
+        kernel(&energy[yx_index(y, 0, img->w)], row, row - img->w, img->w);
+    }
+}
+
+// Time @p kernel (or the legacy loop if NULL) on @p img, compare the result
+// with @p ref and return GB/s of pixels read and energies written.
+static double bench_kernel(const char* name, row_kernel kernel,
+                           struct image* img, uint32_t* energy,
+                           uint32_t const* ref, int reps) {
+    size_t n = (size_t)img->w * img->h;
+    double best = 1e30;
+    for (int i = 0; i < reps; i++) {
+        memset(energy, 0, n * sizeof(*energy));
+        double start = now_secs();
+        if (kernel)
+            rows_local_energy(energy, img, kernel);
+        else
+            legacy_local_energy(energy, img, img->w);
+        double elapsed = now_secs() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    // the first row is only computed by the legacy loop
+    if (memcmp(energy + img->w, ref + img->w,
+               (n - img->w) * sizeof(*energy)) != 0) {
+        printf("%sFAILED%s %s differs from the legacy loop\n", RED, RESET,
+               name);
+        exit(EXIT_FAILURE);
+    }
+
+    double gbps = n * (sizeof(struct pixel) + sizeof(uint32_t)) / best / 1e9;
+    printf("%-8s %8.2f ms: %6.2f GB/s\n", name, best * 1e3, gbps);
+    return gbps;
+}
+
+typedef void (*dp_kernel)(uint32_t*, uint32_t const*, int);
+typedef int (*dp_min_kernel)(uint32_t*, uint32_t const*, int);
+
+// Run the DP row update @p kernel on every row below the first one, and
+// @p min_kernel on the bottom row.
+static int rows_cumulative(uint32_t* energy, int w0, int h, dp_kernel kernel,
+                           dp_min_kernel min_kernel) {
+    for (int y = 1; y < h - 1; y++)
+        kernel(&energy[y * w0], &energy[(y - 1) * w0], w0);
+    return min_kernel(&energy[(h - 1) * w0], &energy[(h - 2) * w0], w0);
+}
+
+// Time the DP pass with @p kernel and @p min_kernel (or the legacy loop if
+// NULL) on the local energy @p local, compare the result and the minimum
+// with @p ref and @p ref_min and return GB/s of energies read and written.
+static double bench_dp(const char* name, dp_kernel kernel,
+                       dp_min_kernel min_kernel, uint32_t const* local,
+                       int w0, int h, uint32_t* energy, uint32_t const* ref,
+                       int ref_min, int reps) {
+    size_t n = (size_t)w0 * h;
+    double best = 1e30;
+    int min = -1;
+    for (int i = 0; i < reps; i++) {
+        memcpy(energy, local, n * sizeof(*energy));
+        double start = now_secs();
+        if (kernel)
+            min = rows_cumulative(energy, w0, h, kernel, min_kernel);
+        else
+            min = legacy_cumulative(energy, w0, w0, h);
+        double elapsed = now_secs() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    if (min != ref_min || memcmp(energy, ref, n * sizeof(*energy)) != 0) {
+        printf("%sFAILED%s %s differs from the legacy loop\n", RED, RESET,
+               name);
+        exit(EXIT_FAILURE);
+    }
+
+    double gbps = n * 2 * sizeof(uint32_t) / best / 1e9;
+    printf("%-8s %8.2f ms: %6.2f GB/s\n", name, best * 1e3, gbps);
+    return gbps;
+}
+
+// Time the whole energy calculation with the kernels of @p isa: two passes
+// over the image with its row kernels, or the fused single pass of
+// calculate_energy_min_column if @p fused is set. Compare the result and the
+// minimum with @p ref and @p ref_min and return the time in seconds.
+static double bench_total(enum kernel_isa isa, bool fused, struct image* img,
+                          uint32_t* energy, uint32_t const* ref, int ref_min,
+                          int reps) {
+    struct kernels const* k = kernels_get(isa);
+    size_t n = (size_t)img->w * img->h;
+    double best = 1e30;
+    int min = -1;
+    kernels_select(isa);
+    for (int i = 0; i < reps; i++) {
+        double start = now_secs();
+        if (fused) {
+            min = calculate_energy_min_column(energy, img, img->w);
+        } else {
+            energy[0] = 0;
+            for (uint32_t x = 1; x < img->w; x++)
+                energy[x] = diff_color(img->pixels[x], img->pixels[x - 1]);
+            rows_local_energy(energy, img, k->local_energy_row_rgb8);
+            min = rows_cumulative(energy, img->w, img->h,
+                                  k->cumulative_row_u32,
+                                  k->cumulative_row_min_u32);
+        }
+        double elapsed = now_secs() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    kernels_select(KERNEL_AUTO);
+    if (min != ref_min || memcmp(energy, ref, n * sizeof(*energy)) != 0) {
+        printf("%sFAILED%s %s %s differs from the legacy loops\n", RED, RESET,
+               k->name, fused ? "fused" : "two-pass");
+        exit(EXIT_FAILURE);
+    }
+    return best;
+}
+
+// The original brightness loop of image_brightness, kept as the baseline to
+// compare to.
+static uint8_t legacy_brightness(struct image* img) {
+    uint64_t total = 0;
+    int size = img->w * img->h;
+    for (int i = 0; i < size; i++) {
+        struct pixel p = img->pixels[i];
+        uint8_t brightness = (p.r + p.g + p.b) / 3;
+        total += brightness;
+    }
+    return total / size;
+}
+
+typedef uint64_t (*brightness_kernel)(struct pixel const*, size_t);
+
+// Time the brightness with @p kernel (or the legacy loop if NULL) on @p img,
+// compare the result with @p ref and return GB/s of pixels read.
+static double bench_brightness(const char* name, brightness_kernel kernel,
+                               struct image* img, uint8_t ref, int reps) {
+    size_t n = (size_t)img->w * img->h;
+    double best = 1e30;
+    uint8_t brightness = 0;
+    for (int i = 0; i < reps; i++) {
+        double start = now_secs();
+        if (kernel)
+            brightness = kernel(img->pixels, n) / n;
+        else
+            brightness = legacy_brightness(img);
+        double elapsed = now_secs() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    if (brightness != ref) {
+        printf("%sFAILED%s %s differs from the legacy loop\n", RED, RESET,
+               name);
+        exit(EXIT_FAILURE);
+    }
+
+    double gbps = n * sizeof(struct pixel) / best / 1e9;
+    printf("%-8s %8.2f ms: %6.2f GB/s\n", name, best * 1e3, gbps);
+    return gbps;
+}
+
+// diff_color, inlined like it would be in a kernel written by hand.
+static inline uint32_t diff_by_hand(struct pixel a, struct pixel b) {
+    int dr = a.r - b.r, dg = a.g - b.g, db = a.b - b.b;
+    return dr * dr + dg * dg + db * db;
+}
+
+// The dual gradient of a packed RGB row written out by hand, to compare the
+// kernel expanded from its definition to. Like the kernels, the ones written
+// by hand are called through pointers, so they must not be inlined into the
+// benchmark loop.
+__attribute__((noinline)) static void
+dual_gradient_by_hand(uint32_t* out, void const* above_row,
+                      void const* this_row, void const* below_row,
+                      size_t plane, int w) {
+    struct pixel const* above = above_row;
+    struct pixel const* row = this_row;
+    struct pixel const* below = below_row;
+    (void)plane;
+    out[0] = diff_by_hand(row[1], row[0]) + diff_by_hand(below[0], above[0]);
+    for (int x = 1; x < w - 1; x++)
+        out[x] = diff_by_hand(row[x + 1], row[x - 1]) +
+                 diff_by_hand(below[x], above[x]);
+    out[w - 1] = diff_by_hand(row[w - 1], row[w - 2]) +
+                 diff_by_hand(below[w - 1], above[w - 1]);
+}
+
+static inline uint32_t sobel_by_hand_at(struct pixel const* a,
+                                        struct pixel const* r,
+                                        struct pixel const* b, int l, int x,
+                                        int rr) {
+#define SOBEL_CHANNEL(c)                                                   \
+    ((a[rr].c + 2 * r[rr].c + b[rr].c - a[l].c - 2 * r[l].c - b[l].c) *  \
+         (a[rr].c + 2 * r[rr].c + b[rr].c - a[l].c - 2 * r[l].c - b[l].c) + \
+     (b[l].c + 2 * b[x].c + b[rr].c - a[l].c - 2 * a[x].c - a[rr].c) *     \
+         (b[l].c + 2 * b[x].c + b[rr].c - a[l].c - 2 * a[x].c - a[rr].c))
+    return (uint32_t)(SOBEL_CHANNEL(r) + SOBEL_CHANNEL(g) + SOBEL_CHANNEL(b)) >>
+           4;
+#undef SOBEL_CHANNEL
+}
+
+// The Sobel energy of a packed RGB row written out by hand.
+__attribute__((noinline)) static void
+sobel_by_hand(uint32_t* out, void const* above, void const* row,
+              void const* below, size_t plane, int w) {
+    (void)plane;
+    out[0] = sobel_by_hand_at(above, row, below, 0, 0, 1);
+    for (int x = 1; x < w - 1; x++)
+        out[x] = sobel_by_hand_at(above, row, below, x - 1, x, x + 1);
+    out[w - 1] = sobel_by_hand_at(above, row, below, w - 2, w - 1, w - 1);
+}
+
+// The total forward energy of a packed RGB row written out by hand.
+__attribute__((noinline)) static void
+forward_by_hand(uint32_t* out, uint32_t const* total_above,
+                void const* above_row, void const* this_row, size_t plane,
+                int w, uint8_t* left, uint8_t* right) {
+    struct pixel const* above = above_row;
+    struct pixel const* row = this_row;
+    (void)plane;
+    memset(left, 0, ((size_t)w + 7) / 8);
+    memset(right, 0, ((size_t)w + 7) / 8);
+    for (int x = 0; x < w; x++) {
+        int l = x > 0 ? x - 1 : 0, r = x < w - 1 ? x + 1 : x;
+        uint32_t up = diff_by_hand(row[r], row[l]);
+        uint32_t total = total_above[x] + up;
+        if (x > 0 &&
+            total_above[x - 1] + up + diff_by_hand(above[x], row[l]) < total) {
+            total = total_above[x - 1] + up + diff_by_hand(above[x], row[l]);
+            left[x / 8] |= 1 << x % 8;
+        }
+        if (x < w - 1 &&
+            total_above[x + 1] + up + diff_by_hand(above[x], row[r]) < total) {
+            total = total_above[x + 1] + up + diff_by_hand(above[x], row[r]);
+            left[x / 8] &= ~(1 << x % 8);
+            right[x / 8] |= 1 << x % 8;
+        }
+        out[x] = total;
+    }
+}
+
+typedef void (*function_row_kernel)(uint32_t*, void const*, void const*,
+                                    void const*, size_t, int);
+typedef void (*total_row_kernel)(uint32_t*, uint32_t const*, void const*,
+                                 void const*, size_t, int, uint8_t*,
+                                 uint8_t*);
+
+// Time the rows of @p img below the top one with the local energy @p local
+// or, if it is NULL, the total energy @p total of an energy function, and
+// return the best time of @p reps runs in seconds. The energy goes to
+// @p energy.
+static double bench_function_rows(function_row_kernel local,
+                                  total_row_kernel total, struct image* img,
+                                  uint32_t* energy, int reps) {
+    size_t const stride = ((size_t)img->w + 7) / 8;
+    uint8_t* dirs = malloc(2 * stride);
+    double best = 1e30;
+    for (int i = 0; i < reps; i++) {
+        memset(energy, 0, img->w * sizeof(uint32_t));
+        double start = now_secs();
+        for (uint32_t y = 1; y < img->h - 1; y++) {
+            struct pixel const* row = &img->pixels[y * img->w];
+            uint32_t* out = &energy[y * img->w];
+            if (local)
+                local(out, row - img->w, row, row + img->w, 0, img->w);
+            else
+                total(out, out - img->w, row - img->w, row, 0, img->w, dirs,
+                      dirs + stride);
+        }
+        double elapsed = now_secs() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    free(dirs);
+    return best;
+}
+
+// Compare the row kernels that the energy functions expand for packed RGB
+// pixels with the same energies written out by hand on @p img.
+static void bench_functions(struct image* img, int reps) {
+    static enum energy_kind const kinds[] = {ENERGY_DUAL_GRADIENT,
+                                             ENERGY_SOBEL, ENERGY_FORWARD};
+    static function_row_kernel const local_by_hand[] = {
+        dual_gradient_by_hand, sobel_by_hand, NULL};
+    size_t n = (size_t)img->w * img->h;
+    uint32_t* by_hand = malloc(n * sizeof(uint32_t));
+    uint32_t* expanded = malloc(n * sizeof(uint32_t));
+
+    printf("Energy functions on %ux%u, expanded kernel vs written by hand\n",
+           img->w, img->h);
+    for (int i = 0; i < 3; i++) {
+        struct energy_function const* f = energy_get(kinds[i]);
+        double hand = bench_function_rows(local_by_hand[i], forward_by_hand,
+                                          img, by_hand, reps);
+        double kernel = bench_function_rows(
+            f->local_energy_row_u32[PIXEL_RGB8],
+            f->total_energy_row_u32[PIXEL_RGB8], img, expanded, reps);
+        if (memcmp(by_hand, expanded, n * sizeof(uint32_t)) != 0) {
+            printf("%sFAILED%s %s differs from the one written by hand\n",
+                   RED, RESET, f->name);
+            exit(EXIT_FAILURE);
+        }
+        printf("%-14s %8.2f ms -> %6.2f ms: %.2fx\n", f->name, hand * 1e3,
+               kernel * 1e3, hand / kernel);
+    }
+    free(expanded);
+    free(by_hand);
+}
+
+// Time the direction DP over the local energy @p local of @p w x @p h with
+// the kernels @p k the way find_seam runs it: every local energy row is copied
+// into a row of its own, and the DP keeps two 32-bit rows, or two 16-bit rows
+// relative to their least entry if @p u16 is set. Returns the best time of
+// @p reps runs in seconds.
+static double bench_dir_rows(struct kernels const* k, bool u16,
+                             uint32_t const* local, int w, int h, int reps) {
+    size_t stride = ((size_t)w + 7) / 8;
+    uint8_t* dirs = malloc(2 * stride);
+    uint32_t* rows = malloc(3 * (size_t)w * sizeof(uint32_t));
+    uint16_t* rows16 = (uint16_t*)(rows + w);
+    double best = 1e30;
+    for (int i = 0; i < reps; i++) {
+        memcpy(rows, local, (size_t)w * sizeof(uint32_t));
+        for (int x = 0; x < w; x++)
+            rows16[x] = local[x] < UINT16_MAX ? local[x] : UINT16_MAX;
+        double start = now_secs();
+        for (int y = 1; y < h; y++) {
+            uint32_t const* in = &local[(size_t)y * w];
+            if (u16) {
+                memcpy(rows, in, (size_t)w * sizeof(uint32_t));
+                k->cumulative_row_dir_u16(&rows16[y % 2 * w], rows,
+                                          &rows16[(y - 1) % 2 * w], w, dirs,
+                                          dirs + stride);
+            } else {
+                uint32_t* row = &rows[y % 2 * w];
+                memcpy(row, in, (size_t)w * sizeof(uint32_t));
+                k->cumulative_row_dir_u32(row, &rows[(y - 1) % 2 * w], w,
+                                          dirs, dirs + stride);
+            }
+        }
+        double elapsed = now_secs() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    free(rows);
+    free(dirs);
+    return best;
+}
+
+// Time find_seam on @p img with 32-bit and 16-bit rows for every set of
+// kernels, after the DP rows alone, and count the seams that differ.
+static void bench_seam_dp(struct image* img, uint32_t const* local,
+                          int reps) {
+    printf("Direction DP rows of %ux%u, 32-bit vs 16-bit rows\n", img->w,
+           img->h);
+    for (int isa = KERNEL_SCALAR + 1; isa < KERNEL_COUNT; isa++) {
+        struct kernels const* k = kernels_get(isa);
+        if (k == NULL || k->cumulative_row_dir_u16 == NULL) continue;
+        double wide = bench_dir_rows(k, false, local, img->w, img->h, reps);
+        double narrow = bench_dir_rows(k, true, local, img->w, img->h, reps);
+        printf("%-8s %8.2f ms -> %6.2f ms: %.2fx\n", k->name, wide * 1e3,
+               narrow * 1e3, wide / narrow);
+    }
+
+    printf("find_seam on %ux%u, 32-bit vs 16-bit rows\n", img->w, img->h);
+    uint32_t* seam = malloc(img->h * sizeof(uint32_t));
+    uint32_t* seam16 = malloc(img->h * sizeof(uint32_t));
+    for (int isa = KERNEL_SCALAR + 1; isa < KERNEL_COUNT; isa++) {
+        struct kernels const* k = kernels_get(isa);
+        if (k == NULL) continue;
+        kernels_select(isa);
+        double times[2] = {1e30, 1e30};
+        for (int dp = 0; dp < 2; dp++) {
+            seam_dp_select(dp ? SEAM_DP_U16 : SEAM_DP_U32);
+            for (int i = 0; i < reps; i++) {
+                double start = now_secs();
+                find_seam(img, img->w, dp ? seam16 : seam);
+                double elapsed = now_secs() - start;
+                if (elapsed < times[dp]) times[dp] = elapsed;
+            }
+        }
+        printf("%-8s %8.2f ms -> %6.2f ms: %.2fx, %s seam\n", k->name,
+               times[0] * 1e3, times[1] * 1e3, times[0] / times[1],
+               memcmp(seam, seam16, img->h * sizeof(uint32_t)) ? "other"
+                                                               : "same");
+    }
+    seam_dp_select(SEAM_DP_U32);
+    kernels_select(KERNEL_AUTO);
+    free(seam16);
+    free(seam);
+}
+
+int main(int argc, char** argv) {
+    const char* source = argc > 1 ? argv[1] : "test/data/owl.ppm";
+    int reps = argc > 2 ? atoi(argv[2]) : 5;
+
+    struct image* owl = image_read_from_file(source);
+    struct image* img = tile(owl, 3840, 2160);
+    size_t n = (size_t)img->w * img->h;
+    uint32_t* ref = malloc(n * sizeof(uint32_t));
+    uint32_t* energy = malloc(n * sizeof(uint32_t));
+    legacy_local_energy(ref, img, img->w);
+    printf("Local energy of %s tiled to %ux%u\n", source, img->w, img->h);
+
+    double legacy = bench_kernel("legacy", NULL, img, energy, ref, reps);
+    for (int isa = KERNEL_SCALAR + 1; isa < KERNEL_COUNT; isa++) {
+        struct kernels const* k = kernels_get(isa);
+        if (k == NULL || k->local_energy_row_rgb8 == NULL) continue;
+        double gbps = bench_kernel(k->name, k->local_energy_row_rgb8, img,
+                                   energy, ref, reps);
+        printf("Speedup: %.1fx\n", gbps / legacy);
+    }
+
+    printf("Cumulative energy and bottom-row minimum of %ux%u\n", img->w,
+           img->h);
+    uint32_t* dp_ref = malloc(n * sizeof(uint32_t));
+    memcpy(dp_ref, ref, n * sizeof(uint32_t));
+    int ref_min = legacy_cumulative(dp_ref, img->w, img->w, img->h);
+    legacy = bench_dp("legacy", NULL, NULL, ref, img->w, img->h, energy,
+                      dp_ref, ref_min, reps);
+    for (int isa = KERNEL_SCALAR + 1; isa < KERNEL_COUNT; isa++) {
+        struct kernels const* k = kernels_get(isa);
+        if (k == NULL || k->cumulative_row_u32 == NULL) continue;
+        double gbps = bench_dp(k->name, k->cumulative_row_u32,
+                               k->cumulative_row_min_u32, ref, img->w, img->h,
+                               energy, dp_ref, ref_min, reps);
+        printf("Speedup: %.1fx\n", gbps / legacy);
+    }
+
+    printf("Total energy of %ux%u, two passes vs one fused pass\n", img->w,
+           img->h);
+    for (int isa = KERNEL_SCALAR + 1; isa < KERNEL_COUNT; isa++) {
+        struct kernels const* k = kernels_get(isa);
+        if (k == NULL) continue;
+        double two = bench_total(isa, false, img, energy, dp_ref, ref_min, reps);
+        double one = bench_total(isa, true, img, energy, dp_ref, ref_min, reps);
+        printf("%-8s %8.2f ms -> %6.2f ms: %.2fx\n", k->name, two * 1e3,
+               one * 1e3, two / one);
+    }
+    free(dp_ref);
+
+    printf("Brightness of %ux%u\n", img->w, img->h);
+    uint8_t const ref_brightness = legacy_brightness(img);
+    legacy = bench_brightness("legacy", NULL, img, ref_brightness, reps);
+    for (int isa = KERNEL_SCALAR + 1; isa < KERNEL_COUNT; isa++) {
+        struct kernels const* k = kernels_get(isa);
+        if (k == NULL || k->brightness_sum_rgb8 == NULL) continue;
+        double gbps = bench_brightness(k->name, k->brightness_sum_rgb8, img,
+                                       ref_brightness, reps);
+        printf("Speedup: %.1fx\n", gbps / legacy);
+    }
+
+    bench_functions(img, reps);
+    bench_seam_dp(img, ref, reps);
+
+    free(energy);
+    free(ref);
+    image_destroy(img);
+    image_destroy(owl);
+
+    printf("%sPASSED%s Energy benchmark\n", GREEN, RESET);
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../../src/image.h"
+
+#include "bench_common.h"
+
+// Add color definitions
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+#define BENCH_FILE "/tmp/bench_image_io.ppm"
+
+// The original per-pixel fscanf reader, kept as the baseline to compare to.
+static struct image* legacy_read_from_file(const char* filename) {
+    FILE* f = fopen(filename, "r");
+    if (f == NULL) exit(EXIT_FAILURE);
+
+    int w, h;
+    if (fscanf(f, "P3") == EOF || fscanf(f, "%d %d 255 ", &w, &h) == EOF ||
+        w <= 0 || h <= 0) {
+        fclose(f);
+        exit(EXIT_FAILURE);
+    }
+
+    struct image* img = image_init(w, h);
+    struct pixel* pixels = img->pixels;
+    for (int i = 0; i < w * h; ++i, ++pixels) {
+        unsigned int r, g, b;
+        if (fscanf(f, "%u %u %u ", &r, &g, &b) == EOF) {
+            image_destroy(img);
+            fclose(f);
+            exit(EXIT_FAILURE);
+        }
+        pixels->r = r;
+        pixels->g = g;
+        pixels->b = b;
+    }
+
+    fclose(f);
+    return img;
+}
+
+// The original per-pixel fprintf writer, kept as the baseline to compare to.
+static void legacy_write_to_file(struct image* img, const char* filename) {
+    FILE* f = fopen(filename, "w");
+    if (f == NULL) exit(EXIT_FAILURE);
+
+    fprintf(f, "P3 \n%d %d \n255\n", img->w, img->h);
+    for (int i = 0; i < img->w * img->h; i++) {
+        struct pixel pix = img->pixels[i];
+        fprintf(f, "%u %u %u \n", pix.r, pix.g, pix.b);
+    }
+    fclose(f);
+}
+
+// Write @p img as QOI regardless of the file name.
+static void write_qoi(struct image* img, const char* filename) {
+    image_write_to_file_format(img, filename, IMAGE_FORMAT_QOI, img->w);
+}
+
+// Tile @p src @p factor times in both directions.
+static struct image* scale_up(struct image* src, int factor) {
+    struct image* img = image_init(src->w * factor, src->h * factor);
+    for (int y = 0; y < img->h; y++) {
+        for (int x = 0; x < img->w; x++) {
+            img->pixels[y * img->w + x] =
+                src->pixels[(y % src->h) * src->w + x % src->w];
+        }
+    }
+    return img;
+}
+
+// Time @p read on @p filename, verify it against @p ref and return MB/s.
+static double bench_reader(const char* name,
+                           struct image* (*read)(const char*),
+                           const char* filename, struct image* ref,
+                           int reps) {
+    struct stat st;
+    stat(filename, &st);
+
+    double best = 1e30;
+    for (int i = 0; i < reps; i++) {
+        double start = now_secs();
+        struct image* img = read(filename);
+        double elapsed = now_secs() - start;
+        if (elapsed < best) best = elapsed;
+
+        assert(img->w == ref->w && img->h == ref->h);
+        assert(memcmp(img->pixels, ref->pixels,
+                      (size_t)img->w * img->h * sizeof(*img->pixels)) == 0);
+        image_destroy(img);
+    }
+
+    double mbps = st.st_size / best / 1e6;
+    printf("%-10s %8.1f MB in %7.3f s: %8.1f MB/s\n", name, st.st_size / 1e6,
+           best, mbps);
+    return mbps;
+}
+
+// Time @p write of @p img and return MB/s.
+static double bench_writer(const char* name,
+                           void (*write)(struct image*, const char*),
+                           struct image* img, int reps) {
+    double best = 1e30;
+    for (int i = 0; i < reps; i++) {
+        double start = now_secs();
+        write(img, BENCH_FILE ".out");
+        double elapsed = now_secs() - start;
+        if (elapsed < best) best = elapsed;
+    }
+
+    struct stat st;
+    stat(BENCH_FILE ".out", &st);
+    remove(BENCH_FILE ".out");
+
+    double mbps = st.st_size / best / 1e6;
+    printf("%-10s %8.1f MB in %7.3f s: %8.1f MB/s\n", name, st.st_size / 1e6,
+           best, mbps);
+    return mbps;
+}
+
+int main(int argc, char** argv) {
+    const char* source = argc > 1 ? argv[1] : "test/data/owl.ppm";
+    int factor = argc > 2 ? atoi(argv[2]) : 8;
+    int reps = argc > 3 ? atoi(argv[3]) : 3;
+
+    struct image* owl = image_read_from_file(source);
+    struct image* big = scale_up(owl, factor);
+    image_write_to_file(big, BENCH_FILE);
+    printf("Decoding %s scaled %dx to %ux%u\n", source, factor, big->w,
+           big->h);
+
+    double legacy = bench_reader("fscanf", legacy_read_from_file, BENCH_FILE,
+                                 big, reps);
+    image_set_io_threads(1);
+    double fast = bench_reader("tokenizer", image_read_from_file, BENCH_FILE,
+                               big, reps);
+    printf("Speedup: %.1fx\n", fast / legacy);
+    image_set_io_threads(0);
+    double parallel = bench_reader("parallel", image_read_from_file,
+                                   BENCH_FILE, big, reps);
+    printf("Speedup: %.1fx\n", parallel / legacy);
+
+    printf("Encoding %ux%u\n", big->w, big->h);
+    legacy = bench_writer("fprintf", legacy_write_to_file, big, reps);
+    image_set_io_threads(1);
+    fast = bench_writer("lookup", image_write_to_file, big, reps);
+    printf("Speedup: %.1fx\n", fast / legacy);
+    image_set_io_threads(0);
+    parallel = bench_writer("parallel", image_write_to_file, big, reps);
+    printf("Speedup: %.1fx\n", parallel / legacy);
+
+    printf("QOI %ux%u\n", big->w, big->h);
+    write_qoi(big, BENCH_FILE ".qoi");
+    bench_reader("qoi read", image_read_from_file, BENCH_FILE ".qoi", big,
+                 reps);
+    bench_writer("qoi write", write_qoi, big, reps);
+    remove(BENCH_FILE ".qoi");
+
+    remove(BENCH_FILE);
+    image_destroy(big);
+    image_destroy(owl);
+
+    printf("%sPASSED%s Image I/O benchmark\n", GREEN, RESET);
+    return 0;
+}
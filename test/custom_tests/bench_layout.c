@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/energy.h"
+#include "../../src/image.h"
+#include "../../src/kernels.h"
+
+#include "bench_common.h"
+
+// Add color definitions
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+// The number of seams carved per measurement.
+#define SEAMS 16
+
+static enum pixel_type const layouts[] = {PIXEL_RGB8, PIXEL_RGBX8,
+                                          PIXEL_PLANAR8};
+static char const* const layout_names[] = {"packed", "rgbx", "planar"};
+#define N_LAYOUTS 3
+
+// The times of the steps of carving an image in one layout, in seconds.
+struct layout_times {
+    double convert, seam, carve, write;
+};
+
+// Convert a copy of @p src to @p layout and time the conversion, finding and
+// carving SEAMS seams, and writing the result as P6. The seams are stored in
+// @p seams (SEAMS rows of the height each) and the best of @p reps runs is
+// returned.
+static struct layout_times bench_layout(struct image* src,
+                                        enum pixel_type layout,
+                                        uint32_t* seams, int reps) {
+    struct layout_times best = {1e30, 1e30, 1e30, 1e30};
+    size_t const bytes = (size_t)src->w * src->h * sizeof(struct pixel);
+    for (int i = 0; i < reps; i++) {
+        struct image* img = image_init(src->w, src->h);
+        memcpy(img->pixels, src->pixels, bytes);
+
+        double start = now_secs();
+        image_convert(img, layout);
+        double convert = now_secs() - start;
+
+        double seam = 0, carve = 0;
+        int w = img->w;
+        for (int s = 0; s < SEAMS; s++, w--) {
+            uint32_t* path = &seams[(size_t)s * img->h];
+            start = now_secs();
+            find_seam(img, w, path);
+            double found = now_secs();
+            carve_path(img, w, path);
+            seam += found - start;
+            carve += now_secs() - found;
+        }
+
+        start = now_secs();
+        image_write_to_file_format(img, "/dev/null", IMAGE_FORMAT_P6, w);
+        double write = now_secs() - start;
+        image_destroy(img);
+
+        if (convert < best.convert) best.convert = convert;
+        if (seam < best.seam) best.seam = seam;
+        if (carve < best.carve) best.carve = carve;
+        if (write < best.write) best.write = write;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    const char* source = argc > 1 ? argv[1] : "test/data/owl.ppm";
+    int reps = argc > 2 ? atoi(argv[2]) : 3;
+    static int const sizes[][2] = {
+        {320, 240}, {1280, 720}, {1920, 1080}, {3840, 2160}};
+
+    struct image* owl = image_read_from_file(source);
+    printf("Pixel layouts with the %s kernels, %d seams per run\n",
+           kernels_active()->name, SEAMS);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        struct image* img = tile(owl, sizes[s][0], sizes[s][1]);
+        size_t const n = (size_t)SEAMS * img->h;
+        uint32_t* ref = malloc(n * sizeof(uint32_t));
+        uint32_t* seams = malloc(n * sizeof(uint32_t));
+
+        printf("%s tiled to %ux%u\n", source, img->w, img->h);
+        printf("%-8s %10s %10s %10s %10s %10s\n", "layout", "convert",
+               "seam", "carve", "write", "break-even");
+        struct layout_times packed;
+        double best_seam = 1e30;
+        int best = 0;
+        for (int l = 0; l < N_LAYOUTS; l++) {
+            struct layout_times t =
+                bench_layout(img, layouts[l], l == 0 ? ref : seams, reps);
+            if (l > 0 && memcmp(seams, ref, n * sizeof(uint32_t)) != 0) {
+                printf("%sFAILED%s %s finds other seams than packed\n", RED,
+                       RESET, layout_names[l]);
+                return EXIT_FAILURE;
+            }
+            if (l == 0) packed = t;
+            // per seam, and how many seams it takes until the faster seams
+            // pay for converting and unpacking on writing
+            double seam = (t.seam + t.carve) / SEAMS;
+            double packed_seam = (packed.seam + packed.carve) / SEAMS;
+            double extra = t.convert + t.write - packed.write;
+            printf("%-8s %8.2fms %8.2fms %8.2fms %8.2fms", layout_names[l],
+                   t.convert * 1e3, t.seam / SEAMS * 1e3,
+                   t.carve / SEAMS * 1e3, t.write * 1e3);
+            if (l == 0)
+                printf(" %10s\n", "-");
+            else if (seam < packed_seam)
+                printf(" %10.0f\n", extra / (packed_seam - seam));
+            else
+                printf(" %10s\n", "never");
+            if (seam < best_seam) {
+                best_seam = seam;
+                best = l;
+            }
+        }
+        printf("Fastest per seam: %s\n", layout_names[best]);
+
+        free(seams);
+        free(ref);
+        image_destroy(img);
+    }
+    image_destroy(owl);
+
+    printf("%sPASSED%s Layout benchmark\n", GREEN, RESET);
+    return 0;
+}
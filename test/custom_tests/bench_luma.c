@@ -0,0 +1,141 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/energy.h"
+#include "../../src/image.h"
+
+#include "bench_common.h"
+
+// Add color definitions
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+// Carve @p n seams out of a copy of @p src, on the luma if @p luma is set,
+// and return the carved image and the time it took, including adding the
+// luma plane.
+static struct image* carve(struct image* src, int n, bool luma,
+                           double* secs) {
+    struct image* img = copy_image(src);
+    uint32_t* seam = malloc(img->h * sizeof(uint32_t));
+    double start = now_secs();
+    if (luma) image_add_luma(img);
+    for (int i = 0; i < n; i++) {
+        find_seam(img, img->w - i, seam);
+        carve_path(img, img->w - i, seam);
+    }
+    *secs = now_secs() - start;
+    free(seam);
+    return img;
+}
+
+// How the seams on the luma drift from the exact ones.
+struct drift {
+    int same;                     // luma seams equal to the exact seam
+    double mean_ratio, max_ratio; // RGB cost of luma seam / least cost
+    double differing;             // fraction of output pixels that differ
+    double psnr;                  // of the luma output against the exact one
+};
+
+// Carve @p n seams out of a copy of @p src on the luma and compare every
+// seam with the exact seam of the same image state, then compare the result
+// with @p exact, the image carved with the exact seams.
+static struct drift measure_drift(struct image* src, int n,
+                                  struct image* exact) {
+    struct drift d = {0, 0, 0, 0, 0};
+    struct image* img = copy_image(src);
+    image_add_luma(img);
+    uint32_t* seam = malloc(img->h * sizeof(uint32_t));
+    uint32_t* best = malloc(img->h * sizeof(uint32_t));
+    for (int i = 0; i < n; i++) {
+        int w = img->w - i;
+        find_seam(img, w, seam);
+        // the exact seam of the same pixels, without the luma plane
+        uint8_t* luma = img->luma;
+        img->luma = NULL;
+        find_seam(img, w, best);
+        img->luma = luma;
+
+        uint64_t cost = seam_cost(img, seam);
+        uint64_t optimum = seam_cost(img, best);
+        double ratio = optimum ? (double)cost / optimum
+                       : cost  ? INFINITY
+                               : 1;
+        d.same += memcmp(seam, best, img->h * sizeof(uint32_t)) == 0;
+        d.mean_ratio += ratio / n;
+        if (ratio > d.max_ratio) d.max_ratio = ratio;
+        carve_path(img, w, seam);
+    }
+
+    size_t px = (size_t)img->w * img->h, differing = 0;
+    double sq = 0;
+    for (size_t i = 0; i < px; i++) {
+        struct pixel a = img->pixels[i], b = exact->pixels[i];
+        differing += memcmp(&a, &b, sizeof(a)) != 0;
+        sq += diff_color(a, b);
+    }
+    d.differing = (double)differing / px;
+    d.psnr = sq ? 10 * log10(255.0 * 255.0 * 3 * px / sq) : INFINITY;
+
+    free(best);
+    free(seam);
+    image_destroy(img);
+    return d;
+}
+
+// Report the drift and the speed of carving a quarter of the columns out of
+// @p img, which is called @p name.
+static void report(char const* name, struct image* img) {
+    int n = img->w / 4 > 0 ? img->w / 4 : 1;
+    double exact_secs, luma_secs;
+    struct image* exact = carve(img, n, false, &exact_secs);
+    struct image* luma = carve(img, n, true, &luma_secs);
+    image_destroy(luma);
+    struct drift d = measure_drift(img, n, exact);
+    image_destroy(exact);
+
+    printf("%-22s %5d %6.1f%% %7.3f %7.3f %8.2f%% %6.1fdB %7.2fx\n", name, n,
+           100.0 * d.same / n, d.mean_ratio, d.max_ratio, 100 * d.differing,
+           d.psnr, exact_secs / luma_secs);
+}
+
+int main(int argc, char** argv) {
+    static char const* const corpus[] = {
+        "test/data/owl.ppm", "test/data/owl2.ppm", "test/data/owl2.pgm",
+        "test/data/small1.ppm", "test/data/small2.ppm"};
+    int n_files = argc > 1 ? argc - 1 : 5;
+    char const* const* files =
+        argc > 1 ? (char const* const*)argv + 1 : corpus;
+
+    printf("Luma energy vs diff_color, carving a quarter of the columns\n");
+    printf("%-22s %5s %7s %7s %7s %9s %8s %8s\n", "image", "seams", "same",
+           "mean", "worst", "differ", "PSNR", "speedup");
+    for (int i = 0; i < n_files; i++) {
+        struct image* img = image_read_from_file(files[i]);
+        if (!pixel_is_rgb8(img->type)) {
+            // graymaps are carved on their gray values either way
+            printf("%-22s skipped, not an 8-bit RGB image\n", files[i]);
+            image_destroy(img);
+            continue;
+        }
+        char const* slash = strrchr(files[i], '/');
+        report(slash ? slash + 1 : files[i], img);
+        if (i == 0) {
+            struct image* big = tile(img, 1920, 1080);
+            char name[64];
+            snprintf(name, sizeof(name), "%s 1920x1080",
+                     slash ? slash + 1 : files[i]);
+            report(name, big);
+            image_destroy(big);
+        }
+        image_destroy(img);
+    }
+    printf("same: luma seams equal to the exact seam of the same image;\n"
+           "mean/worst: RGB energy of the luma seam over the least one;\n"
+           "differ/PSNR: output against carving with exact seams\n");
+
+    printf("%sPASSED%s Luma benchmark\n", GREEN, RESET);
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/energy.h"
+#include "../../src/image.h"
+#include "../../src/pyramid.h"
+
+#include "bench_common.h"
+
+// Add color definitions
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+// A run of carving seams, exactly or on a pyramid.
+struct pyramid_run {
+    struct image* img; // the carved image
+    double secs;       // finding and carving the seams
+    uint64_t cost;     // the local energy the seams took away
+};
+
+// Carve @p n seams out of a copy of @p src like `find_and_carve_path`, on a
+// pyramid with bands of @p band columns, or exactly with energy planes if
+// @p band is 0.
+static struct pyramid_run carve(struct image* src, int n, int band) {
+    struct pyramid_run run = {copy_image(src), 0, 0};
+    struct image* img = run.img;
+    uint32_t* seam = malloc(img->h * sizeof(uint32_t));
+    int w = img->w;
+    double start = now_secs();
+    struct pyramid* pyr = band > 0 ? pyramid_init(img, band) : NULL;
+    if (pyr == NULL) {
+        energy_add_plane(img);
+        image_defer_compaction(img, COMPACTION_SEAMS);
+    }
+    run.secs += now_secs() - start;
+    for (int i = 0; i < n; i++, w--) {
+        start = now_secs();
+        if (pyr != NULL)
+            pyramid_find_seam(pyr, w, seam);
+        else
+            find_seam(img, w, seam);
+        run.secs += now_secs() - start;
+        run.cost += seam_cost(img, seam);
+        start = now_secs();
+        if (pyr != NULL)
+            pyramid_carve_path(pyr, w, seam);
+        else
+            carve_path(img, w, seam);
+        run.secs += now_secs() - start;
+    }
+    start = now_secs();
+    if (pyr != NULL) pyramid_destroy(pyr);
+    image_compact(img);
+    run.secs += now_secs() - start;
+    free(seam);
+    return run;
+}
+
+// Report the quality and the speed of carving @p n seams out of @p img,
+// which is called @p name, on pyramids with several band widths against
+// carving them exactly.
+static void report(char const* name, struct image* img, int n) {
+    static int const bands[] = {0, 1, 2, 4, 8, 16, 32};
+    struct pyramid_run exact = carve(img, n, 0);
+    size_t px = (size_t)img->w * img->h;
+    for (size_t i = 0; i < sizeof(bands) / sizeof(bands[0]); i++) {
+        struct pyramid_run run = i == 0 ? exact : carve(img, n, bands[i]);
+        size_t differing = 0;
+        double sq = 0;
+        for (size_t p = 0; p < px; p++) {
+            struct pixel a = run.img->pixels[p], b = exact.img->pixels[p];
+            differing += memcmp(&a, &b, sizeof(a)) != 0;
+            sq += diff_color(a, b);
+        }
+        double psnr = sq ? 10 * log10(255.0 * 255.0 * 3 * px / sq) : INFINITY;
+        char band[16];
+        snprintf(band, sizeof(band), i == 0 ? "exact" : "%d", bands[i]);
+        printf("%-22s %5d %5s %8.3f %8.2f%% %6.1fdB %8.3fms %7.2fx\n", name,
+               n, band, (double)run.cost / exact.cost, 100.0 * differing / px,
+               psnr, run.secs / n * 1e3, exact.secs / run.secs);
+        if (i > 0) image_destroy(run.img);
+    }
+    image_destroy(exact.img);
+}
+
+int main(int argc, char** argv) {
+    static int const sizes[][2] = {{1920, 1080}, {3840, 2160}, {8192, 6144}};
+    char const* source = argc > 1 ? argv[1] : "test/data/owl.ppm";
+    int n_sizes = argc > 2 ? atoi(argv[2]) : 2;
+
+    struct image* owl = image_read_from_file(source);
+    if (!pixel_is_rgb8(owl->type)) {
+        printf("%sFAILED%s %s is not an 8-bit RGB image\n", RED, RESET,
+               source);
+        return EXIT_FAILURE;
+    }
+    printf("Pyramid seam search, band columns on either side\n");
+    printf("%-22s %5s %5s %8s %9s %8s %10s %8s\n", "image", "seams", "band",
+           "cost", "differ", "PSNR", "per seam", "speedup");
+    for (int s = 0; s < n_sizes && s < 3; s++) {
+        struct image* img = tile(owl, sizes[s][0], sizes[s][1]);
+        char const* slash = strrchr(source, '/');
+        char name[64];
+        snprintf(name, sizeof(name), "%s %ux%u", slash ? slash + 1 : source,
+                 img->w, img->h);
+        // fewer seams on larger images, whose exact seams take long
+        report(name, img, s < 2 ? img->w / 4 : 64);
+        image_destroy(img);
+    }
+    image_destroy(owl);
+    printf("cost: local energy the seams take away over that of the exact "
+           "seams;\ndiffer/PSNR: output against the exact seams\n");
+
+    printf("%sPASSED%s Pyramid benchmark\n", GREEN, RESET);
+    return 0;
+}
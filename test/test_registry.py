@@ -92,6 +92,348 @@ def test_carve_eval(tu, tn, args_ref_out): # TODO REMOVE
         return check_res
 
 
+def read_pnm(img_name):
+    """Return the magic number and the header and sample values of a P3 or P6 image."""
+    with open(img_name, 'rb') as img_src:
+        data = img_src.read()
+    magic = data[:2].decode()
+    if magic != 'P6':
+        return magic, [int(x) for x in data.split()[1:]]
+    fields = data.split(maxsplit=4)
+    header = [int(x) for x in fields[1:4]]
+    body = data[len(data) - header[0] * header[1] * 3:]
+    return magic, header + list(body)
+
+def read_qoi(img_name):
+    """Decode a QOI image like read_pnm, independently of the C decoder."""
+    with open(img_name, 'rb') as img_src:
+        data = img_src.read()
+    if data[:4] != b'qoif' or data[-8:] != bytes([0] * 7 + [1]):
+        return None
+    w, h = int.from_bytes(data[4:8], 'big'), int.from_bytes(data[8:12], 'big')
+    index = [(0, 0, 0, 0)] * 64
+    r, g, b, a = 0, 0, 0, 255
+    vals, pos, run = [], 14, 0
+    for _ in range(w * h):
+        if run > 0:
+            run -= 1
+        else:
+            op = data[pos]
+            if op == 0xfe:
+                r, g, b = data[pos + 1:pos + 4]
+                pos += 4
+            elif op == 0xff:
+                r, g, b, a = data[pos + 1:pos + 5]
+                pos += 5
+            elif op >> 6 == 0:
+                r, g, b, a = index[op]
+                pos += 1
+            elif op >> 6 == 1:
+                r = (r + (op >> 4 & 3) - 2) % 256
+                g = (g + (op >> 2 & 3) - 2) % 256
+                b = (b + (op & 3) - 2) % 256
+                pos += 1
+            elif op >> 6 == 2:
+                vg = (op & 0x3f) - 32
+                r = (r + vg - 8 + (data[pos + 1] >> 4)) % 256
+                g = (g + vg) % 256
+                b = (b + vg - 8 + (data[pos + 1] & 0xf)) % 256
+                pos += 2
+            else:
+                run = op & 0x3f
+                pos += 1
+            index[(r * 3 + g * 5 + b * 7 + a * 11) % 64] = (r, g, b, a)
+        vals += [r, g, b]
+    if pos != len(data) - 8:
+        return None
+    return [w, h, 255] + vals
+
+def test_qoi_roundtrip(tu, tn, args_ref_out):
+    args, ref_file, out_file = args_ref_out
+    carve_bin = tu.join_base(carve_path)
+    if not os.path.exists(carve_bin):
+        return tu.FAILURE("carve binary not available")
+    # convert the P3 input to QOI without carving, then carve the QOI file
+    qoi_file = out_file + '.qoi'
+    rc, out, err = tu.run(carve_bin, ['-f', 'qoi', '-n', '0', args[-1]])
+    check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+    if not check_res:
+        return check_res
+    if read_qoi(out_file) != read_pnm(args[-1])[1]:
+        return tu.FAILURE('QOI image does not decode to the input image')
+    os.replace(out_file, qoi_file)
+    rc, out, err = tu.run(carve_bin, args[:-1] + [qoi_file])
+    os.remove(qoi_file)
+    check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+    if not check_res:
+        return check_res
+    if read_pnm(out_file)[1] != read_pnm(ref_file)[1]:
+        return tu.FAILURE('incorrect output image')
+    return tu.SUCCESS()
+
+def parse_pnm(data):
+    """Return the header and sample values of the P3 image in @p data."""
+    return [int(x) for x in data.split()[1:]]
+
+def test_stdio(tu, tn, args_ref):
+    import subprocess
+    import tempfile
+    args, ref_file = args_ref
+    carve_bin = tu.join_base(carve_path)
+    if not os.path.exists(carve_bin):
+        return tu.FAILURE("carve binary not available")
+    # read the image from stdin and write the result to stdout
+    with open(args[-1], 'rb') as img_src:
+        data = img_src.read()
+    cproc = subprocess.run([carve_bin, '-o', '-'] + args[:-1] + ['-'], input=data,
+                           stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=timeout_secs)
+    if cproc.returncode != 0:
+        return tu.FAILURE('application did not return EXIT_SUCCESS\n' + cproc.stderr.decode())
+    exp = read_pnm(ref_file)[1]
+    if parse_pnm(cproc.stdout) != exp:
+        return tu.FAILURE('incorrect image on stdout')
+    # write the result to a file of its own, which leaves out.ppm alone
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        out_file = os.path.join(tmp_dir, 'carved.ppm')
+        rc, out, err = tu.run(carve_bin, ['-o', out_file] + args)
+        check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+        if not check_res:
+            return check_res
+        if read_pnm(out_file)[1] != exp:
+            return tu.FAILURE('incorrect output image')
+    return tu.SUCCESS()
+
+def test_p6_roundtrip(tu, tn, args_ref_out):
+    args, ref_file, out_file = args_ref_out
+    carve_bin = tu.join_base(carve_path)
+    if not os.path.exists(carve_bin):
+        return tu.FAILURE("carve binary not available")
+    # convert the P3 input to P6 without carving, then carve the P6 file
+    p6_file = out_file + '.p6'
+    rc, out, err = tu.run(carve_bin, ['-f', 'p6', '-n', '0', args[-1]])
+    check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+    if not check_res:
+        return check_res
+    if read_pnm(out_file)[0] != 'P6':
+        return tu.FAILURE('no P6 image produced')
+    os.replace(out_file, p6_file)
+    rc, out, err = tu.run(carve_bin, args[:-1] + [p6_file])
+    os.remove(p6_file)
+    check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+    if not check_res:
+        return check_res
+    if read_pnm(out_file)[1] != read_pnm(ref_file)[1]:
+        return tu.FAILURE('incorrect output image')
+    return tu.SUCCESS()
+
+def test_carve_trim(tu, tn, args_ref_out):
+    args, ref_file, out_file = args_ref_out
+    carve_bin = tu.join_base(carve_path)
+    if not os.path.exists(carve_bin):
+        return tu.FAILURE("carve binary not available")
+    rc, out, err = tu.run(carve_bin, args)
+    check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+    if not check_res:
+        return check_res
+    # the reference keeps the black columns on the right, cut them off
+    n = int(args[args.index('-n') + 1])
+    ref = read_pnm(ref_file)[1]
+    w, h = ref[0], ref[1]
+    rows = [ref[3 + y * w * 3:3 + (y + 1) * w * 3] for y in range(h)]
+    exp = [w - n, h, ref[2]] + [v for row in rows for v in row[:(w - n) * 3]]
+    if read_pnm(out_file)[1] != exp:
+        return tu.FAILURE('incorrect output image')
+    return tu.SUCCESS()
+
+def test_16bit(tu, tn, args_ref_out):
+    import struct
+    import tempfile
+    args, ref_file, out_file = args_ref_out
+    carve_bin = tu.join_base(carve_path)
+    if not os.path.exists(carve_bin):
+        return tu.FAILURE("carve binary not available")
+    # widen the 8-bit input to 16 bits, which scales all energies alike
+    vals = read_pnm(args[-1])[1]
+    w, h = vals[0], vals[1]
+    body = struct.pack('>{}H'.format(w * h * 3), *[v * 257 for v in vals[3:]])
+    with tempfile.NamedTemporaryFile('wb', suffix='.ppm', delete=False) as tmp:
+        tmp.write('P6\n{} {}\n65535\n'.format(w, h).encode() + body)
+    try:
+        rc, out, err = tu.run(carve_bin, args[:-1] + [tmp.name])
+    finally:
+        os.remove(tmp.name)
+    check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+    if not check_res:
+        return check_res
+    if '-p' in args:
+        with open(ref_file) as ref_src:
+            if out != ref_src.read():
+                return tu.FAILURE('incorrect minimal path')
+        return tu.SUCCESS()
+    ref = read_pnm(ref_file)[1]
+    exp = ref[:2] + [65535] + [v * 257 for v in ref[3:]]
+    if read_pnm(out_file)[1] != exp:
+        return tu.FAILURE('incorrect output image')
+    return tu.SUCCESS()
+
+def test_p3_parallel(tu, tn, mutation):
+    import random
+    import tempfile
+    carve_bin = tu.join_base(carve_path)
+    if not os.path.exists(carve_bin):
+        return tu.FAILURE("carve binary not available")
+    # large enough to be split into several chunks
+    w, h = 500, 500
+    rng = random.Random(42)
+    vals = [rng.randrange(256) for _ in range(w * h * 3)]
+    if mutation == 'short':
+        vals = vals[:-1]
+    elif mutation == 'extra':
+        vals = vals + [0]
+    elif mutation == 'range':
+        vals[len(vals) // 2] = 256
+    header = 'P3\n{} {}\n255\n'.format(w, h)
+    if mutation == 'header':
+        header = 'P3\n{} {}\n65536\n'.format(w, h)
+    body = '\n'.join(' '.join(map(str, vals[i:i + 24])) for i in range(0, len(vals), 24))
+    with tempfile.NamedTemporaryFile('w', suffix='.ppm', delete=False) as tmp:
+        tmp.write(header + body + '\n')
+    try:
+        rc, out, err = tu.run(carve_bin, ['-j', '8', '-s', tmp.name])
+    finally:
+        os.remove(tmp.name)
+    if mutation is not None:
+        return tu.check((rc, out, err), 'application did not return EXIT_FAILURE\n' + err, exp_rc=1)
+    check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+    if not check_res:
+        return check_res
+    total = sum((vals[i] + vals[i + 1] + vals[i + 2]) // 3 for i in range(0, len(vals), 3))
+    exp = 'width: {}\nheight: {}\nbrightness: {}\n'.format(w, h, total // (w * h))
+    if out != exp:
+        return tu.FAILURE('incorrect statistics')
+    return tu.SUCCESS()
+
+def test_p3_parallel_write(tu, tn, args):
+    carve_bin = tu.join_base(carve_path)
+    if not os.path.exists(carve_bin):
+        return tu.FAILURE("carve binary not available")
+    outputs = []
+    for threads in ['1', '4']:
+        rc, out, err = tu.run(carve_bin, ['-j', threads] + args)
+        check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+        if not check_res:
+            return check_res
+        with open('out.ppm', 'rb') as out_src:
+            outputs.append(out_src.read())
+    if outputs[0] != outputs[1]:
+        return tu.FAILURE('parallel output differs from serial output')
+    return tu.SUCCESS()
+
+
+def test_stream_path(tu, tn, fmt_mutation):
+    import tempfile
+    fmt, mutation = fmt_mutation
+    carve_bin = tu.join_base(carve_path)
+    if not os.path.exists(carve_bin):
+        return tu.FAILURE("carve binary not available")
+    # -p streams the file, so it has to notice damage only past the rows it read
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        img_file = os.path.join(tmp_dir, 'owl.' + fmt)
+        rc, out, err = tu.run(carve_bin, ['-f', fmt, '-n', '0', '-o', img_file, 'test/data/owl.ppm'])
+        check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+        if not check_res:
+            return check_res
+        with open(img_file, 'rb') as img_src:
+            data = img_src.read()
+        if mutation == 'short':
+            data = data[:-1]
+        elif mutation == 'extra':
+            data = data + b'\0'
+        with open(img_file, 'wb') as img_dst:
+            img_dst.write(data)
+        rc, out, err = tu.run(carve_bin, ['-p', img_file])
+    if mutation is not None:
+        return tu.check((rc, out, err), 'application did not return EXIT_FAILURE\n' + err, exp_rc=1)
+    check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+    if not check_res:
+        return check_res
+    with open('test/ref_output/owl.path') as ref_src:
+        if out != ref_src.read():
+            return tu.FAILURE('incorrect minimal path')
+    return tu.SUCCESS()
+
+def test_luma_path(tu, tn, args):
+    import tempfile
+    carve_bin = tu.join_base(carve_path)
+    if not os.path.exists(carve_bin):
+        return tu.FAILURE("carve binary not available")
+    # --luma finds the seam of the graymap of the BT.601 luma of the image
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        img_file = os.path.join(tmp_dir, 'img.ppm')
+        rc, out, err = tu.run(carve_bin, ['-f', 'p6', '-n', '0', '-o', img_file] + args)
+        check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+        if not check_res:
+            return check_res
+        with open(img_file, 'rb') as img_src:
+            data = img_src.read()
+        magic, w, h, maxval, body = data.split(maxsplit=4)
+        luma = [(77 * body[i] + 150 * body[i + 1] + 29 * body[i + 2] + 128) >> 8
+                for i in range(0, int(w) * int(h) * 3, 3)]
+        gray_file = os.path.join(tmp_dir, 'img.pgm')
+        with open(gray_file, 'wb') as gray_dst:
+            gray_dst.write(b'P5\n%s %s\n255\n' % (w, h) + bytes(luma))
+        rc, ref, err = tu.run(carve_bin, ['-p', gray_file])
+        check_res = tu.check((rc, ref, err), 'application did not return EXIT_SUCCESS\n' + err)
+        if not check_res:
+            return check_res
+        rc, out, err = tu.run(carve_bin, ['--luma', '-p', img_file])
+        check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+        if not check_res:
+            return check_res
+        if out != ref:
+            return tu.FAILURE('incorrect minimal path on the luma')
+    return tu.SUCCESS()
+
+def test_energy_layouts(tu, tn, energy):
+    carve_bin = tu.join_base(carve_path)
+    if not os.path.exists(carve_bin):
+        return tu.FAILURE("carve binary not available")
+    # every layout has its own kernel of the energy function, all carve alike
+    outputs = []
+    for layout in ['packed', 'rgbx', 'planar']:
+        rc, out, err = tu.run(carve_bin, ['--energy=' + energy, '--layout=' + layout, '-n', '5', '-o', '-', 'test/data/owl.ppm'])
+        check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+        if not check_res:
+            return check_res
+        outputs.append(out)
+    if outputs[1] != outputs[0] or outputs[2] != outputs[0]:
+        return tu.FAILURE('layouts carve differently with the ' + energy + ' energy')
+    rc, out, err = tu.run(carve_bin, ['--energy=' + energy, '-p', 'test/data/owl.ppm'])
+    check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+    if not check_res:
+        return check_res
+    if len(out.split()) != 307:
+        return tu.FAILURE('incorrect minimal path length')
+    return tu.SUCCESS()
+
+def test_dp_verify(tu, tn, args_ref):
+    carve_bin = tu.join_base(carve_path)
+    if not os.path.exists(carve_bin):
+        return tu.FAILURE("carve binary not available")
+    # verifying keeps the 32-bit seams and reports the differing 16-bit ones
+    args, ref_file, seams = args_ref
+    rc, out, err = tu.run(carve_bin, ['--dp=verify'] + args)
+    check_res = tu.check((rc, out, err), 'application did not return EXIT_SUCCESS\n' + err)
+    if not check_res:
+        return check_res
+    if ref_file is not None:
+        with open(ref_file, "r") as ref_src:
+            if ref_src.read() != out:
+                return tu.FAILURE('incorrect minimal path')
+    if 'u16 seams: 0 of %d differ' % seams not in err:
+        return tu.FAILURE('unexpected verification report: ' + err)
+    return tu.SUCCESS()
+
 def specialize(fun, arg):
     return lambda tu, tn, x=arg: fun(tu, tn, x)
 
@@ -99,6 +441,8 @@ pre_tests = {
     'public.statistics.small1_s',
     'public.statistics.small2_s',
     'public.statistics.owl_s',
+    'public.statistics.imgbroken1_s',
+    'public.statistics.imgbroken2_s',
     'public.min_path.small1_m',
     'public.min_path.small2_m',
     'public.min_path.owl_m',
@@ -119,6 +463,28 @@ all_tests = {
     'public.min_path.min_energy_wide_1': unit_test,
     'public.min_path.optimal_path_tall': unit_test,
     'public.carve.carve_path_small2': unit_test,
+    'public.formats.p6_read_write': unit_test,
+    'public.formats.p6_map_carve': unit_test,
+    'public.min_path.energy_gray': unit_test,
+    'public.carve.carve_path_gray': unit_test,
+    'public.formats.qoi_read_write': unit_test,
+    'public.min_path.local_energy_simd': unit_test,
+    'public.min_path.cumulative_simd': unit_test,
+    'public.statistics.brightness_simd': unit_test,
+    'public.carve.kernel_conformance': unit_test,
+    'public.min_path.direction_bits': unit_test,
+    'public.min_path.stream_rows': unit_test,
+    'public.formats.layout_read_write': unit_test,
+    'public.min_path.luma': unit_test,
+    'public.min_path.energy_functions': unit_test,
+    'public.min_path.seam_dp': unit_test,
+    'public.carve.energy_plane': unit_test,
+    'public.carve.total_plane': unit_test,
+    'public.carve.seams_per_pass': unit_test,
+    'public.carve.deferred_compaction': unit_test,
+    'public.carve.pyramid': unit_test,
+    'public.formats.rgb16_read_write': unit_test,
+    'public.min_path.energy_rgb16': unit_test,
 }
 
 for t in pre_tests:
@@ -143,6 +509,45 @@ for t in pre_tests:
         else:
             all_tests[t] = specialize(test_carve, (['-n', num, case_path], 'test/ref_output/' + case + '.ppm', 'out.ppm'))
 
+all_tests['public.formats.p6_roundtrip'] = specialize(test_p6_roundtrip, (['-f', 'p6', '-n', '1', 'test/data/small2.ppm'], 'test/ref_output/small2_1.ppm', 'out.ppm'))
+all_tests['public.formats.qoi_roundtrip'] = specialize(test_qoi_roundtrip, (['-n', '1', 'test/data/small2.ppm'], 'test/ref_output/small2_1.ppm', 'out.ppm'))
+all_tests['public.formats.qoi_owl'] = specialize(test_qoi_roundtrip, (['-n', '0', 'test/data/owl.ppm'], 'test/data/owl.ppm', 'out.ppm'))
+all_tests['public.formats.stdio_small2_1'] = specialize(test_stdio, (['-n', '1', 'test/data/small2.ppm'], 'test/ref_output/small2_1.ppm'))
+all_tests['public.formats.stdio_owl2_gray_3'] = specialize(test_stdio, (['-n', '3', 'test/data/owl2.pgm'], 'test/ref_output/owl2_3.pgm'))
+all_tests['public.formats.p6_mmap'] = specialize(test_p6_roundtrip, (['-m', '-f', 'p6', '-n', '1', 'test/data/small2.ppm'], 'test/ref_output/small2_1.ppm', 'out.ppm'))
+for mutation in [None, 'short', 'extra', 'range', 'header']:
+    all_tests['public.formats.p3_parallel_' + (mutation or 'valid')] = specialize(test_p3_parallel, mutation)
+all_tests['public.formats.p3_parallel_write'] = specialize(test_p3_parallel_write, ['-n', '2', 'test/data/owl.ppm'])
+all_tests['public.min_path.owl2_gray_m'] = specialize(test_literal, (['-p', 'test/data/owl2.pgm'], 'test/ref_output/owl2.path', 'incorrect minimal path'))
+all_tests['public.carve.owl2_gray_3'] = specialize(test_carve, (['-n', '3', 'test/data/owl2.pgm'], 'test/ref_output/owl2_3.pgm', 'out.ppm'))
+all_tests['public.min_path.owl_16bit'] = specialize(test_16bit, (['-p', 'test/data/owl.ppm'], 'test/ref_output/owl.path', None))
+all_tests['public.carve.small2_16bit_1'] = specialize(test_16bit, (['-n', '1', 'test/data/small2.ppm'], 'test/ref_output/small2_1.ppm', 'out.ppm'))
+all_tests['public.min_path.owl_kernel_scalar'] = specialize(test_literal, (['--kernel=scalar', '-p', 'test/data/owl.ppm'], 'test/ref_output/owl.path', 'incorrect minimal path'))
+all_tests['public.statistics.kernel_invalid'] = specialize(test_invalidinput, ['--kernel=mmx', '-s', 'test/data/small1.ppm'])
+all_tests['public.carve.small2_1_trim'] = specialize(test_carve_trim, (['--trim', '-n', '1', 'test/data/small2.ppm'], 'test/ref_output/small2_1.ppm', 'out.ppm'))
 
 timeout_secs = 5
-
+for fmt in ['p6', 'qoi']:
+    for mutation in [None, 'short', 'extra']:
+        all_tests['public.min_path.owl_stream_' + fmt + '_' + (mutation or 'valid')] = specialize(test_stream_path, (fmt, mutation))
+for layout in ['rgbx', 'planar']:
+    all_tests['public.carve.small2_1_' + layout] = specialize(test_carve, (['--layout=' + layout, '-n', '1', 'test/data/small2.ppm'], 'test/ref_output/small2_1.ppm', 'out.ppm'))
+all_tests['public.carve.owl2_gray_3_planar'] = specialize(test_carve, (['--layout=planar', '-n', '3', 'test/data/owl2.pgm'], 'test/ref_output/owl2_3.pgm', 'out.ppm'))
+all_tests['public.statistics.layout_invalid'] = specialize(test_invalidinput, ['--layout=bgr', '-s', 'test/data/small1.ppm'])
+all_tests['public.min_path.owl_luma'] = specialize(test_luma_path, ['test/data/owl.ppm'])
+all_tests['public.min_path.owl_energy_gradient'] = specialize(test_literal, (['--energy=gradient', '-p', 'test/data/owl.ppm'], 'test/ref_output/owl.path', 'incorrect minimal path'))
+for energy in ['dual-gradient', 'sobel', 'forward']:
+    all_tests['public.carve.owl_energy_' + energy] = specialize(test_energy_layouts, energy)
+all_tests['public.statistics.energy_invalid'] = specialize(test_invalidinput, ['--energy=laplace', '-s', 'test/data/small1.ppm'])
+all_tests['public.min_path.owl_dp_u16'] = specialize(test_literal, (['--dp=u16', '-p', 'test/data/owl.ppm'], 'test/ref_output/owl.path', 'incorrect minimal path'))
+all_tests['public.carve.small2_1_dp_u16'] = specialize(test_carve, (['--dp=u16', '-n', '1', 'test/data/small2.ppm'], 'test/ref_output/small2_1.ppm', 'out.ppm'))
+all_tests['public.min_path.owl_dp_verify'] = specialize(test_dp_verify, (['-p', 'test/data/owl.ppm'], 'test/ref_output/owl.path', 1))
+all_tests['public.carve.owl_dp_verify'] = specialize(test_dp_verify, (['-n', '20', '-o', '/dev/null', 'test/data/owl.ppm'], None, 20))
+all_tests['public.statistics.dp_invalid'] = specialize(test_invalidinput, ['--dp=u8', '-s', 'test/data/small1.ppm'])
+all_tests['public.carve.small2_1_seams_per_pass'] = specialize(test_carve, (['--seams-per-pass=8', '-n', '1', 'test/data/small2.ppm'], 'test/ref_output/small2_1.ppm', 'out.ppm'))
+all_tests['public.carve.owl2_gray_3_seams_per_pass_1'] = specialize(test_carve, (['-b', '1', '-n', '3', 'test/data/owl2.pgm'], 'test/ref_output/owl2_3.pgm', 'out.ppm'))
+all_tests['public.statistics.seams_per_pass_invalid'] = specialize(test_invalidinput, ['--seams-per-pass=0', '-s', 'test/data/small1.ppm'])
+all_tests['public.carve.owl2_gray_3_pyramid'] = specialize(test_carve, (['--pyramid=4', '-n', '3', 'test/data/owl2.pgm'], 'test/ref_output/owl2_3.pgm', 'out.ppm'))
+all_tests['public.statistics.pyramid_invalid'] = specialize(test_invalidinput, ['--pyramid=0', '-s', 'test/data/small1.ppm'])
+all_tests['public.carve.owl2_gray_3_defer'] = specialize(test_carve, (['--defer=2', '-n', '3', 'test/data/owl2.pgm'], 'test/ref_output/owl2_3.pgm', 'out.ppm'))
+all_tests['public.statistics.defer_invalid'] = specialize(test_invalidinput, ['--defer=-1', '-s', 'test/data/small1.ppm'])